@@ -0,0 +1,50 @@
+// Licensed under the MIT License.
+
+#include "FrameBufferPool.h"
+#include <atomic>
+
+FrameBufferPool::FrameBufferPool(size_t bufferCapacity, size_t initialCount)
+	: m_bufferCapacity(bufferCapacity)
+	, m_next(0)
+{
+	for (size_t i = 0; i < initialCount; i++)
+	{
+		SharedFrame buffer = std::make_shared<FrameBuffer>();
+		buffer->data.resize(bufferCapacity);
+		m_buffers.push_back(buffer);
+	}
+}
+
+SharedFrame FrameBufferPool::Acquire()
+{
+	// Round-robin so the buffer released longest ago is checked first
+	for (size_t i = 0; i < m_buffers.size(); i++)
+	{
+		SharedFrame& buffer = m_buffers[(m_next + i) % m_buffers.size()];
+		if (buffer.use_count() == 1)
+		{
+			// Pairs with the release of the last connection that sent this buffer
+			std::atomic_thread_fence(std::memory_order_acquire);
+			m_next = (m_next + i + 1) % m_buffers.size();
+			buffer->size = 0;
+			buffer->offset = 0;
+			return buffer;
+		}
+	}
+
+	// Every buffer is still queued somewhere, grow the pool
+	SharedFrame buffer = std::make_shared<FrameBuffer>();
+	buffer->data.resize(m_bufferCapacity);
+	m_buffers.push_back(buffer);
+	return buffer;
+}
+
+size_t FrameBufferPool::GetBufferCapacity() const
+{
+	return m_bufferCapacity;
+}
+
+const std::vector<SharedFrame>& FrameBufferPool::GetBuffers() const
+{
+	return m_buffers;
+}
@@ -0,0 +1,41 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// One serialized frame. It is written once and then only read by every
+// connection that sends it, which keeps it alive through the shared pointer.
+struct FrameBuffer
+{
+    std::vector<uint8_t> data;
+    size_t size = 0;
+    size_t offset = 0;  // where the frame starts in data, transports may put a header in front
+};
+
+using SharedFrame = std::shared_ptr<FrameBuffer>;
+
+// Recycles frame buffers so serializing a frame does not allocate once the
+// pool has grown to the number of frames in flight. Not thread-safe: acquire
+// from the serializing thread only, the buffers may be released from any thread.
+class FrameBufferPool
+{
+public:
+    FrameBufferPool(size_t bufferCapacity, size_t initialCount = 4);
+
+    // Returns a buffer with at least bufferCapacity bytes that nobody else references
+    SharedFrame Acquire();
+
+    size_t GetBufferCapacity() const;
+
+    // The buffers so far, for transports that register them up front
+    const std::vector<SharedFrame>& GetBuffers() const;
+
+private:
+    std::vector<SharedFrame> m_buffers;
+    size_t m_bufferCapacity;
+    size_t m_next;
+};
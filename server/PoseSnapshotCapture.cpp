@@ -1,12 +1,11 @@
 // Licensed under the MIT License.
 
 #include "PoseSnapshotCapture.h"
-#include <nlohmann/json.hpp>
+#include "SkeletonJsonWriter.h"
+#include <cstring>
 #include <fstream>
-#include <iomanip>
 #include <ctime>
 
-using json = nlohmann::json;
 using namespace std::chrono;
 
 PoseSnapshotCapture::PoseSnapshotCapture(milliseconds captureDelay)
@@ -16,6 +15,7 @@ PoseSnapshotCapture::PoseSnapshotCapture(milliseconds captureDelay)
 	, m_bothHandsAreRaised(false)
 	, m_snapshotTaken(false)
 	, m_countdownStarted(false)
+	, m_jsonBuffer(SkeletonJson::MaxSkeletonSize)
 {
 }
 
@@ -136,44 +136,21 @@ void PoseSnapshotCapture::SaveSkeletonSnapshot(const k4abt_body_t& body)
 
 	char filename[256];
 	std::tm timeinfo;
+#ifdef _WIN32
 	localtime_s(&timeinfo, &time);
+#else
+	localtime_r(&time, &timeinfo);
+#endif
 	strftime(filename, sizeof(filename), "pose_snapshot_%Y%m%d_%H%M%S.json", &timeinfo);
 
-	// Create JSON object
-	json jsonData;
-	jsonData["body_id"] = body.id;
-	jsonData["timestamp"] = filename;
-
-	// Add all joints
-	json jointsArray = json::array();
-	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	// Make sure the buffer can hold the skeleton and the quoted file name
+	size_t requiredSize = SkeletonJson::MaxSkeletonSize + SkeletonJson::MaxStringSize(strlen(filename));
+	if (m_jsonBuffer.size() < requiredSize)
 	{
-		const k4a_float3_t& pos = body.skeleton.joints[joint].position;
-		const k4a_quaternion_t& ori = body.skeleton.joints[joint].orientation;
-		k4abt_joint_confidence_level_t confidence = body.skeleton.joints[joint].confidence_level;
-
-		json jointObj;
-		jointObj["joint"] = joint;
-
-		jointObj["position"] = {
-			   {"x", pos.xyz.x},
-		 {"y", pos.xyz.y},
-			   {"z", pos.xyz.z}
-		};
-
-		jointObj["orientation"] = {
-			{"w", ori.wxyz.w},
- {"x", ori.wxyz.x},
-			{"y", ori.wxyz.y},
-			{"z", ori.wxyz.z}
-		};
-
-		jointObj["confidence_level"] = static_cast<int>(confidence);
-
-		jointsArray.push_back(jointObj);
+		m_jsonBuffer.resize(requiredSize);
 	}
 
-	jsonData["joints"] = jointsArray;
+	size_t length = SkeletonJson::WriteSnapshot(m_jsonBuffer.data(), body, filename);
 
 	// Write to file with pretty print
 	std::ofstream file(filename);
@@ -183,7 +160,8 @@ void PoseSnapshotCapture::SaveSkeletonSnapshot(const k4abt_body_t& body)
 		return;
 	}
 
-	file << std::setw(2) << jsonData << std::endl;
+	file.write(m_jsonBuffer.data(), static_cast<std::streamsize>(length));
+	file << std::endl;
 	file.close();
 
 	printf("Pose snapshot saved to: %s\n", filename);
@@ -5,6 +5,7 @@
 #include <k4abt.h>
 #include <chrono>
 #include <string>
+#include <vector>
 
 class PoseSnapshotCapture
 {
@@ -41,4 +42,7 @@ private:
     bool m_bothHandsAreRaised;
     bool m_snapshotTaken;
     bool m_countdownStarted;
+
+    // Preallocated output for the snapshot JSON writer
+    std::vector<char> m_jsonBuffer;
 };
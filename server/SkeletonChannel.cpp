@@ -0,0 +1,106 @@
+// Licensed under the MIT License.
+
+#include "SkeletonChannel.h"
+#include "SkeletonWebSocket.h"
+#include <cstdio>
+
+SkeletonChannel::SkeletonChannel(size_t frameCapacity, size_t clientQueueCapacity, bool webSocket)
+	: m_clientQueueCapacity(clientQueueCapacity)
+	, m_webSocket(webSocket)
+	, m_framePool(SkeletonWebSocket::MaxFrameHeaderSize + frameCapacity, clientQueueCapacity + 1)
+{
+}
+
+SkeletonChannel::~SkeletonChannel()
+{
+	Stop();
+}
+
+bool SkeletonChannel::Start(const std::string& bindAddress, int port, bool sendRing)
+{
+	WSADATA wsaData;
+	int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if (result != 0)
+	{
+		printf("WSAStartup failed with error: %d\n", result);
+		return false;
+	}
+
+	// Echoes go out in the binary layout, like everything else on a channel
+	m_server = std::make_unique<SkeletonFanoutServer>(m_clientQueueCapacity, m_webSocket, sendRing);
+	m_server->SetEncoding(SkeletonEncoding::Binary);
+	if (!m_server->Start(bindAddress, port))
+	{
+		m_server.reset();
+		WSACleanup();
+		return false;
+	}
+
+	// Messages are large, the pooled buffers are worth sending without pinning them every time
+	m_server->RegisterBuffers(m_framePool.GetBuffers());
+	return true;
+}
+
+void SkeletonChannel::Stop()
+{
+	if (m_server)
+	{
+		m_server->Stop();
+		m_server.reset();
+		WSACleanup();
+	}
+}
+
+bool SkeletonChannel::IsRunning() const
+{
+	return m_server != nullptr;
+}
+
+const std::vector<SkeletonSubscription>& SkeletonChannel::UpdateSubscriptions()
+{
+	m_subscriptions.clear();
+	if (m_server && m_server->GetClientCount() > 0)
+	{
+		m_server->GetSubscriptions(m_subscriptions);
+	}
+	return m_subscriptions;
+}
+
+SharedFrame SkeletonChannel::Acquire()
+{
+	return m_framePool.Acquire();
+}
+
+uint8_t* SkeletonChannel::GetPayload(const SharedFrame& frame)
+{
+	return frame->data.data() + SkeletonWebSocket::MaxFrameHeaderSize;
+}
+
+void SkeletonChannel::Broadcast(const SharedFrame& frame, size_t size, const SkeletonSubscription& subscription)
+{
+	if (!m_server)
+	{
+		return;
+	}
+
+	// WebSocket frames get their header in the room left in front of the payload
+	frame->offset = SkeletonWebSocket::MaxFrameHeaderSize;
+	frame->size = size;
+	if (m_webSocket)
+	{
+		frame->offset -= SkeletonWebSocket::FrameHeaderSize(size);
+		frame->size += SkeletonWebSocket::WriteFrameHeader(frame->data.data() + frame->offset,
+			SkeletonWebSocket::Opcode::Binary, size);
+	}
+	m_server->Broadcast(frame, subscription);
+}
+
+size_t SkeletonChannel::GetClientCount() const
+{
+	return m_server ? m_server->GetClientCount() : 0;
+}
+
+uint64_t SkeletonChannel::GetFramesDropped() const
+{
+	return m_server ? m_server->GetFramesDropped() : 0;
+}
@@ -0,0 +1,55 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FrameBufferPool.h"
+#include "SkeletonFanoutServer.h"
+#include "SkeletonSubscription.h"
+
+// A listening port for one kind of per-frame image data next to the skeleton stream,
+// such as depth or silhouettes. Large messages get a port of their own so they never
+// hold up the skeletons queued behind them; clients pair the streams by timestamp.
+//
+// Clients are served by a SkeletonFanoutServer, so they send a subscription line and
+// pings like on the skeleton port. The channel writes every message once per distinct
+// subscription into a pooled buffer; in WebSocket mode messages go out as binary messages.
+class SkeletonChannel
+{
+public:
+    // frameCapacity is the largest message written, clients keep at most
+    // clientQueueCapacity of them queued and drop the oldest beyond that
+    SkeletonChannel(size_t frameCapacity, size_t clientQueueCapacity, bool webSocket = false);
+    ~SkeletonChannel();
+
+    // sendRing sends through io_uring where available, see SkeletonSendRing
+    bool Start(const std::string& bindAddress, int port, bool sendRing = false);
+    void Stop();
+    bool IsRunning() const;
+
+    // Distinct subscriptions of the clients past their handshake, empty while nobody
+    // is listening so callers can skip encoding altogether
+    const std::vector<SkeletonSubscription>& UpdateSubscriptions();
+
+    // A buffer to write one message into, at GetPayload(frame), up to frameCapacity bytes
+    SharedFrame Acquire();
+    static uint8_t* GetPayload(const SharedFrame& frame);
+
+    // Close the message written at the payload and queue it on every client with the subscription
+    void Broadcast(const SharedFrame& frame, size_t size, const SkeletonSubscription& subscription);
+
+    size_t GetClientCount() const;
+    uint64_t GetFramesDropped() const;
+
+private:
+    size_t m_clientQueueCapacity;
+    bool m_webSocket;
+    FrameBufferPool m_framePool;
+    std::unique_ptr<SkeletonFanoutServer> m_server;
+    std::vector<SkeletonSubscription> m_subscriptions;
+};
@@ -0,0 +1,28 @@
+// Licensed under the MIT License.
+
+#include "SkeletonCommandChannel.h"
+
+SkeletonCommandChannel::SkeletonCommandChannel()
+	: m_pending(0)
+{
+}
+
+void SkeletonCommandChannel::Post(SkeletonCommand command)
+{
+	m_pending.fetch_or(static_cast<uint32_t>(command), std::memory_order_acq_rel);
+}
+
+bool SkeletonCommandChannel::Take(SkeletonCommand command)
+{
+	uint32_t bit = static_cast<uint32_t>(command);
+	if (command == SkeletonCommand::Stop)
+	{
+		return IsStopping();
+	}
+	return (m_pending.fetch_and(~bit, std::memory_order_acq_rel) & bit) != 0;
+}
+
+bool SkeletonCommandChannel::IsStopping() const
+{
+	return (m_pending.load(std::memory_order_acquire) & static_cast<uint32_t>(SkeletonCommand::Stop)) != 0;
+}
@@ -0,0 +1,33 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Commands the viewer's window and signal handlers give the pipeline threads
+enum class SkeletonCommand : uint32_t
+{
+    Stop = 1,      // every stage winds down, stays posted once posted
+    Snapshot = 2,  // save a pose snapshot of the next tracked body
+};
+
+// Thread-safe mailbox of pending commands. Any thread may post, and a command
+// is taken once by the stage that acts on it. Posting a command that is still
+// pending is a no-op, so pressing a key twice before a frame arrives acts once.
+// Lock-free, so posting from a signal handler is fine.
+class SkeletonCommandChannel
+{
+public:
+    SkeletonCommandChannel();
+
+    void Post(SkeletonCommand command);
+
+    // Whether the command was pending, clearing it. Stop is never cleared.
+    bool Take(SkeletonCommand command);
+
+    bool IsStopping() const;
+
+private:
+    std::atomic<uint32_t> m_pending;
+};
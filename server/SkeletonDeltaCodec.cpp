@@ -0,0 +1,562 @@
+// Licensed under the MIT License.
+
+#include "SkeletonDeltaCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace SkeletonWire;
+
+namespace
+{
+	const uint8_t KeyframeFlag = 0x1;
+	const uint8_t DeadReckoningFlag = 0x2;
+
+	int32_t QuantizeAbsolute(float value)
+	{
+		return static_cast<int32_t>(std::lround(value * QuantizedPositionScale));
+	}
+
+	uint8_t* WriteVarint(uint8_t* out, int32_t value)
+	{
+		// Zig-zag so small negative deltas stay short too
+		uint32_t encoded = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+		while (encoded >= 0x80)
+		{
+			*out++ = static_cast<uint8_t>(encoded | 0x80);
+			encoded >>= 7;
+		}
+		*out++ = static_cast<uint8_t>(encoded);
+		return out;
+	}
+
+	bool ReadVarint(const uint8_t*& in, const uint8_t* end, int32_t& value)
+	{
+		uint32_t encoded = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (in == end)
+			{
+				return false;
+			}
+			uint8_t byte = *in++;
+			encoded |= static_cast<uint32_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				value = static_cast<int32_t>(encoded >> 1) ^ -static_cast<int32_t>(encoded & 1);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Where a dead-reckoned coordinate is expected at time at, on the line through its
+	// last two updates. Integer arithmetic, the encoder and decoder must agree exactly.
+	int32_t Extrapolate(int32_t position, int32_t previous, uint64_t time, uint64_t previousTime, uint64_t at)
+	{
+		if (at <= time || time <= previousTime)
+		{
+			return position;
+		}
+		int64_t elapsed = static_cast<int64_t>(std::min(at - time, MaxPredictionUsec));
+		int64_t predicted = position + static_cast<int64_t>(position - previous) * elapsed / static_cast<int64_t>(time - previousTime);
+		return static_cast<int32_t>(std::clamp<int64_t>(predicted, INT32_MIN, INT32_MAX));
+	}
+
+	// Rotation angle between two quaternions, in radians
+	float AngleBetween(const k4a_quaternion_t& a, const k4a_quaternion_t& b)
+	{
+		float dot = 0.0f;
+		float normB = 0.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			dot += a.v[i] * b.v[i];
+			normB += b.v[i] * b.v[i];
+		}
+		if (!(normB > 1e-12f))
+		{
+			return 0.0f;
+		}
+		float cosHalf = std::min(1.0f, std::fabs(dot) / std::sqrt(normB));
+		return 2.0f * std::acos(cosHalf);
+	}
+}
+
+SkeletonDeltaEncoder::SkeletonDeltaEncoder(uint32_t keyframeInterval, float positionToleranceMm, float orientationTolerance)
+	: m_keyframeInterval(std::max<uint32_t>(keyframeInterval, 1))
+	, m_positionTolerance(static_cast<int32_t>(std::lround(std::max(0.0f, positionToleranceMm) * QuantizedPositionScale)))
+	, m_orientationTolerance(std::max(0.0f, orientationTolerance))
+	, m_jointMask(AllJointsMask)
+	, m_predictionError(0)
+	, m_heartbeatUsec(0)
+	, m_bodies()
+	, m_frameCount(0)
+	, m_needKeyframe(true)
+	, m_lastBodyIds()
+	, m_lastBodyCount(0)
+{
+}
+
+void SkeletonDeltaEncoder::ForceKeyframe()
+{
+	m_needKeyframe = true;
+}
+
+void SkeletonDeltaEncoder::SetJointMask(uint32_t mask)
+{
+	if (mask != m_jointMask)
+	{
+		m_jointMask = mask;
+		m_needKeyframe = true;
+	}
+}
+
+void SkeletonDeltaEncoder::SetTolerance(float positionToleranceMm, float orientationTolerance)
+{
+	m_positionTolerance = static_cast<int32_t>(std::lround(std::max(0.0f, positionToleranceMm) * QuantizedPositionScale));
+	m_orientationTolerance = std::max(0.0f, orientationTolerance);
+}
+
+void SkeletonDeltaEncoder::SetDeadReckoning(float errorMm, uint32_t heartbeatMs)
+{
+	int32_t error = static_cast<int32_t>(std::lround(std::max(0.0f, errorMm) * QuantizedPositionScale));
+	uint64_t heartbeat = std::max<uint64_t>(heartbeatMs, 1) * 1000;
+	if (error != m_predictionError || (error > 0 && heartbeat != m_heartbeatUsec))
+	{
+		m_predictionError = error;
+		m_heartbeatUsec = heartbeat;
+		m_needKeyframe = true;
+	}
+}
+
+size_t SkeletonDeltaEncoder::Write(uint8_t* buffer, const k4abt_body_t& body, uint64_t timestamp, uint32_t sequence)
+{
+	Record record;
+	uint8_t* out = BeginFrame(buffer, MessageType::DeltaSkeleton, timestamp, sequence);
+	out = WriteRecord(out, body, timestamp, record);
+	if (CanSuppress(&body, 1, &record))
+	{
+		return 0;
+	}
+
+	CommitFrame(&body, 1, &record, timestamp, sequence);
+	return FinishFrame(buffer, out);
+}
+
+size_t SkeletonDeltaEncoder::WriteBodies(uint8_t* buffer, const k4abt_body_t* bodies, size_t count, uint64_t timestamp, uint32_t sequence)
+{
+	count = std::min(count, MaxBodies);
+
+	Record records[MaxBodies];
+	uint8_t* out = BeginFrame(buffer, MessageType::Bodies, timestamp, sequence);
+	out = WriteU8(out, static_cast<uint8_t>(count));
+	out = WriteU8(out, static_cast<uint8_t>(MessageType::DeltaSkeleton));
+	for (size_t i = 0; i < count; i++)
+	{
+		uint8_t* record = out + BodyRecordPrefixSize;
+		uint8_t* recordEnd = WriteRecord(record, bodies[i], timestamp, records[i]);
+		WriteU16(out, static_cast<uint16_t>(recordEnd - record));
+		out = recordEnd;
+	}
+	if (CanSuppress(bodies, count, records))
+	{
+		return 0;
+	}
+
+	CommitFrame(bodies, count, records, timestamp, sequence);
+	return FinishFrame(buffer, out);
+}
+
+bool SkeletonDeltaEncoder::CanSuppress(const k4abt_body_t* bodies, size_t count, const Record* records) const
+{
+	// The decoder cannot tell a frame that was left out from one with no bodies,
+	// so the bodies must be the ones it already has
+	if (m_predictionError == 0 || count != m_lastBodyCount)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!records[i].empty || bodies[i].id != m_lastBodyIds[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void SkeletonDeltaEncoder::CommitFrame(const k4abt_body_t* bodies, size_t count, const Record* records,
+	uint64_t timestamp, uint32_t sequence)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		BodyState& state = *records[i].state;
+		state.lastSequence = sequence;
+		state.lastFrame = m_frameCount;
+		state.framesSinceKeyframe = records[i].keyframe ? 0 : state.framesSinceKeyframe + 1;
+		state.keyframeTime = records[i].keyframe ? timestamp : state.keyframeTime;
+		m_lastBodyIds[i] = bodies[i].id;
+	}
+	m_lastBodyCount = count;
+	m_frameCount++;
+	m_needKeyframe = false;
+}
+
+SkeletonDeltaEncoder::BodyState& SkeletonDeltaEncoder::FindBody(uint32_t bodyId, bool& isNew)
+{
+	BodyState* reuse = &m_bodies[0];
+	for (BodyState& state : m_bodies)
+	{
+		if (state.used && state.bodyId == bodyId)
+		{
+			isNew = false;
+			return state;
+		}
+		if (!state.used || (reuse->used && state.lastFrame < reuse->lastFrame))
+		{
+			reuse = &state;
+		}
+	}
+
+	// Ids are not reused by the tracker for a long time, so the least recently
+	// written slot belongs to someone who left
+	isNew = true;
+	reuse->used = true;
+	reuse->bodyId = bodyId;
+	return *reuse;
+}
+
+uint8_t* SkeletonDeltaEncoder::WriteRecord(uint8_t* out, const k4abt_body_t& body, uint64_t timestamp, Record& record)
+{
+	bool isNew;
+	BodyState& state = FindBody(body.id, isNew);
+	bool deadReckoning = m_predictionError > 0;
+	bool keyframe = m_needKeyframe || isNew || (deadReckoning ?
+		timestamp < state.keyframeTime || timestamp - state.keyframeTime >= m_heartbeatUsec :
+		state.framesSinceKeyframe + 1 >= m_keyframeInterval);
+	int32_t positionTolerance = std::max(m_positionTolerance, m_predictionError);
+
+	out = WriteU32(out, body.id);
+	out = WriteU8(out, static_cast<uint8_t>((keyframe ? KeyframeFlag : 0) | (deadReckoning ? DeadReckoningFlag : 0)));
+	out = WriteU32(out, state.lastSequence);
+
+	// Masks are filled in once the joints have been compared
+	uint8_t* masks = out;
+	out += 8;
+
+	// Joints outside the joint mask report no confidence
+	bool confidenceChanged = false;
+	memset(out, 0, K4ABT_JOINT_COUNT / 4);
+	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	{
+		if ((m_jointMask & (1u << joint)) == 0)
+		{
+			continue;
+		}
+		uint8_t confidence = static_cast<uint8_t>(body.skeleton.joints[joint].confidence_level) & 0x3;
+		out[joint / 4] |= static_cast<uint8_t>(confidence << (2 * (joint % 4)));
+		confidenceChanged = confidenceChanged || confidence != state.joints[joint].confidence;
+		state.joints[joint].confidence = confidence;
+	}
+	out += K4ABT_JOINT_COUNT / 4;
+
+	uint32_t positionMask = keyframe ? m_jointMask : 0;
+	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	{
+		if ((m_jointMask & (1u << joint)) == 0)
+		{
+			continue;
+		}
+
+		const k4a_float3_t& position = body.skeleton.joints[joint].position;
+		JointState& jointState = state.joints[joint];
+
+		// What the decoder has for the joint right now
+		int32_t base[3];
+		int32_t quantized[3];
+		bool changed = keyframe;
+		for (int i = 0; i < 3; i++)
+		{
+			base[i] = deadReckoning ?
+				Extrapolate(jointState.position[i], jointState.previous[i], jointState.time, jointState.previousTime, timestamp) :
+				jointState.position[i];
+			quantized[i] = QuantizeAbsolute(position.v[i]);
+			changed = changed || std::abs(quantized[i] - base[i]) > positionTolerance;
+		}
+		if (!changed)
+		{
+			continue;
+		}
+
+		// A keyframe starts the joint at rest
+		positionMask |= 1u << joint;
+		for (int i = 0; i < 3; i++)
+		{
+			out = WriteVarint(out, quantized[i] - (keyframe ? 0 : base[i]));
+			jointState.previous[i] = keyframe ? quantized[i] : jointState.position[i];
+			jointState.position[i] = quantized[i];
+		}
+		jointState.previousTime = keyframe ? timestamp : jointState.time;
+		jointState.time = timestamp;
+	}
+
+	uint32_t orientationMask = keyframe ? m_jointMask : 0;
+	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	{
+		if ((m_jointMask & (1u << joint)) == 0)
+		{
+			continue;
+		}
+
+		const k4a_quaternion_t& orientation = body.skeleton.joints[joint].orientation;
+		JointState& jointState = state.joints[joint];
+
+		uint32_t packed = PackQuaternion(orientation);
+		if (!keyframe && (packed == jointState.orientation ||
+			AngleBetween(UnpackQuaternion(jointState.orientation), orientation) <= m_orientationTolerance))
+		{
+			continue;
+		}
+
+		orientationMask |= 1u << joint;
+		out = WriteU32(out, packed);
+		jointState.orientation = packed;
+	}
+
+	WriteU32(masks, positionMask);
+	WriteU32(masks + 4, orientationMask);
+
+	record.state = &state;
+	record.keyframe = keyframe;
+	record.empty = !keyframe && positionMask == 0 && orientationMask == 0 && !confidenceChanged;
+	return out;
+}
+
+SkeletonDeltaDecoder::SkeletonDeltaDecoder()
+	: m_bodies()
+	, m_frameCount(0)
+{
+}
+
+bool SkeletonDeltaDecoder::Read(const uint8_t* data, size_t size, k4abt_body_t& body, uint64_t& timestamp)
+{
+	size_t count;
+	return ReadBodies(data, size, &body, 1, count, timestamp) && count == 1;
+}
+
+bool SkeletonDeltaDecoder::ReadBodies(const uint8_t* data, size_t size, k4abt_body_t* bodies, size_t maxBodies,
+	size_t& count, uint64_t& timestamp)
+{
+	count = 0;
+	FrameHeader header;
+	if (!ReadFrameHeader(data, size, header))
+	{
+		return false;
+	}
+
+	size = std::min(size, LengthPrefixSize + header.payloadLength);
+	timestamp = header.timestamp;
+	m_frameCount++;
+
+	k4abt_body_t body;
+	if (header.type == MessageType::DeltaSkeleton)
+	{
+		RecordResult result = ReadRecord(data + FrameHeaderSize, size - FrameHeaderSize, header.sequence, header.timestamp, body);
+		if (result == RecordResult::Applied && maxBodies > 0)
+		{
+			bodies[count++] = body;
+		}
+		return result != RecordResult::Invalid;
+	}
+
+	if (header.type != MessageType::Bodies || size < BodiesHeaderSize ||
+		static_cast<MessageType>(data[FrameHeaderSize + 1]) != MessageType::DeltaSkeleton)
+	{
+		return false;
+	}
+
+	size_t bodyCount = data[FrameHeaderSize];
+	const uint8_t* in = data + BodiesHeaderSize;
+	const uint8_t* end = data + size;
+	for (size_t i = 0; i < bodyCount; i++)
+	{
+		if (end - in < static_cast<ptrdiff_t>(BodyRecordPrefixSize))
+		{
+			return false;
+		}
+		size_t recordSize = ReadU16(in);
+		in += BodyRecordPrefixSize;
+		if (static_cast<size_t>(end - in) < recordSize)
+		{
+			return false;
+		}
+
+		// Every record is applied, even past maxBodies, so the state stays in step
+		RecordResult result = ReadRecord(in, recordSize, header.sequence, header.timestamp, body);
+		if (result == RecordResult::Invalid)
+		{
+			return false;
+		}
+		if (result == RecordResult::Applied && count < maxBodies)
+		{
+			bodies[count++] = body;
+		}
+		in += recordSize;
+	}
+	return true;
+}
+
+void SkeletonDeltaDecoder::Predict(uint64_t timestamp, k4abt_body_t* bodies, size_t maxBodies, size_t& count) const
+{
+	count = 0;
+	for (const BodyState& state : m_bodies)
+	{
+		if (!state.used || state.lastFrame != m_frameCount || count >= maxBodies)
+		{
+			continue;
+		}
+
+		k4abt_body_t& body = bodies[count++];
+		body = state.body;
+		if (!state.deadReckoning)
+		{
+			continue;
+		}
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			const JointHistory& history = state.history[joint];
+			for (int i = 0; i < 3; i++)
+			{
+				int32_t predicted = Extrapolate(state.positions[joint][i], history.previous[i], history.time, history.previousTime, timestamp);
+				body.skeleton.joints[joint].position.v[i] = predicted / QuantizedPositionScale;
+			}
+		}
+	}
+}
+
+SkeletonDeltaDecoder::RecordResult SkeletonDeltaDecoder::ReadRecord(const uint8_t* in, size_t size, uint32_t sequence,
+	uint64_t timestamp, k4abt_body_t& body)
+{
+	const uint8_t* end = in + size;
+	if (size < 4 + 1 + 4 + 8 + K4ABT_JOINT_COUNT / 4)
+	{
+		return RecordResult::Invalid;
+	}
+
+	uint32_t bodyId = ReadU32(in);
+	bool keyframe = (in[4] & KeyframeFlag) != 0;
+	bool deadReckoning = (in[4] & DeadReckoningFlag) != 0;
+	uint32_t baseSequence = ReadU32(in + 5);
+	uint32_t positionMask = ReadU32(in + 9);
+	uint32_t orientationMask = ReadU32(in + 13);
+	const uint8_t* confidences = in + 17;
+	in += 17 + K4ABT_JOINT_COUNT / 4;
+
+	BodyState* state = nullptr;
+	BodyState* reuse = &m_bodies[0];
+	for (BodyState& candidate : m_bodies)
+	{
+		if (candidate.used && candidate.body.id == bodyId)
+		{
+			state = &candidate;
+			break;
+		}
+		if (!candidate.used || (reuse->used && candidate.lastFrame < reuse->lastFrame))
+		{
+			reuse = &candidate;
+		}
+	}
+
+	// A delta is only meaningful on top of the exact frame it was computed against
+	if (!keyframe && (state == nullptr || baseSequence != state->lastSequence))
+	{
+		if (state != nullptr)
+		{
+			state->used = false;
+		}
+		return RecordResult::Skipped;
+	}
+
+	// Decode into copies so a truncated record leaves the state untouched
+	int32_t positions[K4ABT_JOINT_COUNT][3] = {};
+	JointHistory history[K4ABT_JOINT_COUNT] = {};
+	k4abt_body_t decoded = {};
+	if (state != nullptr)
+	{
+		memcpy(positions, state->positions, sizeof(positions));
+		memcpy(history, state->history, sizeof(history));
+		decoded = state->body;
+	}
+	decoded.id = bodyId;
+
+	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	{
+		// Joints without an update carry on along their line, as the encoder assumed
+		JointHistory& jointHistory = history[joint];
+		bool updated = (positionMask & (1u << joint)) != 0;
+		if (!updated && (!deadReckoning || keyframe))
+		{
+			continue;
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			int32_t base = deadReckoning && !keyframe ?
+				Extrapolate(positions[joint][i], jointHistory.previous[i], jointHistory.time, jointHistory.previousTime, timestamp) :
+				positions[joint][i];
+			if (updated)
+			{
+				int32_t delta;
+				if (!ReadVarint(in, end, delta))
+				{
+					return RecordResult::Invalid;
+				}
+				int32_t position = (keyframe ? 0 : base) + delta;
+				jointHistory.previous[i] = keyframe ? position : positions[joint][i];
+				positions[joint][i] = position;
+				base = position;
+			}
+			decoded.skeleton.joints[joint].position.v[i] = base / QuantizedPositionScale;
+		}
+		if (updated)
+		{
+			jointHistory.previousTime = keyframe ? timestamp : jointHistory.time;
+			jointHistory.time = timestamp;
+		}
+	}
+
+	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	{
+		if ((orientationMask & (1u << joint)) == 0)
+		{
+			continue;
+		}
+		if (end - in < 4)
+		{
+			return RecordResult::Invalid;
+		}
+		decoded.skeleton.joints[joint].orientation = UnpackQuaternion(ReadU32(in));
+		in += 4;
+	}
+
+	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	{
+		decoded.skeleton.joints[joint].confidence_level =
+			static_cast<k4abt_joint_confidence_level_t>((confidences[joint / 4] >> (2 * (joint % 4))) & 0x3);
+	}
+
+	if (state == nullptr)
+	{
+		state = reuse;
+	}
+	state->used = true;
+	state->deadReckoning = deadReckoning;
+	state->lastSequence = sequence;
+	state->lastFrame = m_frameCount;
+	state->body = decoded;
+	memcpy(state->positions, positions, sizeof(positions));
+	memcpy(state->history, history, sizeof(history));
+
+	body = decoded;
+	return RecordResult::Applied;
+}
@@ -0,0 +1,180 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <k4abt.h>
+#include <cstddef>
+#include <cstdint>
+
+#include "SkeletonWireFormat.h"
+
+// Temporal delta frames (message type 3). After the common 20 byte header:
+//
+//   uint32  body id
+//   uint8   flags (bit 0: keyframe, bit 1: dead reckoning)
+//   uint32  base sequence, the frame this one is a delta against (ignored for keyframes)
+//   uint32  position mask, bit n set when joint n carries a position delta
+//   uint32  orientation mask, bit n set when joint n carries an orientation
+//   8 x u8  confidence levels, packed like the quantized frames
+//   per set position bit:    3 zig-zag LEB128 varints, x/y/z delta in 0.1 mm units
+//   per set orientation bit: uint32 smallest-three quaternion (see SkeletonWireFormat.h)
+//
+// Keyframes set every bit of the encoder's joint mask (all joints unless a
+// subscription asked for fewer) and encode positions as deltas from zero. Joints whose
+// change stays within the tolerance are left out; the encoder mirrors the state the
+// decoder reconstructs, so that error never accumulates across frames.
+//
+// With dead reckoning, positions are compared against and encoded relative to where
+// the decoder extrapolates them: along the line through the joint's last two updates,
+// for at most MaxPredictionUsec after the last one. A keyframe starts every joint at
+// rest. Both sides extrapolate in integer arithmetic, so they agree to the bit. Frames
+// in which no joint drifted past the error are not written at all, and keyframes are
+// due by device time, the heartbeat, instead of by frame count.
+//
+// In multi-body frames every record is the payload above, and the base sequence is
+// the last frame that carried the same body, so each body resynchronizes on its own.
+namespace SkeletonWire
+{
+    constexpr size_t MaxDeltaRecordSize = 4 + 1 + 4 + 4 + 4 + K4ABT_JOINT_COUNT / 4 +
+        K4ABT_JOINT_COUNT * 3 * 5 + K4ABT_JOINT_COUNT * sizeof(uint32_t);
+    constexpr size_t MaxDeltaFrameSize = FrameHeaderSize + MaxDeltaRecordSize;
+    static_assert(MaxDeltaFrameSize <= MaxSkeletonFrameSize, "Delta frames must fit the frame buffers");
+
+    // How far past its last update a dead-reckoned joint keeps moving
+    constexpr uint64_t MaxPredictionUsec = 250000;
+}
+
+// Encoder side, one instance per connection (or per group of connections that
+// receive exactly the same frames)
+class SkeletonDeltaEncoder
+{
+public:
+    SkeletonDeltaEncoder(uint32_t keyframeInterval = 30, float positionToleranceMm = 1.0f, float orientationTolerance = 0.005f);
+
+    // Write a delta frame, or a keyframe when one is due, into buffer
+    // (MaxDeltaFrameSize bytes). Returns the number of bytes written, 0 for a frame
+    // dead reckoning left out.
+    size_t Write(uint8_t* buffer, const k4abt_body_t& body, uint64_t timestamp, uint32_t sequence);
+
+    // Multi-body counterpart, buffer must hold MaxBodiesFrameSize bytes
+    size_t WriteBodies(uint8_t* buffer, const k4abt_body_t* bodies, size_t count, uint64_t timestamp, uint32_t sequence);
+
+    // Make the next frame a keyframe for every body, e.g. after a (re)connect or reported loss
+    void ForceKeyframe();
+
+    // Only ever send the joints in mask (bit n for joint n), the others stay at zero
+    // on the receiving side. Takes effect with a keyframe.
+    void SetJointMask(uint32_t mask);
+
+    // Change the tolerances of the constructor, e.g. to send less on a slow link.
+    // Takes effect with the next frame, the decoder needs no telling.
+    void SetTolerance(float positionToleranceMm, float orientationTolerance);
+
+    // Only send positions that drifted more than errorMm from where the decoder
+    // extrapolates them, and leave out frames with nothing to send. A keyframe goes
+    // out every heartbeatMs of device time regardless. errorMm 0 turns it off.
+    // Takes effect with a keyframe.
+    void SetDeadReckoning(float errorMm, uint32_t heartbeatMs = 1000);
+
+private:
+    struct JointState
+    {
+        int32_t position[3];
+        int32_t previous[3];    // position of the update before, for dead reckoning
+        uint64_t time;          // device time of the last and the previous update
+        uint64_t previousTime;
+        uint32_t orientation;
+        uint8_t confidence;
+    };
+
+    struct BodyState
+    {
+        bool used;
+        uint32_t bodyId;
+        uint32_t lastSequence;
+        uint32_t framesSinceKeyframe;
+        uint64_t keyframeTime;
+        uint64_t lastFrame;  // m_frameCount when the body was last written, picks the slot to reuse
+        JointState joints[K4ABT_JOINT_COUNT];
+    };
+
+    // One body's part of the frame being written, committed once the frame is kept
+    struct Record
+    {
+        BodyState* state;
+        bool keyframe;
+        bool empty;  // no position, orientation or confidence changed
+    };
+
+    BodyState& FindBody(uint32_t bodyId, bool& isNew);
+    uint8_t* WriteRecord(uint8_t* out, const k4abt_body_t& body, uint64_t timestamp, Record& record);
+    bool CanSuppress(const k4abt_body_t* bodies, size_t count, const Record* records) const;
+    void CommitFrame(const k4abt_body_t* bodies, size_t count, const Record* records, uint64_t timestamp, uint32_t sequence);
+
+    uint32_t m_keyframeInterval;
+    int32_t m_positionTolerance;
+    float m_orientationTolerance;
+    uint32_t m_jointMask;
+    int32_t m_predictionError;  // 0.1 mm units, 0 without dead reckoning
+    uint64_t m_heartbeatUsec;
+
+    BodyState m_bodies[SkeletonWire::MaxBodies];
+    uint64_t m_frameCount;
+    bool m_needKeyframe;
+
+    // Bodies of the last frame written, a frame with others is never left out
+    uint32_t m_lastBodyIds[SkeletonWire::MaxBodies];
+    size_t m_lastBodyCount;
+};
+
+// Receiver side. Frames whose base was never received (lost datagram, dropped
+// frame) are rejected until the next keyframe resynchronizes the stream.
+class SkeletonDeltaDecoder
+{
+public:
+    SkeletonDeltaDecoder();
+
+    // Returns true and fills body/timestamp when the frame could be applied
+    bool Read(const uint8_t* data, size_t size, k4abt_body_t& body, uint64_t& timestamp);
+
+    // Decode a single-body or multi-body delta frame. count receives the number of
+    // bodies that could be applied, bodies still waiting for a keyframe are left out.
+    bool ReadBodies(const uint8_t* data, size_t size, k4abt_body_t* bodies, size_t maxBodies,
+        size_t& count, uint64_t& timestamp);
+
+    // The bodies of the last frame read as they are expected at timestamp (device
+    // time), for rendering between the frames of a dead-reckoned stream. Other
+    // streams' bodies stay where the last frame put them.
+    void Predict(uint64_t timestamp, k4abt_body_t* bodies, size_t maxBodies, size_t& count) const;
+
+private:
+    struct JointHistory
+    {
+        int32_t previous[3];
+        uint64_t time;
+        uint64_t previousTime;
+    };
+
+    struct BodyState
+    {
+        bool used;
+        bool deadReckoning;
+        uint32_t lastSequence;
+        uint64_t lastFrame;
+        k4abt_body_t body;
+        int32_t positions[K4ABT_JOINT_COUNT][3];
+        JointHistory history[K4ABT_JOINT_COUNT];
+    };
+
+    enum class RecordResult
+    {
+        Applied,
+        Skipped,  // Base frame missing, wait for the body's next keyframe
+        Invalid
+    };
+
+    RecordResult ReadRecord(const uint8_t* in, size_t size, uint32_t sequence, uint64_t timestamp, k4abt_body_t& body);
+
+    BodyState m_bodies[SkeletonWire::MaxBodies];
+    uint64_t m_frameCount;
+};
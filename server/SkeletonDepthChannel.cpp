@@ -0,0 +1,88 @@
+// Licensed under the MIT License.
+
+#include "SkeletonDepthChannel.h"
+#include "SkeletonDepthCodec.h"
+#include <cstdio>
+
+namespace
+{
+	// A slow client keeps at most this many depth frames queued, the newest win
+	constexpr size_t ClientQueueCapacity = 2;
+}
+
+SkeletonDepthChannel::SkeletonDepthChannel(int width, int height, bool webSocket)
+	: m_width(width)
+	, m_height(height)
+	, m_channel(SkeletonDepth::MaxDepthFrameSize(static_cast<size_t>(width) * static_cast<size_t>(height)), ClientQueueCapacity, webSocket)
+	, m_sequence(0)
+	, m_framesSent(0)
+	, m_rawBytes(0)
+	, m_compressedBytes(0)
+{
+}
+
+SkeletonDepthChannel::~SkeletonDepthChannel()
+{
+	Stop();
+}
+
+bool SkeletonDepthChannel::Start(const std::string& bindAddress, int port, bool sendRing)
+{
+	if (!m_channel.Start(bindAddress, port, sendRing))
+	{
+		return false;
+	}
+	printf("Depth channel on port %d, %dx%d RVL frames\n", port, m_width, m_height);
+	return true;
+}
+
+void SkeletonDepthChannel::Stop()
+{
+	m_channel.Stop();
+}
+
+bool SkeletonDepthChannel::IsRunning() const
+{
+	return m_channel.IsRunning();
+}
+
+bool SkeletonDepthChannel::SendDepth(const uint16_t* depth, int width, int height, uint64_t timestamp)
+{
+	if (!m_channel.IsRunning() || width != m_width || height != m_height)
+	{
+		return false;
+	}
+
+	// Subscriptions do not change what a client gets, but Broadcast goes by them
+	const std::vector<SkeletonSubscription>& subscriptions = m_channel.UpdateSubscriptions();
+	if (subscriptions.empty())
+	{
+		return true;
+	}
+
+	uint64_t start = SkeletonLatency::HostTimeUsec();
+	SharedFrame frame = m_channel.Acquire();
+	size_t size = SkeletonDepth::WriteDepthFrame(SkeletonChannel::GetPayload(frame), depth, width, height, timestamp, m_sequence++);
+	m_compressLatency.Record(SkeletonLatency::HostTimeUsec() - start);
+
+	for (const SkeletonSubscription& subscription : subscriptions)
+	{
+		m_channel.Broadcast(frame, size, subscription);
+	}
+	m_framesSent++;
+	m_rawBytes += static_cast<uint64_t>(width) * static_cast<uint64_t>(height) * sizeof(uint16_t);
+	m_compressedBytes += size;
+	return true;
+}
+
+SkeletonDepthStats SkeletonDepthChannel::GetStats() const
+{
+	SkeletonDepthStats stats;
+	stats.framesSent = m_framesSent;
+	uint64_t compressedBytes = m_compressedBytes;
+	stats.compressionRatio = compressedBytes > 0 ? static_cast<double>(m_rawBytes) / static_cast<double>(compressedBytes) : 0.0;
+	stats.compressLatency = SkeletonLatency::GetPercentiles(m_compressLatency);
+	stats.framesDropped = m_channel.GetFramesDropped();
+	stats.clientCount = m_channel.GetClientCount();
+	return stats;
+}
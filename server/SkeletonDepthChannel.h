@@ -0,0 +1,55 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "SkeletonChannel.h"
+#include "SkeletonLatency.h"
+
+struct SkeletonDepthStats
+{
+    uint64_t framesSent = 0;
+    uint64_t framesDropped = 0;
+    size_t clientCount = 0;
+    double compressionRatio = 0.0;  // raw uint16 depth bytes per compressed byte
+    SkeletonLatencyPercentiles compressLatency;
+};
+
+// Optional second listening port that streams the depth image of every body frame,
+// RVL-compressed (see SkeletonDepthCodec.h), to any number of clients. It is kept
+// apart from the skeleton stream so a depth frame of a few hundred kilobytes never
+// holds up the skeletons behind it; clients pair the two streams by timestamp.
+//
+// Clients may send a subscription line and pings like on the skeleton port (see
+// SkeletonChannel.h), although every client gets the same frames.
+class SkeletonDepthChannel
+{
+public:
+    // Frames of another size than width x height are not sent
+    SkeletonDepthChannel(int width, int height, bool webSocket = false);
+    ~SkeletonDepthChannel();
+
+    bool Start(const std::string& bindAddress, int port, bool sendRing = false);
+    void Stop();
+    bool IsRunning() const;
+
+    // Compress the image once and queue it on every client. Does no work while nobody
+    // is connected. Call from one thread only.
+    bool SendDepth(const uint16_t* depth, int width, int height, uint64_t timestamp);
+
+    SkeletonDepthStats GetStats() const;
+
+private:
+    int m_width;
+    int m_height;
+    SkeletonChannel m_channel;
+    uint32_t m_sequence;
+
+    std::atomic<uint64_t> m_framesSent;
+    std::atomic<uint64_t> m_rawBytes;
+    std::atomic<uint64_t> m_compressedBytes;
+    SkeletonLatency::Histogram m_compressLatency;
+};
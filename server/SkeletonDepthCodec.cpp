@@ -0,0 +1,274 @@
+// Licensed under the MIT License.
+
+#include "SkeletonDepthCodec.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SKELETON_DEPTH_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	class NibbleWriter
+	{
+	public:
+		explicit NibbleWriter(uint8_t* out)
+			: m_out(out)
+			, m_word(0)
+			, m_nibbles(0)
+		{
+		}
+
+		void WriteVle(uint32_t value)
+		{
+			do
+			{
+				uint32_t nibble = value & 7;
+				value >>= 3;
+				if (value != 0)
+				{
+					nibble |= 8;
+				}
+				m_word = (m_word << 4) | nibble;
+				if (++m_nibbles == 8)
+				{
+					m_out = SkeletonWire::WriteU32(m_out, m_word);
+					m_word = 0;
+					m_nibbles = 0;
+				}
+			} while (value != 0);
+		}
+
+		// Flush the last, partially filled word
+		uint8_t* Finish()
+		{
+			if (m_nibbles > 0)
+			{
+				m_out = SkeletonWire::WriteU32(m_out, m_word << (4 * (8 - m_nibbles)));
+				m_word = 0;
+				m_nibbles = 0;
+			}
+			return m_out;
+		}
+
+	private:
+		uint8_t* m_out;
+		uint32_t m_word;
+		int m_nibbles;
+	};
+
+	class NibbleReader
+	{
+	public:
+		NibbleReader(const uint8_t* data, size_t size)
+			: m_in(data)
+			, m_end(data + size)
+			, m_word(0)
+			, m_nibbles(0)
+			, m_failed(false)
+		{
+		}
+
+		uint32_t ReadVle()
+		{
+			uint32_t value = 0;
+			for (int shift = 0; ; shift += 3)
+			{
+				if (m_nibbles == 0)
+				{
+					if (m_end - m_in < 4)
+					{
+						m_failed = true;
+						return 0;
+					}
+					m_word = SkeletonWire::ReadU32(m_in);
+					m_in += 4;
+					m_nibbles = 8;
+				}
+				uint32_t nibble = m_word >> 28;
+				m_word <<= 4;
+				m_nibbles--;
+				value |= (nibble & 7) << shift;
+				if ((nibble & 8) == 0)
+				{
+					return value;
+				}
+				if (shift >= 30)
+				{
+					// Longer than any 32-bit value
+					m_failed = true;
+					return 0;
+				}
+			}
+		}
+
+		bool Failed() const { return m_failed; }
+
+	private:
+		const uint8_t* m_in;
+		const uint8_t* m_end;
+		uint32_t m_word;
+		int m_nibbles;
+		bool m_failed;
+	};
+
+#ifdef SKELETON_DEPTH_SSE2
+	int LowestSetBit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	// Bit 2n and 2n+1 are set for every zero pixel n of the 8 at depth
+	uint32_t ZeroMask(const uint16_t* depth)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(pixels, _mm_setzero_si128())));
+	}
+#endif
+
+	// Run lengths are found 8 pixels at a time where SSE2 is available. Only the scan
+	// is vectorized: every variable-length code depends on where the previous one ended.
+	size_t ZeroRun(const uint16_t* depth, size_t count)
+	{
+		size_t i = 0;
+#ifdef SKELETON_DEPTH_SSE2
+		for (; i + 8 <= count; i += 8)
+		{
+			uint32_t mask = ZeroMask(depth + i);
+			if (mask != 0xFFFF)
+			{
+				return i + LowestSetBit(~mask) / 2;
+			}
+		}
+#endif
+		while (i < count && depth[i] == 0)
+		{
+			i++;
+		}
+		return i;
+	}
+
+	size_t NonZeroRun(const uint16_t* depth, size_t count)
+	{
+		size_t i = 0;
+#ifdef SKELETON_DEPTH_SSE2
+		for (; i + 8 <= count; i += 8)
+		{
+			uint32_t mask = ZeroMask(depth + i);
+			if (mask != 0)
+			{
+				return i + LowestSetBit(mask) / 2;
+			}
+		}
+#endif
+		while (i < count && depth[i] != 0)
+		{
+			i++;
+		}
+		return i;
+	}
+}
+
+namespace SkeletonDepth
+{
+	size_t CompressRvl(const uint16_t* depth, size_t pixels, uint8_t* out)
+	{
+		NibbleWriter writer(out);
+		int previous = 0;
+		size_t i = 0;
+		while (i < pixels)
+		{
+			size_t zeros = ZeroRun(depth + i, pixels - i);
+			writer.WriteVle(static_cast<uint32_t>(zeros));
+			i += zeros;
+
+			size_t nonZeros = NonZeroRun(depth + i, pixels - i);
+			writer.WriteVle(static_cast<uint32_t>(nonZeros));
+			for (size_t end = i + nonZeros; i < end; i++)
+			{
+				int current = depth[i];
+				int delta = current - previous;
+				writer.WriteVle((static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+				previous = current;
+			}
+		}
+		return static_cast<size_t>(writer.Finish() - out);
+	}
+
+	bool DecompressRvl(const uint8_t* data, size_t size, uint16_t* depth, size_t pixels)
+	{
+		NibbleReader reader(data, size);
+		uint16_t* out = depth;
+		uint16_t* end = depth + pixels;
+		int previous = 0;
+		while (out != end)
+		{
+			uint32_t zeros = reader.ReadVle();
+			if (reader.Failed() || zeros > static_cast<size_t>(end - out))
+			{
+				return false;
+			}
+			std::fill(out, out + zeros, static_cast<uint16_t>(0));
+			out += zeros;
+
+			uint32_t nonZeros = reader.ReadVle();
+			if (reader.Failed() || nonZeros > static_cast<size_t>(end - out))
+			{
+				return false;
+			}
+			for (uint32_t i = 0; i < nonZeros; i++)
+			{
+				uint32_t positive = reader.ReadVle();
+				int delta = static_cast<int>(positive >> 1) ^ -static_cast<int>(positive & 1);
+				previous += delta;
+				*out++ = static_cast<uint16_t>(previous);
+			}
+			if (reader.Failed())
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t WriteDepthFrame(uint8_t* buffer, const uint16_t* depth, int width, int height,
+		uint64_t timestamp, uint32_t sequence)
+	{
+		uint8_t* out = SkeletonWire::BeginFrame(buffer, SkeletonWire::MessageType::Depth, timestamp, sequence);
+		out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(width));
+		out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(height));
+		out = SkeletonWire::WriteU8(out, RvlCodec);
+		out += CompressRvl(depth, static_cast<size_t>(width) * static_cast<size_t>(height), out);
+		return SkeletonWire::FinishFrame(buffer, out);
+	}
+
+	bool ReadDepthFrame(const uint8_t* data, size_t size, std::vector<uint16_t>& depth,
+		int& width, int& height, uint64_t& timestamp)
+	{
+		SkeletonWire::FrameHeader header;
+		if (!SkeletonWire::ReadFrameHeader(data, size, header) || header.type != SkeletonWire::MessageType::Depth ||
+			size < DepthHeaderSize || SkeletonWire::LengthPrefixSize + header.payloadLength > size ||
+			data[SkeletonWire::FrameHeaderSize + 4] != RvlCodec)
+		{
+			return false;
+		}
+
+		width = SkeletonWire::ReadU16(data + SkeletonWire::FrameHeaderSize);
+		height = SkeletonWire::ReadU16(data + SkeletonWire::FrameHeaderSize + 2);
+		timestamp = header.timestamp;
+		depth.resize(static_cast<size_t>(width) * static_cast<size_t>(height));
+		return DecompressRvl(data + DepthHeaderSize, SkeletonWire::LengthPrefixSize + header.payloadLength - DepthHeaderSize,
+			depth.data(), depth.size());
+	}
+}
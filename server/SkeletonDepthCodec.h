@@ -0,0 +1,43 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SkeletonWireFormat.h"
+
+// Lossless depth image compression with RVL (A. Wilson, "Fast Lossless Depth Image
+// Compression", 2017), and the depth frames that carry it (SkeletonWire message type 7).
+//
+// The image is coded as alternating runs of zero (no depth) and non-zero pixels. Every
+// pair of runs starts with the zero count and the non-zero count, followed by each
+// non-zero pixel as the zigzag-coded difference to the previous non-zero pixel. All
+// numbers are variable-length: 3 bits per nibble, the high bit set when another nibble
+// follows. Nibbles fill 32-bit words from the most significant end, and the words are
+// little-endian on the wire, so existing RVL decoders read the stream unchanged on
+// little-endian hosts.
+namespace SkeletonDepth
+{
+    constexpr uint8_t RvlCodec = 1;
+    constexpr size_t DepthHeaderSize = SkeletonWire::FrameHeaderSize + 5;
+
+    // No pixel costs more than 8 nibbles, counting its share of the run lengths
+    constexpr size_t MaxRvlSize(size_t pixels) { return 4 * pixels + 8; }
+    constexpr size_t MaxDepthFrameSize(size_t pixels) { return DepthHeaderSize + MaxRvlSize(pixels); }
+
+    // out must hold MaxRvlSize(pixels) bytes. Returns the number of bytes written.
+    size_t CompressRvl(const uint16_t* depth, size_t pixels, uint8_t* out);
+
+    // Returns false if the data ends early or does not decode to exactly pixels pixels
+    bool DecompressRvl(const uint8_t* data, size_t size, uint16_t* depth, size_t pixels);
+
+    // Complete depth frame, including the length prefix. buffer must hold
+    // MaxDepthFrameSize(width * height) bytes. Returns the number of bytes written.
+    size_t WriteDepthFrame(uint8_t* buffer, const uint16_t* depth, int width, int height,
+        uint64_t timestamp, uint32_t sequence);
+
+    bool ReadDepthFrame(const uint8_t* data, size_t size, std::vector<uint16_t>& depth,
+        int& width, int& height, uint64_t& timestamp);
+}
@@ -0,0 +1,841 @@
+// Licensed under the MIT License.
+
+#include "SkeletonFanoutServer.h"
+#include "SkeletonJsonWriter.h"
+#include "SkeletonLatency.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+namespace
+{
+	bool SetNonBlocking(SOCKET socket)
+	{
+		u_long nonBlocking = 1;
+		return ioctlsocket(socket, FIONBIO, &nonBlocking) == 0;
+	}
+
+	// A UDP socket connected to itself, used to interrupt the poller when a frame is queued
+	SOCKET CreateWakeSocket()
+	{
+		SOCKET wakeSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (wakeSocket == INVALID_SOCKET)
+		{
+			return INVALID_SOCKET;
+		}
+
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = 0;
+		inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+		socklen_t addressLength = sizeof(address);
+		if (bind(wakeSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+			getsockname(wakeSocket, (sockaddr*)&address, &addressLength) == SOCKET_ERROR ||
+			connect(wakeSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+			!SetNonBlocking(wakeSocket))
+		{
+			closesocket(wakeSocket);
+			return INVALID_SOCKET;
+		}
+
+		return wakeSocket;
+	}
+
+	// Pongs and close replies are rare enough to allocate
+	SharedFrame MakeControlFrame(SkeletonWebSocket::Opcode opcode, const std::string& payload)
+	{
+		SharedFrame frame = std::make_shared<FrameBuffer>();
+		frame->data.resize(SkeletonWebSocket::MaxFrameHeaderSize + payload.size());
+		frame->size = SkeletonWebSocket::WriteFrameHeader(frame->data.data(), opcode, payload.size());
+		std::copy(payload.begin(), payload.end(), frame->data.begin() + frame->size);
+		frame->size += payload.size();
+		return frame;
+	}
+}
+
+SkeletonFanoutServer::SkeletonFanoutServer(size_t clientQueueCapacity, bool webSocket, bool sendRing)
+	: m_clientQueueCapacity(clientQueueCapacity > 0 ? clientQueueCapacity : 1)
+	, m_webSocket(webSocket)
+	, m_encoding(SkeletonEncoding::Json)
+	, m_listenSocket(INVALID_SOCKET)
+	, m_wakeSocket(INVALID_SOCKET)
+	, m_useSendRing(sendRing)
+	, m_rateControl(false)
+	, m_adaptiveByDefault(false)
+	, m_running(false)
+	, m_clientCount(0)
+	, m_subscriptionsVersion(0)
+	, m_framesDropped(0)
+{
+}
+
+SkeletonFanoutServer::~SkeletonFanoutServer()
+{
+	Stop();
+}
+
+bool SkeletonFanoutServer::Start(const std::string& bindAddress, int port)
+{
+	if (m_running)
+	{
+		return true;
+	}
+
+	sockaddr_in serverAddr = {};
+	serverAddr.sin_family = AF_INET;
+	serverAddr.sin_port = htons(port);
+	if (inet_pton(AF_INET, bindAddress.c_str(), &serverAddr.sin_addr) <= 0)
+	{
+		printf("Invalid listen address: %s\n", bindAddress.c_str());
+		return false;
+	}
+
+	m_listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (m_listenSocket == INVALID_SOCKET)
+	{
+		printf("Listen socket creation failed with error: %d\n", WSAGetLastError());
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	if (bind(m_listenSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR ||
+		listen(m_listenSocket, SOMAXCONN) == SOCKET_ERROR ||
+		!SetNonBlocking(m_listenSocket))
+	{
+		printf("Listening on %s:%d failed with error: %d\n", bindAddress.c_str(), port, WSAGetLastError());
+		closesocket(m_listenSocket);
+		m_listenSocket = INVALID_SOCKET;
+		return false;
+	}
+
+	m_wakeSocket = CreateWakeSocket();
+	if (m_wakeSocket == INVALID_SOCKET)
+	{
+		printf("Wake socket creation failed with error: %d\n", WSAGetLastError());
+		closesocket(m_listenSocket);
+		m_listenSocket = INVALID_SOCKET;
+		return false;
+	}
+
+	// The addresses of the two socket members tell their events apart from client events
+	if (!m_poller.Open() ||
+		!m_poller.Add(m_wakeSocket, SocketPoller::Readable, &m_wakeSocket) ||
+		!m_poller.Add(m_listenSocket, SocketPoller::Readable, &m_listenSocket))
+	{
+		printf("Skeleton server poller creation failed with error: %d\n", WSAGetLastError());
+		m_poller.Close();
+		closesocket(m_listenSocket);
+		closesocket(m_wakeSocket);
+		m_listenSocket = INVALID_SOCKET;
+		m_wakeSocket = INVALID_SOCKET;
+		return false;
+	}
+
+	if (m_useSendRing && !m_sendRing.Open())
+	{
+		printf("io_uring is not available, sending with send() instead\n");
+	}
+
+	m_running = true;
+	m_thread = std::thread(&SkeletonFanoutServer::NetworkLoop, this);
+	printf("Skeleton %sserver listening on %s:%d%s\n", m_webSocket ? "WebSocket " : "", bindAddress.c_str(), port,
+		!m_sendRing.IsOpen() ? "" : m_sendRing.SupportsZeroCopy() ? ", io_uring sends with zero-copy" : ", io_uring sends");
+	return true;
+}
+
+void SkeletonFanoutServer::Stop()
+{
+	if (!m_thread.joinable())
+	{
+		return;
+	}
+
+	m_running = false;
+	Wake();
+	m_thread.join();
+
+	for (auto& client : m_clients)
+	{
+		CloseClient(*client);
+	}
+	RemoveClosedClients();
+
+	m_sendRing.Close();
+	m_poller.Close();
+	closesocket(m_listenSocket);
+	closesocket(m_wakeSocket);
+	m_listenSocket = INVALID_SOCKET;
+	m_wakeSocket = INVALID_SOCKET;
+}
+
+void SkeletonFanoutServer::Broadcast(const SharedFrame& frame, const SkeletonSubscription& subscription)
+{
+	if (m_clientCount == 0)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& client : m_clients)
+		{
+			if (!client->subscribed || client->subscription != subscription)
+			{
+				continue;
+			}
+
+			// Never evict the frame that is partially on the wire
+			size_t firstDroppable = client->writeOffset > 0 ? 1 : 0;
+			if (client->queue.size() >= m_clientQueueCapacity && client->queue.size() > firstDroppable)
+			{
+				client->queue.erase(client->queue.begin() + firstDroppable);
+				m_framesDropped++;
+			}
+			client->queue.push_back(frame);
+		}
+	}
+
+	Wake();
+}
+
+void SkeletonFanoutServer::RegisterBuffers(const std::vector<SharedFrame>& frames)
+{
+	// The network thread uses the ring with the lock held
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_sendRing.IsOpen())
+	{
+		m_sendRing.RegisterBuffers(frames);
+	}
+}
+
+void SkeletonFanoutServer::EnableRateControl(bool byDefault)
+{
+	m_rateControl = true;
+	m_adaptiveByDefault = byDefault;
+}
+
+bool SkeletonFanoutServer::IsWebSocket() const
+{
+	return m_webSocket;
+}
+
+void SkeletonFanoutServer::SetEncoding(SkeletonEncoding encoding)
+{
+	m_encoding = encoding;
+}
+
+size_t SkeletonFanoutServer::GetClientCount() const
+{
+	return m_clientCount;
+}
+
+uint64_t SkeletonFanoutServer::GetFramesDropped() const
+{
+	return m_framesDropped;
+}
+
+void SkeletonFanoutServer::GetClientStats(std::vector<SkeletonClientStats>& stats) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	stats.clear();
+	for (auto& client : m_clients)
+	{
+		SkeletonClientStats clientStats;
+		clientStats.address = client->address;
+		clientStats.adaptive = client->adaptive;
+		clientStats.level = client->adaptive ? client->rateController.GetLevel() : 0;
+		clientStats.rateHz = client->subscription.maxRateHz;
+		clientStats.precisionLevel = client->subscription.precisionLevel;
+		clientStats.bytesWritten = client->bytesWritten;
+		clientStats.estimate = client->rateController.GetEstimate();
+		stats.push_back(clientStats);
+	}
+}
+
+void SkeletonFanoutServer::GetSubscriptions(std::vector<SkeletonSubscription>& subscriptions) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	subscriptions = m_subscriptions;
+}
+
+uint64_t SkeletonFanoutServer::GetSubscriptionsVersion() const
+{
+	return m_subscriptionsVersion;
+}
+
+void SkeletonFanoutServer::Wake()
+{
+	char signal = 0;
+	send(m_wakeSocket, &signal, 1, 0);
+}
+
+void SkeletonFanoutServer::NetworkLoop()
+{
+	std::vector<SocketPoller::Event> events;
+
+	while (m_running)
+	{
+		if (!m_poller.Wait(events, ExpireHandshakes()))
+		{
+			printf("Skeleton server poll failed with error: %d\n", WSAGetLastError());
+			break;
+		}
+
+		for (const SocketPoller::Event& event : events)
+		{
+			if (event.context == &m_wakeSocket)
+			{
+				char drain[64];
+				while (recv(m_wakeSocket, drain, sizeof(drain), 0) > 0)
+				{
+				}
+				continue;
+			}
+
+			if (event.context == &m_listenSocket)
+			{
+				AcceptClients();
+				continue;
+			}
+
+			Client& client = *static_cast<Client*>(event.context);
+			if (client.closed)
+			{
+				continue;
+			}
+
+			bool keep = (event.events & SocketPoller::Closed) == 0;
+			if (keep && (event.events & SocketPoller::Readable))
+			{
+				keep = DrainClientInput(client);
+			}
+			if (!keep)
+			{
+				CloseClient(client);
+				continue;
+			}
+			client.writable = (event.events & SocketPoller::Writable) != 0;
+		}
+
+		// Write newly queued frames straight away. Only clients whose socket buffer
+		// filled up wait for a Writable event, everybody else costs no extra syscall.
+		// With the send ring all of them together cost one.
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_flushing.clear();
+			for (auto& client : m_clients)
+			{
+				if (!client->closed && (!client->writeInterest || client->writable) && !client->queue.empty())
+				{
+					m_flushing.push_back(client.get());
+				}
+				client->writable = false;
+			}
+			FlushClients();
+		}
+		for (Client* client : m_flushing)
+		{
+			if (client->sendFailed)
+			{
+				CloseClient(*client);
+				continue;
+			}
+			UpdateWriteInterest(*client);
+		}
+
+		RemoveClosedClients();
+		UpdateRateControl();
+	}
+}
+
+void SkeletonFanoutServer::AcceptClients()
+{
+	for (;;)
+	{
+		sockaddr_in clientAddr = {};
+		socklen_t addressLength = sizeof(clientAddr);
+		SOCKET clientSocket = accept(m_listenSocket, (sockaddr*)&clientAddr, &addressLength);
+		if (clientSocket == INVALID_SOCKET)
+		{
+			return;
+		}
+
+		int noDelay = 1;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		if (!SetNonBlocking(clientSocket))
+		{
+			closesocket(clientSocket);
+			continue;
+		}
+
+		char addressText[INET_ADDRSTRLEN] = {};
+		inet_ntop(AF_INET, &clientAddr.sin_addr, addressText, sizeof(addressText));
+
+		auto client = std::make_unique<Client>();
+		client->socket = clientSocket;
+		client->connectTime = std::chrono::steady_clock::now();
+		client->upgraded = !m_webSocket;
+		client->address = std::string(addressText) + ":" + std::to_string(ntohs(clientAddr.sin_port));
+		if (!m_poller.Add(clientSocket, SocketPoller::Readable, client.get()))
+		{
+			closesocket(clientSocket);
+			continue;
+		}
+		printf("Skeleton client connected: %s\n", client->address.c_str());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_clients.push_back(std::move(client));
+		m_clientCount = m_clients.size();
+	}
+}
+
+bool SkeletonFanoutServer::FlushClient(Client& client)
+{
+	while (!client.queue.empty())
+	{
+		const FrameBuffer& frame = *client.queue.front();
+		const char* data = reinterpret_cast<const char*>(frame.data.data()) + frame.offset + client.writeOffset;
+		int remaining = (int)(frame.size - client.writeOffset);
+
+		int result = send(client.socket, data, remaining, SocketSendFlags);
+		if (result == SOCKET_ERROR)
+		{
+			// Socket buffer is full, continue when the poller says it is writable again
+			return WSAGetLastError() == WSAEWOULDBLOCK;
+		}
+
+		client.writeOffset += static_cast<size_t>(result);
+		client.bytesWritten += static_cast<uint64_t>(result);
+		if (client.writeOffset < frame.size)
+		{
+			return true;
+		}
+
+		client.queue.pop_front();
+		client.writeOffset = 0;
+	}
+	return true;
+}
+
+void SkeletonFanoutServer::FlushClients()
+{
+	// Called with m_mutex held
+	if (m_sendRing.IsOpen())
+	{
+		FlushClientsThroughRing();
+		return;
+	}
+	for (Client* client : m_flushing)
+	{
+		client->sendFailed = !FlushClient(*client);
+	}
+}
+
+void SkeletonFanoutServer::FlushClientsThroughRing()
+{
+	// Every round sends the front frame of each client in one submission, until all
+	// queues are empty or their socket buffers full. The lock keeps Broadcast from
+	// evicting a frame while it is being sent.
+	m_sending = m_flushing;
+	while (!m_sending.empty())
+	{
+		size_t queued = 0;
+		for (; queued < m_sending.size(); queued++)
+		{
+			Client& client = *m_sending[queued];
+			const SharedFrame& frame = client.queue.front();
+			if (!m_sendRing.QueueSend(client.socket, frame, frame->offset + client.writeOffset,
+				frame->size - client.writeOffset, &client))
+			{
+				break;
+			}
+		}
+
+		if (queued == 0)
+		{
+			// Every slot is held by a zero-copy send the kernel has not let go of, a
+			// peer that stopped reading can pin them all. Another round would not free
+			// any, the rest are sent with send() instead.
+			for (Client* client : m_sending)
+			{
+				client->sendFailed = !FlushClient(*client);
+			}
+			return;
+		}
+
+		if (!m_sendRing.Submit(m_sendResults))
+		{
+			// Which of the sends went out is unknown, these streams cannot go on
+			printf("io_uring submission failed with error: %d, sending with send() instead\n", errno);
+			m_sendRing.Close();
+			for (size_t i = 0; i < queued; i++)
+			{
+				m_sending[i]->sendFailed = true;
+			}
+			return;
+		}
+
+		m_sendingNext.assign(m_sending.begin() + queued, m_sending.end());
+		for (const SkeletonSendRing::Result& result : m_sendResults)
+		{
+			Client& client = *static_cast<Client*>(result.context);
+			if (result.result < 0)
+			{
+				// A full socket buffer waits for Writable like with plain sends
+				client.sendFailed = result.result != -EAGAIN && result.result != -EWOULDBLOCK;
+				continue;
+			}
+
+			client.writeOffset += static_cast<size_t>(result.result);
+			client.bytesWritten += static_cast<uint64_t>(result.result);
+			if (client.writeOffset < client.queue.front()->size)
+			{
+				continue;
+			}
+			client.queue.pop_front();
+			client.writeOffset = 0;
+			if (!client.queue.empty())
+			{
+				m_sendingNext.push_back(&client);
+			}
+		}
+		m_sending.swap(m_sendingNext);
+	}
+}
+
+bool SkeletonFanoutServer::DrainClientInput(Client& client)
+{
+	char buffer[256];
+	for (;;)
+	{
+		int result = recv(client.socket, buffer, sizeof(buffer), 0);
+		if (result <= 0)
+		{
+			return result == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK;
+		}
+
+		bool keep = !m_webSocket ? ReadSubscription(client, buffer, static_cast<size_t>(result)) :
+			client.upgraded ? ReadWebSocketFrames(client, buffer, static_cast<size_t>(result)) :
+			ReadUpgrade(client, buffer, static_cast<size_t>(result));
+		if (!keep)
+		{
+			return false;
+		}
+	}
+}
+
+bool SkeletonFanoutServer::ReadSubscription(Client& client, const char* data, size_t size)
+{
+	// All a client ever says is subscription lines, the latest one wins, and pings
+	uint64_t receiveTime = SkeletonLatency::HostTimeUsec();
+	SkeletonSubscription subscription;
+	bool updated;
+	if (!client.reader.Append(data, size, subscription, updated))
+	{
+		printf("Skeleton client %s sent an overlong subscription\n", client.address.c_str());
+		return false;
+	}
+	if (updated)
+	{
+		Subscribe(client, subscription);
+	}
+
+	uint64_t pingTime;
+	while (client.reader.TakePing(pingTime))
+	{
+		QueueEcho(client, pingTime, receiveTime);
+	}
+	return true;
+}
+
+void SkeletonFanoutServer::QueueEcho(Client& client, uint64_t pingTime, uint64_t receiveTime)
+{
+	// Written like the client's frames, the send time is taken just before it is queued
+	// in front of them, and this poll round writes it out
+	bool json = client.subscription.GetEffectiveEncoding(m_encoding) == SkeletonEncoding::Json;
+	size_t headerSize = m_webSocket ? SkeletonWebSocket::MaxFrameHeaderSize : 0;
+
+	SharedFrame frame = std::make_shared<FrameBuffer>();
+	frame->data.resize(headerSize + std::max(SkeletonWire::EchoFrameSize, SkeletonJson::MaxEchoSize + 1));
+	uint8_t* payload = frame->data.data() + headerSize;
+	uint64_t sendTime = SkeletonLatency::HostTimeUsec();
+	if (json)
+	{
+		frame->size = SkeletonJson::WriteEcho(reinterpret_cast<char*>(payload), pingTime, receiveTime, sendTime);
+		if (!m_webSocket)
+		{
+			payload[frame->size++] = '\n';
+		}
+	}
+	else
+	{
+		frame->size = SkeletonWire::WriteEchoFrame(payload, pingTime, receiveTime, sendTime);
+	}
+
+	if (m_webSocket)
+	{
+		frame->offset = headerSize - SkeletonWebSocket::FrameHeaderSize(frame->size);
+		frame->size += SkeletonWebSocket::WriteFrameHeader(frame->data.data() + frame->offset,
+			json ? SkeletonWebSocket::Opcode::Text : SkeletonWebSocket::Opcode::Binary, frame->size);
+	}
+	QueueNext(client, frame);
+}
+
+void SkeletonFanoutServer::QueueNext(Client& client, const SharedFrame& frame)
+{
+	// Goes right behind the frame on the wire, if any, and never interleaves with it
+	std::lock_guard<std::mutex> lock(m_mutex);
+	client.queue.insert(client.queue.begin() + (client.writeOffset > 0 ? 1 : 0), frame);
+}
+
+bool SkeletonFanoutServer::ReadUpgrade(Client& client, const char* data, size_t size)
+{
+	client.request.append(data, size);
+	size_t end = client.request.find("\r\n\r\n");
+	if (end == std::string::npos)
+	{
+		if (client.request.size() > SkeletonWebSocket::MaxRequestSize)
+		{
+			printf("Skeleton client %s sent an overlong upgrade request\n", client.address.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Nothing was queued for the client yet, and an empty socket buffer always takes the short response
+	std::string response;
+	bool accepted = SkeletonWebSocket::AcceptUpgrade(client.request.substr(0, end + 4), response);
+	if (send(client.socket, response.data(), (int)response.size(), SocketSendFlags) != (int)response.size() || !accepted)
+	{
+		printf("Skeleton client %s is not a WebSocket client\n", client.address.c_str());
+		return false;
+	}
+
+	std::string rest = client.request.substr(end + 4);
+	client.request.clear();
+	client.request.shrink_to_fit();
+	client.upgraded = true;
+	client.connectTime = std::chrono::steady_clock::now();
+	return rest.empty() || ReadWebSocketFrames(client, rest.data(), rest.size());
+}
+
+bool SkeletonFanoutServer::ReadWebSocketFrames(Client& client, const char* data, size_t size)
+{
+	using SkeletonWebSocket::Opcode;
+
+	if (!client.frameReader.Append(data, size))
+	{
+		printf("Skeleton client %s broke the WebSocket protocol\n", client.address.c_str());
+		return false;
+	}
+
+	SkeletonWebSocket::FrameReader::Frame frame;
+	while (client.frameReader.Next(frame))
+	{
+		switch (frame.opcode)
+		{
+		case Opcode::Text:
+		case Opcode::Binary:
+		case Opcode::Continuation:
+			// Subscriptions are text messages, one per message, possibly fragmented
+			if (frame.opcode != Opcode::Continuation)
+			{
+				client.textMessage = frame.opcode == Opcode::Text;
+			}
+			if (client.textMessage &&
+				(!ReadSubscription(client, frame.payload.data(), frame.payload.size()) ||
+				(frame.final && !ReadSubscription(client, "\n", 1))))
+			{
+				return false;
+			}
+			break;
+		case Opcode::Ping:
+			QueueNext(client, MakeControlFrame(Opcode::Pong, frame.payload));
+			break;
+		case Opcode::Close:
+		{
+			// Echo the status code unless a frame is half sent, nothing may follow it
+			SharedFrame close = MakeControlFrame(Opcode::Close, frame.payload.substr(0, 2));
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (client.writeOffset == 0)
+			{
+				client.queue.assign(1, close);
+				FlushClient(client);
+			}
+			return false;
+		}
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+void SkeletonFanoutServer::Subscribe(Client& client, const SkeletonSubscription& subscription)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Receivers parse the stream with the encoding they asked for first
+	SkeletonSubscription updated = subscription;
+	if (client.subscribed)
+	{
+		updated.hasEncoding = client.requested.hasEncoding;
+		updated.encoding = client.requested.encoding;
+	}
+
+	client.requested = updated;
+	client.adaptive = m_rateControl && (updated.hasAdaptive ? updated.adaptive : m_adaptiveByDefault);
+	ApplyRateLevel(client);
+	client.subscribed = true;
+	UpdateSubscriptions();
+}
+
+int SkeletonFanoutServer::ExpireHandshakes()
+{
+	// Clients that stay silent get the default stream once their handshake time is up
+	auto now = std::chrono::steady_clock::now();
+	auto wait = std::chrono::milliseconds(100);
+	for (auto& client : m_clients)
+	{
+		if (client->subscribed || client->closed || !client->upgraded)
+		{
+			continue;
+		}
+
+		auto deadline = client->connectTime + HandshakeTimeout;
+		if (now >= deadline)
+		{
+			Subscribe(*client, SkeletonSubscription());
+			continue;
+		}
+		wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1));
+	}
+	return static_cast<int>(wait.count());
+}
+
+void SkeletonFanoutServer::UpdateRateControl()
+{
+	if (!m_rateControl)
+	{
+		return;
+	}
+
+	// Every client's link is estimated for the stats, only adaptive ones change with it
+	uint64_t now = SkeletonLatency::HostTimeUsec();
+	bool changed = false;
+	for (auto& client : m_clients)
+	{
+		if (client->closed || !client->subscribed || now < client->nextRateSample)
+		{
+			continue;
+		}
+		client->nextRateSample = now + SkeletonRateController::SampleIntervalUsec;
+
+		// Only this thread writes to the socket, Broadcast need not wait for the query
+		SkeletonRateController::Sample sample;
+		sample.timeUsec = now;
+		sample.bytesWritten = client->bytesWritten;
+		sample.hasSocketInfo = SkeletonRateController::ReadSocket(client->socket, client->bytesWritten,
+			sample.socketBacklog, sample.rttUsec);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const SharedFrame& frame : client->queue)
+		{
+			sample.bytesQueued += frame->size;
+		}
+		sample.bytesQueued -= client->writeOffset;
+		if (client->rateController.Update(sample) && client->adaptive && ApplyRateLevel(*client))
+		{
+			changed = true;
+		}
+	}
+
+	if (changed)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		UpdateSubscriptions();
+	}
+}
+
+bool SkeletonFanoutServer::ApplyRateLevel(Client& client)
+{
+	// Called with m_mutex held. Whether a client asked to be adaptive or got it by
+	// default, clients on the same level share their stream.
+	SkeletonSubscription served = client.requested;
+	served.hasAdaptive = false;
+	served.adaptive = false;
+	if (client.adaptive)
+	{
+		served.maxRateHz = client.rateController.GetRateHz(client.requested.maxRateHz);
+		served.precisionLevel = client.rateController.GetPrecisionLevel();
+	}
+
+	bool changed = served != client.subscription;
+	client.subscription = served;
+	return changed;
+}
+
+void SkeletonFanoutServer::UpdateSubscriptions()
+{
+	// Called with m_mutex held
+	m_subscriptions.clear();
+	for (auto& client : m_clients)
+	{
+		if (client->subscribed && !client->closed &&
+			std::find(m_subscriptions.begin(), m_subscriptions.end(), client->subscription) == m_subscriptions.end())
+		{
+			m_subscriptions.push_back(client->subscription);
+		}
+	}
+	m_subscriptionsVersion++;
+}
+
+void SkeletonFanoutServer::UpdateWriteInterest(Client& client)
+{
+	bool pending;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pending = !client.queue.empty();
+	}
+
+	// Frames left over after a flush mean the socket buffer is full
+	if (pending != client.writeInterest)
+	{
+		client.writeInterest = pending;
+		m_poller.Modify(client.socket, SocketPoller::Readable | (pending ? SocketPoller::Writable : 0u), &client);
+	}
+}
+
+void SkeletonFanoutServer::CloseClient(Client& client)
+{
+	if (client.closed)
+	{
+		return;
+	}
+
+	// Later events of this poll round may still point at the client, it is only
+	// erased in RemoveClosedClients
+	printf("Skeleton client disconnected: %s\n", client.address.c_str());
+	m_poller.Remove(client.socket);
+	m_sendRing.ForgetSocket(client.socket);
+	closesocket(client.socket);
+	client.closed = true;
+}
+
+void SkeletonFanoutServer::RemoveClosedClients()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto removed = std::remove_if(m_clients.begin(), m_clients.end(),
+		[](const std::unique_ptr<Client>& client) { return client->closed; });
+	if (removed == m_clients.end())
+	{
+		return;
+	}
+
+	m_clients.erase(removed, m_clients.end());
+	m_clientCount = m_clients.size();
+	UpdateSubscriptions();
+}
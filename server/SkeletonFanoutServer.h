@@ -0,0 +1,179 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameBufferPool.h"
+#include "SkeletonRateController.h"
+#include "SkeletonSendRing.h"
+#include "SkeletonSubscription.h"
+#include "SkeletonWebSocket.h"
+#include "SocketPlatform.h"
+#include "SocketPoller.h"
+
+// One client of a SkeletonFanoutServer and how its link is doing
+struct SkeletonClientStats
+{
+    std::string address;
+    bool adaptive = false;
+    int level = 0;                // SkeletonRateController level, 0 unless adaptive
+    float rateHz = 0.0f;          // frame rate it is sent, 0 for every frame
+    uint8_t precisionLevel = 0;   // see SkeletonSubscription::precisionLevel
+    uint64_t bytesWritten = 0;
+    SkeletonRateEstimate estimate;
+};
+
+// Listening TCP server that fans every serialized frame out to all connected
+// clients. A single network thread drives all sockets in non-blocking mode through
+// a SocketPoller (epoll on Linux); each client has its own bounded queue of shared
+// frames, so a slow client only drops its own oldest frames and never delays the others.
+//
+// A client may start by sending a SkeletonSubscription line. Frames are held back
+// until it did, or until HandshakeTimeout passed for clients that never send one.
+//
+// A client may also send ping lines at any time, each is answered with an echo
+// message ahead of any queued frames.
+//
+// In WebSocket mode every client first completes the RFC 6455 upgrade, then sends
+// subscriptions as text messages. The frames handed to Broadcast must then already
+// be complete WebSocket frames, see SkeletonWebSocket.h.
+//
+// With sendRing the writes of each poll round go out through a SkeletonSendRing, one
+// submission for all clients, where io_uring is available.
+//
+// With rate control every client's link is watched by a SkeletonRateController. The
+// frame rate and precision of adaptive clients are lowered while their link cannot
+// keep up, by lowering max_rate and raising precisionLevel of the subscription they
+// are served, which is what GetSubscriptions returns.
+class SkeletonFanoutServer
+{
+public:
+    static constexpr std::chrono::milliseconds HandshakeTimeout{ 250 };
+
+    SkeletonFanoutServer(size_t clientQueueCapacity = 4, bool webSocket = false, bool sendRing = false);
+    ~SkeletonFanoutServer();
+
+    // Bind, listen and start the network thread. Sockets must already be initialized (WSAStartup).
+    bool Start(const std::string& bindAddress, int port);
+    void Stop();
+
+    // Queue a frame on every client with the given subscription. Never waits on the network.
+    void Broadcast(const SharedFrame& frame, const SkeletonSubscription& subscription);
+
+    // Let the send ring send these frames from registered buffers, see SkeletonSendRing.
+    // Does nothing with plain sends.
+    void RegisterBuffers(const std::vector<SharedFrame>& frames);
+
+    // Watch the clients' links and adapt the ones that ask for it in their subscription,
+    // or all others too when byDefault is set. Call before Start.
+    void EnableRateControl(bool byDefault);
+
+    // The distinct subscriptions of all clients past their handshake. The serializer
+    // writes every frame once per subscription.
+    void GetSubscriptions(std::vector<SkeletonSubscription>& subscriptions) const;
+
+    // Changes whenever a client joins, leaves or changes its subscription. Stateful
+    // encoders compare it between frames to notice newcomers that need a full frame first.
+    uint64_t GetSubscriptionsVersion() const;
+
+    bool IsWebSocket() const;
+
+    // Encoding of the clients that did not choose one, which decides how echoes are written
+    void SetEncoding(SkeletonEncoding encoding);
+
+    size_t GetClientCount() const;
+    uint64_t GetFramesDropped() const;
+    void GetClientStats(std::vector<SkeletonClientStats>& stats) const;
+
+private:
+    struct Client
+    {
+        SOCKET socket = INVALID_SOCKET;
+        std::string address;
+        std::deque<SharedFrame> queue;
+        size_t writeOffset = 0;      // bytes of queue.front() already sent
+        uint64_t bytesWritten = 0;
+        bool writeInterest = false;  // registered for Writable, the socket buffer filled up
+        bool writable = false;       // the poller said so in this poll round
+        bool sendFailed = false;     // closed after the current flush
+        bool closed = false;         // removed at the end of the current poll round
+
+        // Frames are only queued once subscribed is set. subscription is what the client
+        // is served, requested what it asked for.
+        std::chrono::steady_clock::time_point connectTime;
+        SkeletonSubscriptionReader reader;
+        SkeletonSubscription requested;
+        SkeletonSubscription subscription;
+        bool subscribed = false;
+
+        // Rate control, samples are taken by the network thread
+        SkeletonRateController rateController;
+        bool adaptive = false;
+        uint64_t nextRateSample = 0;  // host time in us
+
+        // WebSocket mode, the handshake time starts once the upgrade is done
+        bool upgraded = false;
+        std::string request;
+        SkeletonWebSocket::FrameReader frameReader;
+        bool textMessage = false;  // the fragmented message being received is text
+    };
+
+    void NetworkLoop();
+    void AcceptClients();
+    bool FlushClient(Client& client);
+    void FlushClients();
+    void FlushClientsThroughRing();
+    bool DrainClientInput(Client& client);
+    bool ReadSubscription(Client& client, const char* data, size_t size);
+    bool ReadUpgrade(Client& client, const char* data, size_t size);
+    bool ReadWebSocketFrames(Client& client, const char* data, size_t size);
+    void QueueEcho(Client& client, uint64_t pingTime, uint64_t receiveTime);
+    void QueueNext(Client& client, const SharedFrame& frame);
+    void Subscribe(Client& client, const SkeletonSubscription& subscription);
+    int ExpireHandshakes();
+    void UpdateRateControl();
+    bool ApplyRateLevel(Client& client);
+    void UpdateSubscriptions();
+    void UpdateWriteInterest(Client& client);
+    void CloseClient(Client& client);
+    void RemoveClosedClients();
+    void Wake();
+
+    size_t m_clientQueueCapacity;
+    bool m_webSocket;
+    std::atomic<SkeletonEncoding> m_encoding;
+    SOCKET m_listenSocket;
+    SOCKET m_wakeSocket;
+    SocketPoller m_poller;
+    bool m_useSendRing;
+    SkeletonSendRing m_sendRing;
+    bool m_rateControl;
+    bool m_adaptiveByDefault;
+
+    // Clients are added and removed by the network thread only, Broadcast
+    // only touches their queues
+    std::vector<std::unique_ptr<Client>> m_clients;
+    std::vector<SkeletonSubscription> m_subscriptions;
+    mutable std::mutex m_mutex;
+
+    // Clients written in the current poll round, network thread only
+    std::vector<Client*> m_flushing;
+    std::vector<Client*> m_sending;
+    std::vector<Client*> m_sendingNext;
+    std::vector<SkeletonSendRing::Result> m_sendResults;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<size_t> m_clientCount;
+    std::atomic<uint64_t> m_subscriptionsVersion;
+    std::atomic<uint64_t> m_framesDropped;
+};
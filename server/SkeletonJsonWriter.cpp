@@ -0,0 +1,253 @@
+// Licensed under the MIT License.
+
+#include "SkeletonJsonWriter.h"
+#include <nlohmann/json.hpp>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+
+namespace
+{
+	// Constant pieces of the document between two values. The compact and pretty
+	// layouts only differ in these fragments, the value writers are shared.
+	struct Fragments
+	{
+		std::string_view bodyId;
+		std::string_view jointsBegin;
+		std::string_view jointSeparator;
+		std::string_view confidenceLevel;
+		std::string_view joint;
+		std::string_view orientationW;
+		std::string_view orientationX;
+		std::string_view orientationY;
+		std::string_view orientationZ;
+		std::string_view positionX;
+		std::string_view positionY;
+		std::string_view positionZ;
+		std::string_view jointEnd;
+		std::string_view timestamp;
+		std::string_view end;
+	};
+
+	const Fragments CompactFragments = {
+		"{\"body_id\":",
+		",\"joints\":[",
+		",",
+		"{\"confidence_level\":",
+		",\"joint\":",
+		",\"orientation\":{\"w\":",
+		",\"x\":",
+		",\"y\":",
+		",\"z\":",
+		"},\"position\":{\"x\":",
+		",\"y\":",
+		",\"z\":",
+		"}}",
+		"],\"timestamp\":",
+		"}",
+	};
+
+	const Fragments PrettyFragments = {
+		"{\n  \"body_id\": ",
+		",\n  \"joints\": [\n",
+		",\n",
+		"    {\n      \"confidence_level\": ",
+		",\n      \"joint\": ",
+		",\n      \"orientation\": {\n        \"w\": ",
+		",\n        \"x\": ",
+		",\n        \"y\": ",
+		",\n        \"z\": ",
+		"\n      },\n      \"position\": {\n        \"x\": ",
+		",\n        \"y\": ",
+		",\n        \"z\": ",
+		"\n      }\n    }",
+		"\n  ],\n  \"timestamp\": ",
+		"\n}",
+	};
+
+	char* Append(char* out, std::string_view fragment)
+	{
+		memcpy(out, fragment.data(), fragment.size());
+		return out + fragment.size();
+	}
+
+	// Everything up to and including the last joint in jointMask
+	char* WriteBodyAndJoints(char* out, const k4abt_body_t& body, const Fragments& fragments,
+		uint32_t jointMask = SkeletonWire::AllJointsMask)
+	{
+		out = Append(out, fragments.bodyId);
+		out = SkeletonJson::WriteUInt(out, body.id);
+		out = Append(out, fragments.jointsBegin);
+
+		bool first = true;
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			if ((jointMask & (1u << joint)) == 0)
+			{
+				continue;
+			}
+
+			const k4a_float3_t& pos = body.skeleton.joints[joint].position;
+			const k4a_quaternion_t& ori = body.skeleton.joints[joint].orientation;
+			k4abt_joint_confidence_level_t confidence = body.skeleton.joints[joint].confidence_level;
+
+			if (!first)
+			{
+				out = Append(out, fragments.jointSeparator);
+			}
+			first = false;
+
+			out = Append(out, fragments.confidenceLevel);
+			out = SkeletonJson::WriteUInt(out, static_cast<uint64_t>(confidence));
+			out = Append(out, fragments.joint);
+			out = SkeletonJson::WriteUInt(out, static_cast<uint64_t>(joint));
+			out = Append(out, fragments.orientationW);
+			out = SkeletonJson::WriteFloat(out, ori.wxyz.w);
+			out = Append(out, fragments.orientationX);
+			out = SkeletonJson::WriteFloat(out, ori.wxyz.x);
+			out = Append(out, fragments.orientationY);
+			out = SkeletonJson::WriteFloat(out, ori.wxyz.y);
+			out = Append(out, fragments.orientationZ);
+			out = SkeletonJson::WriteFloat(out, ori.wxyz.z);
+			out = Append(out, fragments.positionX);
+			out = SkeletonJson::WriteFloat(out, pos.xyz.x);
+			out = Append(out, fragments.positionY);
+			out = SkeletonJson::WriteFloat(out, pos.xyz.y);
+			out = Append(out, fragments.positionZ);
+			out = SkeletonJson::WriteFloat(out, pos.xyz.z);
+			out = Append(out, fragments.jointEnd);
+		}
+
+		return out;
+	}
+}
+
+namespace SkeletonJson
+{
+	char* WriteUInt(char* out, uint64_t value)
+	{
+		return std::to_chars(out, out + 20, value).ptr;
+	}
+
+	char* WriteFloat(char* out, float value)
+	{
+		// Values are promoted to double, exactly like nlohmann::json stores them
+		double number = value;
+
+		if (!std::isfinite(number))
+		{
+			return Append(out, "null");
+		}
+
+		// std::to_chars also produces shortest round-trip digits but breaks ties
+		// differently from the Grisu2 algorithm used by nlohmann::json::dump(),
+		// which happens often for float values. Use the library's own allocation
+		// free formatter so the output stays byte-identical.
+		return nlohmann::detail::to_chars(out, out + 32, number);
+	}
+
+	char* WriteString(char* out, const char* value)
+	{
+		static const char hexDigits[] = "0123456789abcdef";
+
+		*out++ = '"';
+		for (const char* c = value; *c != '\0'; c++)
+		{
+			const unsigned char character = static_cast<unsigned char>(*c);
+			switch (character)
+			{
+			case '"': out = Append(out, "\\\""); break;
+			case '\\': out = Append(out, "\\\\"); break;
+			case '\b': out = Append(out, "\\b"); break;
+			case '\f': out = Append(out, "\\f"); break;
+			case '\n': out = Append(out, "\\n"); break;
+			case '\r': out = Append(out, "\\r"); break;
+			case '\t': out = Append(out, "\\t"); break;
+			default:
+				if (character < 0x20)
+				{
+					out = Append(out, "\\u00");
+					*out++ = hexDigits[character >> 4];
+					*out++ = hexDigits[character & 0xF];
+				}
+				else
+				{
+					*out++ = static_cast<char>(character);
+				}
+				break;
+			}
+		}
+		*out++ = '"';
+		return out;
+	}
+
+	size_t WriteSkeleton(char* out, const k4abt_body_t& body, uint64_t timestamp, uint32_t jointMask)
+	{
+		char* begin = out;
+		out = WriteBodyAndJoints(out, body, CompactFragments, jointMask);
+		out = Append(out, CompactFragments.timestamp);
+		out = WriteUInt(out, timestamp);
+		out = Append(out, CompactFragments.end);
+		return static_cast<size_t>(out - begin);
+	}
+
+	size_t WriteBodies(char* out, const k4abt_body_t* bodies, size_t count, uint64_t timestamp, uint32_t jointMask)
+	{
+		char* begin = out;
+		out = Append(out, "{\"bodies\":[");
+		for (size_t i = 0; i < count; i++)
+		{
+			if (i > 0)
+			{
+				out = Append(out, ",");
+			}
+			out = WriteBodyAndJoints(out, bodies[i], CompactFragments, jointMask);
+			out = Append(out, "]}");
+		}
+		out = Append(out, "],\"timestamp\":");
+		out = WriteUInt(out, timestamp);
+		out = Append(out, "}");
+		return static_cast<size_t>(out - begin);
+	}
+
+	size_t WriteTiming(char* out, const SkeletonWire::StageTimes& times, uint64_t timestamp)
+	{
+		char* begin = out;
+		out = Append(out, "{\"timing\":{\"capture\":");
+		out = WriteUInt(out, times.capture);
+		out = Append(out, ",\"pop\":");
+		out = WriteUInt(out, times.pop);
+		out = Append(out, ",\"send\":");
+		out = WriteUInt(out, times.send);
+		out = Append(out, ",\"serialize\":");
+		out = WriteUInt(out, times.serialize);
+		out = Append(out, "},\"timestamp\":");
+		out = WriteUInt(out, timestamp);
+		out = Append(out, "}");
+		return static_cast<size_t>(out - begin);
+	}
+
+	size_t WriteEcho(char* out, uint64_t pingTime, uint64_t receiveTime, uint64_t sendTime)
+	{
+		char* begin = out;
+		out = Append(out, "{\"echo\":{\"ping\":");
+		out = WriteUInt(out, pingTime);
+		out = Append(out, ",\"receive\":");
+		out = WriteUInt(out, receiveTime);
+		out = Append(out, ",\"send\":");
+		out = WriteUInt(out, sendTime);
+		out = Append(out, "}}");
+		return static_cast<size_t>(out - begin);
+	}
+
+	size_t WriteSnapshot(char* out, const k4abt_body_t& body, const char* timestamp)
+	{
+		char* begin = out;
+		out = WriteBodyAndJoints(out, body, PrettyFragments);
+		out = Append(out, PrettyFragments.timestamp);
+		out = WriteString(out, timestamp);
+		out = Append(out, PrettyFragments.end);
+		return static_cast<size_t>(out - begin);
+	}
+}
@@ -0,0 +1,60 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <k4abt.h>
+#include <cstddef>
+#include <cstdint>
+
+#include "SkeletonWireFormat.h"
+
+// Hand-written JSON writer for the skeleton schema. It writes straight into a
+// caller-provided buffer without building intermediate json objects, and the
+// output is byte-identical to what nlohmann::json produced for the same data:
+// keys in sorted order, floats formatted as doubles by the Grisu2 algorithm.
+//
+//   {"body_id":1,"joints":[{"confidence_level":2,"joint":0,
+//     "orientation":{"w":1.0,"x":0.0,"y":0.0,"z":0.0},
+//     "position":{"x":123.456,"y":789.012,"z":2345.678}},...],"timestamp":123}
+//
+// Multi-body frames wrap the same body objects, without their timestamp:
+//
+//   {"bodies":[{"body_id":1,"joints":[...]},{"body_id":2,"joints":[...]}],"timestamp":123}
+namespace SkeletonJson
+{
+    // Upper bound for one skeleton in either the compact or the pretty form,
+    // excluding the characters needed for a string timestamp (see MaxStringSize)
+    constexpr size_t MaxSkeletonSize = 256 + K4ABT_JOINT_COUNT * 512;
+
+    // Upper bound for a string value of the given length once quoted and escaped
+    constexpr size_t MaxStringSize(size_t length) { return 2 + 6 * length; }
+
+    // Compact form sent on the socket, with a numeric device timestamp. Joints
+    // outside jointMask (bit n for joint n) are left out of the joints array.
+    // Returns the number of bytes written; out must hold MaxSkeletonSize bytes.
+    size_t WriteSkeleton(char* out, const k4abt_body_t& body, uint64_t timestamp,
+        uint32_t jointMask = SkeletonWire::AllJointsMask);
+
+    // Compact multi-body frame. out must hold MaxBodiesSize(count) bytes.
+    constexpr size_t MaxBodiesSize(size_t count) { return 64 + count * MaxSkeletonSize; }
+    size_t WriteBodies(char* out, const k4abt_body_t* bodies, size_t count, uint64_t timestamp,
+        uint32_t jointMask = SkeletonWire::AllJointsMask);
+
+    // Timing and echo messages, the JSON forms of SkeletonWire message types 5 and 6:
+    //
+    //   {"timing":{"capture":1,"pop":2,"send":4,"serialize":3},"timestamp":123}
+    //   {"echo":{"ping":1,"receive":2,"send":3}}
+    constexpr size_t MaxTimingSize = 192;
+    constexpr size_t MaxEchoSize = 128;
+    size_t WriteTiming(char* out, const SkeletonWire::StageTimes& times, uint64_t timestamp);
+    size_t WriteEcho(char* out, uint64_t pingTime, uint64_t receiveTime, uint64_t sendTime);
+
+    // Pretty-printed form (2 space indent) used for pose snapshot files, with a
+    // string timestamp. out must hold MaxSkeletonSize + MaxStringSize(strlen(timestamp)) bytes.
+    size_t WriteSnapshot(char* out, const k4abt_body_t& body, const char* timestamp);
+
+    // Value writers, exposed for the other JSON messages built from the same pieces
+    char* WriteUInt(char* out, uint64_t value);
+    char* WriteFloat(char* out, float value);
+    char* WriteString(char* out, const char* value);
+}
@@ -0,0 +1,136 @@
+// Licensed under the MIT License.
+
+#include "SkeletonLatency.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace SkeletonLatency
+{
+	uint64_t HostTimeUsec()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	void CaptureTimes::Record(uint64_t deviceTimestamp, uint64_t hostTime)
+	{
+		// Invalidate the slot first, so Find never pairs a timestamp with the host time
+		// of the capture that comes to overwrite it
+		m_deviceTimestamps[m_next].store(0, std::memory_order_release);
+		m_hostTimes[m_next].store(hostTime, std::memory_order_release);
+		m_deviceTimestamps[m_next].store(deviceTimestamp, std::memory_order_release);
+		m_next = (m_next + 1) % Capacity;
+	}
+
+	uint64_t CaptureTimes::Find(uint64_t deviceTimestamp) const
+	{
+		for (size_t i = 0; i < Capacity; i++)
+		{
+			if (m_deviceTimestamps[i].load(std::memory_order_acquire) != deviceTimestamp)
+			{
+				continue;
+			}
+			uint64_t hostTime = m_hostTimes[i].load(std::memory_order_acquire);
+			if (hostTime != 0 && m_deviceTimestamps[i].load(std::memory_order_acquire) == deviceTimestamp)
+			{
+				return hostTime;
+			}
+		}
+		return 0;
+	}
+
+	Histogram::Histogram()
+		: m_count(0)
+	{
+		for (std::atomic<uint64_t>& bucket : m_buckets)
+		{
+			bucket = 0;
+		}
+	}
+
+	int Histogram::BucketIndex(uint64_t usec)
+	{
+		// Values below SubBuckets * 2 get a bucket each, above that every power of two
+		// is split into SubBuckets linear steps
+		if (usec < SubBuckets)
+		{
+			return static_cast<int>(usec);
+		}
+
+		int exponent = 0;
+		for (uint64_t value = usec; value > 1; value >>= 1)
+		{
+			exponent++;
+		}
+		if (exponent > MaxExponent)
+		{
+			return BucketCount - 1;
+		}
+
+		int subBucket = static_cast<int>((usec >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+		return (exponent - SubBucketBits + 1) * SubBuckets + subBucket;
+	}
+
+	uint64_t Histogram::BucketUpperBound(int index)
+	{
+		if (index < SubBuckets)
+		{
+			return static_cast<uint64_t>(index);
+		}
+
+		int exponent = index / SubBuckets + SubBucketBits - 1;
+		uint64_t subBucket = static_cast<uint64_t>(index % SubBuckets);
+		uint64_t width = uint64_t(1) << (exponent - SubBucketBits);
+		return ((SubBuckets + subBucket) << (exponent - SubBucketBits)) + width - 1;
+	}
+
+	void Histogram::Record(uint64_t usec)
+	{
+		m_buckets[BucketIndex(usec)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint64_t Histogram::Percentile(double fraction) const
+	{
+		// Work on a snapshot, the recording thread may go on meanwhile
+		uint64_t buckets[BucketCount];
+		uint64_t count = 0;
+		for (int i = 0; i < BucketCount; i++)
+		{
+			buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+			count += buckets[i];
+		}
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		// Rank of the sample, 1-based, so p100 is the largest one
+		uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count))));
+		uint64_t seen = 0;
+		for (int i = 0; i < BucketCount; i++)
+		{
+			seen += buckets[i];
+			if (seen >= rank)
+			{
+				return BucketUpperBound(i);
+			}
+		}
+		return BucketUpperBound(BucketCount - 1);
+	}
+
+	uint64_t Histogram::GetCount() const
+	{
+		return m_count.load(std::memory_order_relaxed);
+	}
+
+	SkeletonLatencyPercentiles GetPercentiles(const Histogram& histogram)
+	{
+		SkeletonLatencyPercentiles percentiles;
+		percentiles.p50Usec = histogram.Percentile(0.5);
+		percentiles.p99Usec = histogram.Percentile(0.99);
+		percentiles.samples = histogram.GetCount();
+		return percentiles;
+	}
+}
@@ -0,0 +1,74 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct SkeletonLatencyPercentiles
+{
+    uint64_t p50Usec = 0;
+    uint64_t p99Usec = 0;
+    uint64_t samples = 0;
+};
+
+// Host-side latency measurement. Every stage of a body frame is stamped with the
+// host monotonic clock, which consumers can map onto their own clock with the
+// ping/echo exchange (see SkeletonWire message types 5 and 6).
+namespace SkeletonLatency
+{
+    // Host monotonic time in microseconds. Not related to the device clock.
+    uint64_t HostTimeUsec();
+
+    // Remembers when recent captures were dequeued, keyed by their depth image device
+    // timestamp, which is also the device timestamp of the body frame the tracker
+    // makes from them. Record is meant for one thread, such as the capture thread,
+    // and Find may be called from another while it records.
+    class CaptureTimes
+    {
+    public:
+        void Record(uint64_t deviceTimestamp, uint64_t hostTime);
+
+        // 0 if the capture is too old or was never recorded
+        uint64_t Find(uint64_t deviceTimestamp) const;
+
+    private:
+        // The tracker queue is a handful of frames deep
+        static constexpr size_t Capacity = 32;
+
+        std::atomic<uint64_t> m_deviceTimestamps[Capacity] = {};
+        std::atomic<uint64_t> m_hostTimes[Capacity] = {};
+        size_t m_next = 0;
+    };
+
+    // Log-linear histogram of durations in microseconds with 8 buckets per power of
+    // two, so percentiles are within 12.5% of the exact value. Record is meant for one
+    // thread, the percentiles may be read from any thread while it records.
+    class Histogram
+    {
+    public:
+        Histogram();
+
+        void Record(uint64_t usec);
+
+        // Upper bound of the bucket holding the given fraction (0.5 for p50) of all samples
+        uint64_t Percentile(double fraction) const;
+        uint64_t GetCount() const;
+
+    private:
+        static constexpr int SubBucketBits = 3;
+        static constexpr int SubBuckets = 1 << SubBucketBits;
+        static constexpr int MaxExponent = 40;  // 2^40 us is almost two weeks
+        static constexpr int BucketCount = (MaxExponent - SubBucketBits + 2) * SubBuckets;
+
+        static int BucketIndex(uint64_t usec);
+        static uint64_t BucketUpperBound(int index);
+
+        std::atomic<uint64_t> m_buckets[BucketCount];
+        std::atomic<uint64_t> m_count;
+    };
+
+    // p50 and p99 of a histogram, for the stats structs
+    SkeletonLatencyPercentiles GetPercentiles(const Histogram& histogram);
+}
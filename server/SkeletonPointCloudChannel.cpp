@@ -0,0 +1,108 @@
+// Licensed under the MIT License.
+
+#include "SkeletonPointCloudChannel.h"
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace
+{
+	// A slow client keeps at most this many point cloud frames queued, the newest win
+	constexpr size_t ClientQueueCapacity = 2;
+}
+
+SkeletonPointCloudChannel::SkeletonPointCloudChannel(int width, int height, std::vector<float> xyTable, bool webSocket,
+	uint16_t defaultVoxelSizeMm)
+	: m_width(width)
+	, m_height(height)
+	, m_defaultVoxelSizeMm(defaultVoxelSizeMm)
+	, m_channel(SkeletonPointCloud::MaxPointCloudFrameSize(static_cast<size_t>(width) * static_cast<size_t>(height)),
+		ClientQueueCapacity, webSocket)
+	, m_encoder(width, height, std::move(xyTable))
+	, m_sequence(0)
+	, m_framesSent(0)
+	, m_bytesSent(0)
+{
+}
+
+SkeletonPointCloudChannel::~SkeletonPointCloudChannel()
+{
+	Stop();
+}
+
+bool SkeletonPointCloudChannel::Start(const std::string& bindAddress, int port, bool sendRing)
+{
+	if (!m_channel.Start(bindAddress, port, sendRing))
+	{
+		return false;
+	}
+	printf("Point cloud channel on port %d, %d mm voxels by default, %zu threads\n", port, m_defaultVoxelSizeMm,
+		m_encoder.GetThreadCount());
+	return true;
+}
+
+void SkeletonPointCloudChannel::Stop()
+{
+	m_channel.Stop();
+}
+
+bool SkeletonPointCloudChannel::IsRunning() const
+{
+	return m_channel.IsRunning();
+}
+
+bool SkeletonPointCloudChannel::SendPointClouds(const uint16_t* depth, const uint8_t* bodyIndexMap, int width, int height,
+	const uint32_t* bodyIds, size_t bodyCount, uint64_t timestamp)
+{
+	if (!m_channel.IsRunning() || width != m_width || height != m_height)
+	{
+		return false;
+	}
+
+	const std::vector<SkeletonSubscription>& subscriptions = m_channel.UpdateSubscriptions();
+	if (subscriptions.empty())
+	{
+		return true;
+	}
+
+	// Only the encoding is timed, handing a frame to the clients may wake the network thread
+	uint64_t start = SkeletonLatency::HostTimeUsec();
+	m_encoder.SetFrame(depth, bodyIndexMap, bodyIds, bodyCount);
+	uint64_t extractTime = SkeletonLatency::HostTimeUsec() - start;
+	bodyCount = std::min(bodyCount, SkeletonWire::MaxBodies);
+	uint32_t sequence = m_sequence++;
+	for (const SkeletonSubscription& subscription : subscriptions)
+	{
+		uint32_t indexMask = 0;
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			if (subscription.IncludesBody(bodyIds[i]))
+			{
+				indexMask |= 1u << i;
+			}
+		}
+
+		start = SkeletonLatency::HostTimeUsec();
+		SharedFrame frame = m_channel.Acquire();
+		uint16_t voxelSizeMm = subscription.hasVoxelSize ? subscription.voxelSizeMm : m_defaultVoxelSizeMm;
+		size_t size = m_encoder.WriteFrame(SkeletonChannel::GetPayload(frame), indexMask, voxelSizeMm, timestamp, sequence);
+		extractTime += SkeletonLatency::HostTimeUsec() - start;
+		m_channel.Broadcast(frame, size, subscription);
+		m_framesSent++;
+		m_bytesSent += size;
+	}
+	m_extractLatency.Record(extractTime);
+	return true;
+}
+
+SkeletonPointCloudStats SkeletonPointCloudChannel::GetStats() const
+{
+	SkeletonPointCloudStats stats;
+	stats.framesSent = m_framesSent;
+	stats.averageFrameBytes = stats.framesSent > 0 ? static_cast<double>(m_bytesSent) / static_cast<double>(stats.framesSent) : 0.0;
+	stats.threadCount = m_encoder.GetThreadCount();
+	stats.extractLatency = SkeletonLatency::GetPercentiles(m_extractLatency);
+	stats.framesDropped = m_channel.GetFramesDropped();
+	stats.clientCount = m_channel.GetClientCount();
+	return stats;
+}
@@ -0,0 +1,64 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SkeletonChannel.h"
+#include "SkeletonLatency.h"
+#include "SkeletonPointCloudCodec.h"
+
+struct SkeletonPointCloudStats
+{
+    uint64_t framesSent = 0;
+    uint64_t framesDropped = 0;
+    size_t clientCount = 0;
+    double averageFrameBytes = 0.0;
+    size_t threadCount = 0;
+    SkeletonLatencyPercentiles extractLatency;  // cutting out the points and writing every frame for them
+};
+
+// Optional listening port that streams only the points that belong to people: every
+// body's pixels of the depth image, unprojected, optionally voxel-averaged and tagged
+// with the body id (see SkeletonPointCloudCodec.h). Frames are timestamped like the
+// skeletons they belong to.
+//
+// Clients choose with their subscription line (see SkeletonChannel.h): "bodies" limits
+// the clouds to those bodies and "voxel" sets the voxel size, the channel's default when
+// left out. The points are cut out once per body frame and every distinct subscription
+// gets one frame written for it.
+class SkeletonPointCloudChannel
+{
+public:
+    // xyTable as for SkeletonPointCloud::PointCloudEncoder. Images of another size than
+    // width x height are not sent.
+    SkeletonPointCloudChannel(int width, int height, std::vector<float> xyTable, bool webSocket = false,
+        uint16_t defaultVoxelSizeMm = SkeletonPointCloud::DefaultVoxelSizeMm);
+    ~SkeletonPointCloudChannel();
+
+    bool Start(const std::string& bindAddress, int port, bool sendRing = false);
+    void Stop();
+    bool IsRunning() const;
+
+    // Index i of the map belongs to bodyIds[i]. Does no work while nobody is
+    // connected. Call from one thread only.
+    bool SendPointClouds(const uint16_t* depth, const uint8_t* bodyIndexMap, int width, int height,
+        const uint32_t* bodyIds, size_t bodyCount, uint64_t timestamp);
+
+    SkeletonPointCloudStats GetStats() const;
+
+private:
+    int m_width;
+    int m_height;
+    uint16_t m_defaultVoxelSizeMm;
+    SkeletonChannel m_channel;
+    SkeletonPointCloud::PointCloudEncoder m_encoder;
+    uint32_t m_sequence;
+
+    std::atomic<uint64_t> m_framesSent;
+    std::atomic<uint64_t> m_bytesSent;
+    SkeletonLatency::Histogram m_extractLatency;
+};
@@ -0,0 +1,284 @@
+// Licensed under the MIT License.
+
+#include "SkeletonPointCloudCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SKELETON_POINT_CLOUD_SSE2 1
+#endif
+
+namespace
+{
+	constexpr uint8_t Background = 255;
+
+	int16_t ClampToInt16(float value)
+	{
+		return static_cast<int16_t>(std::lrint(std::min(32767.0f, std::max(-32768.0f, value))));
+	}
+
+	// Voxel coordinates of an int16 point fit 17 bits each once shifted to be positive
+	uint64_t VoxelKey(const SkeletonPointCloud::Point& point, int size)
+	{
+		auto cell = [size](int16_t value) {
+			int shifted = static_cast<int>(value) + 32768;
+			return static_cast<uint64_t>(shifted / size);
+		};
+		return (cell(point.x) << 42) | (cell(point.y) << 21) | cell(point.z);
+	}
+
+	uint8_t* WritePoints(uint8_t* out, const SkeletonPointCloud::Point* points, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(points[i].x));
+			out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(points[i].y));
+			out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(points[i].z));
+		}
+		return out;
+	}
+}
+
+namespace SkeletonPointCloud
+{
+	PointCloudEncoder::PointCloudEncoder(int width, int height, std::vector<float> xyTable, size_t threadCount)
+		: m_width(width)
+		, m_height(height)
+		, m_xyTable(std::move(xyTable))
+		, m_workers(threadCount)
+		, m_bodyIds()
+		, m_bodyCount(0)
+		, m_depth(nullptr)
+		, m_bodyIndexMap(nullptr)
+		, m_taskPoints(m_workers.GetThreadCount(), std::vector<std::vector<Point>>(SkeletonWire::MaxBodies))
+		, m_voxelSizes()
+	{
+		m_xyTable.resize(2 * static_cast<size_t>(width) * static_cast<size_t>(height));
+	}
+
+	void PointCloudEncoder::SetFrame(const uint16_t* depth, const uint8_t* bodyIndexMap, const uint32_t* bodyIds, size_t bodyCount)
+	{
+		m_bodyCount = std::min(bodyCount, SkeletonWire::MaxBodies);
+		std::copy(bodyIds, bodyIds + m_bodyCount, m_bodyIds);
+		std::fill(m_voxelSizes, m_voxelSizes + SkeletonWire::MaxBodies, static_cast<uint16_t>(0));
+
+		// Only this is captured, so the task fits std::function without an allocation
+		m_depth = depth;
+		m_bodyIndexMap = bodyIndexMap;
+		m_workers.Run([this](size_t task) {
+			ExtractRows(task);
+		});
+		m_depth = nullptr;
+		m_bodyIndexMap = nullptr;
+	}
+
+	void PointCloudEncoder::ExtractRows(size_t task)
+	{
+		const uint16_t* depth = m_depth;
+		const uint8_t* bodyIndexMap = m_bodyIndexMap;
+		std::vector<std::vector<Point>>& points = m_taskPoints[task];
+		for (std::vector<Point>& body : points)
+		{
+			body.clear();
+		}
+
+		size_t first, end;
+		SkeletonWorkerPool::SplitRows(static_cast<size_t>(m_height), task, m_taskPoints.size(), first, end);
+		size_t width = static_cast<size_t>(m_width);
+		for (size_t y = first; y < end; y++)
+		{
+			size_t row = y * width;
+			size_t x = 0;
+			while (x < width)
+			{
+#ifdef SKELETON_POINT_CLOUD_SSE2
+				// Most of the room is background, skip it 16 pixels at a time
+				if (x + 16 <= width)
+				{
+					__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bodyIndexMap + row + x));
+					if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(Background)))) == 0xFFFF)
+					{
+						x += 16;
+						continue;
+					}
+				}
+#endif
+				size_t pixel = row + x++;
+				uint8_t index = bodyIndexMap[pixel];
+				uint16_t z = depth[pixel];
+				if (index >= m_bodyCount || z == 0)
+				{
+					continue;
+				}
+				float rayX = m_xyTable[2 * pixel];
+				float rayY = m_xyTable[2 * pixel + 1];
+				if (rayX == 0.0f && rayY == 0.0f)
+				{
+					continue;
+				}
+				points[index].push_back({ ClampToInt16(rayX * z), ClampToInt16(rayY * z), ClampToInt16(static_cast<float>(z)) });
+			}
+		}
+	}
+
+	const std::vector<Point>& PointCloudEncoder::Voxelize(size_t index, uint16_t voxelSizeMm)
+	{
+		std::vector<Point>& voxels = m_voxelPoints[index];
+		if (m_voxelSizes[index] == voxelSizeMm)
+		{
+			return voxels;
+		}
+
+		size_t count = 0;
+		for (const std::vector<std::vector<Point>>& task : m_taskPoints)
+		{
+			count += task[index].size();
+		}
+
+		// Open addressing with linear probing, at most half full. Slots hold 1 + the index
+		// of their cell, and cells are kept in the order they were first hit, so only
+		// 4 bytes per slot are cleared and the output follows the rows.
+		size_t tableSize = 64;
+		int shift = 58;
+		while (tableSize < 2 * count)
+		{
+			tableSize *= 2;
+			shift--;
+		}
+		m_slots.assign(tableSize, 0);
+		m_cells.clear();
+		for (const std::vector<std::vector<Point>>& task : m_taskPoints)
+		{
+			for (const Point& point : task[index])
+			{
+				uint64_t key = VoxelKey(point, voxelSizeMm);
+				size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> shift);
+				while (m_slots[slot] != 0 && m_cells[m_slots[slot] - 1].key != key)
+				{
+					slot = (slot + 1) & (tableSize - 1);
+				}
+				if (m_slots[slot] == 0)
+				{
+					m_cells.push_back({ key, 0, 0, 0, 0 });
+					m_slots[slot] = static_cast<uint32_t>(m_cells.size());
+				}
+				VoxelCell& cell = m_cells[m_slots[slot] - 1];
+				cell.sumX += point.x;
+				cell.sumY += point.y;
+				cell.sumZ += point.z;
+				cell.count++;
+			}
+		}
+
+		// Every voxel is sent as the mean of its points
+		voxels.clear();
+		for (const VoxelCell& cell : m_cells)
+		{
+			float count = static_cast<float>(cell.count);
+			voxels.push_back({ ClampToInt16(cell.sumX / count), ClampToInt16(cell.sumY / count), ClampToInt16(cell.sumZ / count) });
+		}
+		m_voxelSizes[index] = voxelSizeMm;
+		return voxels;
+	}
+
+	size_t PointCloudEncoder::WriteFrame(uint8_t* buffer, uint32_t indexMask, uint16_t voxelSizeMm, uint64_t timestamp, uint32_t sequence)
+	{
+		uint8_t* out = SkeletonWire::BeginFrame(buffer, SkeletonWire::MessageType::PointCloud, timestamp, sequence);
+		uint8_t* bodyCount = out;
+		out = SkeletonWire::WriteU8(out, 0);
+		out = SkeletonWire::WriteU16(out, voxelSizeMm);
+		uint8_t written = 0;
+		for (size_t i = 0; i < m_bodyCount; i++)
+		{
+			if (((indexMask >> i) & 1) == 0)
+			{
+				continue;
+			}
+			out = SkeletonWire::WriteU32(out, m_bodyIds[i]);
+			if (voxelSizeMm > 0)
+			{
+				const std::vector<Point>& points = Voxelize(i, voxelSizeMm);
+				out = SkeletonWire::WriteU32(out, static_cast<uint32_t>(points.size()));
+				out = WritePoints(out, points.data(), points.size());
+			}
+			else
+			{
+				size_t count = 0;
+				for (const std::vector<std::vector<Point>>& task : m_taskPoints)
+				{
+					count += task[i].size();
+				}
+				out = SkeletonWire::WriteU32(out, static_cast<uint32_t>(count));
+				for (const std::vector<std::vector<Point>>& task : m_taskPoints)
+				{
+					out = WritePoints(out, task[i].data(), task[i].size());
+				}
+			}
+			written++;
+		}
+		SkeletonWire::WriteU8(bodyCount, written);
+		return SkeletonWire::FinishFrame(buffer, out);
+	}
+
+	size_t PointCloudEncoder::GetPointCount() const
+	{
+		size_t count = 0;
+		for (const std::vector<std::vector<Point>>& task : m_taskPoints)
+		{
+			for (size_t i = 0; i < m_bodyCount; i++)
+			{
+				count += task[i].size();
+			}
+		}
+		return count;
+	}
+
+	bool ReadPointCloudFrame(const uint8_t* data, size_t size, std::vector<BodyPoints>& bodies, uint16_t& voxelSizeMm,
+		uint64_t& timestamp)
+	{
+		SkeletonWire::FrameHeader header;
+		if (!SkeletonWire::ReadFrameHeader(data, size, header) || header.type != SkeletonWire::MessageType::PointCloud ||
+			size < PointCloudHeaderSize || SkeletonWire::LengthPrefixSize + header.payloadLength > size)
+		{
+			return false;
+		}
+
+		const uint8_t* end = data + SkeletonWire::LengthPrefixSize + header.payloadLength;
+		const uint8_t* in = data + SkeletonWire::FrameHeaderSize;
+		size_t bodyCount = in[0];
+		voxelSizeMm = SkeletonWire::ReadU16(in + 1);
+		in += 3;
+		if (bodyCount > SkeletonWire::MaxBodies)
+		{
+			return false;
+		}
+
+		bodies.resize(bodyCount);
+		for (BodyPoints& body : bodies)
+		{
+			if (static_cast<size_t>(end - in) < BodyPrefixSize)
+			{
+				return false;
+			}
+			body.bodyId = SkeletonWire::ReadU32(in);
+			size_t count = SkeletonWire::ReadU32(in + 4);
+			in += BodyPrefixSize;
+			if (static_cast<size_t>(end - in) / PointSize < count)
+			{
+				return false;
+			}
+			body.points.resize(count);
+			for (Point& point : body.points)
+			{
+				point.x = static_cast<int16_t>(SkeletonWire::ReadU16(in));
+				point.y = static_cast<int16_t>(SkeletonWire::ReadU16(in + 2));
+				point.z = static_cast<int16_t>(SkeletonWire::ReadU16(in + 4));
+				in += PointSize;
+			}
+		}
+		timestamp = header.timestamp;
+		return in == end;
+	}
+}
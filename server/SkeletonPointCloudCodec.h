@@ -0,0 +1,101 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SkeletonWireFormat.h"
+#include "SkeletonWorkerPool.h"
+
+// Per-body point clouds cut out of the depth image with the body index map, and the
+// frames that carry them (SkeletonWire message type 10).
+//
+// Every depth pixel of a body is unprojected along its ray from the calibration's xy
+// table and kept as int16 millimeters in depth camera coordinates, the same space as
+// the joint positions. The rows are split over a SkeletonWorkerPool. Points may be
+// averaged per voxel, which cuts a person from tens of thousands of points to a few
+// thousand at 20 mm.
+namespace SkeletonPointCloud
+{
+    constexpr size_t PointCloudHeaderSize = SkeletonWire::FrameHeaderSize + 3;
+    constexpr size_t BodyPrefixSize = 8;
+    constexpr size_t PointSize = 3 * sizeof(int16_t);
+
+    constexpr uint16_t DefaultVoxelSizeMm = 20;
+
+    constexpr size_t MaxPointCloudFrameSize(size_t pixels)
+    {
+        return PointCloudHeaderSize + SkeletonWire::MaxBodies * BodyPrefixSize + pixels * PointSize;
+    }
+
+    struct Point
+    {
+        int16_t x;
+        int16_t y;
+        int16_t z;
+    };
+
+    struct BodyPoints
+    {
+        uint32_t bodyId;
+        std::vector<Point> points;
+    };
+
+    class PointCloudEncoder
+    {
+    public:
+        // xyTable holds the ray of every pixel as x / z and y / z, two floats per pixel
+        // with 0, 0 where the pixel has no valid ray (see Window3dWrapper::CreateXYDepthTable).
+        // threadCount is passed on to the worker pool.
+        PointCloudEncoder(int width, int height, std::vector<float> xyTable, size_t threadCount = 0);
+
+        // Cut out the points of every body. Index i of the map is body bodyIds[i];
+        // indices from bodyCount or MaxBodies on are taken as background. Neither image is kept.
+        void SetFrame(const uint16_t* depth, const uint8_t* bodyIndexMap, const uint32_t* bodyIds, size_t bodyCount);
+
+        // Frame with the bodies whose index bit is set in indexMask, every point when
+        // voxelSizeMm is 0. buffer must hold MaxPointCloudFrameSize(width * height) bytes.
+        // Returns the number of bytes written.
+        size_t WriteFrame(uint8_t* buffer, uint32_t indexMask, uint16_t voxelSizeMm, uint64_t timestamp, uint32_t sequence);
+
+        size_t GetPointCount() const;
+        size_t GetThreadCount() const { return m_workers.GetThreadCount(); }
+
+    private:
+        struct VoxelCell
+        {
+            uint64_t key;
+            int64_t sumX;
+            int64_t sumY;
+            int64_t sumZ;
+            uint32_t count;
+        };
+
+        void ExtractRows(size_t task);
+        const std::vector<Point>& Voxelize(size_t index, uint16_t voxelSizeMm);
+
+        int m_width;
+        int m_height;
+        std::vector<float> m_xyTable;
+        SkeletonWorkerPool m_workers;
+
+        uint32_t m_bodyIds[SkeletonWire::MaxBodies];
+        size_t m_bodyCount;
+        const uint16_t* m_depth;
+        const uint8_t* m_bodyIndexMap;
+
+        // Points of body index b found by task t in m_taskPoints[t][b], in row order
+        std::vector<std::vector<std::vector<Point>>> m_taskPoints;
+
+        // Last downsampled points per body index, kept while subscriptions ask for the same voxel size
+        std::vector<Point> m_voxelPoints[SkeletonWire::MaxBodies];
+        uint16_t m_voxelSizes[SkeletonWire::MaxBodies];
+        std::vector<uint32_t> m_slots;
+        std::vector<VoxelCell> m_cells;
+    };
+
+    bool ReadPointCloudFrame(const uint8_t* data, size_t size, std::vector<BodyPoints>& bodies, uint16_t& voxelSizeMm,
+        uint64_t& timestamp);
+}
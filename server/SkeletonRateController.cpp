@@ -0,0 +1,191 @@
+// Licensed under the MIT License.
+
+#include "SkeletonRateController.h"
+#include <algorithm>
+
+#if defined(__linux__)
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#elif defined(_WIN32)
+#include <mstcpip.h>
+#endif
+
+namespace
+{
+	struct Level
+	{
+		float maxRateHz;  // 0 keeps the client's own rate
+		uint8_t precisionLevel;
+	};
+
+	// Precision goes first, it costs the viewer the least
+	const Level Levels[SkeletonRateController::LevelCount] = {
+		{ 0.0f, 0 },
+		{ 0.0f, 1 },
+		{ 20.0f, 1 },
+		{ 15.0f, 2 },
+		{ 10.0f, 2 },
+		{ 5.0f, 2 },
+	};
+
+	// Weight of the newest interval in the goodput estimate
+	constexpr double GoodputGain = 0.25;
+}
+
+SkeletonRateController::SkeletonRateController(uint64_t targetDelayUsec)
+	: m_targetDelayUsec(targetDelayUsec)
+	, m_level(0)
+	, m_started(false)
+	, m_lastTimeUsec(0)
+	, m_lastAcked(0)
+	, m_lastBacklog(0)
+	, m_minRtt(0)
+	, m_previousMinRtt(0)
+	, m_minRttWindowStart(0)
+	, m_calmSinceUsec(0)
+	, m_lastProbeUsec(0)
+	, m_lastStepDownUsec(0)
+	, m_probeHoldUsec(ProbeHoldUsec)
+{
+}
+
+bool SkeletonRateController::Update(const Sample& sample)
+{
+	// Without socket feedback written bytes count as delivered, and only the
+	// client's own queue as backlog
+	uint64_t socketBacklog = sample.hasSocketInfo ? std::min(sample.socketBacklog, sample.bytesWritten) : 0;
+	uint64_t acked = sample.bytesWritten - socketBacklog;
+	uint64_t backlog = sample.bytesQueued + socketBacklog;
+	uint64_t now = sample.timeUsec;
+	m_estimate.backlogBytes = backlog;
+
+	if (sample.rttUsec > 0)
+	{
+		if (now - m_minRttWindowStart >= MinRttWindowUsec)
+		{
+			m_previousMinRtt = m_minRtt;
+			m_minRtt = 0;
+			m_minRttWindowStart = now;
+		}
+		m_minRtt = m_minRtt == 0 ? sample.rttUsec : std::min(m_minRtt, sample.rttUsec);
+		m_estimate.rttUsec = sample.rttUsec;
+		m_estimate.minRttUsec = m_previousMinRtt == 0 ? m_minRtt : std::min(m_minRtt, m_previousMinRtt);
+	}
+
+	if (!m_started || now <= m_lastTimeUsec)
+	{
+		m_started = true;
+		m_lastTimeUsec = now;
+		m_lastAcked = acked;
+		m_lastBacklog = backlog;
+		m_calmSinceUsec = now;
+		m_minRttWindowStart = now;
+		return false;
+	}
+
+	double seconds = static_cast<double>(now - m_lastTimeUsec) / 1e6;
+	double goodput = static_cast<double>(acked - std::min(acked, m_lastAcked)) / seconds;
+	m_estimate.goodputBytesPerSec = m_estimate.goodputBytesPerSec == 0.0 ? goodput :
+		m_estimate.goodputBytesPerSec + GoodputGain * (goodput - m_estimate.goodputBytesPerSec);
+
+	// The bytes in flight of an unloaded link take one minimum round trip, anything
+	// beyond that is queueing. A link that delivers nothing at all is as bad as it gets.
+	uint64_t delay = 0;
+	if (backlog > 0)
+	{
+		double drainUsec = m_estimate.goodputBytesPerSec >= 1.0 ?
+			static_cast<double>(backlog) * 1e6 / m_estimate.goodputBytesPerSec : static_cast<double>(MaxDelayUsec);
+		drainUsec -= m_estimate.minRttUsec;
+		delay = drainUsec <= 0.0 ? 0 : std::min(static_cast<uint64_t>(drainUsec), MaxDelayUsec);
+	}
+	m_estimate.queueDelayUsec = static_cast<uint32_t>(delay);
+
+	bool draining = backlog < m_lastBacklog;
+	m_lastTimeUsec = now;
+	m_lastAcked = acked;
+	m_lastBacklog = backlog;
+
+	if (delay >= m_targetDelayUsec / 2)
+	{
+		m_calmSinceUsec = now;
+	}
+
+	// One step per sample while the queue still grows, the last step may not show yet
+	if (delay > m_targetDelayUsec && !draining && m_level < LevelCount - 1)
+	{
+		// A probe that filled the queue again waits twice as long next time
+		bool probeFailed = m_lastProbeUsec != 0 && now - m_lastProbeUsec < ProbeHoldUsec;
+		m_probeHoldUsec = probeFailed ? std::min(2 * m_probeHoldUsec, MaxProbeHoldUsec) : ProbeHoldUsec;
+		m_lastStepDownUsec = now;
+		m_level++;
+		return true;
+	}
+
+	// Once a probe has held, the next one need not wait any longer than usual
+	if (m_lastProbeUsec > m_lastStepDownUsec && now - m_lastProbeUsec >= ProbeHoldUsec)
+	{
+		m_probeHoldUsec = ProbeHoldUsec;
+	}
+
+	if (m_level > 0 && now - m_calmSinceUsec >= m_probeHoldUsec)
+	{
+		m_lastProbeUsec = now;
+		m_calmSinceUsec = now;
+		m_level--;
+		return true;
+	}
+	return false;
+}
+
+float SkeletonRateController::GetRateHz(float requestedRateHz) const
+{
+	float cap = Levels[m_level].maxRateHz;
+	if (cap == 0.0f)
+	{
+		return requestedRateHz;
+	}
+	return requestedRateHz == 0.0f ? cap : std::min(requestedRateHz, cap);
+}
+
+uint8_t SkeletonRateController::GetPrecisionLevel() const
+{
+	return Levels[m_level].precisionLevel;
+}
+
+bool SkeletonRateController::ReadSocket(SOCKET socket, uint64_t bytesWritten, uint64_t& backlogBytes, uint32_t& rttUsec)
+{
+#if defined(__linux__)
+	// SIOCOUTQ counts what is in the send queue, sent or not, until it is acknowledged
+	int queued = 0;
+	tcp_info info = {};
+	socklen_t length = sizeof(info);
+	if (ioctl(socket, SIOCOUTQ, &queued) != 0 ||
+		getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
+	{
+		return false;
+	}
+	backlogBytes = std::min(bytesWritten, static_cast<uint64_t>(std::max(queued, 0)));
+	rttUsec = info.tcpi_rtt;
+	return true;
+#elif defined(_WIN32) && defined(SIO_TCP_INFO)
+	// Windows tells what went out and what is in flight, the rest of what was
+	// written still waits in the send buffer
+	DWORD version = 0;
+	TCP_INFO_v0 info = {};
+	DWORD returned = 0;
+	if (WSAIoctl(socket, SIO_TCP_INFO, &version, sizeof(version), &info, sizeof(info), &returned, nullptr, nullptr) != 0)
+	{
+		return false;
+	}
+	uint64_t transmitted = info.BytesOut - std::min<uint64_t>(info.BytesOut, info.BytesRetrans);
+	backlogBytes = bytesWritten - std::min(bytesWritten, transmitted) + info.BytesInFlight;
+	rttUsec = info.RttUs;
+	return true;
+#else
+	(void)socket;
+	(void)bytesWritten;
+	(void)backlogBytes;
+	(void)rttUsec;
+	return false;
+#endif
+}
@@ -0,0 +1,97 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SocketPlatform.h"
+
+// What a rate controller knows about its connection, for the stats
+struct SkeletonRateEstimate
+{
+    double goodputBytesPerSec = 0.0;  // acknowledged by the peer, or written where TCP does not tell
+    uint32_t rttUsec = 0;             // smoothed round trip time reported by TCP, 0 when unknown
+    uint32_t minRttUsec = 0;          // lowest of the last 10 to 20 seconds
+    uint32_t queueDelayUsec = 0;      // how long a frame written now waits behind the others
+    uint64_t backlogBytes = 0;        // queued or written but not acknowledged yet
+};
+
+// Per-connection rate controller for SkeletonFanoutServer clients on links whose
+// bandwidth swings, such as headsets on shared Wi-Fi.
+//
+// Every SampleIntervalUsec the server samples what the connection took: the bytes
+// written, the bytes still in the client's queue and, from the socket, the bytes not
+// acknowledged yet and the round trip time. From these the controller estimates the
+// goodput and how long a frame written now would wait, the backlog divided by the
+// goodput less the unloaded round trip time.
+//
+// It keeps that queueing delay under a target by moving along a ladder of levels,
+// each of which lowers the client's frame rate or encoding precision a step further.
+// While the delay is over the target and the backlog is not draining yet it moves one
+// level down the ladder. Once the delay stayed under half the target for a while it
+// probes one level back up; a probe that fills the queue again doubles the time until
+// the next one. Levels are coarse on purpose, clients on the same level share their
+// serialization.
+class SkeletonRateController
+{
+public:
+    static constexpr uint64_t SampleIntervalUsec = 200000;
+    static constexpr uint64_t DefaultTargetDelayUsec = 100000;
+    static constexpr int LevelCount = 6;
+
+    struct Sample
+    {
+        uint64_t timeUsec = 0;
+        uint64_t bytesWritten = 0;     // handed to the socket since the connection started
+        uint64_t bytesQueued = 0;      // waiting in the client's queue
+        bool hasSocketInfo = false;
+        uint64_t socketBacklog = 0;    // written but not acknowledged by the peer yet
+        uint32_t rttUsec = 0;
+    };
+
+    explicit SkeletonRateController(uint64_t targetDelayUsec = DefaultTargetDelayUsec);
+
+    // Take one sample. Returns true when the level changed.
+    bool Update(const Sample& sample);
+
+    // 0 sends what the client asked for, LevelCount - 1 is the slowest and coarsest
+    int GetLevel() const { return m_level; }
+    const SkeletonRateEstimate& GetEstimate() const { return m_estimate; }
+
+    // Frame rate of the current level for a client that asked for requestedRateHz,
+    // 0 meaning every frame, like SkeletonSubscription::maxRateHz
+    float GetRateHz(float requestedRateHz) const;
+
+    // 0 is full precision, see SkeletonSubscription::precisionLevel
+    uint8_t GetPrecisionLevel() const;
+
+    // Bytes of the bytesWritten the peer has not acknowledged yet, and the smoothed
+    // round trip time. False where the platform does not tell.
+    static bool ReadSocket(SOCKET socket, uint64_t bytesWritten, uint64_t& backlogBytes, uint32_t& rttUsec);
+
+private:
+    static constexpr uint64_t MinRttWindowUsec = 10000000;
+    static constexpr uint64_t ProbeHoldUsec = 2000000;
+    static constexpr uint64_t MaxProbeHoldUsec = 16000000;
+    static constexpr uint64_t MaxDelayUsec = 10000000;
+
+    uint64_t m_targetDelayUsec;
+    int m_level;
+
+    SkeletonRateEstimate m_estimate;
+    bool m_started;
+    uint64_t m_lastTimeUsec;
+    uint64_t m_lastAcked;
+    uint64_t m_lastBacklog;
+
+    // Lowest round trip time of the current and the previous window
+    uint32_t m_minRtt;
+    uint32_t m_previousMinRtt;
+    uint64_t m_minRttWindowStart;
+
+    uint64_t m_calmSinceUsec;     // the delay has been under half the target since
+    uint64_t m_lastProbeUsec;     // when the last probe went back up the ladder, 0 before the first
+    uint64_t m_lastStepDownUsec;
+    uint64_t m_probeHoldUsec;
+};
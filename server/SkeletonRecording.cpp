@@ -0,0 +1,204 @@
+// Licensed under the MIT License.
+
+#include "SkeletonRecording.h"
+#include "SkeletonDeltaCodec.h"
+#include "SkeletonWireFormat.h"
+#include <nlohmann/json.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using json = nlohmann::json;
+using namespace SkeletonWire;
+
+namespace
+{
+	bool ReadBody(const json& value, k4abt_body_t& body)
+	{
+		if (!value.is_object() || !value.contains("joints") || !value["joints"].is_array())
+		{
+			return false;
+		}
+		body = {};
+		body.id = value.value("body_id", 0u);
+		for (const json& joint : value["joints"])
+		{
+			// Stream frames number the joints with "joint", snapshots with "joint_id"
+			int id = joint.contains("joint") ? joint.value("joint", -1) : joint.value("joint_id", -1);
+			if (id < 0 || id >= static_cast<int>(K4ABT_JOINT_COUNT) ||
+				!joint.contains("position") || !joint.contains("orientation"))
+			{
+				return false;
+			}
+			k4abt_joint_t& target = body.skeleton.joints[id];
+			const json& position = joint["position"];
+			const json& orientation = joint["orientation"];
+			target.position.xyz.x = position.value("x", 0.0f);
+			target.position.xyz.y = position.value("y", 0.0f);
+			target.position.xyz.z = position.value("z", 0.0f);
+			target.orientation.wxyz.w = orientation.value("w", 1.0f);
+			target.orientation.wxyz.x = orientation.value("x", 0.0f);
+			target.orientation.wxyz.y = orientation.value("y", 0.0f);
+			target.orientation.wxyz.z = orientation.value("z", 0.0f);
+			target.confidence_level = static_cast<k4abt_joint_confidence_level_t>(joint.value("confidence_level", 0));
+		}
+		return true;
+	}
+
+	bool ReadFrame(const json& value, SkeletonRecording::Frame& frame)
+	{
+		frame.bodies.clear();
+
+		// Snapshots name the file in the timestamp instead
+		auto timestamp = value.is_object() ? value.find("timestamp") : value.end();
+		frame.timestamp = timestamp != value.end() && timestamp->is_number_unsigned() ? timestamp->get<uint64_t>() : 0;
+
+		if (value.is_object() && value.contains("bodies") && value["bodies"].is_array())
+		{
+			for (const json& item : value["bodies"])
+			{
+				k4abt_body_t body;
+				if (!ReadBody(item, body))
+				{
+					return false;
+				}
+				frame.bodies.push_back(body);
+			}
+			return !frame.bodies.empty();
+		}
+		k4abt_body_t body;
+		if (!ReadBody(value, body))
+		{
+			return false;
+		}
+		frame.bodies.push_back(body);
+		return true;
+	}
+
+	void LoadJson(const std::string& text, std::vector<SkeletonRecording::Frame>& frames)
+	{
+		SkeletonRecording::Frame frame;
+		json document = json::parse(text, nullptr, false);
+		if (!document.is_discarded())
+		{
+			if (ReadFrame(document, frame))
+			{
+				frames.push_back(frame);
+			}
+			return;
+		}
+
+		size_t start = 0;
+		while (start < text.size())
+		{
+			size_t end = text.find('\n', start);
+			if (end == std::string::npos)
+			{
+				end = text.size();
+			}
+			json line = json::parse(text.begin() + start, text.begin() + end, nullptr, false);
+			start = end + 1;
+			// Timing and echo lines are interleaved with the frames when subscribed
+			if (!line.is_discarded() && ReadFrame(line, frame))
+			{
+				frames.push_back(frame);
+			}
+		}
+	}
+
+	void LoadBinary(const std::string& data, std::vector<SkeletonRecording::Frame>& frames)
+	{
+		SkeletonDeltaDecoder deltaDecoder;
+		k4abt_body_t bodies[MaxBodies];
+		const uint8_t* in = reinterpret_cast<const uint8_t*>(data.data());
+		size_t remaining = data.size();
+
+		// A capture that was stopped mid-frame ends with a partial one
+		while (remaining >= FrameHeaderSize)
+		{
+			FrameHeader header;
+			if (!ReadFrameHeader(in, remaining, header) || LengthPrefixSize + header.payloadLength > remaining)
+			{
+				break;
+			}
+			size_t size = LengthPrefixSize + header.payloadLength;
+
+			bool delta = header.type == MessageType::DeltaSkeleton ||
+				(header.type == MessageType::Bodies && size >= BodiesHeaderSize &&
+					static_cast<MessageType>(in[FrameHeaderSize + 1]) == MessageType::DeltaSkeleton);
+			bool skeleton = header.type == MessageType::Skeleton || header.type == MessageType::QuantizedSkeleton ||
+				header.type == MessageType::Bodies;
+
+			size_t count = 0;
+			uint64_t timestamp = 0;
+			bool decoded = delta ? deltaDecoder.ReadBodies(in, size, bodies, MaxBodies, count, timestamp) :
+				skeleton && ReadBodiesFrame(in, size, bodies, MaxBodies, count, timestamp);
+			if (decoded && count > 0)
+			{
+				SkeletonRecording::Frame frame;
+				frame.timestamp = timestamp;
+				frame.bodies.assign(bodies, bodies + count);
+				frames.push_back(frame);
+			}
+
+			in += size;
+			remaining -= size;
+		}
+	}
+}
+
+namespace SkeletonRecording
+{
+	bool Load(const char* path, std::vector<Frame>& frames)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			printf("Cannot open %s\n", path);
+			return false;
+		}
+		std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		// Binary captures start with a frame header, anything else is taken for JSON
+		frames.clear();
+		FrameHeader header;
+		if (ReadFrameHeader(reinterpret_cast<const uint8_t*>(data.data()), data.size(), header))
+		{
+			LoadBinary(data, frames);
+		}
+		else
+		{
+			LoadJson(data, frames);
+		}
+
+		if (frames.empty())
+		{
+			printf("%s holds no skeleton frames\n", path);
+			return false;
+		}
+		return true;
+	}
+
+	void SetBodyCount(std::vector<k4abt_body_t>& bodies, size_t count)
+	{
+		size_t recorded = bodies.size();
+		if (recorded == 0)
+		{
+			return;
+		}
+
+		bodies.resize(count);
+		for (size_t index = recorded; index < count; index++)
+		{
+			k4abt_body_t& body = bodies[index];
+			size_t copy = index / recorded;
+			body = bodies[index % recorded];
+			body.id += static_cast<uint32_t>(100 * copy);
+			for (k4abt_joint_t& joint : body.skeleton.joints)
+			{
+				joint.position.xyz.x += 700.0f * static_cast<float>(copy);
+			}
+		}
+	}
+}
@@ -0,0 +1,37 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <k4abt.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Recorded skeleton streams, read back for replaying them without a device and for
+// the benchmarks. Three kinds of files are understood:
+//
+//   - a pose snapshot, one pretty-printed body as PoseSnapshotCapture saves it
+//   - a JSON capture, what a JSON consumer received: one single- or multi-body frame
+//     per line, with any timing and echo lines in between
+//   - a binary capture, what a BINARY, QUANTIZED or DELTA consumer received: the
+//     length-prefixed frames back to back, with any timing and echo frames in between
+//
+// A capture is simply the bytes read from the socket, e.g. `nc HOST 8888 > capture.bin`.
+namespace SkeletonRecording
+{
+    struct Frame
+    {
+        uint64_t timestamp = 0;  // device time in microseconds, 0 for a snapshot
+        std::vector<k4abt_body_t> bodies;
+    };
+
+    // Read every frame of the file at path. Frames without bodies are left out, and
+    // delta frames that arrive before the first keyframe of their body cannot be
+    // decoded. Prints why and returns false when nothing could be read.
+    bool Load(const char* path, std::vector<Frame>& frames);
+
+    // Bring bodies to exactly count, for a crowd out of a recording of a few people.
+    // Missing bodies are copies of the recorded ones, moved 700 mm aside per copy and
+    // with their id raised by 100 per copy.
+    void SetBodyCount(std::vector<k4abt_body_t>& bodies, size_t count);
+}
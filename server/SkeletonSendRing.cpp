@@ -0,0 +1,556 @@
+// Licensed under the MIT License.
+
+#include "SkeletonSendRing.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SKELETON_SEND_RING 1
+#endif
+#endif
+
+#ifdef SKELETON_SEND_RING
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+namespace
+{
+	// No liburing, the three system calls are all the ring needs
+	int Setup(unsigned entries, io_uring_params* params)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+	}
+
+	int Enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+	}
+
+	int Register(int fd, unsigned opcode, const void* argument, unsigned count)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, argument, count));
+	}
+
+	// How long Close waits for the kernel to let go of the pages of zero-copy sends,
+	// and how long a wait of the thread that reaps the rest of them lasts
+	const int CloseDrainMs = 100;
+	const int RetiredDrainMs = 1000;
+
+	unsigned* RingField(void* ring, uint32_t offset)
+	{
+		return reinterpret_cast<unsigned*>(static_cast<uint8_t*>(ring) + offset);
+	}
+
+	// Whether the kernel knows an opcode, kernels without the probe know none of the newer ones
+	bool Supports(int fd, uint8_t opcode)
+	{
+		const unsigned count = 256;
+		std::vector<uint8_t> buffer(sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op), 0);
+		io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+		if (Register(fd, IORING_REGISTER_PROBE, probe, count) < 0 || opcode > probe->last_op)
+		{
+			return false;
+		}
+		return (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+	}
+}
+
+SkeletonSendRing::SkeletonSendRing()
+	: m_fd(-1)
+	, m_zeroCopy(false)
+	, m_reportUsage(false)
+	, m_sqRing(nullptr)
+	, m_sqRingSize(0)
+	, m_cqRing(nullptr)
+	, m_cqRingSize(0)
+	, m_sqes(nullptr)
+	, m_sqesSize(0)
+	, m_sqHead(nullptr)
+	, m_sqTail(nullptr)
+	, m_sqMask(nullptr)
+	, m_sqArray(nullptr)
+	, m_sqEntries(0)
+	, m_cqHead(nullptr)
+	, m_cqTail(nullptr)
+	, m_cqMask(nullptr)
+	, m_cqes(nullptr)
+	, m_queued(0)
+	, m_pendingResults(0)
+{
+}
+
+SkeletonSendRing::~SkeletonSendRing()
+{
+	Close();
+
+	// Whatever the kernel still holds is waited for on a thread of its own, however
+	// long TCP takes to let go of it. The frames are released as their notifications
+	// come in, never before.
+	if (!m_retired.empty())
+	{
+		std::thread([retired = std::move(m_retired)]() {
+			for (const std::unique_ptr<SkeletonSendRing>& ring : retired)
+			{
+				while (!ring->DrainNotifications(RetiredDrainMs))
+				{
+				}
+			}
+		}).detach();
+	}
+}
+
+bool SkeletonSendRing::Open()
+{
+	Close();
+
+	io_uring_params params = {};
+	m_fd = Setup(Entries, &params);
+	if (m_fd < 0)
+	{
+		return false;
+	}
+
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+	}
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+	m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	m_cqRing = m_sqRing == MAP_FAILED || (params.features & IORING_FEAT_SINGLE_MMAP) ? m_sqRing :
+		mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+	void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	m_sqes = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+	if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == nullptr || !Supports(m_fd, IORING_OP_SEND))
+	{
+		m_sqRing = m_sqRing == MAP_FAILED ? nullptr : m_sqRing;
+		m_cqRing = m_cqRing == MAP_FAILED ? nullptr : m_cqRing;
+		Close();
+		return false;
+	}
+
+	m_sqHead = RingField(m_sqRing, params.sq_off.head);
+	m_sqTail = RingField(m_sqRing, params.sq_off.tail);
+	m_sqMask = RingField(m_sqRing, params.sq_off.ring_mask);
+	m_sqArray = RingField(m_sqRing, params.sq_off.array);
+	m_sqEntries = params.sq_entries;
+	m_cqHead = RingField(m_cqRing, params.cq_off.head);
+	m_cqTail = RingField(m_cqRing, params.cq_off.tail);
+	m_cqMask = RingField(m_cqRing, params.cq_off.ring_mask);
+	m_cqes = reinterpret_cast<io_uring_cqe*>(static_cast<uint8_t*>(m_cqRing) + params.cq_off.cqes);
+
+	// A zero-copy send holds its slot until the kernel lets go of the pages, which
+	// may be after the next submissions
+	m_slots.assign(2 * static_cast<size_t>(params.cq_entries), Slot());
+	m_freeSlots.clear();
+	for (size_t i = m_slots.size(); i > 0; i--)
+	{
+		m_freeSlots.push_back(static_cast<uint32_t>(i - 1));
+	}
+
+#ifdef IORING_RECVSEND_FIXED_BUF
+	m_zeroCopy = Supports(m_fd, IORING_OP_SEND_ZC);
+	m_reportUsage = m_zeroCopy && ProbeUsageReport();
+#endif
+	return true;
+}
+
+bool SkeletonSendRing::ProbeUsageReport()
+{
+#ifdef IORING_SEND_ZC_REPORT_USAGE
+	// Kernels before 6.2 refuse the flag when the send is prepared, with EINVAL. An
+	// unconnected UDP socket gets as far as the send itself and fails there.
+	SOCKET probe = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (probe == INVALID_SOCKET)
+	{
+		return false;
+	}
+	SharedFrame frame = std::make_shared<FrameBuffer>();
+	frame->data.resize(1);
+	m_reportUsage = true;
+	std::vector<Result> results;
+	bool supported = QueueSend(probe, frame, 0, 1, nullptr, true) && Submit(results) && results.size() == 1 &&
+		results[0].result != -EINVAL;
+
+	// Nothing was sent, any notification is posted right away
+	Submit(results);
+	closesocket(probe);
+	ForgetSocket(probe);
+	return supported;
+#else
+	return false;
+#endif
+}
+
+void SkeletonSendRing::Close()
+{
+	ReapRetired();
+
+	// The sockets of zero-copy sends still in flight may stay open and go on with plain
+	// sends, and even a closed one lets TCP flush the pinned pages. Their frames must not
+	// go back to the pool before the kernel's notification is in, so a ring that still
+	// has some keeps its descriptor and slots until it is reaped.
+	if (m_cqes != nullptr && !DrainNotifications(CloseDrainMs))
+	{
+		m_retired.push_back(Retire());
+	}
+	Release();
+}
+
+std::unique_ptr<SkeletonSendRing> SkeletonSendRing::Retire()
+{
+	std::unique_ptr<SkeletonSendRing> ring(new SkeletonSendRing());
+	ring->m_fd = m_fd;
+	ring->m_sqRing = m_sqRing;
+	ring->m_sqRingSize = m_sqRingSize;
+	ring->m_cqRing = m_cqRing;
+	ring->m_cqRingSize = m_cqRingSize;
+	ring->m_sqes = m_sqes;
+	ring->m_sqesSize = m_sqesSize;
+	ring->m_cqHead = m_cqHead;
+	ring->m_cqTail = m_cqTail;
+	ring->m_cqMask = m_cqMask;
+	ring->m_cqes = m_cqes;
+	ring->m_pendingResults = m_pendingResults;
+	ring->m_slots.swap(m_slots);
+	ring->m_freeSlots.swap(m_freeSlots);
+
+	// The mappings and the descriptor are the retired ring's now
+	m_fd = -1;
+	m_sqRing = nullptr;
+	m_cqRing = nullptr;
+	m_sqes = nullptr;
+	return ring;
+}
+
+void SkeletonSendRing::ReapRetired()
+{
+	// Retired rings whose notifications are all in release their frames as they go
+	m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(),
+		[](const std::unique_ptr<SkeletonSendRing>& ring) { return ring->DrainNotifications(0); }), m_retired.end());
+}
+
+void SkeletonSendRing::Release()
+{
+	if (m_sqes != nullptr)
+	{
+		munmap(m_sqes, m_sqesSize);
+	}
+	if (m_cqRing != nullptr && m_cqRing != m_sqRing)
+	{
+		munmap(m_cqRing, m_cqRingSize);
+	}
+	if (m_sqRing != nullptr)
+	{
+		munmap(m_sqRing, m_sqRingSize);
+	}
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+
+	m_fd = -1;
+	m_zeroCopy = false;
+	m_reportUsage = false;
+	m_sqRing = nullptr;
+	m_cqRing = nullptr;
+	m_sqes = nullptr;
+	m_cqes = nullptr;
+	m_queued = 0;
+	m_pendingResults = 0;
+	m_slots.clear();
+	m_freeSlots.clear();
+	m_registered.clear();
+	m_copyingSockets.clear();
+}
+
+bool SkeletonSendRing::IsOpen() const
+{
+	return m_fd >= 0;
+}
+
+bool SkeletonSendRing::SupportsZeroCopy() const
+{
+	return m_zeroCopy;
+}
+
+bool SkeletonSendRing::RegisterBuffers(const std::vector<SharedFrame>& frames)
+{
+	if (!m_zeroCopy || !m_registered.empty() || frames.empty())
+	{
+		return false;
+	}
+
+	std::vector<iovec> buffers;
+	for (const SharedFrame& frame : frames)
+	{
+		buffers.push_back({ frame->data.data(), frame->data.size() });
+	}
+
+	// Counts against RLIMIT_MEMLOCK, large frames then just go without
+	if (Register(m_fd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) < 0)
+	{
+		return false;
+	}
+	for (const SharedFrame& frame : frames)
+	{
+		m_registered.push_back({ frame, frame->data.data(), frame->data.size() });
+	}
+	return true;
+}
+
+int SkeletonSendRing::FindRegisteredBuffer(const SharedFrame& frame, const uint8_t* data, size_t size) const
+{
+	for (size_t i = 0; i < m_registered.size(); i++)
+	{
+		// A buffer that was freed may be at the same address as a new one, only the
+		// living frame that was registered matches
+		const RegisteredBuffer& buffer = m_registered[i];
+		if (data >= buffer.data && data + size <= buffer.data + buffer.size && buffer.frame.lock() == frame)
+		{
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+
+bool SkeletonSendRing::QueueSend(SOCKET socket, const SharedFrame& frame, size_t start, size_t size, void* context)
+{
+	bool copying = std::find(m_copyingSockets.begin(), m_copyingSockets.end(), socket) != m_copyingSockets.end();
+	return QueueSend(socket, frame, start, size, context, m_zeroCopy && !copying && size >= ZeroCopyThreshold);
+}
+
+bool SkeletonSendRing::QueueSend(SOCKET socket, const SharedFrame& frame, size_t start, size_t size, void* context,
+	bool zeroCopy)
+{
+	if (m_freeSlots.empty() && m_pendingResults == 0)
+	{
+		// Only notifications come in between submissions, some slots may be free by now
+		ReapCompletions(nullptr);
+	}
+
+	unsigned tail = *m_sqTail + m_queued;
+	if (m_freeSlots.empty() || tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+	{
+		return false;
+	}
+
+	uint32_t slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+	m_slots[slot].frame = frame;
+	m_slots[slot].context = context;
+	m_slots[slot].socket = socket;
+
+	unsigned index = tail & *m_sqMask;
+	io_uring_sqe& sqe = m_sqes[index];
+	memset(&sqe, 0, sizeof(sqe));
+	const uint8_t* data = frame->data.data() + start;
+	sqe.opcode = IORING_OP_SEND;
+	sqe.fd = socket;
+	sqe.addr = reinterpret_cast<uint64_t>(data);
+	sqe.len = static_cast<uint32_t>(size);
+	sqe.msg_flags = SocketSendFlags;
+	sqe.user_data = slot;
+#ifdef IORING_RECVSEND_FIXED_BUF
+	if (zeroCopy)
+	{
+		sqe.opcode = IORING_OP_SEND_ZC;
+#ifdef IORING_SEND_ZC_REPORT_USAGE
+		sqe.ioprio = m_reportUsage ? IORING_SEND_ZC_REPORT_USAGE : 0;
+#endif
+		int buffer = FindRegisteredBuffer(frame, data, size);
+		if (buffer >= 0)
+		{
+			sqe.ioprio |= IORING_RECVSEND_FIXED_BUF;
+			sqe.buf_index = static_cast<uint16_t>(buffer);
+		}
+	}
+#endif
+	m_sqArray[index] = index;
+	m_queued++;
+	return true;
+}
+
+bool SkeletonSendRing::Submit(std::vector<Result>& results)
+{
+	results.clear();
+	if (m_queued > 0)
+	{
+		__atomic_store_n(m_sqTail, *m_sqTail + m_queued, __ATOMIC_RELEASE);
+		m_pendingResults += m_queued;
+	}
+
+	// Non-blocking sockets complete their sends inline, the wait is only for the
+	// kernel to post them
+	unsigned toSubmit = m_queued;
+	ReapCompletions(&results);
+	while (toSubmit > 0 || m_pendingResults > 0)
+	{
+		int submitted = Enter(m_fd, toSubmit, toSubmit > 0 ? 0 : 1, IORING_ENTER_GETEVENTS);
+		if (submitted < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+			{
+				ReapCompletions(&results);
+				continue;
+			}
+			return false;
+		}
+		toSubmit -= std::min(toSubmit, static_cast<unsigned>(submitted));
+		ReapCompletions(&results);
+	}
+	m_queued = 0;
+	return true;
+}
+
+void SkeletonSendRing::ReapCompletions(std::vector<Result>* results)
+{
+	unsigned head = *m_cqHead;
+	unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+		uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+#ifdef IORING_CQE_F_NOTIF
+		if (cqe.flags & IORING_CQE_F_NOTIF)
+		{
+			// The kernel let go of the pages of a zero-copy send. If it had to copy them
+			// anyway, pinning them only cost time.
+#ifdef IORING_NOTIF_USAGE_ZC_COPIED
+			SOCKET socket = m_slots[slot].socket;
+			if ((cqe.res & IORING_NOTIF_USAGE_ZC_COPIED) &&
+				std::find(m_copyingSockets.begin(), m_copyingSockets.end(), socket) == m_copyingSockets.end())
+			{
+				m_copyingSockets.push_back(socket);
+			}
+#endif
+			ReleaseSlot(slot);
+			continue;
+		}
+#endif
+		if (results != nullptr)
+		{
+			results->push_back({ m_slots[slot].context, cqe.res });
+		}
+		m_pendingResults--;
+		if ((cqe.flags & IORING_CQE_F_MORE) == 0)
+		{
+			ReleaseSlot(slot);
+		}
+	}
+	__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+bool SkeletonSendRing::DrainNotifications(int timeoutMs)
+{
+	// Results of a failed submission and zero-copy notifications, whatever is in within
+	// the time. The ring is readable while completions are waiting.
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	ReapCompletions(nullptr);
+	while (m_freeSlots.size() < m_slots.size())
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		pollfd ring = { m_fd, POLLIN, 0 };
+		if (remaining.count() <= 0 || (poll(&ring, 1, static_cast<int>(remaining.count())) < 0 && errno != EINTR))
+		{
+			return false;
+		}
+		ReapCompletions(nullptr);
+	}
+	return true;
+}
+
+void SkeletonSendRing::ForgetSocket(SOCKET socket)
+{
+	m_copyingSockets.erase(std::remove(m_copyingSockets.begin(), m_copyingSockets.end(), socket), m_copyingSockets.end());
+}
+
+void SkeletonSendRing::ReleaseSlot(uint32_t slot)
+{
+	m_slots[slot].frame.reset();
+	m_slots[slot].context = nullptr;
+	m_slots[slot].socket = INVALID_SOCKET;
+	m_freeSlots.push_back(slot);
+}
+
+#else
+
+// Plain sends only
+SkeletonSendRing::SkeletonSendRing()
+	: m_fd(-1)
+	, m_zeroCopy(false)
+	, m_reportUsage(false)
+	, m_sqRing(nullptr)
+	, m_sqRingSize(0)
+	, m_cqRing(nullptr)
+	, m_cqRingSize(0)
+	, m_sqes(nullptr)
+	, m_sqesSize(0)
+	, m_sqHead(nullptr)
+	, m_sqTail(nullptr)
+	, m_sqMask(nullptr)
+	, m_sqArray(nullptr)
+	, m_sqEntries(0)
+	, m_cqHead(nullptr)
+	, m_cqTail(nullptr)
+	, m_cqMask(nullptr)
+	, m_cqes(nullptr)
+	, m_queued(0)
+	, m_pendingResults(0)
+{
+}
+
+SkeletonSendRing::~SkeletonSendRing()
+{
+}
+
+bool SkeletonSendRing::Open()
+{
+	return false;
+}
+
+void SkeletonSendRing::Close()
+{
+}
+
+bool SkeletonSendRing::IsOpen() const
+{
+	return false;
+}
+
+bool SkeletonSendRing::SupportsZeroCopy() const
+{
+	return false;
+}
+
+bool SkeletonSendRing::RegisterBuffers(const std::vector<SharedFrame>& /*frames*/)
+{
+	return false;
+}
+
+bool SkeletonSendRing::QueueSend(SOCKET /*socket*/, const SharedFrame& /*frame*/, size_t /*start*/, size_t /*size*/,
+	void* /*context*/)
+{
+	return false;
+}
+
+bool SkeletonSendRing::Submit(std::vector<Result>& results)
+{
+	results.clear();
+	return false;
+}
+
+void SkeletonSendRing::ForgetSocket(SOCKET /*socket*/)
+{
+}
+
+#endif
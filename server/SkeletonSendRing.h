@@ -0,0 +1,124 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "FrameBufferPool.h"
+#include "SocketPlatform.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// Batches the socket writes of a SkeletonFanoutServer poll round into one io_uring
+// submission on Linux, instead of one send() call per client and frame.
+//
+// Frames of at least ZeroCopyThreshold bytes, depth images and point clouds, go out
+// as zero-copy sends: the kernel takes the frame's pages instead of copying them into
+// the socket buffer, and the frame is kept alive until the kernel reports it is done
+// with them. Buffers registered up front, a channel's pooled frames, also skip the
+// page pinning on every send. Where the kernel reports that it copied the data after
+// all, as it always does over loopback, the socket goes back to copying sends.
+//
+// Sockets must be non-blocking. A send that would block completes with -EAGAIN like a
+// plain send does, so every result is in when Submit returns. Where io_uring is missing
+// or disabled Open fails and the caller keeps using plain sends.
+class SkeletonSendRing
+{
+public:
+    static constexpr size_t ZeroCopyThreshold = 16384;
+    static constexpr unsigned Entries = 64;
+
+    struct Result
+    {
+        void* context;
+        int result;  // bytes sent, or a negative errno
+    };
+
+    SkeletonSendRing();
+    ~SkeletonSendRing();
+
+    bool Open();
+
+    // Waits a little for the kernel to let go of the frames of zero-copy sends still in
+    // flight. The ones it still holds then are released as their notifications come in,
+    // checked on the next Open or Close and waited for on a thread when the ring is destroyed.
+    void Close();
+    bool IsOpen() const;
+    bool SupportsZeroCopy() const;
+
+    // Register the buffers of the frames, once. Only frames that are still alive are
+    // sent from their registration, the ring does not keep them alive.
+    bool RegisterBuffers(const std::vector<SharedFrame>& frames);
+
+    // Queue a send of size bytes from frame->data at start. Returns false when the ring
+    // is full, Submit first. With every slot held by a zero-copy send the kernel has not
+    // let go of yet, Submit frees none either.
+    bool QueueSend(SOCKET socket, const SharedFrame& frame, size_t start, size_t size, void* context);
+
+    // Submit the queued sends and wait for their results, in no particular order
+    bool Submit(std::vector<Result>& results);
+
+    // The socket is closed, a new one may get its number
+    void ForgetSocket(SOCKET socket);
+
+private:
+    struct Slot
+    {
+        SharedFrame frame;
+        void* context = nullptr;
+        SOCKET socket = INVALID_SOCKET;
+    };
+
+    struct RegisteredBuffer
+    {
+        std::weak_ptr<FrameBuffer> frame;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    bool QueueSend(SOCKET socket, const SharedFrame& frame, size_t start, size_t size, void* context, bool zeroCopy);
+    bool ProbeUsageReport();
+    int FindRegisteredBuffer(const SharedFrame& frame, const uint8_t* data, size_t size) const;
+    void ReapCompletions(std::vector<Result>* results);
+    bool DrainNotifications(int timeoutMs);  // whether every slot is free
+    std::unique_ptr<SkeletonSendRing> Retire();
+    void ReapRetired();
+    void Release();
+    void ReleaseSlot(uint32_t slot);
+
+    int m_fd;
+    bool m_zeroCopy;
+    bool m_reportUsage;  // the kernel says whether a zero-copy send was copied after all
+
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned* m_sqMask;
+    unsigned* m_sqArray;
+    unsigned m_sqEntries;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned* m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    unsigned m_queued;          // in the submission queue, not yet handed to the kernel
+    unsigned m_pendingResults;  // submitted, result not reaped yet
+
+    // Sends in flight, and zero-copy sends whose pages the kernel still holds
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<RegisteredBuffer> m_registered;
+    std::vector<SOCKET> m_copyingSockets;
+
+    // Closed rings the kernel still holds zero-copy frames of
+    std::vector<std::unique_ptr<SkeletonSendRing>> m_retired;
+};
@@ -0,0 +1,405 @@
+// Licensed under the MIT License.
+
+#include "SkeletonSharedMemory.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <ctime>
+#endif
+
+using namespace SkeletonShm;
+
+namespace
+{
+#ifdef _WIN32
+	void* MapSegment(const std::string& name, bool create, size_t size, void*& handle)
+	{
+		handle = create ?
+			CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+				static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), name.c_str()) :
+			OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+		if (handle == nullptr)
+		{
+			return nullptr;
+		}
+
+		void* mapping = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		if (mapping == nullptr)
+		{
+			CloseHandle(handle);
+			handle = nullptr;
+		}
+		return mapping;
+	}
+
+	void UnmapSegment(void* mapping, size_t /*size*/, void*& handle)
+	{
+		UnmapViewOfFile(mapping);
+		CloseHandle(handle);
+		handle = nullptr;
+	}
+#else
+	// POSIX names start with a single slash
+	std::string SegmentName(const std::string& name)
+	{
+		return name.empty() || name[0] != '/' ? "/" + name : name;
+	}
+
+	void* MapSegment(const std::string& name, bool create, size_t size)
+	{
+		int fd = create ?
+			shm_open(SegmentName(name).c_str(), O_CREAT | O_RDWR, 0600) :
+			shm_open(SegmentName(name).c_str(), O_RDWR, 0);
+		if (fd < 0)
+		{
+			return nullptr;
+		}
+
+		struct stat status = {};
+		if ((create && ftruncate(fd, static_cast<off_t>(size)) != 0) ||
+			(!create && (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < size)))
+		{
+			close(fd);
+			return nullptr;
+		}
+
+		void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		return mapping == MAP_FAILED ? nullptr : mapping;
+	}
+
+	void UnmapSegment(void* mapping, size_t size)
+	{
+		munmap(mapping, size);
+	}
+#endif
+
+#ifdef __linux__
+	// Not FUTEX_PRIVATE_FLAG: the word lives in memory shared between processes
+	void FutexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMs)
+	{
+		timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+	}
+
+	void FutexWakeAll(std::atomic<uint32_t>* word)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+	}
+#endif
+}
+
+SkeletonShmWriter::SkeletonShmWriter()
+	: m_mapping(nullptr)
+	, m_mappingSize(0)
+	, m_header(nullptr)
+	, m_writeIndex(0)
+#ifdef _WIN32
+	, m_handle(nullptr)
+#endif
+{
+}
+
+SkeletonShmWriter::~SkeletonShmWriter()
+{
+	Close();
+}
+
+bool SkeletonShmWriter::Open(const std::string& name, uint32_t slotCount)
+{
+	Close();
+
+	slotCount = std::max<uint32_t>(slotCount, 2);
+	m_mappingSize = SegmentSize(slotCount);
+#ifdef _WIN32
+	m_mapping = MapSegment(name, true, m_mappingSize, m_handle);
+#else
+	m_mapping = MapSegment(name, true, m_mappingSize);
+#endif
+	if (m_mapping == nullptr)
+	{
+		printf("Shared memory segment %s could not be created\n", name.c_str());
+		return false;
+	}
+
+	// A segment left behind by a crashed producer is simply reinitialized
+	m_name = name;
+	m_header = new (m_mapping) ShmHeader();
+	m_header->version = Version;
+	m_header->slotCount = slotCount;
+	m_header->slotSize = SlotSize;
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		new (static_cast<uint8_t*>(m_mapping) + sizeof(ShmHeader) + i * SlotStride) ShmSlotHeader();
+	}
+	m_writeIndex = 0;
+	m_header->magic.store(Magic, std::memory_order_release);
+
+	printf("Publishing skeletons to shared memory %s\n", name.c_str());
+	return true;
+}
+
+void SkeletonShmWriter::Close()
+{
+	if (m_mapping == nullptr)
+	{
+		return;
+	}
+
+	// Readers still mapping the segment keep it alive, they just see no more frames
+#ifdef _WIN32
+	UnmapSegment(m_mapping, m_mappingSize, m_handle);
+#else
+	UnmapSegment(m_mapping, m_mappingSize);
+	shm_unlink(SegmentName(m_name).c_str());
+#endif
+	m_mapping = nullptr;
+	m_header = nullptr;
+}
+
+bool SkeletonShmWriter::IsOpen() const
+{
+	return m_mapping != nullptr;
+}
+
+uint64_t SkeletonShmWriter::GetFramesWritten() const
+{
+	return m_writeIndex;
+}
+
+void SkeletonShmWriter::WriteBodies(const k4abt_body_t* bodies, size_t count, uint64_t timestamp)
+{
+	if (m_header == nullptr)
+	{
+		return;
+	}
+
+	uint64_t index = m_writeIndex++;
+	uint8_t* slotStart = static_cast<uint8_t*>(m_mapping) + sizeof(ShmHeader) + (index % m_header->slotCount) * SlotStride;
+	ShmSlotHeader* slot = reinterpret_cast<ShmSlotHeader*>(slotStart);
+
+	// Odd while the slot is being written, readers that overlap with it notice the change
+	slot->sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->size = static_cast<uint32_t>(SkeletonWire::WriteBodiesFrame(slotStart + sizeof(ShmSlotHeader),
+		SkeletonWire::MessageType::Skeleton, bodies, count, timestamp, static_cast<uint32_t>(index)));
+
+	slot->sequence.store(2 * index + 2, std::memory_order_release);
+	m_header->writeIndex.store(index + 1, std::memory_order_release);
+	Wake();
+}
+
+void SkeletonShmWriter::Wake()
+{
+	// Sequentially consistent so the waiters check cannot move before the bump,
+	// which a reader going to sleep checks in the opposite order
+	m_header->wakeCounter.fetch_add(1);
+
+	// The system call is only paid for while somebody actually sleeps
+#ifdef __linux__
+	if (m_header->waiters.load() > 0)
+	{
+		FutexWakeAll(&m_header->wakeCounter);
+	}
+#endif
+}
+
+SkeletonShmReader::SkeletonShmReader()
+	: m_mapping(nullptr)
+	, m_mappingSize(0)
+	, m_header(nullptr)
+	, m_readIndex(0)
+	, m_framesSkipped(0)
+#ifdef _WIN32
+	, m_handle(nullptr)
+#endif
+{
+}
+
+SkeletonShmReader::~SkeletonShmReader()
+{
+	Close();
+}
+
+bool SkeletonShmReader::Open(const std::string& name)
+{
+	Close();
+
+	// Map the header first to learn how large the ring is
+	size_t headerSize = sizeof(ShmHeader);
+	void* mapping;
+#ifdef _WIN32
+	mapping = MapSegment(name, false, headerSize, m_handle);
+#else
+	mapping = MapSegment(name, false, headerSize);
+#endif
+	if (mapping == nullptr)
+	{
+		return false;
+	}
+
+	ShmHeader* header = static_cast<ShmHeader*>(mapping);
+	bool valid = header->magic.load(std::memory_order_acquire) == Magic &&
+		header->version == Version && header->slotSize == SlotSize && header->slotCount >= 2;
+	uint32_t slotCount = header->slotCount;
+#ifdef _WIN32
+	UnmapSegment(mapping, headerSize, m_handle);
+#else
+	UnmapSegment(mapping, headerSize);
+#endif
+	if (!valid)
+	{
+		return false;
+	}
+
+	m_mappingSize = SegmentSize(slotCount);
+#ifdef _WIN32
+	m_mapping = MapSegment(name, false, m_mappingSize, m_handle);
+#else
+	m_mapping = MapSegment(name, false, m_mappingSize);
+#endif
+	if (m_mapping == nullptr)
+	{
+		return false;
+	}
+
+	m_header = static_cast<ShmHeader*>(m_mapping);
+	uint64_t published = m_header->writeIndex.load(std::memory_order_acquire);
+	m_readIndex = published > 0 ? published - 1 : 0;
+	m_framesSkipped = 0;
+	return true;
+}
+
+void SkeletonShmReader::Close()
+{
+	if (m_mapping == nullptr)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapSegment(m_mapping, m_mappingSize, m_handle);
+#else
+	UnmapSegment(m_mapping, m_mappingSize);
+#endif
+	m_mapping = nullptr;
+	m_header = nullptr;
+}
+
+bool SkeletonShmReader::IsOpen() const
+{
+	return m_mapping != nullptr;
+}
+
+uint64_t SkeletonShmReader::GetFramesSkipped() const
+{
+	return m_framesSkipped;
+}
+
+uint8_t* SkeletonShmReader::Slot(uint64_t index) const
+{
+	return static_cast<uint8_t*>(m_mapping) + sizeof(ShmHeader) + (index % m_header->slotCount) * SlotStride;
+}
+
+bool SkeletonShmReader::HasUnread() const
+{
+	return m_header->writeIndex.load(std::memory_order_acquire) > m_readIndex;
+}
+
+bool SkeletonShmReader::Read(uint8_t* out, size_t& size)
+{
+	if (m_header == nullptr)
+	{
+		return false;
+	}
+
+	for (;;)
+	{
+		uint64_t published = m_header->writeIndex.load(std::memory_order_acquire);
+		if (published <= m_readIndex)
+		{
+			return false;
+		}
+
+		// Lapped: everything older than the newest frame is gone or about to be
+		if (published - m_readIndex > m_header->slotCount - 1)
+		{
+			m_framesSkipped += published - 1 - m_readIndex;
+			m_readIndex = published - 1;
+		}
+
+		ShmSlotHeader* slot = reinterpret_cast<ShmSlotHeader*>(Slot(m_readIndex));
+		uint64_t expected = 2 * m_readIndex + 2;
+		uint64_t before = slot->sequence.load(std::memory_order_acquire);
+		size = slot->size;
+		if (before == expected && size <= SlotSize)
+		{
+			memcpy(out, reinterpret_cast<uint8_t*>(slot) + sizeof(ShmSlotHeader), size);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot->sequence.load(std::memory_order_relaxed) == before)
+			{
+				m_readIndex++;
+				return true;
+			}
+		}
+
+		// The producer reused the slot while it was being copied, the frame is lost
+		m_framesSkipped++;
+		m_readIndex++;
+	}
+}
+
+bool SkeletonShmReader::Wait(int timeoutMs)
+{
+	if (m_header == nullptr)
+	{
+		return false;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	for (;;)
+	{
+		uint32_t counter = m_header->wakeCounter.load(std::memory_order_acquire);
+		if (HasUnread())
+		{
+			return true;
+		}
+
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		if (remaining.count() <= 0)
+		{
+			return false;
+		}
+
+#ifdef __linux__
+		// The counter check in the kernel closes the race with a frame published
+		// between HasUnread and going to sleep
+		m_header->waiters.fetch_add(1);
+		FutexWait(&m_header->wakeCounter, counter, static_cast<int>(remaining.count()));
+		m_header->waiters.fetch_sub(1);
+#else
+		// No cross-process futex here, poll at a fraction of the frame interval
+		(void)counter;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+	}
+}
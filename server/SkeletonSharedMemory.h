@@ -0,0 +1,127 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <k4abt.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "SkeletonWireFormat.h"
+
+// Same-host transport: a named shared memory segment holding a ring of multi-body
+// frames (message type 4 with full float records, see SkeletonWireFormat.h).
+// The producer serializes straight into the next slot, and publishing a frame costs
+// no system call unless a reader is blocked in Wait. Readers never block the producer.
+// A reader that falls a whole ring behind skips ahead to the newest frame.
+//
+// Every slot is guarded by a seqlock: its sequence is odd while the producer writes
+// it and 2 * (frame index + 1) once frame index is complete. Readers copy a slot and
+// check that its sequence did not change meanwhile.
+//
+// Segment layout, native byte order (the segment never leaves the machine):
+//
+//   ShmHeader, 64 bytes, followed by slotCount slots of sizeof(ShmSlotHeader) + slotSize bytes
+namespace SkeletonShm
+{
+    constexpr uint32_t Magic = 0x4D48534B;  // 'K', 'S', 'H', 'M'
+    constexpr uint32_t Version = 1;
+    constexpr uint32_t DefaultSlotCount = 64;
+    constexpr uint32_t SlotSize = static_cast<uint32_t>(SkeletonWire::MaxBodiesFrameSize);
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+        "Shared memory atomics must not need a lock");
+
+    struct alignas(64) ShmHeader
+    {
+        std::atomic<uint32_t> magic;  // written last by the producer, readers check it first
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t slotSize;
+        std::atomic<uint64_t> writeIndex;  // number of frames published
+        std::atomic<uint32_t> wakeCounter; // futex word, bumped after every frame
+        std::atomic<uint32_t> waiters;     // readers blocked in Wait
+    };
+
+    struct alignas(64) ShmSlotHeader
+    {
+        std::atomic<uint64_t> sequence;
+        uint32_t size;
+    };
+
+    constexpr size_t SlotStride = sizeof(ShmSlotHeader) + ((SlotSize + 63) / 64) * 64;
+
+    constexpr size_t SegmentSize(uint32_t slotCount)
+    {
+        return sizeof(ShmHeader) + static_cast<size_t>(slotCount) * SlotStride;
+    }
+}
+
+// Producer side. Only one per segment name; it creates the segment and removes the name on Close.
+class SkeletonShmWriter
+{
+public:
+    SkeletonShmWriter();
+    ~SkeletonShmWriter();
+
+    bool Open(const std::string& name, uint32_t slotCount = SkeletonShm::DefaultSlotCount);
+    void Close();
+    bool IsOpen() const;
+
+    // Serialize all bodies of a body frame into the next slot and publish it.
+    // Bodies beyond SkeletonWire::MaxBodies are left out.
+    void WriteBodies(const k4abt_body_t* bodies, size_t count, uint64_t timestamp);
+
+    uint64_t GetFramesWritten() const;
+
+private:
+    void Wake();
+
+    std::string m_name;
+    void* m_mapping;
+    size_t m_mappingSize;
+    SkeletonShm::ShmHeader* m_header;
+    uint64_t m_writeIndex;
+#ifdef _WIN32
+    void* m_handle;
+#endif
+};
+
+// Consumer side, any number per segment and process
+class SkeletonShmReader
+{
+public:
+    SkeletonShmReader();
+    ~SkeletonShmReader();
+
+    // Fails if the producer has not created the segment yet. Reading starts at the
+    // newest frame published at that point.
+    bool Open(const std::string& name);
+    void Close();
+    bool IsOpen() const;
+
+    // Copy the next unread frame into out, which must hold SkeletonShm::SlotSize bytes.
+    // Returns false if there is no new frame.
+    bool Read(uint8_t* out, size_t& size);
+
+    // Block until a frame that has not been read yet is published, or timeoutMs passed.
+    // Returns true if one is available.
+    bool Wait(int timeoutMs);
+
+    // Frames overwritten by the producer before this reader got to them
+    uint64_t GetFramesSkipped() const;
+
+private:
+    bool HasUnread() const;
+    uint8_t* Slot(uint64_t index) const;
+
+    void* m_mapping;
+    size_t m_mappingSize;
+    SkeletonShm::ShmHeader* m_header;
+    uint64_t m_readIndex;
+    uint64_t m_framesSkipped;
+#ifdef _WIN32
+    void* m_handle;
+#endif
+};
@@ -0,0 +1,104 @@
+// Licensed under the MIT License.
+
+#include "SkeletonSilhouetteChannel.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+	// A slow client keeps at most this many silhouette frames queued, the newest win
+	constexpr size_t ClientQueueCapacity = 2;
+}
+
+SkeletonSilhouetteChannel::SkeletonSilhouetteChannel(int width, int height, bool webSocket)
+	: m_width(width)
+	, m_height(height)
+	, m_channel(SkeletonSilhouette::MaxSilhouetteFrameSize(static_cast<size_t>(width), static_cast<size_t>(height)),
+		ClientQueueCapacity, webSocket)
+	, m_sequence(0)
+	, m_framesSent(0)
+	, m_bytesSent(0)
+{
+}
+
+SkeletonSilhouetteChannel::~SkeletonSilhouetteChannel()
+{
+	Stop();
+}
+
+bool SkeletonSilhouetteChannel::Start(const std::string& bindAddress, int port, bool sendRing)
+{
+	if (!m_channel.Start(bindAddress, port, sendRing))
+	{
+		return false;
+	}
+	printf("Silhouette channel on port %d, %dx%d body index maps\n", port, m_width, m_height);
+	return true;
+}
+
+void SkeletonSilhouetteChannel::Stop()
+{
+	m_channel.Stop();
+}
+
+bool SkeletonSilhouetteChannel::IsRunning() const
+{
+	return m_channel.IsRunning();
+}
+
+bool SkeletonSilhouetteChannel::SendBodyIndexMap(const uint8_t* map, int width, int height, const uint32_t* bodyIds,
+	size_t bodyCount, uint64_t timestamp)
+{
+	if (!m_channel.IsRunning() || width != m_width || height != m_height)
+	{
+		return false;
+	}
+
+	const std::vector<SkeletonSubscription>& subscriptions = m_channel.UpdateSubscriptions();
+	if (subscriptions.empty())
+	{
+		return true;
+	}
+
+	// Only the encoding is timed, handing a frame to the clients may wake the network thread
+	uint64_t start = SkeletonLatency::HostTimeUsec();
+	m_encoder.SetMap(map, width, height, bodyIds, bodyCount);
+	uint64_t encodeTime = SkeletonLatency::HostTimeUsec() - start;
+	bodyCount = std::min(bodyCount, SkeletonWire::MaxBodies);
+	uint32_t sequence = m_sequence++;
+	for (const SkeletonSubscription& subscription : subscriptions)
+	{
+		uint32_t indexMask = 0;
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			if (subscription.IncludesBody(bodyIds[i]))
+			{
+				indexMask |= 1u << i;
+			}
+		}
+
+		start = SkeletonLatency::HostTimeUsec();
+		SharedFrame frame = m_channel.Acquire();
+		uint8_t* payload = SkeletonChannel::GetPayload(frame);
+		size_t size = subscription.contours ?
+			m_encoder.WriteContourFrame(payload, indexMask, timestamp, sequence) :
+			m_encoder.WriteRunFrame(payload, indexMask, timestamp, sequence);
+		encodeTime += SkeletonLatency::HostTimeUsec() - start;
+		m_channel.Broadcast(frame, size, subscription);
+		m_framesSent++;
+		m_bytesSent += size;
+	}
+	m_encodeLatency.Record(encodeTime);
+	return true;
+}
+
+SkeletonSilhouetteStats SkeletonSilhouetteChannel::GetStats() const
+{
+	SkeletonSilhouetteStats stats;
+	stats.framesSent = m_framesSent;
+	stats.averageFrameBytes = stats.framesSent > 0 ? static_cast<double>(m_bytesSent) / static_cast<double>(stats.framesSent) : 0.0;
+	stats.encodeLatency = SkeletonLatency::GetPercentiles(m_encodeLatency);
+	stats.framesDropped = m_channel.GetFramesDropped();
+	stats.clientCount = m_channel.GetClientCount();
+	return stats;
+}
@@ -0,0 +1,58 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "SkeletonChannel.h"
+#include "SkeletonLatency.h"
+#include "SkeletonSilhouetteCodec.h"
+
+struct SkeletonSilhouetteStats
+{
+    uint64_t framesSent = 0;
+    uint64_t framesDropped = 0;
+    size_t clientCount = 0;
+    double averageFrameBytes = 0.0;
+    SkeletonLatencyPercentiles encodeLatency;  // scanning a map and writing every frame for it
+};
+
+// Optional listening port that streams who is where in the depth image: the body index
+// map of every body frame, as run-length rows or outline polygons (see
+// SkeletonSilhouetteCodec.h). Frames are timestamped like the skeletons they belong to.
+//
+// Clients choose with their subscription line (see SkeletonChannel.h): "bodies" limits
+// the silhouettes to those bodies and "contours" asks for outlines instead of runs.
+// The map is scanned once per body frame and every distinct subscription gets one frame
+// written for it, so encoding stays cheap enough for the frame thread.
+class SkeletonSilhouetteChannel
+{
+public:
+    // Maps of another size than width x height are not sent
+    SkeletonSilhouetteChannel(int width, int height, bool webSocket = false);
+    ~SkeletonSilhouetteChannel();
+
+    bool Start(const std::string& bindAddress, int port, bool sendRing = false);
+    void Stop();
+    bool IsRunning() const;
+
+    // Index i of the map belongs to bodyIds[i]. Does no work while nobody is
+    // connected. Call from one thread only.
+    bool SendBodyIndexMap(const uint8_t* map, int width, int height, const uint32_t* bodyIds, size_t bodyCount,
+        uint64_t timestamp);
+
+    SkeletonSilhouetteStats GetStats() const;
+
+private:
+    int m_width;
+    int m_height;
+    SkeletonChannel m_channel;
+    SkeletonSilhouette::SilhouetteEncoder m_encoder;
+    uint32_t m_sequence;
+
+    std::atomic<uint64_t> m_framesSent;
+    std::atomic<uint64_t> m_bytesSent;
+    SkeletonLatency::Histogram m_encodeLatency;
+};
@@ -0,0 +1,516 @@
+// Licensed under the MIT License.
+
+#include "SkeletonSilhouetteCodec.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SKELETON_SILHOUETTE_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// Moore neighbourhood, clockwise on screen (y grows downwards) starting east
+	const int NeighbourX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+	const int NeighbourY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+	// Direction of the neighbour at offset (x, y), indexed by (y + 1) * 3 + x + 1
+	const int DirectionOf[9] = { 5, 6, 7, 4, -1, 0, 3, 2, 1 };
+
+	constexpr int West = 4;
+
+#ifdef SKELETON_SILHOUETTE_SSE2
+	int LowestSetBit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+#endif
+
+	// Number of leading pixels equal to value, compared 16 at a time where SSE2 is available
+	size_t SameRun(const uint8_t* pixels, size_t count, uint8_t value)
+	{
+		size_t i = 0;
+#ifdef SKELETON_SILHOUETTE_SSE2
+		__m128i match = _mm_set1_epi8(static_cast<char>(value));
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, match)));
+			if (mask != 0xFFFF)
+			{
+				return i + LowestSetBit(~mask);
+			}
+		}
+#endif
+		while (i < count && pixels[i] == value)
+		{
+			i++;
+		}
+		return i;
+	}
+
+	// Squared distance of point from the line through a and b, times the squared length of
+	// a-b so that a span needs no division; from a itself when a and b are the same point
+	int64_t ScaledLineDistance(const SkeletonSilhouette::ContourPoint& point,
+		const SkeletonSilhouette::ContourPoint& a, const SkeletonSilhouette::ContourPoint& b)
+	{
+		int64_t dx = static_cast<int64_t>(b.x) - a.x;
+		int64_t dy = static_cast<int64_t>(b.y) - a.y;
+		int64_t px = static_cast<int64_t>(point.x) - a.x;
+		int64_t py = static_cast<int64_t>(point.y) - a.y;
+		if (dx == 0 && dy == 0)
+		{
+			return px * px + py * py;
+		}
+		int64_t cross = dx * py - dy * px;
+		return cross * cross;
+	}
+
+	// Header shared by both frame types, up to and including the body id table
+	uint8_t* WriteSilhouetteHeader(uint8_t* buffer, SkeletonWire::MessageType type, int width, int height,
+		const uint32_t* bodyIds, size_t bodyCount, uint64_t timestamp, uint32_t sequence)
+	{
+		uint8_t* out = SkeletonWire::BeginFrame(buffer, type, timestamp, sequence);
+		out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(width));
+		out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(height));
+		out = SkeletonWire::WriteU8(out, static_cast<uint8_t>(bodyCount));
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			out = SkeletonWire::WriteU32(out, bodyIds[i]);
+		}
+		return out;
+	}
+
+	// Validates the header and body id table. On success in points past
+	// the table and end to the end of the payload.
+	bool ReadSilhouetteHeader(const uint8_t* data, size_t size, SkeletonWire::MessageType type, int& width, int& height,
+		std::vector<uint32_t>& bodyIds, uint64_t& timestamp, const uint8_t*& in, const uint8_t*& end)
+	{
+		SkeletonWire::FrameHeader header;
+		if (!SkeletonWire::ReadFrameHeader(data, size, header) || header.type != type ||
+			size < SkeletonSilhouette::SilhouetteHeaderSize || SkeletonWire::LengthPrefixSize + header.payloadLength > size)
+		{
+			return false;
+		}
+
+		end = data + SkeletonWire::LengthPrefixSize + header.payloadLength;
+		in = data + SkeletonWire::FrameHeaderSize;
+		width = SkeletonWire::ReadU16(in);
+		height = SkeletonWire::ReadU16(in + 2);
+		size_t bodyCount = in[4];
+		in += 5;
+		if (bodyCount > SkeletonWire::MaxBodies || static_cast<size_t>(end - in) < 4 * bodyCount)
+		{
+			return false;
+		}
+		bodyIds.resize(bodyCount);
+		for (size_t i = 0; i < bodyCount; i++, in += 4)
+		{
+			bodyIds[i] = SkeletonWire::ReadU32(in);
+		}
+		timestamp = header.timestamp;
+		return true;
+	}
+}
+
+namespace SkeletonSilhouette
+{
+	SilhouetteEncoder::SilhouetteEncoder(float contourTolerance)
+		: m_tolerance(contourTolerance)
+		, m_width(0)
+		, m_height(0)
+		, m_bodyIds()
+		, m_bodyCount(0)
+		, m_traced(false)
+	{
+	}
+
+	void SilhouetteEncoder::SetMap(const uint8_t* map, int width, int height, const uint32_t* bodyIds, size_t bodyCount)
+	{
+		m_width = width;
+		m_height = height;
+		m_bodyCount = std::min(bodyCount, SkeletonWire::MaxBodies);
+		std::copy(bodyIds, bodyIds + m_bodyCount, m_bodyIds);
+		m_traced = false;
+
+		m_runs.clear();
+		m_rowStarts.resize(static_cast<size_t>(height) + 1);
+		for (int y = 0; y < height; y++)
+		{
+			m_rowStarts[y] = static_cast<uint32_t>(m_runs.size());
+			const uint8_t* row = map + static_cast<size_t>(y) * static_cast<size_t>(width);
+			int x = 0;
+			while (x < width)
+			{
+				uint8_t index = row[x];
+				int length = static_cast<int>(SameRun(row + x, static_cast<size_t>(width - x), index));
+				if (index < m_bodyCount)
+				{
+					m_runs.push_back({ static_cast<uint16_t>(x), static_cast<uint16_t>(length), index });
+				}
+				x += length;
+			}
+		}
+		m_rowStarts[height] = static_cast<uint32_t>(m_runs.size());
+	}
+
+	size_t SilhouetteEncoder::WriteRunFrame(uint8_t* buffer, uint32_t indexMask, uint64_t timestamp, uint32_t sequence) const
+	{
+		uint8_t* out = WriteSilhouetteHeader(buffer, SkeletonWire::MessageType::SilhouetteRuns, m_width, m_height,
+			m_bodyIds, m_bodyCount, timestamp, sequence);
+		for (int y = 0; y < m_height; y++)
+		{
+			uint8_t* runCount = out;
+			out += 2;
+			uint16_t written = 0;
+			for (uint32_t i = m_rowStarts[y]; i < m_rowStarts[y + 1]; i++)
+			{
+				const Run& run = m_runs[i];
+				if ((indexMask >> run.index) & 1)
+				{
+					out = SkeletonWire::WriteU16(out, run.x);
+					out = SkeletonWire::WriteU16(out, run.length);
+					out = SkeletonWire::WriteU8(out, run.index);
+					written++;
+				}
+			}
+			SkeletonWire::WriteU16(runCount, written);
+		}
+		return SkeletonWire::FinishFrame(buffer, out);
+	}
+
+	size_t SilhouetteEncoder::WriteContourFrame(uint8_t* buffer, uint32_t indexMask, uint64_t timestamp, uint32_t sequence)
+	{
+		if (!m_traced)
+		{
+			TraceContours();
+			m_traced = true;
+		}
+
+		uint8_t* out = WriteSilhouetteHeader(buffer, SkeletonWire::MessageType::SilhouetteContours, m_width, m_height,
+			m_bodyIds, m_bodyCount, timestamp, sequence);
+		const uint8_t* limit = buffer + MaxSilhouetteFrameSize(m_width, m_height);
+		uint8_t* contourCount = out;
+		out += 2;
+		uint16_t written = 0;
+		for (const TracedContour& contour : m_contours)
+		{
+			if (((indexMask >> contour.index) & 1) == 0 || contour.count > UINT16_MAX)
+			{
+				continue;
+			}
+			if (written == UINT16_MAX || ContourPrefixSize + 4 * contour.count > static_cast<size_t>(limit - out))
+			{
+				break;
+			}
+			out = SkeletonWire::WriteU8(out, contour.index);
+			out = SkeletonWire::WriteU16(out, static_cast<uint16_t>(contour.count));
+			for (size_t i = contour.first; i < contour.first + contour.count; i++)
+			{
+				out = SkeletonWire::WriteU16(out, m_points[i].x);
+				out = SkeletonWire::WriteU16(out, m_points[i].y);
+			}
+			written++;
+		}
+		SkeletonWire::WriteU16(contourCount, written);
+		return SkeletonWire::FinishFrame(buffer, out);
+	}
+
+	uint32_t SilhouetteEncoder::FindRoot(uint32_t run)
+	{
+		while (m_parents[run] != run)
+		{
+			m_parents[run] = m_parents[m_parents[run]];
+			run = m_parents[run];
+		}
+		return run;
+	}
+
+	bool SilhouetteEncoder::IsBody(int x, int y, uint8_t index) const
+	{
+		return x >= 0 && y >= 0 && x < m_width && y < m_height &&
+			m_map[static_cast<size_t>(y) * static_cast<size_t>(m_width) + static_cast<size_t>(x)] == index;
+	}
+
+	void SilhouetteEncoder::TraceContours()
+	{
+		m_contours.clear();
+		m_points.clear();
+
+		m_map.assign(static_cast<size_t>(m_width) * static_cast<size_t>(m_height), Background);
+		for (int y = 0; y < m_height; y++)
+		{
+			uint8_t* row = m_map.data() + static_cast<size_t>(y) * static_cast<size_t>(m_width);
+			for (uint32_t i = m_rowStarts[y]; i < m_rowStarts[y + 1]; i++)
+			{
+				memset(row + m_runs[i].x, m_runs[i].index, m_runs[i].length);
+			}
+		}
+
+		// Join runs of the same body that touch a run of the row above, diagonals included
+		m_parents.resize(m_runs.size());
+		std::iota(m_parents.begin(), m_parents.end(), 0u);
+		for (int y = 1; y < m_height; y++)
+		{
+			uint32_t above = m_rowStarts[y - 1];
+			for (uint32_t i = m_rowStarts[y]; i < m_rowStarts[y + 1]; i++)
+			{
+				const Run& run = m_runs[i];
+				while (above < m_rowStarts[y] && m_runs[above].x + m_runs[above].length < run.x)
+				{
+					above++;
+				}
+				for (uint32_t j = above; j < m_rowStarts[y] && m_runs[j].x <= run.x + run.length; j++)
+				{
+					if (m_runs[j].index == run.index)
+					{
+						uint32_t a = FindRoot(i);
+						uint32_t b = FindRoot(j);
+						m_parents[std::max(a, b)] = std::min(a, b);
+					}
+				}
+			}
+		}
+
+		m_pixels.assign(m_runs.size(), 0);
+		for (uint32_t i = 0; i < m_runs.size(); i++)
+		{
+			m_pixels[FindRoot(i)] += m_runs[i].length;
+		}
+
+		// A component's first run in scan order starts at its top-left pixel, which lies on its outer border
+		for (int y = 0; y < m_height; y++)
+		{
+			for (uint32_t i = m_rowStarts[y]; i < m_rowStarts[y + 1]; i++)
+			{
+				uint32_t root = FindRoot(i);
+				if (m_pixels[root] >= MinContourPixels)
+				{
+					TraceComponent(m_runs[i].x, y, m_runs[i].index, m_pixels[root]);
+					m_pixels[root] = 0;
+				}
+			}
+		}
+	}
+
+	void SilhouetteEncoder::TraceComponent(int startX, int startY, uint8_t index, size_t pixels)
+	{
+		m_traceBuffer.clear();
+		m_traceBuffer.push_back({ static_cast<uint16_t>(startX), static_cast<uint16_t>(startY) });
+
+		// Moore neighbour tracing, ended by Jacob's criterion: back at the start about to
+		// take the first step again. Nothing lies above or left of the start pixel.
+		int x = startX;
+		int y = startY;
+		int backtrack = West;
+		int firstDirection = -1;
+		for (size_t step = 0; step < 4 * pixels + 8; step++)
+		{
+			int direction = -1;
+			for (int i = 1; i <= 8; i++)
+			{
+				int candidate = (backtrack + i) & 7;
+				if (IsBody(x + NeighbourX[candidate], y + NeighbourY[candidate], index))
+				{
+					direction = candidate;
+					break;
+				}
+			}
+			if (direction < 0)
+			{
+				break;
+			}
+			if (x == startX && y == startY)
+			{
+				if (firstDirection < 0)
+				{
+					firstDirection = direction;
+				}
+				else if (direction == firstDirection)
+				{
+					break;
+				}
+			}
+
+			// The next search starts after the last neighbour found empty, seen from the new pixel
+			int previous = (direction + 7) & 7;
+			int offsetX = NeighbourX[previous] - NeighbourX[direction];
+			int offsetY = NeighbourY[previous] - NeighbourY[direction];
+			backtrack = DirectionOf[(offsetY + 1) * 3 + offsetX + 1];
+			x += NeighbourX[direction];
+			y += NeighbourY[direction];
+			m_traceBuffer.push_back({ static_cast<uint16_t>(x), static_cast<uint16_t>(y) });
+		}
+		if (m_traceBuffer.size() > 1 && m_traceBuffer.back().x == startX && m_traceBuffer.back().y == startY)
+		{
+			m_traceBuffer.pop_back();
+		}
+
+		size_t first = m_points.size();
+		Simplify();
+		m_contours.push_back({ index, first, m_points.size() - first });
+	}
+
+	void SilhouetteEncoder::Simplify()
+	{
+		// Douglas-Peucker on the closed outline: split at the point farthest from the
+		// start, then keep splitting every span whose farthest point is off by more
+		// than the tolerance. Index count stands for the start point closing the loop.
+		size_t count = m_traceBuffer.size();
+		if (count <= 3)
+		{
+			m_points.insert(m_points.end(), m_traceBuffer.begin(), m_traceBuffer.end());
+			return;
+		}
+
+		const ContourPoint* trace = m_traceBuffer.data();
+		size_t farthest = 0;
+		int64_t farthestDistance = -1;
+		for (size_t i = 1; i < count; i++)
+		{
+			int64_t distance = ScaledLineDistance(trace[i], trace[0], trace[0]);
+			if (distance > farthestDistance)
+			{
+				farthestDistance = distance;
+				farthest = i;
+			}
+		}
+
+		m_keep.assign(count, 0);
+		m_keep[0] = 1;
+		m_keep[farthest] = 1;
+		m_spans.clear();
+		m_spans.push_back({ 0, farthest });
+		m_spans.push_back({ farthest, count });
+		double toleranceSquared = static_cast<double>(m_tolerance) * m_tolerance;
+		while (!m_spans.empty())
+		{
+			std::pair<size_t, size_t> span = m_spans.back();
+			m_spans.pop_back();
+			const ContourPoint& a = trace[span.first];
+			const ContourPoint& b = trace[span.second % count];
+			int64_t dx = static_cast<int64_t>(b.x) - a.x;
+			int64_t dy = static_cast<int64_t>(b.y) - a.y;
+			int64_t lengthSquared = std::max<int64_t>(dx * dx + dy * dy, 1);
+			size_t split = 0;
+			int64_t splitDistance = static_cast<int64_t>(toleranceSquared * static_cast<double>(lengthSquared));
+			for (size_t i = span.first + 1; i < span.second; i++)
+			{
+				int64_t distance = ScaledLineDistance(trace[i], a, b);
+				if (distance > splitDistance)
+				{
+					splitDistance = distance;
+					split = i;
+				}
+			}
+			if (split != 0)
+			{
+				m_keep[split] = 1;
+				m_spans.push_back({ span.first, split });
+				m_spans.push_back({ split, span.second });
+			}
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (m_keep[i])
+			{
+				m_points.push_back(trace[i]);
+			}
+		}
+	}
+
+	bool ReadRunFrame(const uint8_t* data, size_t size, std::vector<uint8_t>& map, int& width, int& height,
+		std::vector<uint32_t>& bodyIds, uint64_t& timestamp)
+	{
+		const uint8_t* in;
+		const uint8_t* end;
+		if (!ReadSilhouetteHeader(data, size, SkeletonWire::MessageType::SilhouetteRuns, width, height, bodyIds, timestamp, in, end))
+		{
+			return false;
+		}
+
+		map.assign(static_cast<size_t>(width) * static_cast<size_t>(height), Background);
+		for (int y = 0; y < height; y++)
+		{
+			if (end - in < 2)
+			{
+				return false;
+			}
+			size_t runCount = SkeletonWire::ReadU16(in);
+			in += 2;
+			if (static_cast<size_t>(end - in) < runCount * RunSize)
+			{
+				return false;
+			}
+			uint8_t* row = map.data() + static_cast<size_t>(y) * static_cast<size_t>(width);
+			for (size_t i = 0; i < runCount; i++, in += RunSize)
+			{
+				size_t x = SkeletonWire::ReadU16(in);
+				size_t length = SkeletonWire::ReadU16(in + 2);
+				uint8_t index = in[4];
+				if (x + length > static_cast<size_t>(width) || index >= bodyIds.size())
+				{
+					return false;
+				}
+				memset(row + x, index, length);
+			}
+		}
+		return in == end;
+	}
+
+	bool ReadContourFrame(const uint8_t* data, size_t size, std::vector<Contour>& contours, int& width, int& height,
+		uint64_t& timestamp)
+	{
+		const uint8_t* in;
+		const uint8_t* end;
+		std::vector<uint32_t> bodyIds;
+		if (!ReadSilhouetteHeader(data, size, SkeletonWire::MessageType::SilhouetteContours, width, height, bodyIds, timestamp, in, end) ||
+			end - in < 2)
+		{
+			return false;
+		}
+
+		size_t contourCount = SkeletonWire::ReadU16(in);
+		in += 2;
+		contours.resize(contourCount);
+		for (Contour& contour : contours)
+		{
+			if (static_cast<size_t>(end - in) < ContourPrefixSize || in[0] >= bodyIds.size())
+			{
+				return false;
+			}
+			contour.bodyId = bodyIds[in[0]];
+			size_t pointCount = SkeletonWire::ReadU16(in + 1);
+			in += ContourPrefixSize;
+			if (static_cast<size_t>(end - in) < 4 * pointCount)
+			{
+				return false;
+			}
+			contour.points.resize(pointCount);
+			for (ContourPoint& point : contour.points)
+			{
+				point.x = SkeletonWire::ReadU16(in);
+				point.y = SkeletonWire::ReadU16(in + 2);
+				in += 4;
+				if (point.x >= width || point.y >= height)
+				{
+					return false;
+				}
+			}
+		}
+		return in == end;
+	}
+}
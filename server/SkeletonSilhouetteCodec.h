@@ -0,0 +1,120 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "SkeletonWireFormat.h"
+
+// Silhouettes from the tracker's body index map, as run-length rows (SkeletonWire
+// message type 8) or as simplified outline polygons per body (message type 9).
+//
+// A map is scanned once into runs of equal body index, 16 pixels at a time where SSE2
+// is available, and every frame written for it is made from those runs. Outlines are
+// traced only when a contour frame is asked for: runs that touch (8-connected) form a
+// component, the outer border of each component is followed from its top-left pixel
+// (Moore neighbour tracing) and thinned with Douglas-Peucker. Holes are not traced.
+namespace SkeletonSilhouette
+{
+    // Value of pixels that belong to no body, K4ABT_BODY_INDEX_MAP_BACKGROUND
+    constexpr uint8_t Background = 255;
+
+    constexpr size_t SilhouetteHeaderSize = SkeletonWire::FrameHeaderSize + 5;
+    constexpr size_t RunSize = 5;
+    constexpr size_t ContourPrefixSize = 3;
+
+    // Outlines stay within this many pixels of the traced border
+    constexpr float DefaultContourTolerance = 1.0f;
+
+    // Components of fewer pixels are left out of contour frames, run frames keep them
+    constexpr size_t MinContourPixels = 16;
+
+    // Every pixel its own run is the worst case for run frames; contour frames are
+    // cut short rather than grow beyond the same size
+    constexpr size_t MaxSilhouetteFrameSize(size_t width, size_t height)
+    {
+        return SilhouetteHeaderSize + 4 * SkeletonWire::MaxBodies + 2 + height * (2 + RunSize * width);
+    }
+
+    struct ContourPoint
+    {
+        uint16_t x;
+        uint16_t y;
+    };
+
+    struct Contour
+    {
+        uint32_t bodyId;
+        std::vector<ContourPoint> points;
+    };
+
+    class SilhouetteEncoder
+    {
+    public:
+        explicit SilhouetteEncoder(float contourTolerance = DefaultContourTolerance);
+
+        // Scan a body index map. Index i of the map is body bodyIds[i]; indices from
+        // bodyCount or MaxBodies on are taken as background. The map is not kept.
+        void SetMap(const uint8_t* map, int width, int height, const uint32_t* bodyIds, size_t bodyCount);
+
+        // Frames with the pixels of the body indices whose bit is set in indexMask.
+        // buffer must hold MaxSilhouetteFrameSize(width, height) bytes. Returns the
+        // number of bytes written.
+        size_t WriteRunFrame(uint8_t* buffer, uint32_t indexMask, uint64_t timestamp, uint32_t sequence) const;
+        size_t WriteContourFrame(uint8_t* buffer, uint32_t indexMask, uint64_t timestamp, uint32_t sequence);
+
+        size_t GetRunCount() const { return m_runs.size(); }
+
+    private:
+        struct Run
+        {
+            uint16_t x;
+            uint16_t length;
+            uint8_t index;
+        };
+
+        struct TracedContour
+        {
+            uint8_t index;
+            size_t first;
+            size_t count;
+        };
+
+        void TraceContours();
+        void TraceComponent(int startX, int startY, uint8_t index, size_t pixels);
+        void Simplify();
+        bool IsBody(int x, int y, uint8_t index) const;
+        uint32_t FindRoot(uint32_t run);
+
+        float m_tolerance;
+        int m_width;
+        int m_height;
+        uint32_t m_bodyIds[SkeletonWire::MaxBodies];
+        size_t m_bodyCount;
+
+        // Runs in scan order, those of row y from m_rowStarts[y] to m_rowStarts[y + 1]
+        std::vector<Run> m_runs;
+        std::vector<uint32_t> m_rowStarts;
+
+        // Contour tracing state, kept across frames so tracing does not allocate.
+        // The map is rebuilt from the runs for the pixel lookups of the tracer.
+        std::vector<uint8_t> m_map;
+        bool m_traced;
+        std::vector<uint32_t> m_parents;
+        std::vector<uint32_t> m_pixels;
+        std::vector<ContourPoint> m_traceBuffer;
+        std::vector<uint8_t> m_keep;
+        std::vector<std::pair<size_t, size_t>> m_spans;
+        std::vector<ContourPoint> m_points;
+        std::vector<TracedContour> m_contours;
+    };
+
+    bool ReadRunFrame(const uint8_t* data, size_t size, std::vector<uint8_t>& map, int& width, int& height,
+        std::vector<uint32_t>& bodyIds, uint64_t& timestamp);
+
+    bool ReadContourFrame(const uint8_t* data, size_t size, std::vector<Contour>& contours, int& width, int& height,
+        uint64_t& timestamp);
+}
@@ -1,17 +1,105 @@
 // Licensed under the MIT License.
 
 #include "SkeletonSocketSender.h"
-#include <nlohmann/json.hpp>
+#include "SkeletonJsonWriter.h"
+#include "SkeletonWebSocket.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 
-using json = nlohmann::json;
+namespace
+{
+	// Room for the largest frame in any encoding, and for the timing message behind it,
+	// each with a WebSocket header in front
+	constexpr size_t FrameBufferSize =
+		SkeletonWebSocket::MaxFrameHeaderSize + std::max(SkeletonWire::MaxBodiesFrameSize, SkeletonJson::MaxBodiesSize(SkeletonWire::MaxBodies) + 1) +
+		SkeletonWebSocket::MaxFrameHeaderSize + std::max(SkeletonWire::TimingFrameSize, SkeletonJson::MaxTimingSize + 1);
+
+	// What the precision levels the rate controller picks for slow links mean, from
+	// level 1 on. DELTA leaves out smaller changes, JSON rounds to binary fractions
+	// that print with a few digits instead of up to 17.
+	struct Precision
+	{
+		float deltaPositionToleranceMm;
+		float deltaOrientationTolerance;
+		float jsonPositionStepMm;
+		float jsonOrientationStep;
+	};
+
+	const Precision ReducedPrecisions[] = {
+		{ 2.0f, 0.01f, 1.0f, 1.0f / 256.0f },
+		{ 5.0f, 0.02f, 4.0f, 1.0f / 64.0f },
+	};
+
+	const Precision& GetReducedPrecision(uint8_t precisionLevel)
+	{
+		size_t index = std::min<size_t>(precisionLevel, std::size(ReducedPrecisions)) - 1;
+		return ReducedPrecisions[index];
+	}
+
+	void RoundBody(k4abt_body_t& body, const Precision& precision)
+	{
+		for (k4abt_joint_t& joint : body.skeleton.joints)
+		{
+			for (float& value : joint.position.v)
+			{
+				value = std::round(value / precision.jsonPositionStepMm) * precision.jsonPositionStepMm;
+			}
+			for (float& value : joint.orientation.v)
+			{
+				value = std::round(value / precision.jsonOrientationStep) * precision.jsonOrientationStep;
+			}
+		}
+	}
 
-SkeletonSocketSender::SkeletonSocketSender(const std::string& host, int port)
+	void RecordInterval(SkeletonLatency::Histogram& histogram, uint64_t start, uint64_t end)
+	{
+		// Stages the caller did not stamp are left out
+		if (start != 0 && end >= start)
+		{
+			histogram.Record(end - start);
+		}
+	}
+}
+
+SkeletonSocketSender::SkeletonSocketSender(const std::string& host, int port, SkeletonEncoding encoding, SenderMode mode)
 	: m_host(host)
 	, m_port(port)
+	, m_mode(mode)
 	, m_socket(INVALID_SOCKET)
 	, m_initialized(false)
 	, m_connected(false)
+	, m_encoding(encoding)
+	, m_sequence(0)
+	, m_framePool(FrameBufferSize)
+	, m_subscriptionsVersion(UINT64_MAX)
+	, m_forceKeyframe(false)
+	, m_selectedBodies()
+	, m_serverAddr()
+	, m_connectRunning(false)
+	, m_consumerSubscribed(false)
+	, m_consumerSubscriptionVersion(0)
+	, m_echoPending(false)
+	, m_sendRing(false)
+	, m_adaptiveRate(false)
+	, m_deadReckoningErrorMm(0.0f)
+	, m_heartbeatMs(1000)
+	, m_overflowPolicy(QueueOverflowPolicy::DropOldest)
+	, m_asyncRunning(false)
+	, m_ioThreadWaiting(false)
+	, m_producerWaiting(false)
+	, m_framesQueued(0)
+	, m_framesSent(0)
+	, m_framesDropped(0)
+	, m_framesSuppressed(0)
+	, m_floatFrameBytes(0)
+	, m_bytesSerialized(0)
+	, m_lastLatencyUsec(0)
+	, m_maxLatencyUsec(0)
+	, m_totalLatencyUsec(0)
+	, m_latencySamples(0)
 {
 }
 
@@ -38,137 +126,928 @@ bool SkeletonSocketSender::Initialize()
 
 	m_initialized = true;
 
-	// Create socket
-	m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (m_socket == INVALID_SOCKET)
+	if (m_mode == SenderMode::Listen || m_mode == SenderMode::WebSocket)
 	{
-		printf("Socket creation failed with error: %ld\n", WSAGetLastError());
-		WSACleanup();
-		m_initialized = false;
-		return false;
+		m_server = std::make_unique<SkeletonFanoutServer>(4, m_mode == SenderMode::WebSocket, m_sendRing);
+		m_server->SetEncoding(m_encoding);
+		m_server->EnableRateControl(m_adaptiveRate);
+		if (!m_server->Start(m_host, m_port))
+		{
+			m_server.reset();
+			WSACleanup();
+			m_initialized = false;
+			return false;
+		}
+
+		m_connected = true;
+		return true;
+	}
+
+	if (m_mode == SenderMode::Udp)
+	{
+		std::vector<std::string> destinations;
+		size_t start = 0;
+		while (start <= m_host.size())
+		{
+			size_t end = m_host.find(',', start);
+			if (end == std::string::npos)
+			{
+				end = m_host.size();
+			}
+			if (end > start)
+			{
+				destinations.push_back(m_host.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+
+		m_udp = std::make_unique<SkeletonUdpTransport>();
+		if (!m_udp->Open(destinations, m_port))
+		{
+			m_udp.reset();
+			WSACleanup();
+			m_initialized = false;
+			return false;
+		}
+
+		// Datagrams must be self-contained, which needs the sequence number of the binary frames
+		if (m_encoding == SkeletonEncoding::Json)
+		{
+			printf("UDP transport sends binary frames, ignoring the JSON encoding\n");
+			m_encoding = SkeletonEncoding::Binary;
+		}
+
+		m_connected = true;
+		return true;
 	}
 
 	// Setup server address structure
-	sockaddr_in serverAddr;
-	serverAddr.sin_family = AF_INET;
-	serverAddr.sin_port = htons(m_port);
+	m_serverAddr.sin_family = AF_INET;
+	m_serverAddr.sin_port = htons(m_port);
 
 	// Convert IP address from string to binary form
-	if (inet_pton(AF_INET, m_host.c_str(), &serverAddr.sin_addr) <= 0)
+	if (inet_pton(AF_INET, m_host.c_str(), &m_serverAddr.sin_addr) <= 0)
 	{
 		printf("Invalid address / Address not supported\n");
-		closesocket(m_socket);
-		m_socket = INVALID_SOCKET;
 		WSACleanup();
 		m_initialized = false;
 		return false;
 	}
 
-	// Connect to server
-	result = connect(m_socket, (sockaddr*)&serverAddr, sizeof(serverAddr));
+	// Connect on a background thread so a consumer that is not up yet, or restarts
+	// later, never stalls the frame loop
+	m_connectRunning = true;
+	m_connectThread = std::thread(&SkeletonSocketSender::ConnectLoop, this);
+	printf("Streaming skeletons to %s:%d whenever it is reachable\n", m_host.c_str(), m_port);
+	return true;
+}
+
+void SkeletonSocketSender::ConnectLoop()
+{
+	const auto initialBackoff = std::chrono::milliseconds(250);
+	const auto maxBackoff = std::chrono::seconds(8);
+	std::chrono::milliseconds backoff = initialBackoff;
+	bool reportFailure = true;
+	bool consumerGone = false;
+
+	while (m_connectRunning)
+	{
+		if (m_connected)
+		{
+			// Pick up subscription changes until the consumer hangs up. Shutting the
+			// socket down makes the next send fail, which hands it back to this thread.
+			if (!consumerGone && !WatchConsumer(100))
+			{
+				shutdown(m_socket, SD_BOTH);
+				consumerGone = true;
+			}
+			if (consumerGone)
+			{
+				// Sleep until a send fails or Close is called
+				std::unique_lock<std::mutex> lock(m_connectMutex);
+				m_connectCondition.wait(lock, [this] { return !m_connected || !m_connectRunning; });
+			}
+			continue;
+		}
+
+		if (m_socket != INVALID_SOCKET)
+		{
+			closesocket(m_socket);
+			m_socket = INVALID_SOCKET;
+		}
+
+		SOCKET connectedSocket = ConnectWithTimeout();
+		if (connectedSocket != INVALID_SOCKET)
+		{
+			m_socket = connectedSocket;
+			if (ReadHandshake())
+			{
+				backoff = initialBackoff;
+				reportFailure = true;
+				consumerGone = false;
+
+				// The consumer starts from scratch, delta streams need a keyframe first
+				m_forceKeyframe = true;
+				m_connected = true;
+				printf("Connected to server at %s:%d\n", m_host.c_str(), m_port);
+				continue;
+			}
+		}
+
+		// Only report the first failure of a series, a consumer may stay away for long
+		if (reportFailure && m_connectRunning)
+		{
+			printf("Connection to %s:%d failed, retrying in the background\n", m_host.c_str(), m_port);
+			reportFailure = false;
+		}
+
+		std::unique_lock<std::mutex> lock(m_connectMutex);
+		m_connectCondition.wait_for(lock, backoff, [this] { return !m_connectRunning; });
+		backoff = std::min<std::chrono::milliseconds>(backoff * 2, maxBackoff);
+	}
+}
+
+SOCKET SkeletonSocketSender::ConnectWithTimeout()
+{
+	const int timeoutMs = 2000;
+	const int sliceMs = 100;
+
+	SOCKET connectSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (connectSocket == INVALID_SOCKET)
+	{
+		return INVALID_SOCKET;
+	}
+
+	u_long nonBlocking = 1;
+	ioctlsocket(connectSocket, FIONBIO, &nonBlocking);
+
+	int result = connect(connectSocket, (sockaddr*)&m_serverAddr, sizeof(m_serverAddr));
+	if (result == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK && WSAGetLastError() != WSAEINPROGRESS)
+	{
+		closesocket(connectSocket);
+		return INVALID_SOCKET;
+	}
+
+	// Wait in short slices so Close never waits for a full timeout
+	for (int waited = 0; result == SOCKET_ERROR && waited < timeoutMs && m_connectRunning; waited += sliceMs)
+	{
+		fd_set writeSet;
+		fd_set errorSet;
+		FD_ZERO(&writeSet);
+		FD_ZERO(&errorSet);
+		FD_SET(connectSocket, &writeSet);
+		FD_SET(connectSocket, &errorSet);
+		timeval timeout = { 0, sliceMs * 1000 };
+
+		int ready = select((int)connectSocket + 1, nullptr, &writeSet, &errorSet, &timeout);
+		if (ready == SOCKET_ERROR)
+		{
+			break;
+		}
+		if (ready > 0)
+		{
+			int error = 0;
+			socklen_t errorLength = sizeof(error);
+			getsockopt(connectSocket, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLength);
+			if (error == 0 && FD_ISSET(connectSocket, &writeSet))
+			{
+				result = 0;
+			}
+			break;
+		}
+	}
+
 	if (result == SOCKET_ERROR)
 	{
-		printf("Connection failed with error: %ld\n", WSAGetLastError());
-		printf("Make sure the server is running at %s:%d\n", m_host.c_str(), m_port);
-		closesocket(m_socket);
-		m_socket = INVALID_SOCKET;
-		WSACleanup();
-		m_initialized = false;
+		closesocket(connectSocket);
+		return INVALID_SOCKET;
+	}
+
+	// Frames are written with blocking sends once connected
+	u_long blocking = 0;
+	ioctlsocket(connectSocket, FIONBIO, &blocking);
+	return connectSocket;
+}
+
+bool SkeletonSocketSender::ReadHandshake()
+{
+	// Every consumer starts with the default subscription
+	m_consumerReader = SkeletonSubscriptionReader();
+	m_consumerSubscribed = false;
+	{
+		std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+		m_consumerSubscription = SkeletonSubscription();
+		m_pendingEchoes.clear();
+		m_echoPending = false;
+	}
+	m_consumerSubscriptionVersion++;
+
+	// Give it a moment to ask for something else before the first frame goes out
+	auto deadline = std::chrono::steady_clock::now() + SkeletonFanoutServer::HandshakeTimeout;
+	while (!m_consumerSubscribed && m_connectRunning)
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		if (remaining.count() <= 0)
+		{
+			break;
+		}
+		if (!WatchConsumer(static_cast<int>(remaining.count())))
+		{
+			return false;
+		}
+	}
+	m_consumerSubscribed = true;
+	return true;
+}
+
+bool SkeletonSocketSender::WatchConsumer(int timeoutMs)
+{
+	WSAPOLLFD pollFd = {};
+	pollFd.fd = m_socket;
+	pollFd.events = POLLRDNORM;
+	int ready = WSAPoll(&pollFd, 1, timeoutMs);
+	if (ready <= 0)
+	{
+		return ready == 0;
+	}
+
+	char buffer[256];
+	int result = recv(m_socket, buffer, sizeof(buffer), 0);
+	if (result <= 0)
+	{
+		return false;
+	}
+	uint64_t receiveTime = SkeletonLatency::HostTimeUsec();
+
+	SkeletonSubscription subscription;
+	bool updated;
+	if (!m_consumerReader.Append(buffer, static_cast<size_t>(result), subscription, updated))
+	{
+		printf("Consumer sent an overlong subscription\n");
 		return false;
 	}
+	if (updated)
+	{
+		std::lock_guard<std::mutex> lock(m_subscriptionMutex);
 
-	m_connected = true;
-	printf("Connected to server at %s:%d\n", m_host.c_str(), m_port);
+		// Receivers parse the stream with the encoding they asked for first
+		if (m_consumerSubscribed)
+		{
+			subscription.hasEncoding = m_consumerSubscription.hasEncoding;
+			subscription.encoding = m_consumerSubscription.encoding;
+		}
+		m_consumerSubscription = subscription;
+		m_consumerSubscribed = true;
+		m_consumerSubscriptionVersion++;
+	}
+
+	// Pings are answered by the sending thread, which owns the socket for writing
+	uint64_t pingTime;
+	while (m_consumerReader.TakePing(pingTime))
+	{
+		std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+		if (m_pendingEchoes.size() < SkeletonSubscriptionReader::MaxPendingPings)
+		{
+			m_pendingEchoes.push_back({ pingTime, receiveTime });
+			m_echoPending = true;
+		}
+	}
 	return true;
 }
 
-bool SkeletonSocketSender::SendSkeletonData(const k4abt_body_t& body, uint64_t timestamp)
+void SkeletonSocketSender::ConnectionLost()
+{
+	std::lock_guard<std::mutex> lock(m_connectMutex);
+	m_connected = false;
+	m_connectCondition.notify_one();
+}
+
+bool SkeletonSocketSender::SendSkeletonData(const k4abt_body_t& body, uint64_t timestamp, const SkeletonWire::StageTimes& times)
 {
-	if (!m_connected || m_socket == INVALID_SOCKET)
+	return Send(&body, 1, false, timestamp, times);
+}
+
+bool SkeletonSocketSender::SendSkeletonData(const k4abt_body_t* bodies, size_t count, uint64_t timestamp,
+	const SkeletonWire::StageTimes& times)
+{
+	return Send(bodies, std::min(count, SkeletonWire::MaxBodies), false, timestamp, times);
+}
+
+bool SkeletonSocketSender::SendBodies(const k4abt_body_t* bodies, size_t count, uint64_t timestamp,
+	const SkeletonWire::StageTimes& times)
+{
+	return Send(bodies, std::min(count, SkeletonWire::MaxBodies), true, timestamp, times);
+}
+
+bool SkeletonSocketSender::Send(const k4abt_body_t* bodies, size_t count, bool multiBody, uint64_t timestamp,
+	const SkeletonWire::StageTimes& times)
+{
+	if (!m_connected)
 	{
 		return false;
 	}
 
-	// Create JSON from skeleton
-	std::string jsonData = CreateJsonFromSkeleton(body, timestamp);
+	// Nobody to serialize for
+	if (m_server && m_server->GetClientCount() == 0)
+	{
+		return true;
+	}
 
-	// Add newline delimiter for easier parsing on receiver side
-	jsonData += "\n";
+	if (m_asyncRunning)
+	{
+		return EnqueueFrame(bodies, count, multiBody, timestamp, times);
+	}
 
-	// Send data
-	int result = send(m_socket, jsonData.c_str(), (int)jsonData.length(), 0);
-	if (result == SOCKET_ERROR)
+	if (!WriteAndSend(bodies, count, multiBody, timestamp, times))
 	{
-		printf("Send failed with error: %ld\n", WSAGetLastError());
-		m_connected = false;
 		return false;
 	}
 
+	m_framesSent++;
 	return true;
 }
 
-void SkeletonSocketSender::Close()
+bool SkeletonSocketSender::WriteAndSend(const k4abt_body_t* bodies, size_t count, bool multiBody, uint64_t timestamp,
+	SkeletonWire::StageTimes times)
 {
-	if (m_socket != INVALID_SOCKET)
+	uint32_t sequence = m_sequence++;
+
+	times.serialize = SkeletonLatency::HostTimeUsec();
+	RecordInterval(m_trackerLatency, times.capture, times.pop);
+	RecordInterval(m_loopLatency, times.pop, times.serialize);
+
+	// The connect-mode consumer's echoes go out ahead of the frame
+	if (m_echoPending && !SendEchoes())
 	{
-		closesocket(m_socket);
-		m_socket = INVALID_SOCKET;
+		return false;
 	}
 
-	if (m_initialized)
+	UpdateStreams();
+	if (m_forceKeyframe.exchange(false))
 	{
-		WSACleanup();
-		m_initialized = false;
+		for (auto& stream : m_streams)
+		{
+			stream->deltaEncoder.ForceKeyframe();
+		}
 	}
 
-	m_connected = false;
+	// Serialized once per distinct subscription, never once per consumer
+	bool sent = true;
+	for (auto& stream : m_streams)
+	{
+		sent = WriteStream(*stream, bodies, count, multiBody, timestamp, sequence, times) && sent;
+	}
+	return sent;
 }
 
-bool SkeletonSocketSender::IsConnected() const
+bool SkeletonSocketSender::SendEchoes()
 {
-	return m_connected;
+	std::vector<PendingEcho> echoes;
+	SkeletonEncoding encoding;
+	{
+		std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+		echoes.swap(m_pendingEchoes);
+		m_echoPending = false;
+		encoding = m_consumerSubscription.GetEffectiveEncoding(m_encoding);
+	}
+
+	for (const PendingEcho& echo : echoes)
+	{
+		uint8_t buffer[std::max(SkeletonWire::EchoFrameSize, SkeletonJson::MaxEchoSize + 1)];
+		uint64_t sendTime = SkeletonLatency::HostTimeUsec();
+		size_t size;
+		if (encoding == SkeletonEncoding::Json)
+		{
+			size = SkeletonJson::WriteEcho(reinterpret_cast<char*>(buffer), echo.pingTime, echo.receiveTime, sendTime);
+			buffer[size++] = '\n';
+		}
+		else
+		{
+			size = SkeletonWire::WriteEchoFrame(buffer, echo.pingTime, echo.receiveTime, sendTime);
+		}
+		if (!SendBuffer(reinterpret_cast<const char*>(buffer), size))
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
-std::string SkeletonSocketSender::CreateJsonFromSkeleton(const k4abt_body_t& body, uint64_t timestamp)
+bool SkeletonSocketSender::WriteStream(Stream& stream, const k4abt_body_t* bodies, size_t count, bool multiBody,
+	uint64_t timestamp, uint32_t sequence, SkeletonWire::StageTimes times)
 {
-	json jsonData;
+	const SkeletonSubscription& subscription = stream.subscription;
 
-	jsonData["body_id"] = body.id;
-	jsonData["timestamp"] = timestamp;
+	// Decimate by device time, allowing for a little jitter. A timestamp far before
+	// the due time means playback started over.
+	uint64_t interval = subscription.maxRateHz > 0.0f ? static_cast<uint64_t>(1000000.0 / subscription.maxRateHz) : 0;
+	if (interval > 0 && stream.started && timestamp + interval / 8 < stream.nextFrameTimestamp &&
+		stream.nextFrameTimestamp <= timestamp + interval)
+	{
+		return true;
+	}
 
-	// Add all joints
-	json jointsArray = json::array();
-	for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+	// Bodies nobody asked for are never serialized
+	if (subscription.bodyIdCount > 0)
 	{
-		const k4a_float3_t& pos = body.skeleton.joints[joint].position;
-		const k4a_quaternion_t& ori = body.skeleton.joints[joint].orientation;
-		k4abt_joint_confidence_level_t confidence = body.skeleton.joints[joint].confidence_level;
+		size_t selected = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (subscription.IncludesBody(bodies[i].id))
+			{
+				m_selectedBodies[selected++] = bodies[i];
+			}
+		}
+		bodies = m_selectedBodies;
+		count = selected;
+	}
 
-		json jointObj;
-		jointObj["joint"] = joint;
+	// Single-body frames carry the first body, and there may be none to send
+	if (!multiBody)
+	{
+		if (count == 0)
+		{
+			return true;
+		}
+		count = 1;
+	}
 
-		jointObj["position"] = {
-			{"x", pos.xyz.x},
-	   {"y", pos.xyz.y},
-   {"z", pos.xyz.z}
-		};
+	if (interval > 0)
+	{
+		bool onSchedule = stream.started && stream.nextFrameTimestamp + interval > timestamp &&
+			stream.nextFrameTimestamp <= timestamp + interval;
+		stream.nextFrameTimestamp = (onSchedule ? stream.nextFrameTimestamp : timestamp) + interval;
+		stream.started = true;
+	}
 
-		jointObj["orientation"] = {
-					{"w", ori.wxyz.w},
-					{"x", ori.wxyz.x},
-					{"y", ori.wxyz.y},
-					{"z", ori.wxyz.z}
-		};
+	// Rounded for links that cannot keep up, in a copy of the caller's bodies
+	SkeletonEncoding encoding = subscription.GetEffectiveEncoding(m_encoding);
+	if (encoding == SkeletonEncoding::Json && subscription.precisionLevel > 0)
+	{
+		if (bodies != m_selectedBodies)
+		{
+			std::copy(bodies, bodies + count, m_selectedBodies);
+			bodies = m_selectedBodies;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			RoundBody(m_selectedBodies[i], GetReducedPrecision(subscription.precisionLevel));
+		}
+	}
+
+	m_floatFrameBytes += multiBody ?
+		SkeletonWire::BodiesHeaderSize + count * (SkeletonWire::BodyRecordPrefixSize + SkeletonWire::SkeletonFrameSize - SkeletonWire::FrameHeaderSize) :
+		SkeletonWire::SkeletonFrameSize;
+
+	// Serialize once into a pooled buffer, every client of the stream sends from the same bytes.
+	// WebSocket frames get their header in the room left in front of the payload.
+	SharedFrame frame = m_framePool.Acquire();
+
+	bool webSocket = m_server && m_server->IsWebSocket();
+	frame->offset = webSocket ? SkeletonWebSocket::MaxFrameHeaderSize : 0;
+	uint8_t* buffer = frame->data.data() + frame->offset;
+	uint32_t jointMask = subscription.jointMask;
+	if (encoding == SkeletonEncoding::Binary)
+	{
+		// Fixed-layout frame written straight into the reusable send buffer
+		frame->size = multiBody ?
+			SkeletonWire::WriteBodiesFrame(buffer, SkeletonWire::MessageType::Skeleton, bodies, count, timestamp, sequence) :
+			SkeletonWire::WriteSkeletonFrame(buffer, bodies[0], timestamp, sequence);
+	}
+	else if (encoding == SkeletonEncoding::Quantized)
+	{
+		frame->size = multiBody ?
+			SkeletonWire::WriteBodiesFrame(buffer, SkeletonWire::MessageType::QuantizedSkeleton, bodies, count, timestamp, sequence) :
+			SkeletonWire::WriteQuantizedSkeletonFrame(buffer, bodies[0], timestamp, sequence);
+	}
+	else if (encoding == SkeletonEncoding::Delta)
+	{
+		frame->size = multiBody ?
+			stream.deltaEncoder.WriteBodies(buffer, bodies, count, timestamp, sequence) :
+			stream.deltaEncoder.Write(buffer, bodies[0], timestamp, sequence);
 
-		jointObj["confidence_level"] = static_cast<int>(confidence);
+		// Nothing drifted, the consumers' extrapolation is still close enough
+		if (frame->size == 0)
+		{
+			m_framesSuppressed++;
+			return true;
+		}
+	}
+	else
+	{
+		// Write JSON from skeleton into the same buffer, no intermediate json objects
+		char* jsonData = reinterpret_cast<char*>(buffer);
+		size_t length = multiBody ?
+			SkeletonJson::WriteBodies(jsonData, bodies, count, timestamp, jointMask) :
+			SkeletonJson::WriteSkeleton(jsonData, bodies[0], timestamp, jointMask);
 
-		jointsArray.push_back(jointObj);
+		// Add newline delimiter for easier parsing on receiver side, WebSocket messages delimit themselves
+		if (!webSocket)
+		{
+			jsonData[length++] = '\n';
+		}
+		frame->size = length;
 	}
 
-	jsonData["joints"] = jointsArray;
+	if (webSocket)
+	{
+		SkeletonWebSocket::Opcode opcode = encoding == SkeletonEncoding::Json ?
+			SkeletonWebSocket::Opcode::Text : SkeletonWebSocket::Opcode::Binary;
+		frame->offset -= SkeletonWebSocket::FrameHeaderSize(frame->size);
+		frame->size += SkeletonWebSocket::WriteFrameHeader(frame->data.data() + frame->offset, opcode, frame->size);
+	}
 
-	// Return compact JSON (no indentation for faster transmission)
-	return jsonData.dump();
+	// Stamped as late as possible, the timing message is written last and goes out with the frame
+	times.send = SkeletonLatency::HostTimeUsec();
+	RecordInterval(m_serializeLatency, times.serialize, times.send);
+	if (subscription.timing)
+	{
+		uint8_t* end = frame->data.data() + frame->offset + frame->size;
+		uint8_t* timing = webSocket ? end + SkeletonWebSocket::MaxFrameHeaderSize : end;
+		size_t timingSize;
+		if (encoding == SkeletonEncoding::Json)
+		{
+			timingSize = SkeletonJson::WriteTiming(reinterpret_cast<char*>(timing), times, timestamp);
+			if (!webSocket)
+			{
+				timing[timingSize++] = '\n';
+			}
+		}
+		else
+		{
+			timingSize = SkeletonWire::WriteTimingFrame(timing, times, timestamp, sequence);
+		}
+
+		if (webSocket)
+		{
+			// A message of its own, moved up against its header
+			SkeletonWebSocket::Opcode opcode = encoding == SkeletonEncoding::Json ?
+				SkeletonWebSocket::Opcode::Text : SkeletonWebSocket::Opcode::Binary;
+			size_t headerSize = SkeletonWebSocket::WriteFrameHeader(end, opcode, timingSize);
+			memmove(end + headerSize, timing, timingSize);
+			timingSize += headerSize;
+		}
+		frame->size += timingSize;
+	}
+
+	m_bytesSerialized += frame->size;
+
+	bool sent = true;
+	if (m_server)
+	{
+		m_server->Broadcast(frame, subscription);
+	}
+	else if (m_udp)
+	{
+		// Loss is expected and harmless here, never drop the transport over it
+		m_udp->SendToAll(frame->data.data() + frame->offset, frame->size);
+	}
+	else
+	{
+		sent = SendBuffer(reinterpret_cast<const char*>(frame->data.data() + frame->offset), frame->size);
+	}
+
+	uint64_t written = SkeletonLatency::HostTimeUsec();
+	RecordInterval(m_writeLatency, times.send, written);
+	RecordInterval(m_totalLatency, times.capture, written);
+	return sent;
+}
+
+void SkeletonSocketSender::UpdateStreams()
+{
+	uint64_t version = m_server ? m_server->GetSubscriptionsVersion() : m_consumerSubscriptionVersion.load();
+	if (version == m_subscriptionsVersion)
+	{
+		return;
+	}
+	m_subscriptionsVersion = version;
+
+	if (m_server)
+	{
+		m_server->GetSubscriptions(m_subscriptions);
+	}
+	else
+	{
+		// UDP destinations cannot subscribe and keep the default
+		std::lock_guard<std::mutex> lock(m_subscriptionMutex);
+		m_subscriptions.assign(1, m_consumerSubscription);
+	}
+
+	// Streams that are still wanted keep their rate schedule, the others go
+	std::vector<std::unique_ptr<Stream>> streams;
+	for (const SkeletonSubscription& subscription : m_subscriptions)
+	{
+		auto existing = std::find_if(m_streams.begin(), m_streams.end(),
+			[&](const std::unique_ptr<Stream>& stream) { return stream && stream->subscription == subscription; });
+
+		std::unique_ptr<Stream> stream;
+		if (existing != m_streams.end())
+		{
+			stream = std::move(*existing);
+		}
+		else
+		{
+			stream = std::make_unique<Stream>();
+			stream->subscription = subscription;
+			stream->deltaEncoder.SetJointMask(subscription.jointMask);
+			stream->deltaEncoder.SetDeadReckoning(m_deadReckoningErrorMm, m_heartbeatMs);
+			if (subscription.precisionLevel > 0)
+			{
+				const Precision& precision = GetReducedPrecision(subscription.precisionLevel);
+				stream->deltaEncoder.SetTolerance(precision.deltaPositionToleranceMm, precision.deltaOrientationTolerance);
+			}
+		}
+
+		// Somebody may have just joined the stream and needs a full frame to start from
+		stream->deltaEncoder.ForceKeyframe();
+		streams.push_back(std::move(stream));
+	}
+	m_streams = std::move(streams);
+}
+
+bool SkeletonSocketSender::SendBuffer(const char* data, size_t length)
+{
+	// A blocking send may still return early, keep going until the whole frame is out
+	while (length > 0)
+	{
+		int result = send(m_socket, data, (int)length, SocketSendFlags);
+		if (result == SOCKET_ERROR)
+		{
+			printf("Send failed with error: %d, reconnecting\n", WSAGetLastError());
+			ConnectionLost();
+			return false;
+		}
+
+		data += result;
+		length -= static_cast<size_t>(result);
+	}
+
+	return true;
+}
+
+void SkeletonSocketSender::SetSendRing(bool enabled)
+{
+	m_sendRing = enabled;
+}
+
+void SkeletonSocketSender::SetAdaptiveRate(bool enabled)
+{
+	m_adaptiveRate = enabled;
+}
+
+void SkeletonSocketSender::SetDeadReckoning(float errorMm, uint32_t heartbeatMs)
+{
+	m_deadReckoningErrorMm = errorMm;
+	m_heartbeatMs = heartbeatMs;
+}
+
+void SkeletonSocketSender::SetEncoding(SkeletonEncoding encoding)
+{
+	if (m_udp && encoding == SkeletonEncoding::Json)
+	{
+		return;
+	}
+	if (encoding == SkeletonEncoding::Delta && m_encoding != SkeletonEncoding::Delta)
+	{
+		m_forceKeyframe = true;
+	}
+	m_encoding = encoding;
+	if (m_server)
+	{
+		m_server->SetEncoding(encoding);
+	}
+}
+
+SkeletonEncoding SkeletonSocketSender::GetEncoding() const
+{
+	return m_encoding;
+}
+
+bool SkeletonSocketSender::StartAsync(size_t queueCapacity, QueueOverflowPolicy policy)
+{
+	if (m_asyncRunning)
+	{
+		return true;
+	}
+
+	m_queue = std::make_unique<SpscRingBuffer<FrameRecord>>(std::max<size_t>(queueCapacity, 1));
+	m_overflowPolicy = policy;
+	m_asyncRunning = true;
+	m_ioThread = std::thread(&SkeletonSocketSender::AsyncSendLoop, this);
+	return true;
+}
+
+void SkeletonSocketSender::StopAsync()
+{
+	if (!m_ioThread.joinable())
+	{
+		return;
+	}
+
+	m_asyncRunning = false;
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_wakeCondition.notify_one();
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_spaceMutex);
+		m_spaceCondition.notify_one();
+	}
+	m_ioThread.join();
+
+	// Frames still queued are not worth sending anymore
+	FrameRecord record;
+	while (m_queue->TryPop(record))
+	{
+		m_framesDropped++;
+	}
+}
+
+bool SkeletonSocketSender::IsAsync() const
+{
+	return m_asyncRunning;
+}
+
+bool SkeletonSocketSender::EnqueueFrame(const k4abt_body_t* bodies, size_t count, bool multiBody, uint64_t timestamp,
+	const SkeletonWire::StageTimes& times)
+{
+	FrameRecord record;
+	std::copy(bodies, bodies + count, record.bodies);
+	record.bodyCount = count;
+	record.multiBody = multiBody;
+	record.timestamp = timestamp;
+	record.times = times;
+	record.enqueueTime = std::chrono::steady_clock::now();
+
+	bool queued = true;
+	switch (m_overflowPolicy)
+	{
+	case QueueOverflowPolicy::DropOldest:
+		m_framesDropped += m_queue->PushEvictOldest(record);
+		break;
+	case QueueOverflowPolicy::DropNewest:
+		queued = m_queue->TryPush(record);
+		break;
+	case QueueOverflowPolicy::Block:
+		// The I/O thread may be stuck in a send on a congested link, sleep until it takes a frame
+		while (!(queued = m_queue->TryPush(record)) && m_asyncRunning && m_connected)
+		{
+			std::unique_lock<std::mutex> lock(m_spaceMutex);
+			m_producerWaiting = true;
+			m_spaceCondition.wait_for(lock, std::chrono::milliseconds(10),
+				[this] { return !m_queue->Full() || !m_asyncRunning || !m_connected; });
+			m_producerWaiting = false;
+		}
+		break;
+	}
+
+	if (!queued)
+	{
+		m_framesDropped++;
+		return false;
+	}
+
+	m_framesQueued++;
+
+	// Only touch the mutex when the I/O thread is actually asleep
+	if (m_ioThreadWaiting)
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_wakeCondition.notify_one();
+	}
+	return true;
+}
+
+void SkeletonSocketSender::AsyncSendLoop()
+{
+	FrameRecord record;
+	while (m_asyncRunning)
+	{
+		if (!m_queue->TryPop(record))
+		{
+			std::unique_lock<std::mutex> lock(m_wakeMutex);
+			m_ioThreadWaiting = true;
+			m_wakeCondition.wait_for(lock, std::chrono::milliseconds(100),
+				[this] { return !m_queue->Empty() || !m_asyncRunning; });
+			m_ioThreadWaiting = false;
+			continue;
+		}
+
+		// Pairs with the producer setting m_producerWaiting before it looks for room
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_producerWaiting)
+		{
+			std::lock_guard<std::mutex> lock(m_spaceMutex);
+			m_spaceCondition.notify_one();
+		}
+
+		if (!m_connected || !WriteAndSend(record.bodies, record.bodyCount, record.multiBody, record.timestamp, record.times))
+		{
+			m_framesDropped++;
+			continue;
+		}
+
+		uint64_t latencyUsec = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - record.enqueueTime).count());
+
+		m_framesSent++;
+		m_latencySamples++;
+		m_lastLatencyUsec = latencyUsec;
+		m_totalLatencyUsec += latencyUsec;
+		if (latencyUsec > m_maxLatencyUsec)
+		{
+			m_maxLatencyUsec = latencyUsec;
+		}
+	}
+}
+
+SkeletonSenderStats SkeletonSocketSender::GetStats() const
+{
+	SkeletonSenderStats stats;
+	stats.framesQueued = m_framesQueued;
+	stats.framesSent = m_framesSent;
+	stats.framesDropped = m_framesDropped;
+	stats.framesSuppressed = m_framesSuppressed;
+	if (m_server)
+	{
+		stats.framesDropped += m_server->GetFramesDropped();
+		stats.clientCount = m_server->GetClientCount();
+		m_server->GetClientStats(stats.clients);
+	}
+	if (m_udp)
+	{
+		stats.framesDropped += m_udp->GetDatagramsDropped();
+		stats.clientCount = m_udp->GetDestinationCount();
+	}
+	stats.bytesSerialized = m_bytesSerialized;
+	if (stats.bytesSerialized > 0)
+	{
+		stats.compressionRatio = static_cast<double>(m_floatFrameBytes) / static_cast<double>(stats.bytesSerialized);
+	}
+	stats.lastLatencyUsec = m_lastLatencyUsec;
+	stats.maxLatencyUsec = m_maxLatencyUsec;
+	uint64_t latencySamples = m_latencySamples;
+	if (latencySamples > 0)
+	{
+		stats.averageLatencyUsec = static_cast<double>(m_totalLatencyUsec) / static_cast<double>(latencySamples);
+	}
+	stats.trackerLatency = SkeletonLatency::GetPercentiles(m_trackerLatency);
+	stats.loopLatency = SkeletonLatency::GetPercentiles(m_loopLatency);
+	stats.serializeLatency = SkeletonLatency::GetPercentiles(m_serializeLatency);
+	stats.writeLatency = SkeletonLatency::GetPercentiles(m_writeLatency);
+	stats.totalLatency = SkeletonLatency::GetPercentiles(m_totalLatency);
+	return stats;
+}
+
+void SkeletonSocketSender::Close()
+{
+	if (m_connectThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_connectMutex);
+			m_connectRunning = false;
+			m_connectCondition.notify_one();
+		}
+		m_connectThread.join();
+	}
+
+	// Unblock a send() stuck on a congested link before joining the I/O thread
+	if (m_ioThread.joinable() && m_socket != INVALID_SOCKET)
+	{
+		shutdown(m_socket, SD_BOTH);
+	}
+	StopAsync();
+
+	if (m_server)
+	{
+		m_server->Stop();
+		m_server.reset();
+	}
+
+	if (m_udp)
+	{
+		m_udp->Close();
+		m_udp.reset();
+	}
+
+	if (m_socket != INVALID_SOCKET)
+	{
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+
+	if (m_initialized)
+	{
+		WSACleanup();
+		m_initialized = false;
+	}
+
+	m_connected = false;
+}
+
+bool SkeletonSocketSender::IsConnected() const
+{
+	return m_connected;
 }
 
 const char* SkeletonSocketSender::GetJointName(int jointId) const
@@ -3,37 +3,258 @@
 #pragma once
 
 #include <k4abt.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include <thread>
+#include <vector>
 
-#pragma comment(lib, "ws2_32.lib")
+#include "FrameBufferPool.h"
+#include "SkeletonDeltaCodec.h"
+#include "SkeletonFanoutServer.h"
+#include "SkeletonLatency.h"
+#include "SkeletonSubscription.h"
+#include "SkeletonUdpTransport.h"
+#include "SkeletonWireFormat.h"
+#include "SocketPlatform.h"
+#include "SpscRingBuffer.h"
+
+// How the sender reaches its consumers
+enum class SenderMode
+{
+    Connect,   // Single outbound TCP connection to host:port, re-established in the background when lost
+    Listen,    // Accept any number of clients on host:port and fan frames out to all of them
+    WebSocket, // Like Listen, for browsers: JSON frames go out as text messages, the binary encodings as binary messages
+    Udp        // One datagram per frame to every address in the comma-separated host list
+};
+
+// What the frame loop does when the async queue is full
+enum class QueueOverflowPolicy
+{
+    DropOldest,  // Evict the oldest queued frame, the newest pose always gets through
+    DropNewest,  // Discard the frame being queued
+    Block        // Wait until the I/O thread has made room
+};
+
+struct SkeletonSenderStats
+{
+    uint64_t framesQueued = 0;
+    uint64_t framesSent = 0;
+    uint64_t framesDropped = 0;
+    uint64_t framesSuppressed = 0;  // DELTA frames dead reckoning left out, once per stream
+    size_t clientCount = 0;
+
+    // Serialized bytes handed to the transport, and how much smaller that is
+    // than the same frames in the float binary layout
+    uint64_t bytesSerialized = 0;
+    double compressionRatio = 0.0;
+
+    // Time from SendSkeletonData to the end of the socket write, async mode only
+    uint64_t lastLatencyUsec = 0;
+    uint64_t maxLatencyUsec = 0;
+    double averageLatencyUsec = 0.0;
+
+    // Running percentiles of every stage a frame goes through, from the host times
+    // passed with the frames (see SkeletonWire::StageTimes). Stages whose start time
+    // was not passed are not measured.
+    SkeletonLatencyPercentiles trackerLatency;    // capture dequeued to body frame popped
+    SkeletonLatencyPercentiles loopLatency;       // popped to serialization start, includes the stage and async queues
+    SkeletonLatencyPercentiles serializeLatency;  // serialization of one stream
+    SkeletonLatencyPercentiles writeLatency;      // socket write or handing to the client queues
+    SkeletonLatencyPercentiles totalLatency;      // capture dequeued to the end of the write
+
+    // Listen and WebSocket mode, the rate each client is sent at and how its link is doing
+    std::vector<SkeletonClientStats> clients;
+};
 
 class SkeletonSocketSender
 {
 public:
-    SkeletonSocketSender(const std::string& host = "127.0.0.1", int port = 8888);
+    SkeletonSocketSender(const std::string& host = "127.0.0.1", int port = 8888,
+        SkeletonEncoding encoding = SkeletonEncoding::Json, SenderMode mode = SenderMode::Connect);
     ~SkeletonSocketSender();
 
-    // Initialize the socket connection
+    // Start connecting in the background, or start listening in SenderMode::Listen.
+    // In SenderMode::Connect this only fails for an invalid address: frames are
+    // dropped until the consumer is reachable, and a lost connection is retried
+    // with exponential backoff.
     bool Initialize();
 
-    // Send skeleton data as JSON
-    bool SendSkeletonData(const k4abt_body_t& body, uint64_t timestamp);
+    // Send skeleton data using the selected encoding. In async mode this only
+    // queues the frame and returns false if it had to be dropped.
+    // times carries the host times of the capture and pop stages, if known; the
+    // sender stamps the others.
+    bool SendSkeletonData(const k4abt_body_t& body, uint64_t timestamp,
+        const SkeletonWire::StageTimes& times = SkeletonWire::StageTimes());
+
+    // Single-body frames for all tracked bodies of one body frame: every consumer
+    // gets the first of bodies that its subscription includes
+    bool SendSkeletonData(const k4abt_body_t* bodies, size_t count, uint64_t timestamp,
+        const SkeletonWire::StageTimes& times = SkeletonWire::StageTimes());
+
+    // Send every tracked body of one body frame as a single multi-body message.
+    // Bodies beyond SkeletonWire::MaxBodies are left out.
+    bool SendBodies(const k4abt_body_t* bodies, size_t count, uint64_t timestamp,
+        const SkeletonWire::StageTimes& times = SkeletonWire::StageTimes());
+
+    // Serialize and send frames on a dedicated I/O thread so a congested link
+    // never stalls the caller. The queue capacity is rounded up to a power of two.
+    bool StartAsync(size_t queueCapacity = 4, QueueOverflowPolicy policy = QueueOverflowPolicy::DropOldest);
+    void StopAsync();
+    bool IsAsync() const;
+
+    SkeletonSenderStats GetStats() const;
+
+    // Listen and WebSocket mode: send through io_uring where available, see
+    // SkeletonSendRing. Takes effect with Initialize.
+    void SetSendRing(bool enabled);
+
+    // Listen and WebSocket mode: lower the frame rate and precision of every client
+    // whose link cannot keep up, unless its subscription says "adaptive":false. Without
+    // it only clients that say "adaptive":true are adapted. Takes effect with Initialize.
+    void SetAdaptiveRate(bool enabled);
+
+    // DELTA streams: send a joint's position only once it drifts more than errorMm from
+    // where the consumer extrapolates it, and no frame at all while nothing does. A
+    // keyframe goes out every heartbeatMs regardless. See SkeletonDeltaEncoder::SetDeadReckoning.
+    // Takes effect with Initialize, errorMm 0 turns it off.
+    void SetDeadReckoning(float errorMm, uint32_t heartbeatMs = 1000);
+
+    // Select the wire encoding used for subsequent frames
+    void SetEncoding(SkeletonEncoding encoding);
+    SkeletonEncoding GetEncoding() const;
 
     // Close the connection
     void Close();
 
- // Check if connected
+    // Check if connected (or listening in SenderMode::Listen)
     bool IsConnected() const;
 
 private:
-    std::string CreateJsonFromSkeleton(const k4abt_body_t& body, uint64_t timestamp);
+    // Serialization state of one distinct subscription. Consumers that never sent
+    // a subscription share the default one, so usually there is a single stream.
+    struct Stream
+    {
+        SkeletonSubscription subscription;
+        SkeletonDeltaEncoder deltaEncoder;
+        bool started = false;
+        uint64_t nextFrameTimestamp = 0;  // device time the next frame is due with maxRateHz
+    };
+
+    // Fixed-size record handed from the frame loop to the I/O thread
+    struct FrameRecord
+    {
+        k4abt_body_t bodies[SkeletonWire::MaxBodies];
+        size_t bodyCount;
+        bool multiBody;
+        uint64_t timestamp;
+        SkeletonWire::StageTimes times;
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+
+    // Ping line of the connect-mode consumer waiting for its echo
+    struct PendingEcho
+    {
+        uint64_t pingTime;
+        uint64_t receiveTime;
+    };
+
     const char* GetJointName(int jointId) const;
+    bool Send(const k4abt_body_t* bodies, size_t count, bool multiBody, uint64_t timestamp,
+        const SkeletonWire::StageTimes& times);
+    bool WriteAndSend(const k4abt_body_t* bodies, size_t count, bool multiBody, uint64_t timestamp,
+        SkeletonWire::StageTimes times);
+    bool WriteStream(Stream& stream, const k4abt_body_t* bodies, size_t count, bool multiBody,
+        uint64_t timestamp, uint32_t sequence, SkeletonWire::StageTimes times);
+    bool SendEchoes();
+    void UpdateStreams();
+    bool SendBuffer(const char* data, size_t length);
+    void ConnectLoop();
+    SOCKET ConnectWithTimeout();
+    bool ReadHandshake();
+    bool WatchConsumer(int timeoutMs);
+    void ConnectionLost();
+    bool EnqueueFrame(const k4abt_body_t* bodies, size_t count, bool multiBody, uint64_t timestamp,
+        const SkeletonWire::StageTimes& times);
+    void AsyncSendLoop();
 
     std::string m_host;
     int m_port;
+    SenderMode m_mode;
     SOCKET m_socket;
     bool m_initialized;
-    bool m_connected;
+    std::atomic<bool> m_connected;
+
+    std::atomic<SkeletonEncoding> m_encoding;
+    uint32_t m_sequence;  // counts body frames, streams that skip a frame skip its number
+    FrameBufferPool m_framePool;
+
+    // One stream per distinct subscription, rebuilt when the subscriptions change.
+    // A changed set of consumers, a reconnect or an encoding switch forces keyframes.
+    std::vector<std::unique_ptr<Stream>> m_streams;
+    std::vector<SkeletonSubscription> m_subscriptions;
+    uint64_t m_subscriptionsVersion;
+    std::atomic<bool> m_forceKeyframe;
+    k4abt_body_t m_selectedBodies[SkeletonWire::MaxBodies];
+
+    // Connect mode. The connect thread owns m_socket while m_connected is false,
+    // the sending thread while it is true.
+    sockaddr_in m_serverAddr;
+    std::thread m_connectThread;
+    std::atomic<bool> m_connectRunning;
+    std::mutex m_connectMutex;
+    std::condition_variable m_connectCondition;
+
+    // Connect mode subscription, read by the connect thread
+    SkeletonSubscriptionReader m_consumerReader;
+    bool m_consumerSubscribed;
+    SkeletonSubscription m_consumerSubscription;
+    std::atomic<uint64_t> m_consumerSubscriptionVersion;
+    std::vector<PendingEcho> m_pendingEchoes;
+    std::atomic<bool> m_echoPending;
+    std::mutex m_subscriptionMutex;
+
+    // Listen and WebSocket mode
+    std::unique_ptr<SkeletonFanoutServer> m_server;
+    bool m_sendRing;
+    bool m_adaptiveRate;
+
+    // Applied to every stream's delta encoder
+    float m_deadReckoningErrorMm;
+    uint32_t m_heartbeatMs;
+
+    // UDP mode
+    std::unique_ptr<SkeletonUdpTransport> m_udp;
+
+    // Async mode
+    std::unique_ptr<SpscRingBuffer<FrameRecord>> m_queue;
+    QueueOverflowPolicy m_overflowPolicy;
+    std::thread m_ioThread;
+    std::atomic<bool> m_asyncRunning;
+    std::atomic<bool> m_ioThreadWaiting;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    std::atomic<bool> m_producerWaiting;  // the frame loop waits for room, QueueOverflowPolicy::Block
+    std::mutex m_spaceMutex;
+    std::condition_variable m_spaceCondition;
+
+    // Counters, readable from any thread
+    std::atomic<uint64_t> m_framesQueued;
+    std::atomic<uint64_t> m_framesSent;
+    std::atomic<uint64_t> m_framesDropped;
+    std::atomic<uint64_t> m_framesSuppressed;
+    std::atomic<uint64_t> m_floatFrameBytes;  // what the same frames take in the float binary layout
+    std::atomic<uint64_t> m_bytesSerialized;
+    std::atomic<uint64_t> m_lastLatencyUsec;
+    std::atomic<uint64_t> m_maxLatencyUsec;
+    std::atomic<uint64_t> m_totalLatencyUsec;
+    std::atomic<uint64_t> m_latencySamples;
+    SkeletonLatency::Histogram m_trackerLatency;
+    SkeletonLatency::Histogram m_loopLatency;
+    SkeletonLatency::Histogram m_serializeLatency;
+    SkeletonLatency::Histogram m_writeLatency;
+    SkeletonLatency::Histogram m_totalLatency;
 };
@@ -0,0 +1,255 @@
+// Licensed under the MIT License.
+
+#include "SkeletonSubscription.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdio>
+
+using json = nlohmann::json;
+
+namespace
+{
+	bool ParseEncoding(const std::string& name, SkeletonEncoding& encoding)
+	{
+		if (name == "JSON")
+		{
+			encoding = SkeletonEncoding::Json;
+		}
+		else if (name == "BINARY")
+		{
+			encoding = SkeletonEncoding::Binary;
+		}
+		else if (name == "QUANTIZED")
+		{
+			encoding = SkeletonEncoding::Quantized;
+		}
+		else if (name == "DELTA")
+		{
+			encoding = SkeletonEncoding::Delta;
+		}
+		else
+		{
+			return false;
+		}
+		return true;
+	}
+
+	bool ParsePing(const std::string& line, uint64_t& pingTime)
+	{
+		json document = json::parse(line, nullptr, false);
+		if (document.is_discarded() || !document.is_object())
+		{
+			return false;
+		}
+
+		auto ping = document.find("ping");
+		if (ping == document.end() || !ping->is_number_unsigned())
+		{
+			return false;
+		}
+		pingTime = ping->get<uint64_t>();
+		return true;
+	}
+}
+
+bool SkeletonSubscription::IncludesBody(uint32_t bodyId) const
+{
+	return bodyIdCount == 0 || std::binary_search(bodyIds, bodyIds + bodyIdCount, bodyId);
+}
+
+SkeletonEncoding SkeletonSubscription::GetEffectiveEncoding(SkeletonEncoding defaultEncoding) const
+{
+	SkeletonEncoding selected = hasEncoding ? encoding : defaultEncoding;
+	if (jointMask != SkeletonWire::AllJointsMask &&
+		(selected == SkeletonEncoding::Binary || selected == SkeletonEncoding::Quantized))
+	{
+		return SkeletonEncoding::Delta;
+	}
+	return selected;
+}
+
+bool SkeletonSubscription::Parse(const char* text, size_t length, SkeletonSubscription& subscription)
+{
+	// No exceptions, a consumer sending garbage must not take the server down
+	json document = json::parse(text, text + length, nullptr, false);
+	if (document.is_discarded() || !document.is_object())
+	{
+		return false;
+	}
+
+	SkeletonSubscription parsed;
+
+	auto joints = document.find("joints");
+	if (joints != document.end())
+	{
+		if (!joints->is_array())
+		{
+			return false;
+		}
+		parsed.jointMask = 0;
+		for (const json& joint : *joints)
+		{
+			if (!joint.is_number_unsigned() || joint.get<uint64_t>() >= K4ABT_JOINT_COUNT)
+			{
+				return false;
+			}
+			parsed.jointMask |= 1u << joint.get<uint32_t>();
+		}
+	}
+
+	auto maxRate = document.find("max_rate");
+	if (maxRate != document.end())
+	{
+		if (!maxRate->is_number() || maxRate->get<double>() < 0.0)
+		{
+			return false;
+		}
+		parsed.maxRateHz = maxRate->get<float>();
+	}
+
+	auto bodies = document.find("bodies");
+	if (bodies != document.end())
+	{
+		if (!bodies->is_array() || bodies->size() > SkeletonWire::MaxBodies)
+		{
+			return false;
+		}
+		for (const json& body : *bodies)
+		{
+			if (!body.is_number_unsigned() || body.get<uint64_t>() > UINT32_MAX)
+			{
+				return false;
+			}
+			parsed.bodyIds[parsed.bodyIdCount++] = body.get<uint32_t>();
+		}
+		std::sort(parsed.bodyIds, parsed.bodyIds + parsed.bodyIdCount);
+	}
+
+	auto encoding = document.find("encoding");
+	if (encoding != document.end())
+	{
+		if (!encoding->is_string() || !ParseEncoding(encoding->get<std::string>(), parsed.encoding))
+		{
+			return false;
+		}
+		parsed.hasEncoding = true;
+	}
+
+	auto timing = document.find("timing");
+	if (timing != document.end())
+	{
+		if (!timing->is_boolean())
+		{
+			return false;
+		}
+		parsed.timing = timing->get<bool>();
+	}
+
+	auto contours = document.find("contours");
+	if (contours != document.end())
+	{
+		if (!contours->is_boolean())
+		{
+			return false;
+		}
+		parsed.contours = contours->get<bool>();
+	}
+
+	auto voxel = document.find("voxel");
+	if (voxel != document.end())
+	{
+		if (!voxel->is_number_unsigned() || voxel->get<uint64_t>() > UINT16_MAX)
+		{
+			return false;
+		}
+		parsed.voxelSizeMm = voxel->get<uint16_t>();
+		parsed.hasVoxelSize = true;
+	}
+
+	auto adaptive = document.find("adaptive");
+	if (adaptive != document.end())
+	{
+		if (!adaptive->is_boolean())
+		{
+			return false;
+		}
+		parsed.adaptive = adaptive->get<bool>();
+		parsed.hasAdaptive = true;
+	}
+
+	subscription = parsed;
+	return true;
+}
+
+bool SkeletonSubscription::operator==(const SkeletonSubscription& other) const
+{
+	return jointMask == other.jointMask &&
+		maxRateHz == other.maxRateHz &&
+		bodyIdCount == other.bodyIdCount &&
+		std::equal(bodyIds, bodyIds + bodyIdCount, other.bodyIds) &&
+		hasEncoding == other.hasEncoding &&
+		(!hasEncoding || encoding == other.encoding) &&
+		timing == other.timing &&
+		contours == other.contours &&
+		hasVoxelSize == other.hasVoxelSize &&
+		voxelSizeMm == other.voxelSizeMm &&
+		hasAdaptive == other.hasAdaptive &&
+		adaptive == other.adaptive &&
+		precisionLevel == other.precisionLevel;
+}
+
+bool SkeletonSubscriptionReader::Append(const char* data, size_t size, SkeletonSubscription& subscription, bool& updated)
+{
+	updated = false;
+	for (size_t i = 0; i < size; i++)
+	{
+		if (data[i] != '\n')
+		{
+			if (m_line.size() >= MaxLineLength)
+			{
+				return false;
+			}
+			m_line.push_back(data[i]);
+			continue;
+		}
+
+		if (!m_line.empty() && m_line.back() == '\r')
+		{
+			m_line.pop_back();
+		}
+		uint64_t pingTime;
+		if (!m_line.empty() && m_line.find("\"ping\"") != std::string::npos && ParsePing(m_line, pingTime))
+		{
+			if (m_pings.size() >= MaxPendingPings)
+			{
+				m_pings.pop_front();
+			}
+			m_pings.push_back(pingTime);
+		}
+		else if (!m_line.empty())
+		{
+			if (SkeletonSubscription::Parse(m_line.data(), m_line.size(), subscription))
+			{
+				updated = true;
+			}
+			else
+			{
+				printf("Ignoring malformed skeleton subscription: %s\n", m_line.c_str());
+			}
+		}
+		m_line.clear();
+	}
+	return true;
+}
+
+bool SkeletonSubscriptionReader::TakePing(uint64_t& pingTime)
+{
+	if (m_pings.empty())
+	{
+		return false;
+	}
+
+	pingTime = m_pings.front();
+	m_pings.pop_front();
+	return true;
+}
@@ -0,0 +1,89 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+#include "SkeletonWireFormat.h"
+
+// What one consumer wants to receive. A consumer sends it as a single line of JSON
+// right after connecting, every field is optional:
+//
+//   {"joints":[0,26],"max_rate":5,"bodies":[1,2],"encoding":"QUANTIZED","timing":true}
+//
+//   joints    k4abt_joint_id_t values to send, all joints when left out
+//   max_rate  highest frame rate in Hz, frames are decimated by device timestamp
+//   bodies    body ids to send, every tracked body when left out
+//   encoding  JSON, BINARY, QUANTIZED or DELTA, the sender's encoding when left out
+//   timing    follow every frame with a timing message, see SkeletonWireFormat.h
+//   contours  on the silhouette channel, outline polygons instead of run-length rows
+//   voxel     on the point cloud channel, voxel size in millimeters, 0 for every point
+//   adaptive  on the skeleton port, let the server lower rate and precision while the
+//             link cannot keep up (see SkeletonRateController), the server's choice when left out
+//
+// Further lines replace the joints, rate, bodies, timing, contours, voxel and adaptive; the
+// encoding chosen by the first line stays for the whole connection so receivers never see it change.
+//
+// A line {"ping":N} is not a subscription. It asks for an echo message carrying N back.
+struct SkeletonSubscription
+{
+    uint32_t jointMask = SkeletonWire::AllJointsMask;
+    float maxRateHz = 0.0f;  // 0 sends every frame
+
+    // Sorted, bodyIdCount == 0 means every body
+    uint32_t bodyIds[SkeletonWire::MaxBodies] = {};
+    size_t bodyIdCount = 0;
+
+    bool hasEncoding = false;
+    SkeletonEncoding encoding = SkeletonEncoding::Json;
+
+    bool timing = false;
+    bool contours = false;
+
+    bool hasVoxelSize = false;
+    uint16_t voxelSizeMm = 0;
+
+    bool hasAdaptive = false;
+    bool adaptive = false;
+
+    // Never sent by a client, the server lowers it for links that cannot keep up.
+    // 0 is full precision; DELTA streams leave out smaller changes and JSON rounds
+    // values the higher it is.
+    uint8_t precisionLevel = 0;
+
+    bool IncludesBody(uint32_t bodyId) const;
+
+    // The fixed-layout encodings always carry every joint, so a joint subset of
+    // BINARY or QUANTIZED is sent as DELTA, which only carries the joints in its masks
+    SkeletonEncoding GetEffectiveEncoding(SkeletonEncoding defaultEncoding) const;
+
+    // Parse one line. Returns false and leaves subscription untouched if it is malformed.
+    static bool Parse(const char* text, size_t length, SkeletonSubscription& subscription);
+
+    bool operator==(const SkeletonSubscription& other) const;
+    bool operator!=(const SkeletonSubscription& other) const { return !(*this == other); }
+};
+
+// Splits what a consumer writes on its connection into subscription and ping lines
+class SkeletonSubscriptionReader
+{
+public:
+    static constexpr size_t MaxLineLength = 4096;
+    static constexpr size_t MaxPendingPings = 16;
+
+    // Feed received bytes. subscription receives the last valid complete line and
+    // updated tells whether there was one. Returns false once a line grows beyond
+    // MaxLineLength, the connection is not talking this protocol.
+    bool Append(const char* data, size_t size, SkeletonSubscription& subscription, bool& updated);
+
+    // Take the value of the oldest ping line not answered yet. Beyond MaxPendingPings
+    // the oldest ones are forgotten.
+    bool TakePing(uint64_t& pingTime);
+
+private:
+    std::string m_line;
+    std::deque<uint64_t> m_pings;
+};
@@ -0,0 +1,144 @@
+// Licensed under the MIT License.
+
+#include "SkeletonUdpTransport.h"
+#include <cstdio>
+
+SkeletonUdpTransport::SkeletonUdpTransport()
+	: m_socket(INVALID_SOCKET)
+	, m_datagramsDropped(0)
+{
+}
+
+SkeletonUdpTransport::~SkeletonUdpTransport()
+{
+	Close();
+}
+
+bool SkeletonUdpTransport::Open(const std::vector<std::string>& destinations, int port, int multicastTtl)
+{
+	Close();
+
+	bool hasMulticast = false;
+	for (const std::string& host : destinations)
+	{
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) <= 0)
+		{
+			printf("Invalid UDP destination: %s\n", host.c_str());
+			m_destinations.clear();
+			return false;
+		}
+
+		// 224.0.0.0/4
+		hasMulticast |= (ntohl(address.sin_addr.s_addr) & 0xF0000000) == 0xE0000000;
+		m_destinations.push_back(address);
+	}
+
+	if (m_destinations.empty())
+	{
+		printf("No UDP destination given\n");
+		return false;
+	}
+
+	m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (m_socket == INVALID_SOCKET)
+	{
+		printf("UDP socket creation failed with error: %d\n", WSAGetLastError());
+		m_destinations.clear();
+		return false;
+	}
+
+	u_long nonBlocking = 1;
+	ioctlsocket(m_socket, FIONBIO, &nonBlocking);
+
+	if (hasMulticast)
+	{
+		// Stay on the local network by default, and let receivers on this host join the group
+		int ttl = multicastTtl;
+		int loop = 1;
+		setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+		setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop));
+	}
+
+#ifdef __linux__
+	m_messages.assign(m_destinations.size(), mmsghdr());
+	for (size_t i = 0; i < m_destinations.size(); i++)
+	{
+		m_messages[i].msg_hdr.msg_name = &m_destinations[i];
+		m_messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		m_messages[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+
+	printf("Streaming skeleton datagrams to %zu destination(s) on port %d\n", m_destinations.size(), port);
+	return true;
+}
+
+void SkeletonUdpTransport::Close()
+{
+	if (m_socket != INVALID_SOCKET)
+	{
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+	m_destinations.clear();
+#ifdef __linux__
+	m_messages.clear();
+#endif
+}
+
+size_t SkeletonUdpTransport::SendToAll(const uint8_t* data, size_t size)
+{
+#ifdef __linux__
+	// Every message points at the same payload, one syscall covers all destinations
+	iovec payload = { const_cast<uint8_t*>(data), size };
+	for (mmsghdr& message : m_messages)
+	{
+		message.msg_hdr.msg_iov = &payload;
+	}
+
+	size_t next = 0;
+	size_t sent = 0;
+	while (next < m_messages.size())
+	{
+		int result = sendmmsg(m_socket, m_messages.data() + next, (unsigned int)(m_messages.size() - next), MSG_DONTWAIT);
+		if (result <= 0)
+		{
+			// sendmmsg stops at the first failure, skip that destination and carry on
+			m_datagramsDropped++;
+			next++;
+			continue;
+		}
+		next += static_cast<size_t>(result);
+		sent += static_cast<size_t>(result);
+	}
+	return sent;
+#else
+	// Winsock has no sendmmsg, one sendto per destination from the same payload
+	size_t sent = 0;
+	for (const sockaddr_in& destination : m_destinations)
+	{
+		int result = sendto(m_socket, reinterpret_cast<const char*>(data), (int)size, 0,
+			(const sockaddr*)&destination, sizeof(destination));
+		if (result == SOCKET_ERROR)
+		{
+			m_datagramsDropped++;
+			continue;
+		}
+		sent++;
+	}
+	return sent;
+#endif
+}
+
+size_t SkeletonUdpTransport::GetDestinationCount() const
+{
+	return m_destinations.size();
+}
+
+uint64_t SkeletonUdpTransport::GetDatagramsDropped() const
+{
+	return m_datagramsDropped;
+}
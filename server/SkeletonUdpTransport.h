@@ -0,0 +1,44 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SocketPlatform.h"
+
+// Connectionless skeleton transport for live avatars, where the newest pose
+// matters more than reliable delivery. Every datagram carries one complete,
+// self-contained binary frame (sequence number and device timestamp included),
+// so a lost or reordered datagram never holds up the ones behind it.
+//
+// Destinations can be any mix of unicast addresses and IPv4 multicast groups.
+class SkeletonUdpTransport
+{
+public:
+    SkeletonUdpTransport();
+    ~SkeletonUdpTransport();
+
+    // Sockets must already be initialized (WSAStartup)
+    bool Open(const std::vector<std::string>& destinations, int port, int multicastTtl = 1);
+    void Close();
+
+    // Send one datagram to every destination, in a single sendmmsg call on Linux.
+    // The socket is non-blocking: when its buffer is full the datagram is dropped
+    // instead of stalling the caller. Returns the number of destinations the
+    // datagram was handed to.
+    size_t SendToAll(const uint8_t* data, size_t size);
+
+    size_t GetDestinationCount() const;
+    uint64_t GetDatagramsDropped() const;
+
+private:
+    SOCKET m_socket;
+    std::vector<sockaddr_in> m_destinations;
+#ifdef __linux__
+    std::vector<mmsghdr> m_messages;  // one per destination, prepared in Open
+#endif
+    std::atomic<uint64_t> m_datagramsDropped;
+};
@@ -0,0 +1,335 @@
+// Licensed under the MIT License.
+
+#include "SkeletonWebSocket.h"
+#include <algorithm>
+#include <cctype>
+
+using namespace SkeletonWebSocket;
+
+namespace
+{
+	const char* AcceptGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+	uint32_t RotateLeft(uint32_t value, int bits)
+	{
+		return (value << bits) | (value >> (32 - bits));
+	}
+
+	// FIPS 180-4 SHA-1. Only ever hashes a handshake key, so a plain implementation is fine.
+	void Sha1(const std::string& message, uint8_t digest[20])
+	{
+		uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+		// Pad with 0x80, zeros and the bit length so the total is a multiple of 64 bytes
+		std::string padded = message;
+		padded += static_cast<char>(0x80);
+		while (padded.size() % 64 != 56)
+		{
+			padded += '\0';
+		}
+		uint64_t bitLength = static_cast<uint64_t>(message.size()) * 8;
+		for (int i = 7; i >= 0; i--)
+		{
+			padded += static_cast<char>((bitLength >> (i * 8)) & 0xFF);
+		}
+
+		for (size_t block = 0; block < padded.size(); block += 64)
+		{
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(padded.data()) + block;
+			uint32_t w[80];
+			for (int i = 0; i < 16; i++)
+			{
+				w[i] = (uint32_t(bytes[4 * i]) << 24) | (uint32_t(bytes[4 * i + 1]) << 16) |
+					(uint32_t(bytes[4 * i + 2]) << 8) | uint32_t(bytes[4 * i + 3]);
+			}
+			for (int i = 16; i < 80; i++)
+			{
+				w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+			}
+
+			uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+			for (int i = 0; i < 80; i++)
+			{
+				uint32_t f;
+				uint32_t k;
+				if (i < 20)
+				{
+					f = (b & c) | (~b & d);
+					k = 0x5A827999;
+				}
+				else if (i < 40)
+				{
+					f = b ^ c ^ d;
+					k = 0x6ED9EBA1;
+				}
+				else if (i < 60)
+				{
+					f = (b & c) | (b & d) | (c & d);
+					k = 0x8F1BBCDC;
+				}
+				else
+				{
+					f = b ^ c ^ d;
+					k = 0xCA62C1D6;
+				}
+
+				uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+				e = d;
+				d = c;
+				c = RotateLeft(b, 30);
+				b = a;
+				a = temp;
+			}
+
+			h[0] += a;
+			h[1] += b;
+			h[2] += c;
+			h[3] += d;
+			h[4] += e;
+		}
+
+		for (int i = 0; i < 5; i++)
+		{
+			digest[4 * i] = static_cast<uint8_t>(h[i] >> 24);
+			digest[4 * i + 1] = static_cast<uint8_t>(h[i] >> 16);
+			digest[4 * i + 2] = static_cast<uint8_t>(h[i] >> 8);
+			digest[4 * i + 3] = static_cast<uint8_t>(h[i]);
+		}
+	}
+
+	std::string Base64(const uint8_t* data, size_t size)
+	{
+		static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+		std::string encoded;
+		for (size_t i = 0; i < size; i += 3)
+		{
+			uint32_t group = uint32_t(data[i]) << 16;
+			if (i + 1 < size)
+			{
+				group |= uint32_t(data[i + 1]) << 8;
+			}
+			if (i + 2 < size)
+			{
+				group |= data[i + 2];
+			}
+
+			encoded += alphabet[(group >> 18) & 0x3F];
+			encoded += alphabet[(group >> 12) & 0x3F];
+			encoded += i + 1 < size ? alphabet[(group >> 6) & 0x3F] : '=';
+			encoded += i + 2 < size ? alphabet[group & 0x3F] : '=';
+		}
+		return encoded;
+	}
+
+	std::string ToLower(std::string text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return text;
+	}
+
+	std::string Trim(const std::string& text)
+	{
+		size_t start = text.find_first_not_of(" \t");
+		if (start == std::string::npos)
+		{
+			return std::string();
+		}
+		return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+	}
+
+	// Whether a comma-separated header value lists token, ignoring case
+	bool HasToken(const std::string& value, const char* token)
+	{
+		std::string lowered = ToLower(value);
+		size_t start = 0;
+		while (start <= lowered.size())
+		{
+			size_t end = std::min(lowered.find(',', start), lowered.size());
+			if (Trim(lowered.substr(start, end - start)) == token)
+			{
+				return true;
+			}
+			start = end + 1;
+		}
+		return false;
+	}
+}
+
+size_t SkeletonWebSocket::FrameHeaderSize(size_t payloadSize)
+{
+	return payloadSize < 126 ? 2 : payloadSize <= 0xFFFF ? 4 : 10;
+}
+
+size_t SkeletonWebSocket::WriteFrameHeader(uint8_t* out, Opcode opcode, size_t payloadSize)
+{
+	out[0] = 0x80 | static_cast<uint8_t>(opcode);
+	if (payloadSize < 126)
+	{
+		out[1] = static_cast<uint8_t>(payloadSize);
+		return 2;
+	}
+	if (payloadSize <= 0xFFFF)
+	{
+		out[1] = 126;
+		out[2] = static_cast<uint8_t>(payloadSize >> 8);
+		out[3] = static_cast<uint8_t>(payloadSize);
+		return 4;
+	}
+
+	out[1] = 127;
+	for (int i = 0; i < 8; i++)
+	{
+		out[2 + i] = static_cast<uint8_t>(static_cast<uint64_t>(payloadSize) >> (8 * (7 - i)));
+	}
+	return 10;
+}
+
+std::string SkeletonWebSocket::ComputeAcceptKey(const std::string& key)
+{
+	uint8_t digest[20];
+	Sha1(key + AcceptGuid, digest);
+	return Base64(digest, sizeof(digest));
+}
+
+bool SkeletonWebSocket::AcceptUpgrade(const std::string& request, std::string& response)
+{
+	response = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+	size_t lineEnd = request.find("\r\n");
+	if (lineEnd == std::string::npos || request.compare(0, 4, "GET ") != 0)
+	{
+		return false;
+	}
+
+	std::string key;
+	bool upgrade = false;
+	bool connectionUpgrade = false;
+	bool version13 = false;
+	for (size_t start = lineEnd + 2; ; )
+	{
+		lineEnd = request.find("\r\n", start);
+		if (lineEnd == std::string::npos || lineEnd == start)
+		{
+			break;
+		}
+
+		std::string line = request.substr(start, lineEnd - start);
+		start = lineEnd + 2;
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+		{
+			continue;
+		}
+		std::string name = ToLower(Trim(line.substr(0, colon)));
+		std::string value = Trim(line.substr(colon + 1));
+
+		if (name == "upgrade")
+		{
+			upgrade = HasToken(value, "websocket");
+		}
+		else if (name == "connection")
+		{
+			connectionUpgrade = HasToken(value, "upgrade");
+		}
+		else if (name == "sec-websocket-version")
+		{
+			version13 = value == "13";
+		}
+		else if (name == "sec-websocket-key")
+		{
+			key = value;
+		}
+	}
+
+	if (!upgrade || !connectionUpgrade || key.empty())
+	{
+		return false;
+	}
+	if (!version13)
+	{
+		response = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		return false;
+	}
+
+	response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " +
+		ComputeAcceptKey(key) + "\r\n\r\n";
+	return true;
+}
+
+bool FrameReader::Append(const char* data, size_t size)
+{
+	if (m_failed)
+	{
+		return false;
+	}
+
+	m_buffer.append(data, size);
+	while (m_buffer.size() >= 2)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(m_buffer.data());
+		uint8_t opcode = bytes[0] & 0x0F;
+		bool final = (bytes[0] & 0x80) != 0;
+		bool control = (opcode & 0x08) != 0;
+		uint64_t payloadSize = bytes[1] & 0x7F;
+
+		// Clients must mask, and nothing here negotiated the reserved bits
+		if ((bytes[0] & 0x70) != 0 || (bytes[1] & 0x80) == 0 || (control && (!final || payloadSize > 125)))
+		{
+			m_failed = true;
+			return false;
+		}
+
+		size_t offset = 2;
+		size_t lengthSize = payloadSize == 126 ? 2 : payloadSize == 127 ? 8 : 0;
+		if (m_buffer.size() < offset + lengthSize)
+		{
+			return true;
+		}
+		if (lengthSize > 0)
+		{
+			payloadSize = 0;
+			for (size_t i = 0; i < lengthSize; i++)
+			{
+				payloadSize = (payloadSize << 8) | bytes[offset + i];
+			}
+			offset += lengthSize;
+		}
+		if (payloadSize > MaxClientPayloadSize)
+		{
+			m_failed = true;
+			return false;
+		}
+		if (m_buffer.size() < offset + 4 + payloadSize)
+		{
+			return true;
+		}
+
+		const uint8_t* mask = bytes + offset;
+		offset += 4;
+		Frame frame;
+		frame.opcode = static_cast<Opcode>(opcode);
+		frame.final = final;
+		frame.payload.resize(static_cast<size_t>(payloadSize));
+		for (size_t i = 0; i < payloadSize; i++)
+		{
+			frame.payload[i] = static_cast<char>(bytes[offset + i] ^ mask[i % 4]);
+		}
+		m_frames.push_back(std::move(frame));
+		m_buffer.erase(0, offset + static_cast<size_t>(payloadSize));
+	}
+	return true;
+}
+
+bool FrameReader::Next(Frame& frame)
+{
+	if (m_frames.empty())
+	{
+		return false;
+	}
+
+	frame = std::move(m_frames.front());
+	m_frames.pop_front();
+	return true;
+}
@@ -0,0 +1,78 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+// The parts of RFC 6455 a skeleton server needs to talk to browsers directly:
+// the HTTP upgrade handshake, unmasked server frames and masked client frames.
+// Extensions and subprotocols are never negotiated.
+//
+// Server frames are written in front of an already serialized payload, so one
+// buffer holding header and payload is sent to every browser as it is:
+//
+//   byte 0     FIN bit (always set) and opcode
+//   byte 1     payload length 0-125, or 126 followed by a uint16, or 127 followed by a uint64
+//              (big-endian, the mask bit is never set on server frames)
+namespace SkeletonWebSocket
+{
+    enum class Opcode : uint8_t
+    {
+        Continuation = 0x0,
+        Text = 0x1,
+        Binary = 0x2,
+        Close = 0x8,
+        Ping = 0x9,
+        Pong = 0xA
+    };
+
+    constexpr size_t MaxFrameHeaderSize = 10;
+
+    // Largest client message accepted, browsers only ever send subscriptions
+    constexpr size_t MaxClientPayloadSize = 4096;
+
+    // Largest upgrade request accepted
+    constexpr size_t MaxRequestSize = 8192;
+
+    size_t FrameHeaderSize(size_t payloadSize);
+
+    // Writes the header of an unfragmented server frame. out must hold
+    // FrameHeaderSize(payloadSize) bytes. Returns the number of bytes written.
+    size_t WriteFrameHeader(uint8_t* out, Opcode opcode, size_t payloadSize);
+
+    // Sec-WebSocket-Accept value for a Sec-WebSocket-Key: base64 of the SHA-1 of
+    // the key followed by the RFC 6455 GUID
+    std::string ComputeAcceptKey(const std::string& key);
+
+    // Check a complete upgrade request (up to and including the blank line) and build
+    // the 101 Switching Protocols response. Returns false if it is not a valid
+    // WebSocket version 13 upgrade.
+    bool AcceptUpgrade(const std::string& request, std::string& response);
+
+    // Splits what a browser sends into frames and unmasks their payloads
+    class FrameReader
+    {
+    public:
+        struct Frame
+        {
+            Opcode opcode;
+            bool final;
+            std::string payload;
+        };
+
+        // Feed received bytes. Returns false if the client broke the protocol:
+        // an unmasked frame, reserved bits or a payload beyond MaxClientPayloadSize.
+        bool Append(const char* data, size_t size);
+
+        // Take the next complete frame, if there is one
+        bool Next(Frame& frame);
+
+    private:
+        std::string m_buffer;
+        std::deque<Frame> m_frames;
+        bool m_failed = false;
+    };
+}
@@ -0,0 +1,490 @@
+// Licensed under the MIT License.
+
+#include "SkeletonWireFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Range of the three smallest components of a unit quaternion
+	const float QuaternionComponentLimit = 0.70710678f;
+	const uint32_t QuaternionComponentMax = 1023;
+
+	int16_t QuantizePosition(float value)
+	{
+		float scaled = std::round(value * SkeletonWire::QuantizedPositionScale);
+		return static_cast<int16_t>(std::min(32767.0f, std::max(-32767.0f, scaled)));
+	}
+
+	uint8_t* WriteSkeletonRecord(uint8_t* out, const k4abt_body_t& body)
+	{
+		using namespace SkeletonWire;
+
+		out = WriteU32(out, body.id);
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			const k4a_float3_t& pos = body.skeleton.joints[joint].position;
+			const k4a_quaternion_t& ori = body.skeleton.joints[joint].orientation;
+
+			out = WriteF32(out, pos.xyz.x);
+			out = WriteF32(out, pos.xyz.y);
+			out = WriteF32(out, pos.xyz.z);
+			out = WriteF32(out, ori.wxyz.w);
+			out = WriteF32(out, ori.wxyz.x);
+			out = WriteF32(out, ori.wxyz.y);
+			out = WriteF32(out, ori.wxyz.z);
+			out = WriteU8(out, static_cast<uint8_t>(body.skeleton.joints[joint].confidence_level));
+		}
+		return out;
+	}
+
+	uint8_t* WriteQuantizedSkeletonRecord(uint8_t* out, const k4abt_body_t& body)
+	{
+		using namespace SkeletonWire;
+
+		out = WriteU32(out, body.id);
+
+		const k4a_float3_t& pelvis = body.skeleton.joints[K4ABT_JOINT_PELVIS].position;
+		out = WriteF32(out, pelvis.xyz.x);
+		out = WriteF32(out, pelvis.xyz.y);
+		out = WriteF32(out, pelvis.xyz.z);
+
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			if (joint == K4ABT_JOINT_PELVIS)
+			{
+				continue;
+			}
+
+			const k4a_float3_t& pos = body.skeleton.joints[joint].position;
+			out = WriteU16(out, static_cast<uint16_t>(QuantizePosition(pos.xyz.x - pelvis.xyz.x)));
+			out = WriteU16(out, static_cast<uint16_t>(QuantizePosition(pos.xyz.y - pelvis.xyz.y)));
+			out = WriteU16(out, static_cast<uint16_t>(QuantizePosition(pos.xyz.z - pelvis.xyz.z)));
+		}
+
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			out = WriteU32(out, PackQuaternion(body.skeleton.joints[joint].orientation));
+		}
+
+		memset(out, 0, K4ABT_JOINT_COUNT / 4);
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			uint8_t confidence = static_cast<uint8_t>(body.skeleton.joints[joint].confidence_level) & 0x3;
+			out[joint / 4] |= static_cast<uint8_t>(confidence << (2 * (joint % 4)));
+		}
+		return out + K4ABT_JOINT_COUNT / 4;
+	}
+
+	// Decode one body laid out like the payload of a Skeleton or QuantizedSkeleton frame
+	bool ReadRecord(SkeletonWire::MessageType type, const uint8_t* in, size_t size, k4abt_body_t& body)
+	{
+		using namespace SkeletonWire;
+
+		if (type == MessageType::Skeleton && size >= SkeletonFrameSize - FrameHeaderSize)
+		{
+			body.id = ReadU32(in);
+			in += 4;
+			for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+			{
+				k4abt_joint_t& target = body.skeleton.joints[joint];
+				for (int i = 0; i < 3; i++, in += 4)
+				{
+					target.position.v[i] = ReadF32(in);
+				}
+				for (int i = 0; i < 4; i++, in += 4)
+				{
+					target.orientation.v[i] = ReadF32(in);
+				}
+				target.confidence_level = static_cast<k4abt_joint_confidence_level_t>(*in++);
+			}
+			return true;
+		}
+
+		if (type == MessageType::QuantizedSkeleton && size >= QuantizedSkeletonFrameSize - FrameHeaderSize)
+		{
+			body.id = ReadU32(in);
+			in += 4;
+
+			k4a_float3_t pelvis;
+			for (int i = 0; i < 3; i++, in += 4)
+			{
+				pelvis.v[i] = ReadF32(in);
+			}
+
+			for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+			{
+				k4a_float3_t& position = body.skeleton.joints[joint].position;
+				if (joint == K4ABT_JOINT_PELVIS)
+				{
+					position = pelvis;
+					continue;
+				}
+				for (int i = 0; i < 3; i++, in += 2)
+				{
+					position.v[i] = pelvis.v[i] + static_cast<int16_t>(ReadU16(in)) / QuantizedPositionScale;
+				}
+			}
+
+			for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++, in += 4)
+			{
+				body.skeleton.joints[joint].orientation = UnpackQuaternion(ReadU32(in));
+			}
+
+			for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+			{
+				body.skeleton.joints[joint].confidence_level =
+					static_cast<k4abt_joint_confidence_level_t>((in[joint / 4] >> (2 * (joint % 4))) & 0x3);
+			}
+			return true;
+		}
+
+		return false;
+	}
+}
+
+namespace SkeletonWire
+{
+	uint8_t* WriteU8(uint8_t* out, uint8_t value)
+	{
+		*out = value;
+		return out + 1;
+	}
+
+	uint8_t* WriteU16(uint8_t* out, uint16_t value)
+	{
+		out[0] = static_cast<uint8_t>(value);
+		out[1] = static_cast<uint8_t>(value >> 8);
+		return out + 2;
+	}
+
+	uint8_t* WriteU32(uint8_t* out, uint32_t value)
+	{
+		out[0] = static_cast<uint8_t>(value);
+		out[1] = static_cast<uint8_t>(value >> 8);
+		out[2] = static_cast<uint8_t>(value >> 16);
+		out[3] = static_cast<uint8_t>(value >> 24);
+		return out + 4;
+	}
+
+	uint8_t* WriteU64(uint8_t* out, uint64_t value)
+	{
+		out = WriteU32(out, static_cast<uint32_t>(value));
+		return WriteU32(out, static_cast<uint32_t>(value >> 32));
+	}
+
+	uint8_t* WriteF32(uint8_t* out, float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return WriteU32(out, bits);
+	}
+
+	uint16_t ReadU16(const uint8_t* in)
+	{
+		return static_cast<uint16_t>(in[0] | (in[1] << 8));
+	}
+
+	uint32_t ReadU32(const uint8_t* in)
+	{
+		return static_cast<uint32_t>(in[0]) |
+			(static_cast<uint32_t>(in[1]) << 8) |
+			(static_cast<uint32_t>(in[2]) << 16) |
+			(static_cast<uint32_t>(in[3]) << 24);
+	}
+
+	uint64_t ReadU64(const uint8_t* in)
+	{
+		return static_cast<uint64_t>(ReadU32(in)) | (static_cast<uint64_t>(ReadU32(in + 4)) << 32);
+	}
+
+	float ReadF32(const uint8_t* in)
+	{
+		uint32_t bits = ReadU32(in);
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	uint8_t* BeginFrame(uint8_t* buffer, MessageType type, uint64_t timestamp, uint32_t sequence)
+	{
+		uint8_t* out = buffer + LengthPrefixSize;
+		out = WriteU16(out, Magic);
+		out = WriteU8(out, Version);
+		out = WriteU8(out, static_cast<uint8_t>(type));
+		out = WriteU32(out, sequence);
+		return WriteU64(out, timestamp);
+	}
+
+	size_t FinishFrame(uint8_t* buffer, const uint8_t* end)
+	{
+		size_t size = static_cast<size_t>(end - buffer);
+		WriteU32(buffer, static_cast<uint32_t>(size - LengthPrefixSize));
+		return size;
+	}
+
+	size_t WriteSkeletonFrame(uint8_t* buffer, const k4abt_body_t& body, uint64_t timestamp, uint32_t sequence)
+	{
+		uint8_t* out = BeginFrame(buffer, MessageType::Skeleton, timestamp, sequence);
+		return FinishFrame(buffer, WriteSkeletonRecord(out, body));
+	}
+
+	uint32_t PackQuaternion(const k4a_quaternion_t& orientation)
+	{
+		float components[4] = { orientation.wxyz.w, orientation.wxyz.x, orientation.wxyz.y, orientation.wxyz.z };
+
+		float norm = std::sqrt(components[0] * components[0] + components[1] * components[1] +
+			components[2] * components[2] + components[3] * components[3]);
+		if (!(norm > 1e-6f))
+		{
+			// Untracked joints may carry a zero quaternion, send identity instead
+			components[0] = 1.0f;
+			components[1] = components[2] = components[3] = 0.0f;
+			norm = 1.0f;
+		}
+
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			if (std::fabs(components[i]) > std::fabs(components[largest]))
+			{
+				largest = i;
+			}
+		}
+
+		// q and -q are the same rotation, make the dropped component positive
+		float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+		uint32_t packed = static_cast<uint32_t>(largest) << 30;
+		int shift = 20;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+
+			float value = sign * components[i] / norm;
+			float normalized = (value / QuaternionComponentLimit + 1.0f) * 0.5f;
+			float scaled = std::round(normalized * QuaternionComponentMax);
+			uint32_t quantized = static_cast<uint32_t>(std::min<float>(QuaternionComponentMax, std::max(0.0f, scaled)));
+			packed |= quantized << shift;
+			shift -= 10;
+		}
+		return packed;
+	}
+
+	k4a_quaternion_t UnpackQuaternion(uint32_t packed)
+	{
+		int largest = static_cast<int>(packed >> 30);
+		float components[4];
+		float sumOfSquares = 0.0f;
+		int shift = 20;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+
+			uint32_t quantized = (packed >> shift) & QuaternionComponentMax;
+			components[i] = (static_cast<float>(quantized) / QuaternionComponentMax * 2.0f - 1.0f) * QuaternionComponentLimit;
+			sumOfSquares += components[i] * components[i];
+			shift -= 10;
+		}
+		components[largest] = std::sqrt(std::max(0.0f, 1.0f - sumOfSquares));
+
+		k4a_quaternion_t orientation;
+		orientation.wxyz.w = components[0];
+		orientation.wxyz.x = components[1];
+		orientation.wxyz.y = components[2];
+		orientation.wxyz.z = components[3];
+		return orientation;
+	}
+
+	size_t WriteQuantizedSkeletonFrame(uint8_t* buffer, const k4abt_body_t& body, uint64_t timestamp, uint32_t sequence)
+	{
+		uint8_t* out = BeginFrame(buffer, MessageType::QuantizedSkeleton, timestamp, sequence);
+		return FinishFrame(buffer, WriteQuantizedSkeletonRecord(out, body));
+	}
+
+	size_t WriteBodiesFrame(uint8_t* buffer, MessageType recordType, const k4abt_body_t* bodies, size_t count,
+		uint64_t timestamp, uint32_t sequence)
+	{
+		count = std::min(count, MaxBodies);
+
+		uint8_t* out = BeginFrame(buffer, MessageType::Bodies, timestamp, sequence);
+		out = WriteU8(out, static_cast<uint8_t>(count));
+		out = WriteU8(out, static_cast<uint8_t>(recordType));
+		for (size_t i = 0; i < count; i++)
+		{
+			uint8_t* record = out + BodyRecordPrefixSize;
+			uint8_t* recordEnd = recordType == MessageType::QuantizedSkeleton ?
+				WriteQuantizedSkeletonRecord(record, bodies[i]) : WriteSkeletonRecord(record, bodies[i]);
+			WriteU16(out, static_cast<uint16_t>(recordEnd - record));
+			out = recordEnd;
+		}
+		return FinishFrame(buffer, out);
+	}
+
+	bool ReadSkeletonFrame(const uint8_t* data, size_t size, k4abt_body_t& body, uint64_t& timestamp)
+	{
+		FrameHeader header;
+		if (!ReadFrameHeader(data, size, header))
+		{
+			return false;
+		}
+
+		timestamp = header.timestamp;
+		return ReadRecord(header.type, data + FrameHeaderSize, size - FrameHeaderSize, body);
+	}
+
+	bool ReadBodiesFrame(const uint8_t* data, size_t size, k4abt_body_t* bodies, size_t maxBodies,
+		size_t& count, uint64_t& timestamp)
+	{
+		count = 0;
+		FrameHeader header;
+		if (!ReadFrameHeader(data, size, header))
+		{
+			return false;
+		}
+
+		timestamp = header.timestamp;
+		if (header.type != MessageType::Bodies)
+		{
+			if (maxBodies == 0 || !ReadRecord(header.type, data + FrameHeaderSize, size - FrameHeaderSize, bodies[0]))
+			{
+				return false;
+			}
+			count = 1;
+			return true;
+		}
+
+		if (size < BodiesHeaderSize)
+		{
+			return false;
+		}
+
+		size_t bodyCount = data[FrameHeaderSize];
+		MessageType recordType = static_cast<MessageType>(data[FrameHeaderSize + 1]);
+		const uint8_t* in = data + BodiesHeaderSize;
+		const uint8_t* end = data + size;
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			if (end - in < static_cast<ptrdiff_t>(BodyRecordPrefixSize))
+			{
+				return false;
+			}
+			size_t recordSize = ReadU16(in);
+			in += BodyRecordPrefixSize;
+			if (static_cast<size_t>(end - in) < recordSize)
+			{
+				return false;
+			}
+			if (count < maxBodies)
+			{
+				if (!ReadRecord(recordType, in, recordSize, bodies[count]))
+				{
+					return false;
+				}
+				count++;
+			}
+			in += recordSize;
+		}
+		return true;
+	}
+
+	size_t WriteTimingFrame(uint8_t* buffer, const StageTimes& times, uint64_t timestamp, uint32_t sequence)
+	{
+		uint8_t* out = BeginFrame(buffer, MessageType::Timing, timestamp, sequence);
+		out = WriteU64(out, times.capture);
+		out = WriteU64(out, times.pop);
+		out = WriteU64(out, times.serialize);
+		return FinishFrame(buffer, WriteU64(out, times.send));
+	}
+
+	bool ReadTimingFrame(const uint8_t* data, size_t size, StageTimes& times, uint64_t& timestamp)
+	{
+		FrameHeader header;
+		if (!ReadFrameHeader(data, size, header) || header.type != MessageType::Timing || size < TimingFrameSize)
+		{
+			return false;
+		}
+
+		const uint8_t* in = data + FrameHeaderSize;
+		times.capture = ReadU64(in);
+		times.pop = ReadU64(in + 8);
+		times.serialize = ReadU64(in + 16);
+		times.send = ReadU64(in + 24);
+		timestamp = header.timestamp;
+		return true;
+	}
+
+	size_t WriteEchoFrame(uint8_t* buffer, uint64_t pingTime, uint64_t receiveTime, uint64_t sendTime)
+	{
+		uint8_t* out = BeginFrame(buffer, MessageType::Echo, 0, 0);
+		out = WriteU64(out, pingTime);
+		out = WriteU64(out, receiveTime);
+		return FinishFrame(buffer, WriteU64(out, sendTime));
+	}
+
+	bool ReadEchoFrame(const uint8_t* data, size_t size, uint64_t& pingTime, uint64_t& receiveTime, uint64_t& sendTime)
+	{
+		FrameHeader header;
+		if (!ReadFrameHeader(data, size, header) || header.type != MessageType::Echo || size < EchoFrameSize)
+		{
+			return false;
+		}
+
+		const uint8_t* in = data + FrameHeaderSize;
+		pingTime = ReadU64(in);
+		receiveTime = ReadU64(in + 8);
+		sendTime = ReadU64(in + 16);
+		return true;
+	}
+
+	bool ReadFrameHeader(const uint8_t* data, size_t size, FrameHeader& header)
+	{
+		if (size < FrameHeaderSize || ReadU16(data + 4) != Magic)
+		{
+			return false;
+		}
+
+		header.payloadLength = ReadU32(data);
+		header.version = data[6];
+		header.type = static_cast<MessageType>(data[7]);
+		header.sequence = ReadU32(data + 8);
+		header.timestamp = ReadU64(data + 12);
+		return header.payloadLength + LengthPrefixSize >= FrameHeaderSize;
+	}
+
+	SequenceTracker::Result SequenceTracker::Accept(uint32_t sequence)
+	{
+		if (!m_started)
+		{
+			m_started = true;
+			m_newest = sequence;
+			m_received++;
+			return Result::InOrder;
+		}
+
+		// Signed distance handles the wrap from 0xFFFFFFFF to 0
+		int32_t distance = static_cast<int32_t>(sequence - m_newest);
+		if (distance <= 0)
+		{
+			m_late++;
+			return Result::Late;
+		}
+
+		m_newest = sequence;
+		m_received++;
+		if (distance == 1)
+		{
+			return Result::InOrder;
+		}
+
+		m_lost += static_cast<uint64_t>(distance - 1);
+		return Result::Gap;
+	}
+}
@@ -0,0 +1,245 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <k4abt.h>
+#include <cstddef>
+#include <cstdint>
+
+// Encodings that SkeletonSocketSender can put on the wire
+enum class SkeletonEncoding
+{
+    Json,      // Newline-delimited JSON, one object per frame
+    Binary,    // Length-prefixed fixed-layout frames described below
+    Quantized, // Binary frames with int16 positions and smallest-three quaternions
+    Delta      // Quantized changes since the previous frame with periodic keyframes,
+               // see SkeletonDeltaCodec.h
+};
+
+// Binary skeleton frame layout. All multi-byte fields are little-endian and
+// the layout contains no padding, so receivers can read fields at fixed offsets.
+//
+//   offset  size  field
+//        0     4  payload length (number of bytes following this field)
+//        4     2  magic ('K', 'S')
+//        6     1  version
+//        7     1  message type
+//        8     4  sequence number (incremented for every frame sent)
+//       12     8  device timestamp in microseconds
+//       20     4  body id
+//       24   928  32 joints, 29 bytes each:
+//                   float position x, y, z (millimeters)
+//                   float orientation w, x, y, z
+//                   uint8 confidence level
+//
+// Quantized skeleton frames (message type 2) share the 20 byte header:
+//
+//       20     4  body id
+//       24    12  float pelvis position x, y, z (millimeters)
+//       36   186  31 joints (all but the pelvis), int16 x, y, z relative to the
+//                 pelvis in units of 0.1 mm (clamped to +-3.2 m)
+//      222   128  32 orientations, smallest-three packed into a uint32:
+//                   bits 31-30 index (w, x, y, z) of the dropped largest component
+//                   bits 29-0  the other three components in order, 10 bits each,
+//                              mapped linearly from [-1/sqrt(2), 1/sqrt(2)]
+//      350     8  32 confidence levels, 2 bits each, joint n in byte n / 4 at bit 2 * (n % 4)
+//
+// Worst-case decoding error: 0.05 mm per position axis (inside the clamp range)
+// and about 0.002 per quaternion component, under 0.3 degree of rotation.
+//
+// Multi-body frames (message type 4) carry every tracked body of one body frame:
+//
+//       20     1  body count
+//       21     1  message type of the body records (1, 2 or 3)
+//       22        per body: uint16 record length, then the record, which is laid out
+//                 like a single-body frame of that type from offset 20 on
+//
+// Timing messages (type 5) follow a frame on streams that subscribed to them. Their
+// sequence number and timestamp are those of the frame. All times are host monotonic
+// microseconds (SkeletonLatency::HostTimeUsec), 0 when the stage is unknown:
+//
+//       20     8  capture dequeued from the device or recording
+//       28     8  body frame popped from the tracker
+//       36     8  serialization started
+//       44     8  frame handed to the socket or, in listen mode, to the client queues
+//
+// Echo messages (type 6) answer a consumer's ping line {"ping":N}. Sequence and timestamp are 0:
+//
+//       20     8  N, as sent by the consumer
+//       28     8  host time the ping was received
+//       36     8  host time the echo was handed to the socket
+//
+// Depth frames (type 7) go out on the separate depth channel (see SkeletonDepthChannel.h).
+// Their timestamp is that of the body frame made from the same capture:
+//
+//       20     2  width in pixels
+//       22     2  height in pixels
+//       24     1  codec, 1 for RVL (see SkeletonDepthCodec.h)
+//       25        compressed depth image up to the end of the payload
+//
+// Silhouette frames go out on the separate silhouette channel (see SkeletonSilhouetteChannel.h),
+// timestamped like depth frames. Both kinds start with the bodies of the body index map:
+//
+//       20     2  width in pixels
+//       22     2  height in pixels
+//       24     1  body count n
+//       25    4n  body ids, index i of the map belongs to body id i
+//
+// Run frames (type 8) follow with every row of the map, top to bottom: a uint16 run
+// count, then per run uint16 first column, uint16 length and uint8 body index. Pixels
+// outside the runs are background. Contour frames (type 9) follow with a uint16 contour
+// count, then per contour uint8 body index, uint16 point count and uint16 x, y per point
+// (see SkeletonSilhouetteCodec.h).
+//
+// Point cloud frames (type 10) go out on the separate point cloud channel (see
+// SkeletonPointCloudChannel.h), timestamped like depth frames:
+//
+//       20     1  body count
+//       21     2  voxel size in millimeters, 0 when every point is sent
+//       23        per body: uint32 body id, uint32 point count, then int16 x, y, z per point
+//                 in millimeters, in the depth camera coordinates of the joint positions
+namespace SkeletonWire
+{
+    constexpr uint16_t Magic = 0x534B;
+    constexpr uint8_t Version = 1;
+
+    enum class MessageType : uint8_t
+    {
+        Skeleton = 1,
+        QuantizedSkeleton = 2,
+        DeltaSkeleton = 3,
+        Bodies = 4,
+        Timing = 5,
+        Echo = 6,
+        Depth = 7,
+        SilhouetteRuns = 8,
+        SilhouetteContours = 9,
+        PointCloud = 10
+    };
+
+    constexpr size_t LengthPrefixSize = 4;
+    constexpr size_t FrameHeaderSize = 20;
+    constexpr size_t JointSize = 7 * sizeof(float) + 1;
+    constexpr size_t SkeletonFrameSize = FrameHeaderSize + 4 + K4ABT_JOINT_COUNT * JointSize;
+
+    constexpr float QuantizedPositionScale = 10.0f;  // int16 units per millimeter
+    constexpr size_t QuantizedSkeletonFrameSize = FrameHeaderSize + 4 + 3 * sizeof(float) +
+        (K4ABT_JOINT_COUNT - 1) * 3 * sizeof(int16_t) + K4ABT_JOINT_COUNT * sizeof(uint32_t) + K4ABT_JOINT_COUNT / 4;
+
+    // Largest frame any of the binary encoders writes for one body
+    constexpr size_t MaxSkeletonFrameSize = SkeletonFrameSize;
+
+    // Bodies beyond this count are left out of multi-body frames. Buffers are sized
+    // for it up front so the cost does not change as people come and go.
+    constexpr size_t MaxBodies = 8;
+    constexpr size_t BodiesHeaderSize = FrameHeaderSize + 2;
+    constexpr size_t BodyRecordPrefixSize = 2;
+    constexpr size_t MaxBodiesFrameSize = BodiesHeaderSize + MaxBodies * (BodyRecordPrefixSize + MaxSkeletonFrameSize - FrameHeaderSize);
+
+    constexpr size_t TimingFrameSize = FrameHeaderSize + 4 * sizeof(uint64_t);
+    constexpr size_t EchoFrameSize = FrameHeaderSize + 3 * sizeof(uint64_t);
+
+    // Host monotonic times in microseconds of the stages one body frame went through
+    struct StageTimes
+    {
+        uint64_t capture = 0;
+        uint64_t pop = 0;
+        uint64_t serialize = 0;
+        uint64_t send = 0;
+    };
+
+    // Joint masks have bit n set for joint n
+    static_assert(K4ABT_JOINT_COUNT <= 32, "Joint masks are 32 bits wide");
+    constexpr uint32_t AllJointsMask = K4ABT_JOINT_COUNT == 32 ? 0xFFFFFFFFu : ((1u << K4ABT_JOINT_COUNT) - 1);
+
+    // Write a complete skeleton frame (including the length prefix) into buffer,
+    // which must hold at least SkeletonFrameSize bytes. Returns the number of bytes written.
+    size_t WriteSkeletonFrame(uint8_t* buffer, const k4abt_body_t& body, uint64_t timestamp, uint32_t sequence);
+
+    // Quantized counterpart of WriteSkeletonFrame, buffer must hold QuantizedSkeletonFrameSize bytes
+    size_t WriteQuantizedSkeletonFrame(uint8_t* buffer, const k4abt_body_t& body, uint64_t timestamp, uint32_t sequence);
+
+    // Write a multi-body frame whose records use the Skeleton or QuantizedSkeleton
+    // layout. At most MaxBodies bodies are written; buffer must hold MaxBodiesFrameSize bytes.
+    size_t WriteBodiesFrame(uint8_t* buffer, MessageType recordType, const k4abt_body_t* bodies, size_t count,
+        uint64_t timestamp, uint32_t sequence);
+
+    // Decode a full skeleton or quantized skeleton frame back into a body.
+    // Returns false if the data is not a complete frame of either type.
+    bool ReadSkeletonFrame(const uint8_t* data, size_t size, k4abt_body_t& body, uint64_t& timestamp);
+
+    // Decode a multi-body frame with full or quantized records, or a single-body frame
+    // of either type, into up to maxBodies bodies. count receives the number decoded.
+    bool ReadBodiesFrame(const uint8_t* data, size_t size, k4abt_body_t* bodies, size_t maxBodies,
+        size_t& count, uint64_t& timestamp);
+
+    // Timing message for the frame with the given timestamp and sequence number.
+    // buffer must hold TimingFrameSize bytes. Returns the number of bytes written.
+    size_t WriteTimingFrame(uint8_t* buffer, const StageTimes& times, uint64_t timestamp, uint32_t sequence);
+    bool ReadTimingFrame(const uint8_t* data, size_t size, StageTimes& times, uint64_t& timestamp);
+
+    // Echo message, buffer must hold EchoFrameSize bytes
+    size_t WriteEchoFrame(uint8_t* buffer, uint64_t pingTime, uint64_t receiveTime, uint64_t sendTime);
+    bool ReadEchoFrame(const uint8_t* data, size_t size, uint64_t& pingTime, uint64_t& receiveTime, uint64_t& sendTime);
+
+    // Start a frame of the given type: writes the header with a placeholder length and
+    // returns where the payload goes. FinishFrame fills in the length once the end is known.
+    uint8_t* BeginFrame(uint8_t* buffer, MessageType type, uint64_t timestamp, uint32_t sequence);
+    size_t FinishFrame(uint8_t* buffer, const uint8_t* end);
+
+    // Smallest-three quaternion packing used by the quantized frames
+    uint32_t PackQuaternion(const k4a_quaternion_t& orientation);
+    k4a_quaternion_t UnpackQuaternion(uint32_t packed);
+
+    struct FrameHeader
+    {
+        uint32_t payloadLength;
+        uint8_t version;
+        MessageType type;
+        uint32_t sequence;
+        uint64_t timestamp;
+    };
+
+    // Parse and validate the common header at the start of a frame or datagram.
+    // Returns false if the data is too short or does not start with a frame.
+    bool ReadFrameHeader(const uint8_t* data, size_t size, FrameHeader& header);
+
+    // Receiver-side bookkeeping for transports that may lose or reorder frames.
+    // Sequence numbers are compared with wrap-around, so a stream can run forever.
+    class SequenceTracker
+    {
+    public:
+        enum class Result
+        {
+            InOrder,  // The next expected frame
+            Gap,      // Newer than expected, GetLost() counts the frames skipped over
+            Late      // Not newer than the newest frame seen, should be discarded. A reordered
+                      // frame was already counted in GetLost() when its gap was seen.
+        };
+
+        Result Accept(uint32_t sequence);
+
+        uint64_t GetReceived() const { return m_received; }
+        uint64_t GetLost() const { return m_lost; }
+        uint64_t GetLate() const { return m_late; }
+
+    private:
+        bool m_started = false;
+        uint32_t m_newest = 0;
+        uint64_t m_received = 0;
+        uint64_t m_lost = 0;
+        uint64_t m_late = 0;
+    };
+
+    // Little-endian field helpers, shared by the encoders
+    uint8_t* WriteU8(uint8_t* out, uint8_t value);
+    uint8_t* WriteU16(uint8_t* out, uint16_t value);
+    uint8_t* WriteU32(uint8_t* out, uint32_t value);
+    uint8_t* WriteU64(uint8_t* out, uint64_t value);
+    uint8_t* WriteF32(uint8_t* out, float value);
+
+    uint16_t ReadU16(const uint8_t* in);
+    uint32_t ReadU32(const uint8_t* in);
+    uint64_t ReadU64(const uint8_t* in);
+    float ReadF32(const uint8_t* in);
+}
@@ -0,0 +1,87 @@
+// Licensed under the MIT License.
+
+#include "SkeletonWorkerPool.h"
+#include <algorithm>
+
+SkeletonWorkerPool::SkeletonWorkerPool(size_t threadCount)
+	: m_task(nullptr)
+	, m_generation(0)
+	, m_pending(0)
+	, m_stopping(false)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), MaxThreads);
+	}
+	for (size_t i = 1; i < threadCount; i++)
+	{
+		m_workers.emplace_back(&SkeletonWorkerPool::WorkerLoop, this, i);
+	}
+}
+
+SkeletonWorkerPool::~SkeletonWorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_start.notify_all();
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void SkeletonWorkerPool::Run(const std::function<void(size_t)>& task)
+{
+	if (!m_workers.empty())
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_pending = m_workers.size();
+		m_generation++;
+	}
+	m_start.notify_all();
+
+	task(0);
+
+	if (!m_workers.empty())
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_pending == 0; });
+		m_task = nullptr;
+	}
+}
+
+void SkeletonWorkerPool::SplitRows(size_t height, size_t task, size_t taskCount, size_t& first, size_t& end)
+{
+	first = height * task / taskCount;
+	end = height * (task + 1) / taskCount;
+}
+
+void SkeletonWorkerPool::WorkerLoop(size_t index)
+{
+	uint64_t seen = 0;
+	for (;;)
+	{
+		const std::function<void(size_t)>* task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_start.wait(lock, [&] { return m_stopping || m_generation != seen; });
+			if (m_stopping)
+			{
+				return;
+			}
+			seen = m_generation;
+			task = m_task;
+		}
+
+		(*task)(index);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_pending == 0)
+		{
+			m_done.notify_one();
+		}
+	}
+}
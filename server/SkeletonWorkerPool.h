@@ -0,0 +1,45 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A few threads that split per-frame image work, such as the rows of a depth image,
+// with the thread that asks for it. Threads are started once and wait in between,
+// so handing out a frame's work costs a wake-up rather than a thread start.
+class SkeletonWorkerPool
+{
+public:
+    // threadCount includes the calling thread, 0 picks one per core up to MaxThreads
+    explicit SkeletonWorkerPool(size_t threadCount = 0);
+    ~SkeletonWorkerPool();
+
+    static constexpr size_t MaxThreads = 4;
+
+    // Call task(i) for every i below GetThreadCount(), each on its own thread, the
+    // calling thread doing task(0). Returns once all of them have. Call from one thread only.
+    void Run(const std::function<void(size_t)>& task);
+
+    size_t GetThreadCount() const { return m_workers.size() + 1; }
+
+    // Rows [first, end) of height rows that task i of a Run should take
+    static void SplitRows(size_t height, size_t task, size_t taskCount, size_t& first, size_t& end);
+
+private:
+    void WorkerLoop(size_t index);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const std::function<void(size_t)>* m_task;
+    uint64_t m_generation;
+    size_t m_pending;
+    bool m_stopping;
+};
@@ -0,0 +1,78 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+// The streaming code is written against the Winsock API. On other platforms the
+// few Winsock-only names it uses are mapped onto their BSD socket equivalents.
+#ifdef _WIN32
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+// Sends never raise signals on Windows
+constexpr int SocketSendFlags = 0;
+
+#else
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+typedef unsigned long u_long;
+typedef unsigned long ULONG;
+typedef pollfd WSAPOLLFD;
+
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#define WSAEINPROGRESS EINPROGRESS
+#define SD_BOTH SHUT_RDWR
+#ifndef POLLRDNORM
+#define POLLRDNORM POLLIN
+#endif
+#ifndef POLLWRNORM
+#define POLLWRNORM POLLOUT
+#endif
+#define MAKEWORD(low, high) ((low) | ((high) << 8))
+
+// A peer that went away must surface as a send error, not kill the process with SIGPIPE
+constexpr int SocketSendFlags = MSG_NOSIGNAL;
+
+struct WSADATA
+{
+    int unused;
+};
+
+inline int WSAStartup(int /*version*/, WSADATA* /*data*/) { return 0; }
+inline int WSACleanup() { return 0; }
+inline int WSAGetLastError() { return errno; }
+inline int closesocket(SOCKET socket) { return close(socket); }
+inline int WSAPoll(WSAPOLLFD* fds, ULONG count, int timeoutMs) { return poll(fds, count, timeoutMs); }
+
+// Only FIONBIO is used, to switch a socket between blocking and non-blocking mode
+inline int ioctlsocket(SOCKET socket, long /*command*/, u_long* argument)
+{
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags < 0)
+    {
+        return SOCKET_ERROR;
+    }
+    flags = *argument != 0 ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(socket, F_SETFL, flags) < 0 ? SOCKET_ERROR : 0;
+}
+
+#ifndef FIONBIO
+#define FIONBIO 0
+#endif
+
+#endif
@@ -0,0 +1,214 @@
+// Licensed under the MIT License.
+
+#include "SocketPoller.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#ifdef __linux__
+
+namespace
+{
+	uint32_t ToEpoll(uint32_t interest)
+	{
+		uint32_t events = 0;
+		if (interest & SocketPoller::Readable)
+		{
+			events |= EPOLLIN | EPOLLRDHUP;
+		}
+		if (interest & SocketPoller::Writable)
+		{
+			events |= EPOLLOUT;
+		}
+		return events;
+	}
+}
+
+SocketPoller::SocketPoller()
+	: m_epoll(-1)
+{
+}
+
+bool SocketPoller::Open()
+{
+	Close();
+	m_epoll = epoll_create1(EPOLL_CLOEXEC);
+	return m_epoll >= 0;
+}
+
+void SocketPoller::Close()
+{
+	if (m_epoll >= 0)
+	{
+		close(m_epoll);
+		m_epoll = -1;
+	}
+}
+
+bool SocketPoller::Add(SOCKET socket, uint32_t interest, void* context)
+{
+	epoll_event event = {};
+	event.events = ToEpoll(interest);
+	event.data.ptr = context;
+	return epoll_ctl(m_epoll, EPOLL_CTL_ADD, socket, &event) == 0;
+}
+
+bool SocketPoller::Modify(SOCKET socket, uint32_t interest, void* context)
+{
+	epoll_event event = {};
+	event.events = ToEpoll(interest);
+	event.data.ptr = context;
+	return epoll_ctl(m_epoll, EPOLL_CTL_MOD, socket, &event) == 0;
+}
+
+void SocketPoller::Remove(SOCKET socket)
+{
+	epoll_event event = {};
+	epoll_ctl(m_epoll, EPOLL_CTL_DEL, socket, &event);
+}
+
+bool SocketPoller::Wait(std::vector<Event>& events, int timeoutMs)
+{
+	epoll_event ready[64];
+	events.clear();
+
+	int count = epoll_wait(m_epoll, ready, 64, timeoutMs);
+	if (count < 0)
+	{
+		// A signal is not a failure, the caller simply polls again
+		return errno == EINTR;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t flags = 0;
+		if (ready[i].events & EPOLLIN)
+		{
+			flags |= Readable;
+		}
+		if (ready[i].events & EPOLLOUT)
+		{
+			flags |= Writable;
+		}
+		if (ready[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+		{
+			flags |= Closed;
+		}
+		events.push_back({ ready[i].data.ptr, flags });
+	}
+	return true;
+}
+
+#else
+
+namespace
+{
+	short ToPoll(uint32_t interest)
+	{
+		short events = 0;
+		if (interest & SocketPoller::Readable)
+		{
+			events |= POLLRDNORM;
+		}
+		if (interest & SocketPoller::Writable)
+		{
+			events |= POLLWRNORM;
+		}
+		return events;
+	}
+}
+
+SocketPoller::SocketPoller()
+{
+}
+
+bool SocketPoller::Open()
+{
+	Close();
+	return true;
+}
+
+void SocketPoller::Close()
+{
+	m_pollFds.clear();
+	m_contexts.clear();
+}
+
+bool SocketPoller::Add(SOCKET socket, uint32_t interest, void* context)
+{
+	m_pollFds.push_back({ socket, ToPoll(interest), 0 });
+	m_contexts.push_back(context);
+	return true;
+}
+
+bool SocketPoller::Modify(SOCKET socket, uint32_t interest, void* context)
+{
+	for (size_t i = 0; i < m_pollFds.size(); i++)
+	{
+		if (m_pollFds[i].fd == socket)
+		{
+			m_pollFds[i].events = ToPoll(interest);
+			m_contexts[i] = context;
+			return true;
+		}
+	}
+	return false;
+}
+
+void SocketPoller::Remove(SOCKET socket)
+{
+	for (size_t i = 0; i < m_pollFds.size(); i++)
+	{
+		if (m_pollFds[i].fd == socket)
+		{
+			m_pollFds.erase(m_pollFds.begin() + i);
+			m_contexts.erase(m_contexts.begin() + i);
+			return;
+		}
+	}
+}
+
+bool SocketPoller::Wait(std::vector<Event>& events, int timeoutMs)
+{
+	events.clear();
+
+	int ready = WSAPoll(m_pollFds.data(), (ULONG)m_pollFds.size(), timeoutMs);
+	if (ready == SOCKET_ERROR)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < m_pollFds.size() && ready > 0; i++)
+	{
+		short revents = m_pollFds[i].revents;
+		if (revents == 0)
+		{
+			continue;
+		}
+
+		uint32_t flags = 0;
+		if (revents & POLLRDNORM)
+		{
+			flags |= Readable;
+		}
+		if (revents & POLLWRNORM)
+		{
+			flags |= Writable;
+		}
+		if (revents & (POLLERR | POLLHUP | POLLNVAL))
+		{
+			flags |= Closed;
+		}
+		events.push_back({ m_contexts[i], flags });
+		ready--;
+	}
+	return true;
+}
+
+#endif
+
+SocketPoller::~SocketPoller()
+{
+	Close();
+}
@@ -0,0 +1,54 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "SocketPlatform.h"
+
+// Readiness notification for many non-blocking sockets on one thread. Linux uses
+// epoll, so the cost of a wait only depends on the sockets that are ready; other
+// platforms fall back to WSAPoll/poll over the registered set.
+//
+// Registrations are level-triggered: a socket stays readable or writable until it
+// is drained or filled, so callers only ask for Writable while they have data queued.
+class SocketPoller
+{
+public:
+    enum Events : uint32_t
+    {
+        Readable = 1,
+        Writable = 2,
+        Closed = 4  // Error or hang-up, reported whatever the interest
+    };
+
+    struct Event
+    {
+        void* context;
+        uint32_t events;
+    };
+
+    SocketPoller();
+    ~SocketPoller();
+
+    bool Open();
+    void Close();
+
+    // context is handed back with every event of the socket
+    bool Add(SOCKET socket, uint32_t interest, void* context);
+    bool Modify(SOCKET socket, uint32_t interest, void* context);
+    void Remove(SOCKET socket);
+
+    // Wait up to timeoutMs for events and replace the contents of events with them.
+    // Returns false if the wait itself failed.
+    bool Wait(std::vector<Event>& events, int timeoutMs);
+
+private:
+#ifdef __linux__
+    int m_epoll;
+#else
+    std::vector<WSAPOLLFD> m_pollFds;
+    std::vector<void*> m_contexts;
+#endif
+};
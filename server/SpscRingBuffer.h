@@ -0,0 +1,139 @@
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// Bounded lock-free ring for one producer thread and one consumer thread.
+//
+// Every slot carries a sequence number telling which lap it belongs to, so the
+// producer can also evict the oldest element when the ring is full (the consumer
+// and the producer both claim elements by advancing the tail with a CAS). T is
+// copied in and out and should be a plain, trivially copyable record.
+template <typename T>
+class SpscRingBuffer
+{
+public:
+    // The capacity is rounded up to the next power of two
+    explicit SpscRingBuffer(size_t capacity)
+        : m_mask(0)
+        , m_head(0)
+        , m_tail(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+
+        m_slots.reset(new Slot[size]);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t Capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // Producer: append an item, returns false when the ring is full
+    bool TryPush(const T& item)
+    {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[head & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != head)
+        {
+            return false;
+        }
+
+        slot.value = item;
+        slot.sequence.store(head + 1, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    // Producer: append an item, evicting the oldest ones if the ring is full.
+    // Returns the number of evicted items.
+    size_t PushEvictOldest(const T& item)
+    {
+        size_t evicted = 0;
+        while (!TryPush(item))
+        {
+            uint64_t head = m_head.load(std::memory_order_relaxed);
+            uint64_t tail = m_tail.load(std::memory_order_acquire);
+            if (head - tail >= Capacity() &&
+                m_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel))
+            {
+                // We own the oldest slot now, hand it back without reading it
+                m_slots[tail & m_mask].sequence.store(tail + Capacity(), std::memory_order_release);
+                evicted++;
+                continue;
+            }
+
+            // The consumer is still copying out the slot we need, this is short
+            std::this_thread::yield();
+        }
+        return evicted;
+    }
+
+    // Consumer: take the oldest item, returns false when the ring is empty
+    bool TryPop(T& item)
+    {
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        for (;;)
+        {
+            Slot& slot = m_slots[tail & m_mask];
+            if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+            {
+                // Either empty, or the producer evicted this element meanwhile
+                uint64_t current = m_tail.load(std::memory_order_acquire);
+                if (current == tail)
+                {
+                    return false;
+                }
+                tail = current;
+                continue;
+            }
+
+            if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                item = slot.value;
+                slot.sequence.store(tail + Capacity(), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    // Producer: whether TryPush would fail for lack of room
+    bool Full() const
+    {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        return m_slots[head & m_mask].sequence.load(std::memory_order_seq_cst) != head;
+    }
+
+    bool Empty() const
+    {
+        return m_head.load(std::memory_order_seq_cst) == m_tail.load(std::memory_order_seq_cst);
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+
+    // Keep the producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<uint64_t> m_head;
+    alignas(64) std::atomic<uint64_t> m_tail;
+};
@@ -0,0 +1,621 @@
+// Licensed under the MIT License.
+
+// Serializer microbenchmark. Runs every skeleton encoding over synthetic and
+// recorded bodies and reports ns, bytes and heap allocations per frame for 1 to
+// 6 bodies, then the RVL depth codec, the silhouette encodings and point cloud
+// extraction on synthetic 640x576 depth images and body index maps. The legacy
+// encoder is the nlohmann::json code that CreateJsonFromSkeleton used before the
+// hand-written writer replaced it, kept here as the baseline.
+//
+//   kss_bench [--quick] [RECORDING ...]
+//
+// Recordings are pose snapshot files or captures of a JSON or binary stream, see
+// SkeletonRecording.h. With --quick every case runs briefly and the exit
+// code is 1 if an encoder other than the legacy one allocates, the compact JSON
+// no longer matches the legacy output or RVL or run frames do not round-trip,
+// which makes it usable as a test.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "SkeletonDeltaCodec.h"
+#include "SkeletonDepthCodec.h"
+#include "SkeletonJsonWriter.h"
+#include "SkeletonPointCloudCodec.h"
+#include "SkeletonRecording.h"
+#include "SkeletonSilhouetteCodec.h"
+#include "SkeletonWireFormat.h"
+
+using json = nlohmann::json;
+
+namespace
+{
+	// Counted by the global operator new below. The benchmark is single-threaded.
+	uint64_t g_allocations = 0;
+}
+
+void* operator new(size_t size)
+{
+	g_allocations++;
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+	const size_t MaxBenchBodies = 6;
+	const size_t SyntheticFrameCount = 300;
+	const uint64_t FrameIntervalUsec = 33333;
+	const char* SnapshotName = "pose_snapshot_20240115_143025.json";
+	const int DepthWidth = 640;
+	const int DepthHeight = 576;
+	const int DepthFrameCount = 8;
+
+	typedef std::vector<k4abt_body_t> Frame;
+
+	struct Dataset
+	{
+		std::string name;
+		std::vector<Frame> frames;
+	};
+
+	// The encoder CreateJsonFromSkeleton had before the hand-written writer
+	std::string LegacyJson(const k4abt_body_t& body, uint64_t timestamp)
+	{
+		json jsonData;
+		jsonData["body_id"] = body.id;
+		jsonData["timestamp"] = timestamp;
+
+		json jointsArray = json::array();
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			const k4a_float3_t& pos = body.skeleton.joints[joint].position;
+			const k4a_quaternion_t& orientation = body.skeleton.joints[joint].orientation;
+			k4abt_joint_confidence_level_t confidence = body.skeleton.joints[joint].confidence_level;
+
+			json jointObj;
+			jointObj["joint"] = joint;
+			jointObj["position"] = { {"x", pos.xyz.x}, {"y", pos.xyz.y}, {"z", pos.xyz.z} };
+			jointObj["orientation"] = {
+				{"w", orientation.wxyz.w}, {"x", orientation.wxyz.x},
+				{"y", orientation.wxyz.y}, {"z", orientation.wxyz.z} };
+			jointObj["confidence_level"] = static_cast<int>(confidence);
+			jointsArray.push_back(jointObj);
+		}
+		jsonData["joints"] = jointsArray;
+		return jsonData.dump();
+	}
+
+	// People walking in place in front of the camera: every joint sways a few
+	// centimeters and the orientations turn slowly, so every frame differs
+	Dataset MakeSynthetic()
+	{
+		Dataset dataset;
+		dataset.name = "synthetic";
+		for (size_t frame = 0; frame < SyntheticFrameCount; frame++)
+		{
+			Frame bodies(MaxBenchBodies);
+			for (size_t index = 0; index < MaxBenchBodies; index++)
+			{
+				k4abt_body_t& body = bodies[index];
+				body = {};
+				body.id = static_cast<uint32_t>(index + 1);
+				for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+				{
+					float phase = 0.21f * static_cast<float>(frame) + 0.37f * static_cast<float>(joint + index);
+					k4abt_joint_t& target = body.skeleton.joints[joint];
+					target.position.xyz.x = -1500.0f + 600.0f * index + 40.0f * std::sin(phase);
+					target.position.xyz.y = 800.0f - 55.0f * joint + 25.0f * std::cos(phase);
+					target.position.xyz.z = 2500.0f + 100.0f * index + 30.0f * std::sin(0.5f * phase);
+
+					float angle = 0.02f * static_cast<float>(frame) + 0.1f * static_cast<float>(joint);
+					target.orientation.wxyz.w = std::cos(angle);
+					target.orientation.wxyz.x = 0.6f * std::sin(angle);
+					target.orientation.wxyz.y = 0.8f * std::sin(angle);
+					target.orientation.wxyz.z = 0.0f;
+					target.confidence_level = joint >= K4ABT_JOINT_NOSE ?
+						K4ABT_JOINT_CONFIDENCE_LOW : K4ABT_JOINT_CONFIDENCE_MEDIUM;
+				}
+			}
+			dataset.frames.push_back(bodies);
+		}
+		return dataset;
+	}
+
+	// A pose snapshot or a capture of any encoding, see SkeletonRecording.h
+	bool LoadRecording(const char* path, Dataset& dataset)
+	{
+		std::vector<SkeletonRecording::Frame> recorded;
+		if (!SkeletonRecording::Load(path, recorded))
+		{
+			return false;
+		}
+		dataset.name = path;
+		for (const SkeletonRecording::Frame& frame : recorded)
+		{
+			dataset.frames.push_back(frame.bodies);
+		}
+		return true;
+	}
+
+	// Bring every frame to exactly count bodies
+	std::vector<Frame> WithBodyCount(const std::vector<Frame>& frames, size_t count)
+	{
+		std::vector<Frame> result = frames;
+		for (Frame& bodies : result)
+		{
+			SkeletonRecording::SetBodyCount(bodies, count);
+		}
+		return result;
+	}
+
+	// Encodes one frame into out and returns the bytes written
+	typedef std::function<size_t(const Frame& frame, uint64_t timestamp, uint32_t sequence)> Encode;
+
+	struct Encoder
+	{
+		const char* name;
+		bool allocates;
+		Encode encode;
+	};
+
+	struct Result
+	{
+		double nsPerFrame;
+		double bytesPerFrame;
+		double allocationsPerFrame;
+	};
+
+	Result Measure(const Encode& encode, const std::vector<Frame>& frames, std::chrono::milliseconds minDuration)
+	{
+		// One pass to warm up caches and let encoders with state settle
+		uint32_t sequence = 0;
+		for (const Frame& frame : frames)
+		{
+			encode(frame, sequence * FrameIntervalUsec, sequence);
+			sequence++;
+		}
+
+		uint64_t frameCount = 0;
+		uint64_t bytes = 0;
+		uint64_t allocations = g_allocations;
+		auto start = std::chrono::steady_clock::now();
+		auto elapsed = std::chrono::steady_clock::duration::zero();
+		do
+		{
+			for (const Frame& frame : frames)
+			{
+				bytes += encode(frame, sequence * FrameIntervalUsec, sequence);
+				sequence++;
+			}
+			frameCount += frames.size();
+			elapsed = std::chrono::steady_clock::now() - start;
+		} while (elapsed < minDuration);
+
+		Result result;
+		result.nsPerFrame = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / frameCount;
+		result.bytesPerFrame = static_cast<double>(bytes) / frameCount;
+		result.allocationsPerFrame = static_cast<double>(g_allocations - allocations) / frameCount;
+		return result;
+	}
+
+	// The hand-written writer promises the legacy output byte for byte
+	bool CheckJson(const std::vector<Frame>& frames, std::vector<char>& buffer)
+	{
+		for (size_t index = 0; index < frames.size(); index++)
+		{
+			for (const k4abt_body_t& body : frames[index])
+			{
+				std::string legacy = LegacyJson(body, index * FrameIntervalUsec);
+				size_t size = SkeletonJson::WriteSkeleton(buffer.data(), body, index * FrameIntervalUsec);
+				if (legacy.size() != size || memcmp(legacy.data(), buffer.data(), size) != 0)
+				{
+					printf("Compact JSON differs from the legacy encoder for body %u of frame %zu\n", body.id, index);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Time each codec over the DepthFrameCount images until minDuration has passed.
+	// Returns false if one of them allocates.
+	template <size_t Count>
+	bool MeasureImageCodecs(const std::pair<const char*, std::function<size_t(size_t)>> (&codecs)[Count],
+		std::chrono::milliseconds minDuration)
+	{
+		bool passed = true;
+		for (const auto& codec : codecs)
+		{
+			uint64_t frames = 0;
+			uint64_t bytes = 0;
+			uint64_t allocations = g_allocations;
+			auto start = std::chrono::steady_clock::now();
+			auto elapsed = std::chrono::steady_clock::duration::zero();
+			do
+			{
+				bytes += codec.second(frames % DepthFrameCount);
+				frames++;
+				elapsed = std::chrono::steady_clock::now() - start;
+			} while (elapsed < minDuration || frames < static_cast<uint64_t>(DepthFrameCount));
+
+			double allocationsPerFrame = static_cast<double>(g_allocations - allocations) / frames;
+			printf("%-16s %12.0f %12.1f %13.2f\n", codec.first,
+				static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / frames,
+				static_cast<double>(bytes) / frames, allocationsPerFrame);
+			if (allocationsPerFrame > 0)
+			{
+				printf("%s allocates on every frame\n", codec.first);
+				passed = false;
+			}
+		}
+		return passed;
+	}
+
+	// A person in front of a wall with invalid pixels at the edges and in patches,
+	// sensor noise on every valid pixel
+	std::vector<uint16_t> MakeDepth(int frame)
+	{
+		std::vector<uint16_t> depth(static_cast<size_t>(DepthWidth) * DepthHeight);
+		uint32_t noise = 12345u + static_cast<uint32_t>(frame);
+		for (int y = 0; y < DepthHeight; y++)
+		{
+			for (int x = 0; x < DepthWidth; x++)
+			{
+				noise = noise * 1664525u + 1013904223u;
+				int dx = x - DepthWidth / 2 - 4 * frame;
+				int dy = y - DepthHeight / 2;
+				bool invalid = x < 40 || x >= DepthWidth - 40 || ((x / 16 + y / 16 + frame) % 11 == 0);
+				bool person = dx * dx / 4 + dy * dy / 16 < 3600;
+				int value = person ? 1800 + (dx * dx + dy * dy) / 400 : 3500 + y;
+				depth[static_cast<size_t>(y) * DepthWidth + x] = invalid ? 0 : static_cast<uint16_t>(value + (noise >> 29));
+			}
+		}
+		return depth;
+	}
+
+	bool RunDepth(bool quick)
+	{
+		std::chrono::milliseconds minDuration(quick ? 10 : 300);
+		std::vector<std::vector<uint16_t>> images;
+		for (int frame = 0; frame < DepthFrameCount; frame++)
+		{
+			images.push_back(MakeDepth(frame));
+		}
+		size_t pixels = images[0].size();
+
+		printf("\ndepth %dx%d, %d frames, %zu bytes raw\n", DepthWidth, DepthHeight, DepthFrameCount, pixels * sizeof(uint16_t));
+		printf("%-16s %12s %12s %13s\n", "codec", "ns/frame", "bytes/frame", "allocs/frame");
+
+		std::vector<uint8_t> compressed(SkeletonDepth::MaxRvlSize(pixels) * DepthFrameCount);
+		std::vector<size_t> sizes(DepthFrameCount);
+		for (int frame = 0; frame < DepthFrameCount; frame++)
+		{
+			sizes[frame] = SkeletonDepth::CompressRvl(images[frame].data(), pixels,
+				compressed.data() + frame * SkeletonDepth::MaxRvlSize(pixels));
+		}
+		std::vector<uint16_t> decoded(pixels);
+		bool passed = true;
+
+		const std::pair<const char*, std::function<size_t(size_t)>> codecs[] = {
+			{ "rvl", [&](size_t frame) {
+				return SkeletonDepth::CompressRvl(images[frame].data(), pixels,
+					compressed.data() + frame * SkeletonDepth::MaxRvlSize(pixels));
+			} },
+			{ "rvl decode", [&](size_t frame) {
+				passed = SkeletonDepth::DecompressRvl(compressed.data() + frame * SkeletonDepth::MaxRvlSize(pixels), sizes[frame],
+					decoded.data(), pixels) && decoded == images[frame] && passed;
+				return sizes[frame];
+			} },
+		};
+		passed = MeasureImageCodecs(codecs, minDuration) && passed;
+		if (!passed)
+		{
+			printf("RVL does not decode to the original depth images\n");
+		}
+		return passed;
+	}
+
+	// Two people with ragged edges like the tracker's, walking apart
+	std::vector<uint8_t> MakeBodyIndexMap(int frame)
+	{
+		std::vector<uint8_t> map(static_cast<size_t>(DepthWidth) * DepthHeight, SkeletonSilhouette::Background);
+		uint32_t noise = 54321u + static_cast<uint32_t>(frame);
+		for (int y = 0; y < DepthHeight; y++)
+		{
+			for (int x = 0; x < DepthWidth; x++)
+			{
+				noise = noise * 1664525u + 1013904223u;
+				int ragged = static_cast<int>(noise >> 30);
+				for (int person = 0; person < 2; person++)
+				{
+					int dx = x - DepthWidth / 3 - person * DepthWidth / 3 + (person == 0 ? -frame : frame);
+					int dy = y - DepthHeight / 2;
+					bool torso = dx * dx / 4 + dy * dy / 16 < 3600 + ragged * 60;
+					bool arms = dy > -120 && dy < -90 + ragged && dx > -140 && dx < 140;
+					if (torso || arms)
+					{
+						map[static_cast<size_t>(y) * DepthWidth + x] = static_cast<uint8_t>(person);
+					}
+				}
+			}
+		}
+		return map;
+	}
+
+	bool RunSilhouettes(bool quick)
+	{
+		std::chrono::milliseconds minDuration(quick ? 10 : 300);
+		std::vector<std::vector<uint8_t>> maps;
+		for (int frame = 0; frame < DepthFrameCount; frame++)
+		{
+			maps.push_back(MakeBodyIndexMap(frame));
+		}
+		const uint32_t bodyIds[] = { 1, 2 };
+
+		printf("\nsilhouettes %dx%d, %d frames, 2 bodies\n", DepthWidth, DepthHeight, DepthFrameCount);
+		printf("%-16s %12s %12s %13s\n", "encoding", "ns/frame", "bytes/frame", "allocs/frame");
+
+		SkeletonSilhouette::SilhouetteEncoder encoder;
+		std::vector<uint8_t> buffer(SkeletonSilhouette::MaxSilhouetteFrameSize(DepthWidth, DepthHeight));
+		std::vector<std::vector<uint8_t>> runFrames(DepthFrameCount);
+		for (int frame = 0; frame < DepthFrameCount; frame++)
+		{
+			encoder.SetMap(maps[frame].data(), DepthWidth, DepthHeight, bodyIds, 2);
+			encoder.WriteContourFrame(buffer.data(), 3, 0, 0);
+			size_t size = encoder.WriteRunFrame(buffer.data(), 3, 0, 0);
+			runFrames[frame].assign(buffer.begin(), buffer.begin() + size);
+		}
+		std::vector<uint8_t> decoded;
+		std::vector<uint32_t> decodedIds;
+		bool passed = true;
+		auto decode = [&](size_t frame) {
+			int width, height;
+			uint64_t timestamp;
+			passed = SkeletonSilhouette::ReadRunFrame(runFrames[frame].data(), runFrames[frame].size(), decoded, width, height,
+				decodedIds, timestamp) && decoded == maps[frame] && passed;
+			return runFrames[frame].size();
+		};
+		decode(0);
+
+		const std::pair<const char*, std::function<size_t(size_t)>> codecs[] = {
+			{ "runs", [&](size_t frame) {
+				encoder.SetMap(maps[frame].data(), DepthWidth, DepthHeight, bodyIds, 2);
+				return encoder.WriteRunFrame(buffer.data(), 3, 0, 0);
+			} },
+			{ "contours", [&](size_t frame) {
+				encoder.SetMap(maps[frame].data(), DepthWidth, DepthHeight, bodyIds, 2);
+				return encoder.WriteContourFrame(buffer.data(), 3, 0, 0);
+			} },
+			{ "runs decode", decode },
+		};
+		passed = MeasureImageCodecs(codecs, minDuration) && passed;
+		if (!passed)
+		{
+			printf("Run frames do not decode to the original body index maps\n");
+		}
+		return passed;
+	}
+
+	// Pinhole rays of a 75 degree wide depth camera
+	std::vector<float> MakeXyTable()
+	{
+		std::vector<float> xyTable(2 * static_cast<size_t>(DepthWidth) * DepthHeight);
+		for (int y = 0; y < DepthHeight; y++)
+		{
+			for (int x = 0; x < DepthWidth; x++)
+			{
+				size_t pixel = static_cast<size_t>(y) * DepthWidth + x;
+				xyTable[2 * pixel] = (x - DepthWidth / 2 + 0.5f) / 417.0f;
+				xyTable[2 * pixel + 1] = (y - DepthHeight / 2 + 0.5f) / 417.0f;
+			}
+		}
+		return xyTable;
+	}
+
+	bool RunPointClouds(bool quick)
+	{
+		std::chrono::milliseconds minDuration(quick ? 10 : 300);
+		std::vector<std::vector<uint16_t>> depths;
+		std::vector<std::vector<uint8_t>> maps;
+		for (int frame = 0; frame < DepthFrameCount; frame++)
+		{
+			depths.push_back(MakeDepth(frame));
+			maps.push_back(MakeBodyIndexMap(frame));
+		}
+		const uint32_t bodyIds[] = { 1, 2 };
+
+		SkeletonPointCloud::PointCloudEncoder single(DepthWidth, DepthHeight, MakeXyTable(), 1);
+		SkeletonPointCloud::PointCloudEncoder pooled(DepthWidth, DepthHeight, MakeXyTable(), SkeletonWorkerPool::MaxThreads);
+		std::vector<uint8_t> buffer(SkeletonPointCloud::MaxPointCloudFrameSize(depths[0].size()));
+		for (int frame = 0; frame < DepthFrameCount; frame++)
+		{
+			for (SkeletonPointCloud::PointCloudEncoder* encoder : { &single, &pooled })
+			{
+				encoder->SetFrame(depths[frame].data(), maps[frame].data(), bodyIds, 2);
+				encoder->WriteFrame(buffer.data(), 3, 0, 0, 0);
+				encoder->WriteFrame(buffer.data(), 3, SkeletonPointCloud::DefaultVoxelSizeMm, 0, 0);
+			}
+		}
+
+		printf("\npoint clouds %dx%d, %d frames, 2 bodies, %zu points per frame\n", DepthWidth, DepthHeight, DepthFrameCount,
+			pooled.GetPointCount());
+		printf("%-16s %12s %12s %13s\n", "stage", "ns/frame", "bytes/frame", "allocs/frame");
+
+		char pooledName[32];
+		snprintf(pooledName, sizeof(pooledName), "extract x%zu", pooled.GetThreadCount());
+		const std::pair<const char*, std::function<size_t(size_t)>> codecs[] = {
+			{ "extract x1", [&](size_t frame) {
+				single.SetFrame(depths[frame].data(), maps[frame].data(), bodyIds, 2);
+				return size_t(0);
+			} },
+			{ pooledName, [&](size_t frame) {
+				pooled.SetFrame(depths[frame].data(), maps[frame].data(), bodyIds, 2);
+				return size_t(0);
+			} },
+			{ "every point", [&](size_t frame) {
+				pooled.SetFrame(depths[frame].data(), maps[frame].data(), bodyIds, 2);
+				return pooled.WriteFrame(buffer.data(), 3, 0, 0, 0);
+			} },
+			{ "20 mm voxels", [&](size_t frame) {
+				pooled.SetFrame(depths[frame].data(), maps[frame].data(), bodyIds, 2);
+				return pooled.WriteFrame(buffer.data(), 3, SkeletonPointCloud::DefaultVoxelSizeMm, 0, 0);
+			} },
+		};
+		return MeasureImageCodecs(codecs, minDuration);
+	}
+
+	bool Run(const Dataset& dataset, bool quick)
+	{
+		bool passed = true;
+		std::chrono::milliseconds minDuration(quick ? 10 : 300);
+
+		printf("\n%s, %zu frame%s\n", dataset.name.c_str(), dataset.frames.size(), dataset.frames.size() == 1 ? "" : "s");
+		printf("%-16s %6s %12s %12s %13s\n", "encoding", "bodies", "ns/frame", "bytes/frame", "allocs/frame");
+
+		// Output buffers are allocated once, like the sender's frame buffers
+		std::vector<char> text(SkeletonJson::MaxBodiesSize(MaxBenchBodies) +
+			SkeletonJson::MaxStringSize(strlen(SnapshotName)));
+		std::vector<uint8_t> binary(SkeletonWire::MaxBodiesFrameSize);
+		SkeletonDeltaEncoder deltaEncoder;
+		SkeletonDeltaEncoder deadReckoningEncoder;
+
+		std::vector<Encoder> encoders = {
+			{ "nlohmann", true, [](const Frame& frame, uint64_t timestamp, uint32_t) {
+				size_t size = 0;
+				for (const k4abt_body_t& body : frame)
+				{
+					size += LegacyJson(body, timestamp).size();
+				}
+				return size;
+			} },
+			{ "json", false, [&](const Frame& frame, uint64_t timestamp, uint32_t) {
+				size_t size = 0;
+				for (const k4abt_body_t& body : frame)
+				{
+					size += SkeletonJson::WriteSkeleton(text.data(), body, timestamp);
+				}
+				return size;
+			} },
+			{ "json bodies", false, [&](const Frame& frame, uint64_t timestamp, uint32_t) {
+				return SkeletonJson::WriteBodies(text.data(), frame.data(), frame.size(), timestamp);
+			} },
+			{ "json snapshot", false, [&](const Frame& frame, uint64_t, uint32_t) {
+				size_t size = 0;
+				for (const k4abt_body_t& body : frame)
+				{
+					size += SkeletonJson::WriteSnapshot(text.data(), body, SnapshotName);
+				}
+				return size;
+			} },
+			{ "binary", false, [&](const Frame& frame, uint64_t timestamp, uint32_t sequence) {
+				return SkeletonWire::WriteBodiesFrame(binary.data(), SkeletonWire::MessageType::Skeleton,
+					frame.data(), frame.size(), timestamp, sequence);
+			} },
+			{ "quantized", false, [&](const Frame& frame, uint64_t timestamp, uint32_t sequence) {
+				return SkeletonWire::WriteBodiesFrame(binary.data(), SkeletonWire::MessageType::QuantizedSkeleton,
+					frame.data(), frame.size(), timestamp, sequence);
+			} },
+			{ "delta", false, [&](const Frame& frame, uint64_t timestamp, uint32_t sequence) {
+				return deltaEncoder.WriteBodies(binary.data(), frame.data(), frame.size(), timestamp, sequence);
+			} },
+			{ "delta 10mm dr", false, [&](const Frame& frame, uint64_t timestamp, uint32_t sequence) {
+				return deadReckoningEncoder.WriteBodies(binary.data(), frame.data(), frame.size(), timestamp, sequence);
+			} },
+		};
+
+		for (size_t count = 1; count <= MaxBenchBodies; count++)
+		{
+			std::vector<Frame> frames = WithBodyCount(dataset.frames, count);
+			if (count == 1 && !CheckJson(frames, text))
+			{
+				passed = false;
+			}
+
+			for (const Encoder& encoder : encoders)
+			{
+				deltaEncoder = SkeletonDeltaEncoder();
+				deadReckoningEncoder = SkeletonDeltaEncoder();
+				deadReckoningEncoder.SetDeadReckoning(10.0f);
+				Result result = Measure(encoder.encode, frames, minDuration);
+				printf("%-16s %6zu %12.0f %12.1f %13.2f\n", encoder.name, count,
+					result.nsPerFrame, result.bytesPerFrame, result.allocationsPerFrame);
+				if (!encoder.allocates && result.allocationsPerFrame > 0)
+				{
+					printf("%s allocates on every frame\n", encoder.name);
+					passed = false;
+				}
+			}
+		}
+		return passed;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool quick = false;
+	std::vector<Dataset> datasets;
+	datasets.push_back(MakeSynthetic());
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--quick") == 0)
+		{
+			quick = true;
+			continue;
+		}
+		Dataset recording;
+		if (!LoadRecording(argv[i], recording))
+		{
+			return 1;
+		}
+		datasets.push_back(recording);
+	}
+
+	bool passed = true;
+	for (const Dataset& dataset : datasets)
+	{
+		passed = Run(dataset, quick) && passed;
+	}
+	passed = RunDepth(quick) && passed;
+	passed = RunSilhouettes(quick) && passed;
+	passed = RunPointClouds(quick) && passed;
+	return passed ? 0 : 1;
+}
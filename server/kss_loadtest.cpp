@@ -0,0 +1,885 @@
+// Licensed under the MIT License.
+
+// Loopback load harness for sizing deployments. Drives SkeletonSocketSender with
+// synthetic bodies at a fixed rate and fans them out to receiver processes on the
+// same host, then reports per transport the sustained frames/s and bytes/s every
+// receiver got, the latency from generating a frame to receiving it, and how many
+// frames were lost on the way. Needs no Kinect device, Linux and macOS only.
+//
+//   kss_loadtest [--transport listen|websocket|udp|connect|channel|all] [--receivers N]
+//                [--rate HZ] [--bodies N] [--encoding json|binary|quantized|delta]
+//                [--seconds S] [--async [QUEUE]] [--port PORT] [--quick]
+//                [--send plain|uring|both] [--frame-bytes N]
+//
+// The channel transport broadcasts messages of --frame-bytes, like the depth and
+// point cloud channels, instead of skeletons. --send picks plain send() calls or
+// io_uring for the listen, WebSocket and channel servers, both runs each of them
+// once per send path so their sender CPU time can be compared.
+//
+// Frames carry the host monotonic time they were generated at as their timestamp,
+// which every process on the host reads from the same clock. A rate of 0 sends
+// as fast as the sender accepts frames. --quick is a short run of every transport
+// and send path that fails when a receiver gets no frames or cannot parse them.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "SkeletonChannel.h"
+#include "SkeletonLatency.h"
+#include "SkeletonSocketSender.h"
+#include "SkeletonWebSocket.h"
+#include "SkeletonWireFormat.h"
+
+namespace
+{
+	enum class Transport
+	{
+		Listen,
+		WebSocket,
+		Udp,
+		Connect,
+		Channel
+	};
+
+	const char* TransportName(Transport transport)
+	{
+		switch (transport)
+		{
+		case Transport::Listen: return "listen";
+		case Transport::WebSocket: return "websocket";
+		case Transport::Udp: return "udp";
+		case Transport::Channel: return "channel";
+		default: return "connect";
+		}
+	}
+
+	const char* EncodingName(SkeletonEncoding encoding)
+	{
+		switch (encoding)
+		{
+		case SkeletonEncoding::Json: return "json";
+		case SkeletonEncoding::Binary: return "binary";
+		case SkeletonEncoding::Quantized: return "quantized";
+		default: return "delta";
+		}
+	}
+
+	struct Options
+	{
+		std::vector<Transport> transports = { Transport::Listen, Transport::WebSocket, Transport::Udp, Transport::Connect, Transport::Channel };
+		int receivers = 4;
+		double rateHz = 30.0;
+		size_t bodies = 1;
+		SkeletonEncoding encoding = SkeletonEncoding::Binary;
+		double seconds = 5.0;
+		bool async = false;
+		size_t queueCapacity = 4;
+		int port = 39000;
+		bool quick = false;
+		bool plainSend = true;
+		bool ringSend = false;
+		size_t frameBytes = 256 * 1024;
+	};
+
+	// What a receiver process hands back to the harness, followed by its latency samples
+	struct ReceiverReport
+	{
+		uint64_t frames = 0;
+		uint64_t bytes = 0;
+		uint64_t lost = 0;     // sequence gaps, binary encodings only
+		uint64_t errors = 0;   // data that did not parse
+		uint64_t samples = 0;
+		bool connected = false;
+	};
+
+	const size_t ReceiveBufferSize = 65536;
+	const std::chrono::milliseconds ConnectTimeout(5000);
+	const std::chrono::milliseconds DrainTime(500);
+
+	// Splits what arrives on one connection or in datagrams into messages and
+	// measures each of them
+	class Receiver
+	{
+	public:
+		Receiver(Transport transport, SkeletonEncoding encoding)
+			: m_transport(transport)
+			, m_json(encoding == SkeletonEncoding::Json)
+		{
+		}
+
+		// Bytes of a TCP connection, arrival is the host time recv returned them
+		void Consume(const uint8_t* data, size_t size, uint64_t arrival)
+		{
+			m_report.bytes += size;
+			m_pending.insert(m_pending.end(), data, data + size);
+
+			size_t start = 0;
+			for (;;)
+			{
+				const uint8_t* begin = m_pending.data() + start;
+				size_t available = m_pending.size() - start;
+				size_t used;
+				if (m_transport == Transport::WebSocket)
+				{
+					used = ConsumeWebSocketFrame(begin, available, arrival);
+				}
+				else if (m_json)
+				{
+					const uint8_t* end = static_cast<const uint8_t*>(memchr(begin, '\n', available));
+					used = end == nullptr ? 0 : static_cast<size_t>(end - begin) + 1;
+					if (used > 0)
+					{
+						Message(begin, used - 1, arrival);
+					}
+				}
+				else
+				{
+					used = available < SkeletonWire::LengthPrefixSize ? 0 :
+						SkeletonWire::LengthPrefixSize + SkeletonWire::ReadU32(begin);
+					if (used > available)
+					{
+						used = 0;
+					}
+					if (used > 0)
+					{
+						Message(begin, used, arrival);
+					}
+				}
+				if (used == 0)
+				{
+					break;
+				}
+				start += used;
+			}
+			m_pending.erase(m_pending.begin(), m_pending.begin() + start);
+		}
+
+		void Datagram(const uint8_t* data, size_t size, uint64_t arrival)
+		{
+			m_report.bytes += size;
+			Message(data, size, arrival);
+		}
+
+		ReceiverReport& GetReport() { return m_report; }
+		const std::vector<uint32_t>& GetLatencies() const { return m_latencies; }
+
+	private:
+		// Returns the size of the complete server frame at data, 0 if it is not complete yet
+		size_t ConsumeWebSocketFrame(const uint8_t* data, size_t size, uint64_t arrival)
+		{
+			if (size < 2)
+			{
+				return 0;
+			}
+			uint64_t payload = data[1] & 0x7F;
+			size_t headerSize = payload == 126 ? 4 : payload == 127 ? 10 : 2;
+			if (size < headerSize)
+			{
+				return 0;
+			}
+			if (headerSize > 2)
+			{
+				payload = 0;
+				for (size_t i = 2; i < headerSize; i++)
+				{
+					payload = (payload << 8) | data[i];
+				}
+			}
+			if (size - headerSize < payload)
+			{
+				return 0;
+			}
+
+			uint8_t opcode = data[0] & 0x0F;
+			if (opcode == static_cast<uint8_t>(SkeletonWebSocket::Opcode::Text) ||
+				opcode == static_cast<uint8_t>(SkeletonWebSocket::Opcode::Binary))
+			{
+				Message(data + headerSize, static_cast<size_t>(payload), arrival);
+			}
+			return headerSize + static_cast<size_t>(payload);
+		}
+
+		// One JSON line or one binary frame
+		void Message(const uint8_t* data, size_t size, uint64_t arrival)
+		{
+			uint64_t timestamp;
+			if (m_json)
+			{
+				// The device timestamp is the last member of every frame object
+				static const char Key[] = "\"timestamp\":";
+				std::string text(reinterpret_cast<const char*>(data), size);
+				size_t key = text.rfind(Key);
+				if (key == std::string::npos)
+				{
+					m_report.errors++;
+					return;
+				}
+				timestamp = strtoull(text.c_str() + key + sizeof(Key) - 1, nullptr, 10);
+			}
+			else
+			{
+				SkeletonWire::FrameHeader header;
+				if (!SkeletonWire::ReadFrameHeader(data, size, header))
+				{
+					m_report.errors++;
+					return;
+				}
+				m_sequences.Accept(header.sequence);
+				m_report.lost = m_sequences.GetLost();
+				timestamp = header.timestamp;
+			}
+
+			m_report.frames++;
+			m_latencies.push_back(static_cast<uint32_t>(arrival > timestamp ? arrival - timestamp : 0));
+		}
+
+		Transport m_transport;
+		bool m_json;
+		std::vector<uint8_t> m_pending;
+		SkeletonWire::SequenceTracker m_sequences;
+		ReceiverReport m_report;
+		std::vector<uint32_t> m_latencies;  // microseconds from generating to receiving each frame
+	};
+
+	sockaddr_in LoopbackAddress(int port, int host = 1)
+	{
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(static_cast<uint16_t>(port));
+		address.sin_addr.s_addr = htonl(0x7F000000u | static_cast<uint32_t>(host));
+		return address;
+	}
+
+	bool SendAll(SOCKET socket, const std::string& data)
+	{
+		return send(socket, data.data(), data.size(), SocketSendFlags) == static_cast<ssize_t>(data.size());
+	}
+
+	// The sender may still be starting up, keep trying for a while
+	SOCKET ConnectToSender(int port)
+	{
+		sockaddr_in address = LoopbackAddress(port);
+		auto deadline = std::chrono::steady_clock::now() + ConnectTimeout;
+		while (std::chrono::steady_clock::now() < deadline)
+		{
+			SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (connect(client, (sockaddr*)&address, sizeof(address)) == 0)
+			{
+				return client;
+			}
+			closesocket(client);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		return INVALID_SOCKET;
+	}
+
+	// Upgrade to WebSocket and subscribe with the default subscription, in a masked text frame
+	bool UpgradeWebSocket(SOCKET socket)
+	{
+		std::string request =
+			"GET /skeletons HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+		if (!SendAll(socket, request))
+		{
+			return false;
+		}
+
+		std::string response;
+		char c;
+		while (response.find("\r\n\r\n") == std::string::npos && recv(socket, &c, 1, 0) == 1)
+		{
+			response += c;
+		}
+		if (response.compare(0, 12, "HTTP/1.1 101") != 0)
+		{
+			return false;
+		}
+
+		const char mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+		std::string frame = { static_cast<char>(0x80 | static_cast<uint8_t>(SkeletonWebSocket::Opcode::Text)), static_cast<char>(0x80 | 2) };
+		frame.append(mask, 4);
+		frame += static_cast<char>('{' ^ mask[0]);
+		frame += static_cast<char>('}' ^ mask[1]);
+		return SendAll(socket, frame);
+	}
+
+	// Body of a receiver process. Reports readiness with one byte on resultFd, reads
+	// until the harness closes controlFd, then writes its report and latencies.
+	int RunReceiver(const Options& options, Transport transport, int index, int controlFd, int resultFd)
+	{
+		Receiver receiver(transport, transport == Transport::Channel ? SkeletonEncoding::Binary : options.encoding);
+		SOCKET socket = INVALID_SOCKET;
+		SOCKET listenSocket = INVALID_SOCKET;
+
+		if (transport == Transport::Udp)
+		{
+			// Every receiver has its own loopback address, all on the same port
+			socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			int bufferSize = 4 << 20;
+			setsockopt(socket, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferSize, sizeof(bufferSize));
+			sockaddr_in address = LoopbackAddress(options.port, index + 1);
+			if (bind(socket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+			{
+				closesocket(socket);
+				socket = INVALID_SOCKET;
+			}
+		}
+		else if (transport == Transport::Connect)
+		{
+			listenSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			int reuse = 1;
+			setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+			sockaddr_in address = LoopbackAddress(options.port);
+			if (bind(listenSocket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+				listen(listenSocket, 1) == SOCKET_ERROR)
+			{
+				closesocket(listenSocket);
+				listenSocket = INVALID_SOCKET;
+			}
+		}
+
+		// The listen-mode servers are started after the receivers, connecting waits for them
+		char ready = 1;
+		if (write(resultFd, &ready, 1) != 1)
+		{
+			return 1;
+		}
+
+		if (transport == Transport::Listen || transport == Transport::WebSocket || transport == Transport::Channel)
+		{
+			socket = ConnectToSender(options.port);
+			bool subscribed = socket != INVALID_SOCKET &&
+				(transport == Transport::WebSocket ? UpgradeWebSocket(socket) : SendAll(socket, "{}\n"));
+			if (!subscribed && socket != INVALID_SOCKET)
+			{
+				closesocket(socket);
+				socket = INVALID_SOCKET;
+			}
+		}
+		else if (listenSocket != INVALID_SOCKET)
+		{
+			pollfd fds[2] = { { listenSocket, POLLIN, 0 }, { controlFd, POLLIN, 0 } };
+			if (poll(fds, 2, static_cast<int>(ConnectTimeout.count())) > 0 && (fds[0].revents & POLLIN) != 0)
+			{
+				socket = accept(listenSocket, nullptr, nullptr);
+			}
+			closesocket(listenSocket);
+		}
+
+		receiver.GetReport().connected = socket != INVALID_SOCKET;
+		std::vector<uint8_t> buffer(ReceiveBufferSize);
+		bool stopping = false;
+		while (socket != INVALID_SOCKET)
+		{
+			pollfd fds[2] = { { socket, POLLIN, 0 }, { controlFd, POLLIN, 0 } };
+			if (!stopping && poll(fds, 2, -1) < 0)
+			{
+				break;
+			}
+			if ((fds[1].revents & (POLLIN | POLLHUP)) != 0)
+			{
+				// Take what is still queued without waiting, then stop
+				stopping = true;
+				u_long nonBlocking = 1;
+				ioctlsocket(socket, FIONBIO, &nonBlocking);
+			}
+
+			ssize_t size = recv(socket, reinterpret_cast<char*>(buffer.data()), buffer.size(), 0);
+			if (size <= 0)
+			{
+				break;
+			}
+			uint64_t arrival = SkeletonLatency::HostTimeUsec();
+			if (transport == Transport::Udp)
+			{
+				receiver.Datagram(buffer.data(), static_cast<size_t>(size), arrival);
+			}
+			else
+			{
+				receiver.Consume(buffer.data(), static_cast<size_t>(size), arrival);
+			}
+		}
+		if (socket != INVALID_SOCKET)
+		{
+			closesocket(socket);
+		}
+
+		ReceiverReport report = receiver.GetReport();
+		const std::vector<uint32_t>& latencies = receiver.GetLatencies();
+		report.samples = latencies.size();
+		bool written = write(resultFd, &report, sizeof(report)) == static_cast<ssize_t>(sizeof(report));
+		size_t offset = 0;
+		while (written && offset < latencies.size() * sizeof(uint32_t))
+		{
+			ssize_t result = write(resultFd, reinterpret_cast<const char*>(latencies.data()) + offset,
+				latencies.size() * sizeof(uint32_t) - offset);
+			written = result > 0;
+			offset += written ? static_cast<size_t>(result) : 0;
+		}
+		return written ? 0 : 1;
+	}
+
+	bool ReadExactly(int fd, void* data, size_t size)
+	{
+		char* out = static_cast<char*>(data);
+		while (size > 0)
+		{
+			ssize_t result = read(fd, out, size);
+			if (result <= 0)
+			{
+				return false;
+			}
+			out += result;
+			size -= static_cast<size_t>(result);
+		}
+		return true;
+	}
+
+	k4abt_body_t MakeBody(uint64_t frame, size_t index)
+	{
+		k4abt_body_t body = {};
+		body.id = static_cast<uint32_t>(index + 1);
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			k4abt_joint_t& target = body.skeleton.joints[joint];
+			target.position.xyz.x = -1500.0f + 600.0f * index + static_cast<float>(frame % 100);
+			target.position.xyz.y = 800.0f - 55.0f * joint;
+			target.position.xyz.z = 2500.0f + static_cast<float>(joint);
+			target.orientation.wxyz.w = 1.0f;
+			target.confidence_level = K4ABT_JOINT_CONFIDENCE_MEDIUM;
+		}
+		return body;
+	}
+
+	uint64_t Percentile(const std::vector<uint32_t>& sorted, double fraction)
+	{
+		if (sorted.empty())
+		{
+			return 0;
+		}
+		size_t rank = static_cast<size_t>(fraction * static_cast<double>(sorted.size()));
+		return sorted[std::min(rank, sorted.size() - 1)];
+	}
+
+	void PrintRow(const char* name, const ReceiverReport& report, std::vector<uint32_t>& latencies,
+		uint64_t generated, double seconds)
+	{
+		std::sort(latencies.begin(), latencies.end());
+		uint64_t missing = generated > report.frames ? generated - report.frames : 0;
+		printf("  %-9s %10.1f %12.3f %8llu %8llu %9llu %8llu %8llu %6llu\n", name,
+			report.frames / seconds, report.bytes / seconds / 1e6,
+			(unsigned long long)Percentile(latencies, 0.5), (unsigned long long)Percentile(latencies, 0.99),
+			(unsigned long long)Percentile(latencies, 0.999), (unsigned long long)(latencies.empty() ? 0 : latencies.back()),
+			(unsigned long long)missing, (unsigned long long)report.lost);
+	}
+
+	// Process CPU time, user and system, of every thread of the harness
+	double CpuSeconds()
+	{
+		rusage usage = {};
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+	}
+
+	bool RunTransport(const Options& options, Transport transport, bool sendRing)
+	{
+		if (transport == Transport::Udp && options.encoding == SkeletonEncoding::Json)
+		{
+			printf("\nudp: skipped, datagrams carry binary encodings only\n");
+			return true;
+		}
+
+		// A connect-mode sender has exactly one consumer
+		int receiverCount = transport == Transport::Connect ? 1 : options.receivers;
+
+		// Fork before the sender starts its threads
+		std::vector<pid_t> children;
+		std::vector<int> controlFds;
+		std::vector<int> resultFds;
+		fflush(stdout);
+		for (int i = 0; i < receiverCount; i++)
+		{
+			int control[2];
+			int result[2];
+			if (pipe(control) != 0 || pipe(result) != 0)
+			{
+				printf("Cannot create pipes for receiver %d\n", i);
+				return false;
+			}
+			pid_t child = fork();
+			if (child == 0)
+			{
+				close(control[1]);
+				close(result[0]);
+				for (int fd : controlFds)
+				{
+					close(fd);
+				}
+				for (int fd : resultFds)
+				{
+					close(fd);
+				}
+				_exit(RunReceiver(options, transport, i, control[0], result[1]));
+			}
+			close(control[0]);
+			close(result[1]);
+			children.push_back(child);
+			controlFds.push_back(control[1]);
+			resultFds.push_back(result[0]);
+		}
+
+		bool ok = true;
+		for (int fd : resultFds)
+		{
+			char ready;
+			ok = ReadExactly(fd, &ready, 1) && ok;
+		}
+
+		std::string host = "127.0.0.1";
+		if (transport == Transport::Udp)
+		{
+			host.clear();
+			for (int i = 0; i < receiverCount; i++)
+			{
+				host += (i == 0 ? "" : ",") + std::string("127.0.0.") + std::to_string(i + 1);
+			}
+		}
+		SenderMode mode = transport == Transport::Listen ? SenderMode::Listen :
+			transport == Transport::WebSocket ? SenderMode::WebSocket :
+			transport == Transport::Udp ? SenderMode::Udp : SenderMode::Connect;
+
+		// The channel transport sends through a channel of its own instead of the sender
+		SkeletonSocketSender sender(host, options.port, options.encoding, mode);
+		SkeletonChannel channel(options.frameBytes, 2);
+		if (transport == Transport::Channel)
+		{
+			ok = ok && channel.Start("127.0.0.1", options.port, sendRing);
+		}
+		else
+		{
+			sender.SetSendRing(sendRing);
+			ok = ok && sender.Initialize();
+			if (ok && options.async)
+			{
+				ok = sender.StartAsync(options.queueCapacity);
+			}
+		}
+		auto clientCount = [&] {
+			return transport == Transport::Channel ? channel.GetClientCount() : sender.GetStats().clientCount;
+		};
+
+		// Wait until every receiver is connected and subscribed
+		auto deadline = std::chrono::steady_clock::now() + ConnectTimeout;
+		while (ok && std::chrono::steady_clock::now() < deadline &&
+			(transport == Transport::Connect ? !sender.IsConnected() : clientCount() < static_cast<size_t>(receiverCount)))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		uint64_t generated = 0;
+		double startCpu = CpuSeconds();
+		auto start = std::chrono::steady_clock::now();
+		auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(options.seconds));
+		auto interval = options.rateHz > 0 ?
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / options.rateHz)) :
+			std::chrono::steady_clock::duration::zero();
+		k4abt_body_t bodies[SkeletonWire::MaxBodies];
+		while (ok)
+		{
+			auto due = start + interval * static_cast<long long>(generated);
+			if (due >= end || std::chrono::steady_clock::now() >= end)
+			{
+				break;
+			}
+			std::this_thread::sleep_until(due);
+
+			for (size_t i = 0; i < options.bodies; i++)
+			{
+				bodies[i] = MakeBody(generated, i);
+			}
+			SkeletonWire::StageTimes times;
+			times.capture = SkeletonLatency::HostTimeUsec();
+			times.pop = times.capture;
+			if (transport == Transport::Channel)
+			{
+				// The payload is left as it is, only the header matters to the receivers
+				for (const SkeletonSubscription& subscription : channel.UpdateSubscriptions())
+				{
+					SharedFrame frame = channel.Acquire();
+					uint8_t* payload = SkeletonChannel::GetPayload(frame);
+					SkeletonWire::BeginFrame(payload, SkeletonWire::MessageType::Depth, times.capture, static_cast<uint32_t>(generated));
+					channel.Broadcast(frame, SkeletonWire::FinishFrame(payload, payload + options.frameBytes), subscription);
+				}
+			}
+			else if (options.bodies == 1)
+			{
+				sender.SendSkeletonData(bodies[0], times.capture, times);
+			}
+			else
+			{
+				sender.SendBodies(bodies, options.bodies, times.capture, times);
+			}
+			generated++;
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double cpuSeconds = CpuSeconds() - startCpu;
+
+		// Let the queues drain, then have the receivers report
+		std::this_thread::sleep_for(DrainTime);
+		if (options.async)
+		{
+			sender.StopAsync();
+		}
+		uint64_t senderDropped = transport == Transport::Channel ? channel.GetFramesDropped() : sender.GetStats().framesDropped;
+		for (int fd : controlFds)
+		{
+			close(fd);
+		}
+
+		std::vector<ReceiverReport> reports(receiverCount);
+		std::vector<std::vector<uint32_t>> latencies(receiverCount);
+		for (int i = 0; i < receiverCount; i++)
+		{
+			bool received = ReadExactly(resultFds[i], &reports[i], sizeof(ReceiverReport));
+			if (received)
+			{
+				latencies[i].resize(reports[i].samples);
+				received = ReadExactly(resultFds[i], latencies[i].data(), latencies[i].size() * sizeof(uint32_t));
+			}
+			if (!received)
+			{
+				reports[i] = ReceiverReport();
+				latencies[i].clear();
+			}
+			close(resultFds[i]);
+		}
+		for (pid_t child : children)
+		{
+			int status;
+			waitpid(child, &status, 0);
+		}
+		sender.Close();
+		channel.Stop();
+
+		printf("\n%s: %d receiver%s, ", TransportName(transport), receiverCount, receiverCount == 1 ? "" : "s");
+		if (transport == Transport::Channel)
+		{
+			printf("%zu byte frames, ", options.frameBytes);
+		}
+		else
+		{
+			printf("%zu bod%s, %s, ", options.bodies, options.bodies == 1 ? "y" : "ies", EncodingName(options.encoding));
+		}
+		if (options.rateHz > 0)
+		{
+			printf("%.0f Hz", options.rateHz);
+		}
+		else
+		{
+			printf("unpaced");
+		}
+		printf("%s%s\n", options.async && transport != Transport::Channel ? ", async" : "", sendRing ? ", io_uring" : "");
+		printf("  %llu frames generated in %.2f s (%.1f frames/s), %llu dropped by the sender, sender CPU %.1f%%\n",
+			(unsigned long long)generated, seconds, generated / seconds, (unsigned long long)senderDropped,
+			100.0 * cpuSeconds / seconds);
+		printf("  %-9s %10s %12s %8s %8s %9s %8s %8s %6s\n", "receiver", "frames/s", "MB/s",
+			"p50 us", "p99 us", "p99.9 us", "max us", "missing", "gaps");
+
+		ReceiverReport total;
+		std::vector<uint32_t> all;
+		for (int i = 0; i < receiverCount; i++)
+		{
+			if (!reports[i].connected || reports[i].frames == 0 || reports[i].errors > 0)
+			{
+				printf("  receiver %d FAILED: %s, %llu frames, %llu unreadable\n", i,
+					reports[i].connected ? "connected" : "not connected",
+					(unsigned long long)reports[i].frames, (unsigned long long)reports[i].errors);
+				ok = false;
+			}
+			all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+			total.frames += reports[i].frames;
+			total.bytes += reports[i].bytes;
+			total.lost += reports[i].lost;
+			PrintRow(std::to_string(i).c_str(), reports[i], latencies[i], generated, seconds);
+		}
+		if (receiverCount > 1)
+		{
+			PrintRow("all", total, all, generated * receiverCount, seconds);
+		}
+		return ok;
+	}
+
+	bool ParseTransport(const char* name, std::vector<Transport>& transports)
+	{
+		static const Transport All[] = { Transport::Listen, Transport::WebSocket, Transport::Udp, Transport::Connect, Transport::Channel };
+		if (strcmp(name, "all") == 0)
+		{
+			transports.assign(std::begin(All), std::end(All));
+			return true;
+		}
+		for (Transport transport : All)
+		{
+			if (strcmp(name, TransportName(transport)) == 0)
+			{
+				transports.assign(1, transport);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseEncoding(const char* name, SkeletonEncoding& encoding)
+	{
+		static const SkeletonEncoding All[] = {
+			SkeletonEncoding::Json, SkeletonEncoding::Binary, SkeletonEncoding::Quantized, SkeletonEncoding::Delta };
+		for (SkeletonEncoding candidate : All)
+		{
+			if (strcmp(name, EncodingName(candidate)) == 0)
+			{
+				encoding = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseSend(const char* name, Options& options)
+	{
+		options.plainSend = strcmp(name, "plain") == 0 || strcmp(name, "both") == 0;
+		options.ringSend = strcmp(name, "uring") == 0 || strcmp(name, "both") == 0;
+		return options.plainSend || options.ringSend;
+	}
+
+	void PrintUsage()
+	{
+		printf("Usage: kss_loadtest [--transport listen|websocket|udp|connect|channel|all] [--receivers N]\n"
+			"                    [--rate HZ] [--bodies N] [--encoding json|binary|quantized|delta]\n"
+			"                    [--seconds S] [--async [QUEUE]] [--port PORT] [--quick]\n"
+			"                    [--send plain|uring|both] [--frame-bytes N]\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool valid = true;
+		if (strcmp(argv[i], "--quick") == 0)
+		{
+			options.quick = true;
+			options.receivers = 2;
+			options.rateHz = 60.0;
+			options.seconds = 1.0;
+			options.plainSend = true;
+			options.ringSend = true;
+		}
+		else if (strcmp(argv[i], "--async") == 0)
+		{
+			options.async = true;
+			if (value != nullptr && value[0] != '-')
+			{
+				options.queueCapacity = static_cast<size_t>(atoi(value));
+				i++;
+			}
+		}
+		else if (value == nullptr)
+		{
+			valid = false;
+		}
+		else if (strcmp(argv[i], "--transport") == 0)
+		{
+			valid = ParseTransport(value, options.transports);
+			i++;
+		}
+		else if (strcmp(argv[i], "--encoding") == 0)
+		{
+			valid = ParseEncoding(value, options.encoding);
+			i++;
+		}
+		else if (strcmp(argv[i], "--receivers") == 0)
+		{
+			options.receivers = atoi(value);
+			valid = options.receivers > 0 && options.receivers < 255;
+			i++;
+		}
+		else if (strcmp(argv[i], "--rate") == 0)
+		{
+			options.rateHz = atof(value);
+			valid = options.rateHz >= 0;
+			i++;
+		}
+		else if (strcmp(argv[i], "--bodies") == 0)
+		{
+			options.bodies = static_cast<size_t>(atoi(value));
+			valid = options.bodies >= 1 && options.bodies <= SkeletonWire::MaxBodies;
+			i++;
+		}
+		else if (strcmp(argv[i], "--seconds") == 0)
+		{
+			options.seconds = atof(value);
+			valid = options.seconds > 0;
+			i++;
+		}
+		else if (strcmp(argv[i], "--send") == 0)
+		{
+			valid = ParseSend(value, options);
+			i++;
+		}
+		else if (strcmp(argv[i], "--frame-bytes") == 0)
+		{
+			options.frameBytes = static_cast<size_t>(atol(value));
+			valid = options.frameBytes >= SkeletonWire::FrameHeaderSize && options.frameBytes <= (64u << 20);
+			i++;
+		}
+		else if (strcmp(argv[i], "--port") == 0)
+		{
+			options.port = atoi(value);
+			valid = options.port > 0 && options.port < 65536;
+			i++;
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	// A receiver that exits early must not take the harness down with it
+	signal(SIGPIPE, SIG_IGN);
+
+	bool ok = true;
+	for (Transport transport : options.transports)
+	{
+		// UDP and connect mode have a single socket, there is nothing to batch
+		bool servers = transport != Transport::Udp && transport != Transport::Connect;
+		if (options.plainSend || !servers)
+		{
+			ok = RunTransport(options, transport, false) && ok;
+		}
+		if (options.ringSend && servers)
+		{
+			ok = RunTransport(options, transport, true) && ok;
+		}
+	}
+	printf("\n%s\n", ok ? "PASSED" : "FAILED");
+	return ok ? 0 : 1;
+}
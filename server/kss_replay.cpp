@@ -0,0 +1,384 @@
+// Licensed under the MIT License.
+
+// Replays recorded skeleton streams through SkeletonSocketSender, for load testing
+// consumers without a Kinect in the room. The recorded bodies take the same
+// serialization and transport path as live ones, so running flat out measures the
+// sender's throughput ceiling directly.
+//
+//   kss_replay [--transport listen|websocket|udp|connect] [--host HOST] [--port PORT]
+//              [--encoding json|binary|quantized|delta] [--multibody] [--speed X|max]
+//              [--bodies N] [--loop] [--seconds S] [--wait-clients N] [--async [QUEUE]]
+//              RECORDING...
+//
+// Recordings are pose snapshots or captures of a JSON or binary stream, see
+// SkeletonRecording.h. Several recordings play one after the other. Frames go out
+// at their recorded timing, --speed times faster, or with --speed max as fast as
+// the sender takes them. --bodies brings every frame to N bodies, copying the
+// recorded ones for a crowd. The timestamps sent are the recording's device time,
+// divided by the speed, so consumers see the pace they get.
+//
+// Prints the frames and bytes serialized every second, and the totals, how far the
+// replay fell behind its schedule and the sender's stage latencies at the end.
+// Exits with 1 when no frame was sent.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SkeletonLatency.h"
+#include "SkeletonRecording.h"
+#include "SkeletonSocketSender.h"
+#include "SkeletonWireFormat.h"
+
+namespace
+{
+	const uint64_t DefaultFrameIntervalUsec = 33333;
+
+	std::atomic<bool> s_stopping(false);
+
+	void Stop(int)
+	{
+		s_stopping = true;
+	}
+
+	struct Options
+	{
+		SenderMode mode = SenderMode::Listen;
+		std::string host;
+		int port = 8888;
+		SkeletonEncoding encoding = SkeletonEncoding::Json;
+		bool multiBody = false;
+		double speed = 1.0;  // 0 as fast as possible
+		size_t bodies = 0;   // 0 as recorded
+		bool loop = false;
+		double seconds = 0.0;
+		size_t waitClients = 0;
+		bool async = false;
+		size_t queueCapacity = 4;
+		std::vector<const char*> recordings;
+	};
+
+	// One frame of the replay, on a timeline that starts at 0
+	struct ReplayFrame
+	{
+		uint64_t offsetUsec;
+		std::vector<k4abt_body_t> bodies;
+	};
+
+	// Load the recordings one after the other onto a single timeline. Returns its
+	// length including the interval after the last frame, where a loop starts over.
+	bool LoadTimeline(const Options& options, std::vector<ReplayFrame>& timeline, uint64_t& durationUsec)
+	{
+		durationUsec = 0;
+		for (const char* path : options.recordings)
+		{
+			std::vector<SkeletonRecording::Frame> frames;
+			if (!SkeletonRecording::Load(path, frames))
+			{
+				return false;
+			}
+
+			// Timestamps that do not move forward, like a snapshot's, play at 30 Hz
+			uint64_t first = frames.front().timestamp;
+			uint64_t span = frames.back().timestamp > first ? frames.back().timestamp - first : 0;
+			uint64_t interval = span > 0 && frames.size() > 1 ? span / (frames.size() - 1) : DefaultFrameIntervalUsec;
+			for (size_t i = 0; i < frames.size(); i++)
+			{
+				ReplayFrame frame;
+				frame.offsetUsec = durationUsec + (span > 0 ?
+					std::max(frames[i].timestamp, first) - first : i * DefaultFrameIntervalUsec);
+				frame.bodies = std::move(frames[i].bodies);
+				if (options.bodies > 0)
+				{
+					SkeletonRecording::SetBodyCount(frame.bodies, options.bodies);
+				}
+				timeline.push_back(std::move(frame));
+			}
+			durationUsec = timeline.back().offsetUsec + interval;
+			printf("%s: %zu frames, %.1f s\n", path, frames.size(), (span + interval) / 1e6);
+		}
+		return true;
+	}
+
+	bool ParseMode(const char* name, SenderMode& mode)
+	{
+		static const std::pair<const char*, SenderMode> Modes[] = {
+			{ "listen", SenderMode::Listen },
+			{ "websocket", SenderMode::WebSocket },
+			{ "udp", SenderMode::Udp },
+			{ "connect", SenderMode::Connect },
+		};
+		for (const auto& candidate : Modes)
+		{
+			if (strcmp(name, candidate.first) == 0)
+			{
+				mode = candidate.second;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseEncoding(const char* name, SkeletonEncoding& encoding)
+	{
+		static const std::pair<const char*, SkeletonEncoding> Encodings[] = {
+			{ "json", SkeletonEncoding::Json },
+			{ "binary", SkeletonEncoding::Binary },
+			{ "quantized", SkeletonEncoding::Quantized },
+			{ "delta", SkeletonEncoding::Delta },
+		};
+		for (const auto& candidate : Encodings)
+		{
+			if (strcmp(name, candidate.first) == 0)
+			{
+				encoding = candidate.second;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void PrintUsage()
+	{
+		printf("Usage: kss_replay [--transport listen|websocket|udp|connect] [--host HOST] [--port PORT]\n"
+			"                  [--encoding json|binary|quantized|delta] [--multibody] [--speed X|max]\n"
+			"                  [--bodies N] [--loop] [--seconds S] [--wait-clients N] [--async [QUEUE]]\n"
+			"                  RECORDING...\n");
+	}
+
+	void PrintPercentiles(const char* stage, const SkeletonLatencyPercentiles& percentiles)
+	{
+		if (percentiles.samples > 0)
+		{
+			printf("  %-16s p50 %6llu us, p99 %6llu us\n", stage,
+				(unsigned long long)percentiles.p50Usec, (unsigned long long)percentiles.p99Usec);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool valid = true;
+		if (argv[i][0] != '-')
+		{
+			options.recordings.push_back(argv[i]);
+		}
+		else if (strcmp(argv[i], "--multibody") == 0)
+		{
+			options.multiBody = true;
+		}
+		else if (strcmp(argv[i], "--loop") == 0)
+		{
+			options.loop = true;
+		}
+		else if (strcmp(argv[i], "--async") == 0)
+		{
+			options.async = true;
+			if (value != nullptr && value[0] != '-' && atoi(value) > 0)
+			{
+				options.queueCapacity = static_cast<size_t>(atoi(value));
+				i++;
+			}
+		}
+		else if (value == nullptr)
+		{
+			valid = false;
+		}
+		else if (strcmp(argv[i], "--transport") == 0)
+		{
+			valid = ParseMode(value, options.mode);
+			i++;
+		}
+		else if (strcmp(argv[i], "--host") == 0)
+		{
+			options.host = value;
+			i++;
+		}
+		else if (strcmp(argv[i], "--port") == 0)
+		{
+			options.port = atoi(value);
+			valid = options.port > 0 && options.port < 65536;
+			i++;
+		}
+		else if (strcmp(argv[i], "--encoding") == 0)
+		{
+			valid = ParseEncoding(value, options.encoding);
+			i++;
+		}
+		else if (strcmp(argv[i], "--speed") == 0)
+		{
+			options.speed = strcmp(value, "max") == 0 ? 0.0 : atof(value);
+			valid = strcmp(value, "max") == 0 || options.speed > 0;
+			i++;
+		}
+		else if (strcmp(argv[i], "--bodies") == 0)
+		{
+			options.bodies = static_cast<size_t>(atoi(value));
+			valid = options.bodies >= 1 && options.bodies <= SkeletonWire::MaxBodies;
+			i++;
+		}
+		else if (strcmp(argv[i], "--seconds") == 0)
+		{
+			options.seconds = atof(value);
+			valid = options.seconds > 0;
+			i++;
+		}
+		else if (strcmp(argv[i], "--wait-clients") == 0)
+		{
+			options.waitClients = static_cast<size_t>(atoi(value));
+			i++;
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (options.recordings.empty() || (options.mode == SenderMode::Udp && options.encoding == SkeletonEncoding::Json))
+	{
+		if (!options.recordings.empty())
+		{
+			printf("UDP datagrams carry binary encodings only\n");
+		}
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<ReplayFrame> timeline;
+	uint64_t durationUsec;
+	if (!LoadTimeline(options, timeline, durationUsec))
+	{
+		return 1;
+	}
+
+	// Servers accept clients from anywhere, the others send to this host unless told otherwise
+	bool server = options.mode == SenderMode::Listen || options.mode == SenderMode::WebSocket;
+	std::string host = !options.host.empty() ? options.host : server ? "0.0.0.0" : "127.0.0.1";
+	SkeletonSocketSender sender(host, options.port, options.encoding, options.mode);
+	if (!sender.Initialize() || (options.async && !sender.StartAsync(options.queueCapacity)))
+	{
+		printf("Cannot start the sender on %s:%d\n", host.c_str(), options.port);
+		return 1;
+	}
+
+	signal(SIGINT, Stop);
+	signal(SIGTERM, Stop);
+
+	if (options.waitClients > 0)
+	{
+		printf("Waiting for %zu client%s\n", options.waitClients, options.waitClients == 1 ? "" : "s");
+		while (!s_stopping && sender.GetStats().clientCount < options.waitClients)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	if (options.speed > 0)
+	{
+		printf("Replaying %zu frames%s at %gx speed\n", timeline.size(), options.loop ? " in a loop" : "", options.speed);
+	}
+	else
+	{
+		printf("Replaying %zu frames%s as fast as possible\n", timeline.size(), options.loop ? " in a loop" : "");
+	}
+
+	using Clock = std::chrono::steady_clock;
+	auto start = Clock::now();
+	auto end = options.seconds > 0 ? start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds)) :
+		Clock::time_point::max();
+	auto nextReport = start + std::chrono::seconds(1);
+	uint64_t replayed = 0;
+	uint64_t maxLagUsec = 0;
+	SkeletonSenderStats reported;
+	for (uint64_t pass = 0; !s_stopping && (pass == 0 || options.loop); pass++)
+	{
+		for (size_t i = 0; i < timeline.size() && !s_stopping; i++)
+		{
+			uint64_t offset = pass * durationUsec + timeline[i].offsetUsec;
+			uint64_t timestamp = options.speed > 0 ? static_cast<uint64_t>(offset / options.speed) : offset;
+			auto due = start + std::chrono::microseconds(timestamp);
+			auto now = Clock::now();
+			if (now >= end || (options.speed > 0 && due >= end))
+			{
+				s_stopping = true;
+				break;
+			}
+			if (options.speed > 0)
+			{
+				if (due > now)
+				{
+					std::this_thread::sleep_until(due);
+				}
+				else
+				{
+					maxLagUsec = std::max<uint64_t>(maxLagUsec,
+						std::chrono::duration_cast<std::chrono::microseconds>(now - due).count());
+				}
+			}
+
+			SkeletonWire::StageTimes times;
+			times.pop = SkeletonLatency::HostTimeUsec();
+			const std::vector<k4abt_body_t>& bodies = timeline[i].bodies;
+			if (options.multiBody)
+			{
+				sender.SendBodies(bodies.data(), bodies.size(), timestamp, times);
+			}
+			else
+			{
+				sender.SendSkeletonData(bodies.data(), bodies.size(), timestamp, times);
+			}
+			replayed++;
+
+			if (Clock::now() >= nextReport)
+			{
+				SkeletonSenderStats stats = sender.GetStats();
+				printf("%6.1f s: %llu frames/s, %.2f MB/s serialized, %zu clients, %llu dropped\n",
+					std::chrono::duration<double>(Clock::now() - start).count(),
+					(unsigned long long)(stats.framesSent - reported.framesSent),
+					(stats.bytesSerialized - reported.bytesSerialized) / 1e6, stats.clientCount,
+					(unsigned long long)(stats.framesDropped - reported.framesDropped));
+				reported = stats;
+				nextReport += std::chrono::seconds(1);
+			}
+		}
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	if (options.async)
+	{
+		sender.StopAsync();
+	}
+	SkeletonSenderStats stats = sender.GetStats();
+	sender.Close();
+
+	printf("\n%llu frames replayed in %.2f s (%.1f frames/s), %llu sent, %llu dropped, %.2f MB serialized (%.2f MB/s)\n",
+		(unsigned long long)replayed, seconds, replayed / seconds, (unsigned long long)stats.framesSent,
+		(unsigned long long)stats.framesDropped, stats.bytesSerialized / 1e6, stats.bytesSerialized / 1e6 / seconds);
+	if (options.speed > 0)
+	{
+		printf("  at most %.1f ms behind the recorded timing\n", maxLagUsec / 1000.0);
+	}
+	PrintPercentiles("frame loop", stats.loopLatency);
+	PrintPercentiles("serialize", stats.serializeLatency);
+	PrintPercentiles("write", stats.writeLatency);
+
+	// Nothing went out, for the test run that means the serialization or transport is broken
+	return stats.framesSent > 0 ? 0 : 1;
+}
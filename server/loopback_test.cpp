@@ -0,0 +1,1735 @@
+// Licensed under the MIT License.
+
+// Streams synthetic skeletons through SkeletonSocketSender over loopback and checks
+// what arrives: several clients of the listen-mode server, a connect-mode consumer
+// that is started after the sender and restarted mid-stream, clients with
+// subscriptions, browser-like WebSocket clients, latency stamping, the depth channel,
+// the silhouette channel, the point cloud channel, sending through io_uring, the
+// adaptive rate of clients whose link cannot keep up, dead-reckoned DELTA streams, the
+// hand-offs between the viewer's pipeline threads, UDP streams losing datagrams and the
+// error of quantized frames, for the recording given as the argument and bodies at the
+// quantization limits.
+// Needs no Kinect device. Exits with 0 when every check passed.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SkeletonCommandChannel.h"
+#include "SkeletonDeltaCodec.h"
+#include "SkeletonDepthChannel.h"
+#include "SkeletonDepthCodec.h"
+#include "SkeletonLatency.h"
+#include "SkeletonPointCloudChannel.h"
+#include "SkeletonRateController.h"
+#include "SkeletonRecording.h"
+#include "SkeletonSendRing.h"
+#include "SkeletonSilhouetteChannel.h"
+#include "SkeletonSocketSender.h"
+#include "SkeletonWebSocket.h"
+#include "SkeletonWireFormat.h"
+
+namespace
+{
+	const int TestPort = 38888;
+	const int ClientCount = 8;
+	const int FrameCount = 500;
+	const uint64_t FrameIntervalUsec = 33333;
+
+	k4abt_body_t MakeBody(int frame, uint32_t id = 7)
+	{
+		k4abt_body_t body = {};
+		body.id = id;
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			body.skeleton.joints[joint].position.xyz.x = 100.0f * joint;
+			body.skeleton.joints[joint].position.xyz.y = static_cast<float>(frame);
+			body.skeleton.joints[joint].position.xyz.z = 2000.0f + joint;
+			body.skeleton.joints[joint].orientation.wxyz.w = 1.0f;
+			body.skeleton.joints[joint].confidence_level = K4ABT_JOINT_CONFIDENCE_MEDIUM;
+		}
+		return body;
+	}
+
+	// Connect and send the subscription line, if any
+	SOCKET ConnectClient(int port, const char* subscription = nullptr)
+	{
+		SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+		if (connect(client, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+		{
+			closesocket(client);
+			return INVALID_SOCKET;
+		}
+		if (subscription != nullptr)
+		{
+			std::string line = std::string(subscription) + "\n";
+			send(client, line.data(), (int)line.size(), 0);
+		}
+		return client;
+	}
+
+	bool ReceiveAll(SOCKET socket, uint8_t* data, size_t size)
+	{
+		while (size > 0)
+		{
+			int result = recv(socket, reinterpret_cast<char*>(data), (int)size, 0);
+			if (result <= 0)
+			{
+				return false;
+			}
+			data += result;
+			size -= static_cast<size_t>(result);
+		}
+		return true;
+	}
+
+	// Read one length-prefixed frame, false once the sender closed the connection
+	bool ReceiveFrame(SOCKET socket, std::vector<uint8_t>& frame)
+	{
+		frame.resize(SkeletonWire::LengthPrefixSize);
+		if (!ReceiveAll(socket, frame.data(), SkeletonWire::LengthPrefixSize))
+		{
+			return false;
+		}
+		size_t payload = SkeletonWire::ReadU32(frame.data());
+		frame.resize(SkeletonWire::LengthPrefixSize + payload);
+		return ReceiveAll(socket, frame.data() + SkeletonWire::LengthPrefixSize, payload);
+	}
+
+	// Read length-prefixed frames until the last one arrives, checking each of them
+	bool ReadStream(SOCKET socket, uint64_t lastTimestamp, int& received)
+	{
+		std::vector<uint8_t> frame(SkeletonWire::MaxSkeletonFrameSize);
+		bool started = false;
+		uint32_t previous = 0;
+		received = 0;
+
+		for (;;)
+		{
+			if (!ReceiveAll(socket, frame.data(), SkeletonWire::LengthPrefixSize))
+			{
+				return false;
+			}
+			size_t size = SkeletonWire::LengthPrefixSize + SkeletonWire::ReadU32(frame.data());
+			if (size != SkeletonWire::SkeletonFrameSize ||
+				!ReceiveAll(socket, frame.data() + SkeletonWire::LengthPrefixSize, size - SkeletonWire::LengthPrefixSize))
+			{
+				return false;
+			}
+
+			SkeletonWire::FrameHeader header;
+			k4abt_body_t body;
+			uint64_t timestamp;
+			if (!SkeletonWire::ReadFrameHeader(frame.data(), size, header) ||
+				!SkeletonWire::ReadSkeletonFrame(frame.data(), size, body, timestamp))
+			{
+				return false;
+			}
+
+			// Frames may be dropped for a slow reader, but never reordered or corrupted
+			k4abt_body_t expected = MakeBody(static_cast<int>(timestamp));
+			if ((started && header.sequence <= previous) || body.id != expected.id ||
+				body.skeleton.joints[5].position.xyz.y != expected.skeleton.joints[5].position.xyz.y)
+			{
+				return false;
+			}
+			started = true;
+			previous = header.sequence;
+			received++;
+
+			if (timestamp == lastTimestamp)
+			{
+				return true;
+			}
+		}
+	}
+
+	bool TestListenMode(int port = TestPort, bool sendRing = false)
+	{
+		SkeletonSocketSender sender("127.0.0.1", port, SkeletonEncoding::Binary, SenderMode::Listen);
+		sender.SetSendRing(sendRing);
+		if (!sender.Initialize())
+		{
+			return false;
+		}
+
+		// Most clients subscribe to the default stream, the last two never say anything
+		std::vector<SOCKET> clients;
+		for (int i = 0; i < ClientCount; i++)
+		{
+			clients.push_back(ConnectClient(port, i < ClientCount - 2 ? "{}" : nullptr));
+		}
+		for (int wait = 0; wait < 200 && sender.GetStats().clientCount < static_cast<size_t>(ClientCount); wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(SkeletonFanoutServer::HandshakeTimeout + std::chrono::milliseconds(100));
+
+		std::vector<int> received(ClientCount, 0);
+		std::vector<char> passed(ClientCount, 0);
+		std::vector<std::thread> readers;
+		for (int i = 0; i < ClientCount; i++)
+		{
+			readers.emplace_back([&, i] { passed[i] = ReadStream(clients[i], FrameCount - 1, received[i]); });
+		}
+
+		for (int frame = 0; frame < FrameCount; frame++)
+		{
+			sender.SendSkeletonData(MakeBody(frame), static_cast<uint64_t>(frame));
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+		}
+
+		for (std::thread& reader : readers)
+		{
+			reader.join();
+		}
+		SkeletonSenderStats stats = sender.GetStats();
+		sender.Close();
+
+		bool ok = true;
+		for (int i = 0; i < ClientCount; i++)
+		{
+			closesocket(clients[i]);
+			ok = ok && passed[i];
+			printf("  client %d: %s, %d/%d frames\n", i, passed[i] ? "ok" : "FAILED", received[i], FrameCount);
+		}
+		printf("  %llu frames dropped for slow clients\n", (unsigned long long)stats.framesDropped);
+		return ok;
+	}
+
+	bool TestConnectMode()
+	{
+		SkeletonSocketSender sender("127.0.0.1", TestPort + 1, SkeletonEncoding::Binary, SenderMode::Connect);
+		if (!sender.Initialize())
+		{
+			return false;
+		}
+
+		bool ok = true;
+		for (int session = 0; session < 2 && ok; session++)
+		{
+			// The consumer comes up after the sender, and again after it went away
+			SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			int reuse = 1;
+			setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_port = htons(TestPort + 1);
+			inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+			bind(listenSocket, (sockaddr*)&address, sizeof(address));
+			listen(listenSocket, 1);
+
+			SOCKET consumer = accept(listenSocket, nullptr, nullptr);
+			for (int wait = 0; wait < 200 && !sender.IsConnected(); wait++)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+
+			int received = 0;
+			std::thread reader([&] { ok = ReadStream(consumer, FrameCount - 1, received); });
+			for (int frame = 0; frame < FrameCount; frame++)
+			{
+				sender.SendSkeletonData(MakeBody(frame), static_cast<uint64_t>(frame));
+			}
+			reader.join();
+			printf("  session %d: %s, %d/%d frames\n", session, ok ? "ok" : "FAILED", received, FrameCount);
+
+			closesocket(consumer);
+			closesocket(listenSocket);
+
+			// Keep sending until the sender notices the consumer is gone
+			for (int wait = 0; wait < 200 && sender.IsConnected(); wait++)
+			{
+				sender.SendSkeletonData(MakeBody(0), 0);
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+		}
+
+		sender.Close();
+		return ok;
+	}
+
+	bool TestSubscriptions()
+	{
+		const int port = TestPort + 2;
+		const int frameCount = 90;
+
+		SkeletonSocketSender sender("127.0.0.1", port, SkeletonEncoding::Binary, SenderMode::Listen);
+		if (!sender.Initialize())
+		{
+			return false;
+		}
+
+		// Pelvis and head of every body at 10 Hz, and everything about body 8 as JSON
+		SOCKET dashboard = ConnectClient(port, "{\"joints\":[0,26],\"max_rate\":10,\"encoding\":\"DELTA\"}");
+		SOCKET follower = ConnectClient(port, "{\"bodies\":[8],\"encoding\":\"JSON\"}");
+		for (int wait = 0; wait < 200 && sender.GetStats().clientCount < 2; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		int dashboardFrames = 0;
+		bool dashboardOk = true;
+		std::thread dashboardReader([&] {
+			SkeletonDeltaDecoder decoder;
+			std::vector<uint8_t> frame;
+			while (ReceiveFrame(dashboard, frame))
+			{
+				k4abt_body_t body;
+				uint64_t timestamp;
+				if (!decoder.Read(frame.data(), frame.size(), body, timestamp))
+				{
+					dashboardOk = false;
+					continue;
+				}
+				k4abt_body_t expected = MakeBody(static_cast<int>(timestamp / FrameIntervalUsec));
+				dashboardOk = dashboardOk && body.id == expected.id &&
+					body.skeleton.joints[K4ABT_JOINT_HEAD].position.xyz.z == expected.skeleton.joints[K4ABT_JOINT_HEAD].position.xyz.z &&
+					body.skeleton.joints[K4ABT_JOINT_NECK].position.xyz.z == 0.0f &&
+					body.skeleton.joints[K4ABT_JOINT_NECK].confidence_level == K4ABT_JOINT_CONFIDENCE_NONE;
+				dashboardFrames++;
+			}
+		});
+
+		int followerFrames = 0;
+		bool followerOk = true;
+		std::thread followerReader([&] {
+			std::string text;
+			char buffer[4096];
+			int result;
+			while ((result = recv(follower, buffer, sizeof(buffer), 0)) > 0)
+			{
+				text.append(buffer, static_cast<size_t>(result));
+			}
+			for (size_t start = 0, end; (end = text.find('\n', start)) != std::string::npos; start = end + 1)
+			{
+				followerOk = followerOk && text.compare(start, 13, "{\"body_id\":8,") == 0;
+				followerFrames++;
+			}
+		});
+
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			k4abt_body_t bodies[2] = { MakeBody(frame, 7), MakeBody(frame, 8) };
+			sender.SendSkeletonData(bodies, 2, frame * FrameIntervalUsec);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		// Let the queues drain before the server hangs up on the clients
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		sender.Close();
+		dashboardReader.join();
+		followerReader.join();
+		closesocket(dashboard);
+		closesocket(follower);
+
+		// 90 frames at 30 Hz are 3 seconds of device time
+		dashboardOk = dashboardOk && dashboardFrames == frameCount / 3;
+		followerOk = followerOk && followerFrames == frameCount;
+		printf("  10 Hz pelvis and head: %s, %d/%d frames\n", dashboardOk ? "ok" : "FAILED", dashboardFrames, frameCount / 3);
+		printf("  body 8 as JSON: %s, %d/%d frames\n", followerOk ? "ok" : "FAILED", followerFrames, frameCount);
+		return dashboardOk && followerOk;
+	}
+
+	// Masked client frame, as a browser sends it
+	void SendWebSocketFrame(SOCKET socket, SkeletonWebSocket::Opcode opcode, const std::string& payload)
+	{
+		const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+		std::string frame;
+		frame += static_cast<char>(0x80 | static_cast<uint8_t>(opcode));
+		frame += static_cast<char>(0x80 | payload.size());
+		frame.append(reinterpret_cast<const char*>(mask), 4);
+		for (size_t i = 0; i < payload.size(); i++)
+		{
+			frame += static_cast<char>(payload[i] ^ mask[i % 4]);
+		}
+		send(socket, frame.data(), (int)frame.size(), 0);
+	}
+
+	// Read one server frame, which must not be masked
+	bool ReceiveWebSocketFrame(SOCKET socket, uint8_t& opcode, std::vector<uint8_t>& payload)
+	{
+		uint8_t header[10];
+		if (!ReceiveAll(socket, header, 2) || (header[0] & 0x80) == 0 || (header[1] & 0x80) != 0)
+		{
+			return false;
+		}
+		opcode = header[0] & 0x0F;
+		uint64_t size = header[1] & 0x7F;
+		size_t lengthSize = size == 126 ? 2 : size == 127 ? 8 : 0;
+		if (lengthSize > 0)
+		{
+			if (!ReceiveAll(socket, header + 2, lengthSize))
+			{
+				return false;
+			}
+			size = 0;
+			for (size_t i = 0; i < lengthSize; i++)
+			{
+				size = (size << 8) | header[2 + i];
+			}
+		}
+		payload.resize(static_cast<size_t>(size));
+		return ReceiveAll(socket, payload.data(), payload.size());
+	}
+
+	// Upgrade with the sample key of RFC 6455 section 1.3 and check the answer
+	SOCKET ConnectBrowser(int port)
+	{
+		SOCKET client = ConnectClient(port);
+		std::string request =
+			"GET /skeletons HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+		send(client, request.data(), (int)request.size(), 0);
+
+		std::string response;
+		char c;
+		while (response.find("\r\n\r\n") == std::string::npos && recv(client, &c, 1, 0) == 1)
+		{
+			response += c;
+		}
+		if (response.compare(0, 12, "HTTP/1.1 101") != 0 ||
+			response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") == std::string::npos)
+		{
+			closesocket(client);
+			return INVALID_SOCKET;
+		}
+		return client;
+	}
+
+	bool TestWebSocket()
+	{
+		const int port = TestPort + 3;
+		const int frameCount = 60;
+		using SkeletonWebSocket::Opcode;
+
+		SkeletonSocketSender sender("127.0.0.1", port, SkeletonEncoding::Json, SenderMode::WebSocket);
+		if (!sender.Initialize())
+		{
+			return false;
+		}
+
+		// One browser takes the default JSON as text, the other asks for binary frames and pings
+		SOCKET textBrowser = ConnectBrowser(port);
+		SOCKET binaryBrowser = ConnectBrowser(port);
+		bool handshakeOk = textBrowser != INVALID_SOCKET && binaryBrowser != INVALID_SOCKET;
+		printf("  upgrade handshake: %s\n", handshakeOk ? "ok" : "FAILED");
+		if (!handshakeOk)
+		{
+			sender.Close();
+			return false;
+		}
+		SendWebSocketFrame(textBrowser, Opcode::Text, "{}");
+		SendWebSocketFrame(binaryBrowser, Opcode::Text, "{\"encoding\":\"BINARY\"}");
+		SendWebSocketFrame(binaryBrowser, Opcode::Ping, "hello");
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		int textFrames = 0;
+		bool textOk = true;
+		std::thread textReader([&] {
+			uint8_t opcode;
+			std::vector<uint8_t> payload;
+			while (ReceiveWebSocketFrame(textBrowser, opcode, payload))
+			{
+				std::string text(payload.begin(), payload.end());
+				textOk = textOk && opcode == static_cast<uint8_t>(Opcode::Text) &&
+					text.compare(0, 13, "{\"body_id\":7,") == 0 && text.back() == '}';
+				textFrames++;
+			}
+		});
+
+		int binaryFrames = 0;
+		bool binaryOk = true;
+		bool ponged = false;
+		std::thread binaryReader([&] {
+			uint8_t opcode;
+			std::vector<uint8_t> payload;
+			while (ReceiveWebSocketFrame(binaryBrowser, opcode, payload))
+			{
+				if (opcode == static_cast<uint8_t>(Opcode::Pong))
+				{
+					ponged = std::string(payload.begin(), payload.end()) == "hello";
+					continue;
+				}
+				k4abt_body_t body;
+				uint64_t timestamp;
+				binaryOk = binaryOk && opcode == static_cast<uint8_t>(Opcode::Binary) &&
+					SkeletonWire::ReadSkeletonFrame(payload.data(), payload.size(), body, timestamp) &&
+					body.skeleton.joints[5].position.xyz.y == static_cast<float>(timestamp);
+				binaryFrames++;
+			}
+		});
+
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			sender.SendSkeletonData(MakeBody(frame), static_cast<uint64_t>(frame));
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		sender.Close();
+		textReader.join();
+		binaryReader.join();
+		closesocket(textBrowser);
+		closesocket(binaryBrowser);
+
+		textOk = textOk && textFrames == frameCount;
+		binaryOk = binaryOk && binaryFrames == frameCount && ponged;
+		printf("  JSON text messages: %s, %d/%d frames\n", textOk ? "ok" : "FAILED", textFrames, frameCount);
+		printf("  binary messages and ping: %s, %d/%d frames\n", binaryOk ? "ok" : "FAILED", binaryFrames, frameCount);
+		return textOk && binaryOk;
+	}
+
+	bool TestLatencyStamps()
+	{
+		const int port = TestPort + 4;
+		const int frameCount = 60;
+		const uint64_t pingTime = 123456789;
+
+		SkeletonSocketSender sender("127.0.0.1", port, SkeletonEncoding::Binary, SenderMode::Listen);
+		if (!sender.Initialize())
+		{
+			return false;
+		}
+
+		SOCKET client = ConnectClient(port, "{\"timing\":true}");
+		std::string ping = "{\"ping\":" + std::to_string(pingTime) + "}\n";
+		send(client, ping.data(), (int)ping.size(), 0);
+		for (int wait = 0; wait < 200 && sender.GetStats().clientCount < 1; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		// Every frame is followed by its timing message, the echo comes first
+		int frames = 0;
+		int timings = 0;
+		bool echoed = false;
+		bool ok = true;
+		std::thread reader([&] {
+			std::vector<uint8_t> frame;
+			uint32_t frameSequence = 0;
+			uint64_t frameTimestamp = 0;
+			bool timingDue = false;
+			while (ReceiveFrame(client, frame))
+			{
+				SkeletonWire::FrameHeader header;
+				if (!SkeletonWire::ReadFrameHeader(frame.data(), frame.size(), header))
+				{
+					ok = false;
+					continue;
+				}
+
+				SkeletonWire::StageTimes times;
+				uint64_t timestamp;
+				uint64_t echoPing, receiveTime, sendTime;
+				if (SkeletonWire::ReadEchoFrame(frame.data(), frame.size(), echoPing, receiveTime, sendTime))
+				{
+					echoed = echoPing == pingTime && receiveTime != 0 && receiveTime <= sendTime;
+				}
+				else if (SkeletonWire::ReadTimingFrame(frame.data(), frame.size(), times, timestamp))
+				{
+					// Capture and pop are what the test passed, the sender stamps the rest in order
+					ok = ok && timingDue && header.sequence == frameSequence && timestamp == frameTimestamp &&
+						times.capture == 1000 + timestamp && times.pop == 2000 + timestamp &&
+						times.serialize >= times.pop && times.send >= times.serialize;
+					timingDue = false;
+					timings++;
+				}
+				else
+				{
+					ok = ok && !timingDue && header.type == SkeletonWire::MessageType::Skeleton;
+					frameSequence = header.sequence;
+					frameTimestamp = header.timestamp;
+					timingDue = true;
+					frames++;
+				}
+			}
+		});
+
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			SkeletonWire::StageTimes times;
+			times.capture = 1000 + frame;
+			times.pop = 2000 + frame;
+			sender.SendSkeletonData(MakeBody(frame), static_cast<uint64_t>(frame), times);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		SkeletonSenderStats stats = sender.GetStats();
+		sender.Close();
+		reader.join();
+		closesocket(client);
+
+		ok = ok && frames == frameCount && timings == frameCount;
+		bool statsOk = stats.trackerLatency.samples == static_cast<uint64_t>(frameCount) &&
+			stats.trackerLatency.p50Usec >= 1000 && stats.trackerLatency.p99Usec >= stats.trackerLatency.p50Usec &&
+			stats.serializeLatency.samples == static_cast<uint64_t>(frameCount);
+		printf("  timing messages: %s, %d/%d frames\n", ok ? "ok" : "FAILED", timings, frameCount);
+		printf("  ping echo: %s\n", echoed ? "ok" : "FAILED");
+		printf("  stage histograms: %s, tracker p50 %llu us, serialize p99 %llu us\n", statsOk ? "ok" : "FAILED",
+			(unsigned long long)stats.trackerLatency.p50Usec, (unsigned long long)stats.serializeLatency.p99Usec);
+		return ok && echoed && statsOk;
+	}
+
+	// Invalid pixels in blocks, a gradient with noise elsewhere, changing with the frame
+	std::vector<uint16_t> MakeDepth(int width, int height, int frame)
+	{
+		std::vector<uint16_t> depth(static_cast<size_t>(width) * height);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				bool invalid = ((x + frame) / 37 + y / 23) % 5 == 0 || x < y / 8;
+				depth[static_cast<size_t>(y) * width + x] = invalid ? 0 :
+					static_cast<uint16_t>(500 + 3 * x + 2 * y + (x * 7919 + y * 104729 + frame) % 13);
+			}
+		}
+		return depth;
+	}
+
+	bool RoundTrip(const std::vector<uint16_t>& depth)
+	{
+		std::vector<uint8_t> compressed(SkeletonDepth::MaxRvlSize(depth.size()));
+		size_t size = SkeletonDepth::CompressRvl(depth.data(), depth.size(), compressed.data());
+		std::vector<uint16_t> decoded(depth.size(), 1);
+		return size <= compressed.size() && size % 4 == 0 &&
+			SkeletonDepth::DecompressRvl(compressed.data(), size, decoded.data(), decoded.size()) && decoded == depth &&
+			(depth.empty() || !SkeletonDepth::DecompressRvl(compressed.data(), size - 4, decoded.data(), decoded.size()));
+	}
+
+	// Frames of a 640x576 depth channel arrive complete and in order
+	bool StreamDepthFrames(int port, bool sendRing)
+	{
+		const int width = 640;
+		const int height = 576;
+		const int frameCount = 10;
+
+		SkeletonDepthChannel channel(width, height);
+		if (!channel.Start("127.0.0.1", port, sendRing))
+		{
+			return false;
+		}
+		SOCKET client = ConnectClient(port, "{}");
+		for (int wait = 0; wait < 200 && channel.GetStats().clientCount < 1; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		int frames = 0;
+		bool ok = true;
+		std::thread reader([&] {
+			std::vector<uint8_t> frame;
+			std::vector<uint16_t> depth;
+			while (ReceiveFrame(client, frame))
+			{
+				int frameWidth, frameHeight;
+				uint64_t timestamp;
+				ok = ok && SkeletonDepth::ReadDepthFrame(frame.data(), frame.size(), depth, frameWidth, frameHeight, timestamp) &&
+					frameWidth == width && frameHeight == height &&
+					depth == MakeDepth(width, height, static_cast<int>(timestamp / FrameIntervalUsec));
+				frames++;
+			}
+		});
+
+		// Frames of the wrong size are refused
+		std::vector<uint16_t> small(320 * 288, 1000);
+		ok = !channel.SendDepth(small.data(), 320, 288, 0);
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			std::vector<uint16_t> depth = MakeDepth(width, height, frame);
+			channel.SendDepth(depth.data(), width, height, frame * FrameIntervalUsec);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		SkeletonDepthStats stats = channel.GetStats();
+		channel.Stop();
+		reader.join();
+		closesocket(client);
+
+		ok = ok && frames == frameCount && stats.framesSent == static_cast<uint64_t>(frameCount);
+		printf("  depth frames: %s, %d/%d frames, %.2f:1, compress p50 %llu us\n", ok ? "ok" : "FAILED", frames, frameCount,
+			stats.compressionRatio, (unsigned long long)stats.compressLatency.p50Usec);
+		return ok;
+	}
+
+	bool TestDepthChannel()
+	{
+		const int width = 640;
+		const int height = 576;
+
+		// Worst cases of the codec: empty, all invalid, full-range jumps between neighbors,
+		// single valid pixels and a length that is not a multiple of the vector width
+		std::vector<uint16_t> jumps(1001);
+		std::vector<uint16_t> isolated(1003, 0);
+		for (size_t i = 0; i < jumps.size(); i++)
+		{
+			jumps[i] = i % 2 == 0 ? 65535 : 1;
+		}
+		for (size_t i = 0; i < isolated.size(); i += 2)
+		{
+			isolated[i] = static_cast<uint16_t>(i);
+		}
+		bool codecOk = RoundTrip({}) && RoundTrip(std::vector<uint16_t>(777, 0)) && RoundTrip(jumps) &&
+			RoundTrip(isolated) && RoundTrip(MakeDepth(width, height, 0));
+		printf("  RVL round trips: %s\n", codecOk ? "ok" : "FAILED");
+
+		bool streamOk = StreamDepthFrames(TestPort + 5, false);
+		return codecOk && streamOk;
+	}
+
+	// Body index 0 is an ellipse with a hole, index 1 a rectangle and a detached square,
+	// both moving with the frame. A two-pixel speck of index 1 is too small for an outline
+	// and pixels of index 5 belong to no body of the frame.
+	const uint32_t SilhouetteBodyIds[] = { 3, 9 };
+
+	std::vector<uint8_t> MakeBodyIndexMap(int width, int height, int frame, bool withUnknown)
+	{
+		std::vector<uint8_t> map(static_cast<size_t>(width) * height, SkeletonSilhouette::Background);
+		int centerX = width / 4 + frame;
+		int centerY = height / 2;
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				float dx = (x - centerX) / 80.0f;
+				float dy = (y - centerY) / 150.0f;
+				bool hole = std::abs(x - centerX) < 10 && std::abs(y - centerY) < 20;
+				if (dx * dx + dy * dy <= 1.0f && !hole)
+				{
+					map[static_cast<size_t>(y) * width + x] = 0;
+				}
+				else if ((x >= 400 + frame && x < 500 + frame && y >= 100 && y < 400) ||
+					(x >= 550 && x < 560 && y >= 20 && y < 30))
+				{
+					map[static_cast<size_t>(y) * width + x] = 1;
+				}
+			}
+		}
+		map[static_cast<size_t>(height - 1) * width] = 1;
+		map[static_cast<size_t>(height - 1) * width + 1] = 1;
+		if (withUnknown)
+		{
+			std::fill(map.begin() + 5 * width, map.begin() + 6 * width, static_cast<uint8_t>(5));
+		}
+		return map;
+	}
+
+	double PolygonArea(const std::vector<SkeletonSilhouette::ContourPoint>& points)
+	{
+		double area = 0.0;
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			const SkeletonSilhouette::ContourPoint& a = points[i];
+			const SkeletonSilhouette::ContourPoint& b = points[(i + 1) % points.size()];
+			area += static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+		}
+		return std::abs(area) / 2.0;
+	}
+
+	// Both bodies: one outline for the ellipse (its hole is not traced), the rectangle and
+	// square as four corners each. Outline areas run through pixel centers, so they come
+	// out a little smaller than the pixel counts.
+	bool CheckContours(const std::vector<SkeletonSilhouette::Contour>& contours, bool withEllipse)
+	{
+		size_t ellipses = 0;
+		size_t rectangles = 0;
+		for (const SkeletonSilhouette::Contour& contour : contours)
+		{
+			double area = PolygonArea(contour.points);
+			if (contour.bodyId == SilhouetteBodyIds[0] && area > 0.95 * 3.14159 * 80 * 150 && area < 3.14159 * 80 * 150)
+			{
+				ellipses++;
+			}
+			else if (contour.bodyId == SilhouetteBodyIds[1] && contour.points.size() == 4 &&
+				(area == 99.0 * 299.0 || area == 9.0 * 9.0))
+			{
+				rectangles++;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return ellipses == (withEllipse ? 1u : 0u) && rectangles == 2;
+	}
+
+	bool TestSilhouetteChannel()
+	{
+		const int port = TestPort + 6;
+		const int width = 640;
+		const int height = 576;
+		const int frameCount = 10;
+
+		// Encoder on its own: runs decode to the map with unknown indices cleared, masks
+		// leave bodies out, outlines come out as described above
+		SkeletonSilhouette::SilhouetteEncoder encoder;
+		std::vector<uint8_t> buffer(SkeletonSilhouette::MaxSilhouetteFrameSize(width, height));
+		std::vector<uint8_t> map;
+		std::vector<uint32_t> bodyIds;
+		std::vector<SkeletonSilhouette::Contour> contours;
+		int frameWidth, frameHeight;
+		uint64_t timestamp;
+		std::vector<uint8_t> input = MakeBodyIndexMap(width, height, 0, true);
+		encoder.SetMap(input.data(), width, height, SilhouetteBodyIds, 2);
+		size_t size = encoder.WriteRunFrame(buffer.data(), 3, 0, 0);
+		bool codecOk = SkeletonSilhouette::ReadRunFrame(buffer.data(), size, map, frameWidth, frameHeight, bodyIds, timestamp) &&
+			frameWidth == width && frameHeight == height && bodyIds.size() == 2 && bodyIds[1] == SilhouetteBodyIds[1] &&
+			map == MakeBodyIndexMap(width, height, 0, false);
+		size = encoder.WriteRunFrame(buffer.data(), 2, 0, 0);
+		std::vector<uint8_t> rectanglesOnly = MakeBodyIndexMap(width, height, 0, false);
+		std::replace(rectanglesOnly.begin(), rectanglesOnly.end(), static_cast<uint8_t>(0), SkeletonSilhouette::Background);
+		codecOk = codecOk && SkeletonSilhouette::ReadRunFrame(buffer.data(), size, map, frameWidth, frameHeight, bodyIds, timestamp) &&
+			map == rectanglesOnly;
+		size_t contourSize = encoder.WriteContourFrame(buffer.data(), 3, 0, 0);
+		codecOk = codecOk && SkeletonSilhouette::ReadContourFrame(buffer.data(), contourSize, contours, frameWidth, frameHeight, timestamp) &&
+			CheckContours(contours, true);
+		size = encoder.WriteContourFrame(buffer.data(), 0, 0, 0);
+		codecOk = codecOk && SkeletonSilhouette::ReadContourFrame(buffer.data(), size, contours, frameWidth, frameHeight, timestamp) &&
+			contours.empty();
+		printf("  silhouette encoding: %s, %zu runs, %zu bytes of outlines\n", codecOk ? "ok" : "FAILED", encoder.GetRunCount(), contourSize);
+
+		// A client of runs for everybody and one of outlines for body 9 only
+		SkeletonSilhouetteChannel channel(width, height);
+		if (!channel.Start("127.0.0.1", port))
+		{
+			return false;
+		}
+		SOCKET runClient = ConnectClient(port, "{}");
+		SOCKET contourClient = ConnectClient(port, "{\"contours\":true,\"bodies\":[9]}");
+		for (int wait = 0; wait < 200 && channel.GetStats().clientCount < 2; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		int runFrames = 0;
+		int contourFrames = 0;
+		bool runsOk = true;
+		bool contoursOk = true;
+		std::thread runReader([&] {
+			std::vector<uint8_t> frame;
+			std::vector<uint8_t> received;
+			std::vector<uint32_t> ids;
+			while (ReceiveFrame(runClient, frame))
+			{
+				int w, h;
+				uint64_t time;
+				runsOk = runsOk && SkeletonSilhouette::ReadRunFrame(frame.data(), frame.size(), received, w, h, ids, time) &&
+					received == MakeBodyIndexMap(width, height, static_cast<int>(time / FrameIntervalUsec), false);
+				runFrames++;
+			}
+		});
+		std::thread contourReader([&] {
+			std::vector<uint8_t> frame;
+			std::vector<SkeletonSilhouette::Contour> received;
+			while (ReceiveFrame(contourClient, frame))
+			{
+				int w, h;
+				uint64_t time;
+				contoursOk = contoursOk && SkeletonSilhouette::ReadContourFrame(frame.data(), frame.size(), received, w, h, time) &&
+					CheckContours(received, false);
+				contourFrames++;
+			}
+		});
+
+		std::vector<uint8_t> small(320 * 288, SkeletonSilhouette::Background);
+		bool ok = !channel.SendBodyIndexMap(small.data(), 320, 288, SilhouetteBodyIds, 2, 0);
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			std::vector<uint8_t> bodyIndexMap = MakeBodyIndexMap(width, height, frame, true);
+			channel.SendBodyIndexMap(bodyIndexMap.data(), width, height, SilhouetteBodyIds, 2, frame * FrameIntervalUsec);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		SkeletonSilhouetteStats stats = channel.GetStats();
+		channel.Stop();
+		runReader.join();
+		contourReader.join();
+		closesocket(runClient);
+		closesocket(contourClient);
+
+		ok = ok && runsOk && contoursOk && runFrames == frameCount && contourFrames == frameCount &&
+			stats.framesSent == static_cast<uint64_t>(2 * frameCount);
+		printf("  silhouette frames: %s, %d/%d runs, %d/%d outlines, %.0f bytes per frame, encode p50 %llu us\n",
+			ok ? "ok" : "FAILED", runFrames, frameCount, contourFrames, frameCount, stats.averageFrameBytes,
+			(unsigned long long)stats.encodeLatency.p50Usec);
+		return codecOk && ok;
+	}
+
+	// Pinhole rays with the principal point in the middle, no ray for the left column.
+	// Like in the calibration's table, the principal point's own ray of 0, 0 counts as none.
+	std::vector<float> MakeXyTable(int width, int height)
+	{
+		std::vector<float> xyTable(2 * static_cast<size_t>(width) * height, 0.0f);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 1; x < width; x++)
+			{
+				size_t pixel = static_cast<size_t>(y) * width + x;
+				xyTable[2 * pixel] = (x - width / 2) / 500.0f;
+				xyTable[2 * pixel + 1] = (y - height / 2) / 500.0f;
+			}
+		}
+		return xyTable;
+	}
+
+	// Body index 0 stands at 2 m with a few invalid pixels, index 1 at 3 m, the wall at 4 m.
+	// Index 0 reaches into the left column, which has no rays.
+	void MakeBodyImages(int width, int height, int frame, std::vector<uint16_t>& depth, std::vector<uint8_t>& bodyIndexMap)
+	{
+		depth.assign(static_cast<size_t>(width) * height, 4000);
+		bodyIndexMap.assign(depth.size(), SkeletonSilhouette::Background);
+		for (int y = 100; y < 400; y++)
+		{
+			for (int x = 0; x < 120 + frame; x++)
+			{
+				size_t pixel = static_cast<size_t>(y) * width + x;
+				bodyIndexMap[pixel] = 0;
+				depth[pixel] = (x + y) % 37 == 0 ? 0 : 2000;
+			}
+			for (int x = 300; x < 380; x++)
+			{
+				size_t pixel = static_cast<size_t>(y) * width + x;
+				bodyIndexMap[pixel] = 1;
+				depth[pixel] = static_cast<uint16_t>(3000 + x - 300);
+			}
+		}
+	}
+
+	// Every point of body index 0 or 1, computed the slow way, in row order
+	std::vector<SkeletonPointCloud::Point> ExpectedPoints(int width, int height, int frame, uint8_t index)
+	{
+		std::vector<uint16_t> depth;
+		std::vector<uint8_t> bodyIndexMap;
+		MakeBodyImages(width, height, frame, depth, bodyIndexMap);
+		std::vector<float> xyTable = MakeXyTable(width, height);
+		std::vector<SkeletonPointCloud::Point> points;
+		for (size_t pixel = 0; pixel < depth.size(); pixel++)
+		{
+			bool ray = xyTable[2 * pixel] != 0.0f || xyTable[2 * pixel + 1] != 0.0f;
+			if (bodyIndexMap[pixel] == index && depth[pixel] != 0 && ray)
+			{
+				points.push_back({ static_cast<int16_t>(std::lrint(xyTable[2 * pixel] * depth[pixel])),
+					static_cast<int16_t>(std::lrint(xyTable[2 * pixel + 1] * depth[pixel])), static_cast<int16_t>(depth[pixel]) });
+			}
+		}
+		return points;
+	}
+
+	bool SamePoints(const std::vector<SkeletonPointCloud::Point>& a, const std::vector<SkeletonPointCloud::Point>& b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+			[](const SkeletonPointCloud::Point& p, const SkeletonPointCloud::Point& q) { return p.x == q.x && p.y == q.y && p.z == q.z; });
+	}
+
+	// Voxel means of body 0 stay on its plane at 2 m and inside its box
+	bool CheckVoxels(const std::vector<SkeletonPointCloud::Point>& voxels, size_t pointCount)
+	{
+		if (voxels.empty() || voxels.size() * 10 > pointCount)
+		{
+			return false;
+		}
+		for (const SkeletonPointCloud::Point& point : voxels)
+		{
+			if (point.z != 2000 || point.x < -1280 || point.x > -300 || point.y < -760 || point.y > 450)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool TestPointCloudChannel()
+	{
+		const int port = TestPort + 7;
+		const int width = 640;
+		const int height = 576;
+		const int frameCount = 10;
+		const uint32_t bodyIds[] = { 3, 9 };
+
+		// Split over three threads the points come out exactly as computed one by one,
+		// and in the same order; voxels average them
+		std::vector<uint16_t> depth;
+		std::vector<uint8_t> bodyIndexMap;
+		MakeBodyImages(width, height, 0, depth, bodyIndexMap);
+		SkeletonPointCloud::PointCloudEncoder encoder(width, height, MakeXyTable(width, height), 3);
+		encoder.SetFrame(depth.data(), bodyIndexMap.data(), bodyIds, 2);
+		std::vector<uint8_t> buffer(SkeletonPointCloud::MaxPointCloudFrameSize(depth.size()));
+		std::vector<SkeletonPointCloud::BodyPoints> bodies;
+		uint16_t voxelSize;
+		uint64_t timestamp;
+		size_t size = encoder.WriteFrame(buffer.data(), 3, 0, 0, 0);
+		std::vector<SkeletonPointCloud::Point> expected0 = ExpectedPoints(width, height, 0, 0);
+		bool codecOk = SkeletonPointCloud::ReadPointCloudFrame(buffer.data(), size, bodies, voxelSize, timestamp) &&
+			voxelSize == 0 && bodies.size() == 2 && bodies[0].bodyId == 3 && bodies[1].bodyId == 9 &&
+			SamePoints(bodies[0].points, expected0) && SamePoints(bodies[1].points, ExpectedPoints(width, height, 0, 1));
+		size = encoder.WriteFrame(buffer.data(), 1, 20, 0, 0);
+		codecOk = codecOk && SkeletonPointCloud::ReadPointCloudFrame(buffer.data(), size, bodies, voxelSize, timestamp) &&
+			voxelSize == 20 && bodies.size() == 1 && CheckVoxels(bodies[0].points, expected0.size());
+		printf("  point extraction: %s, %zu points, %zu voxels of body 3, %zu threads\n", codecOk ? "ok" : "FAILED",
+			encoder.GetPointCount(), bodies.empty() ? 0 : bodies[0].points.size(), encoder.GetThreadCount());
+
+		// A client with the default voxels and one with every point of body 9
+		SkeletonPointCloudChannel channel(width, height, MakeXyTable(width, height));
+		if (!channel.Start("127.0.0.1", port))
+		{
+			return false;
+		}
+		SOCKET voxelClient = ConnectClient(port, "{}");
+		SOCKET pointClient = ConnectClient(port, "{\"voxel\":0,\"bodies\":[9]}");
+		for (int wait = 0; wait < 200 && channel.GetStats().clientCount < 2; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		int voxelFrames = 0;
+		int pointFrames = 0;
+		bool voxelsOk = true;
+		bool pointsOk = true;
+		std::thread voxelReader([&] {
+			std::vector<uint8_t> frame;
+			std::vector<SkeletonPointCloud::BodyPoints> received;
+			while (ReceiveFrame(voxelClient, frame))
+			{
+				uint16_t voxel;
+				uint64_t time;
+				voxelsOk = voxelsOk && SkeletonPointCloud::ReadPointCloudFrame(frame.data(), frame.size(), received, voxel, time) &&
+					voxel == SkeletonPointCloud::DefaultVoxelSizeMm && received.size() == 2 && received[0].bodyId == 3 &&
+					CheckVoxels(received[0].points, ExpectedPoints(width, height, static_cast<int>(time / FrameIntervalUsec), 0).size());
+				voxelFrames++;
+			}
+		});
+		std::thread pointReader([&] {
+			std::vector<uint8_t> frame;
+			std::vector<SkeletonPointCloud::BodyPoints> received;
+			while (ReceiveFrame(pointClient, frame))
+			{
+				uint16_t voxel;
+				uint64_t time;
+				pointsOk = pointsOk && SkeletonPointCloud::ReadPointCloudFrame(frame.data(), frame.size(), received, voxel, time) &&
+					voxel == 0 && received.size() == 1 && received[0].bodyId == 9 &&
+					SamePoints(received[0].points, ExpectedPoints(width, height, static_cast<int>(time / FrameIntervalUsec), 1));
+				pointFrames++;
+			}
+		});
+
+		bool ok = !channel.SendPointClouds(depth.data(), bodyIndexMap.data(), 320, 288, bodyIds, 2, 0);
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			MakeBodyImages(width, height, frame, depth, bodyIndexMap);
+			channel.SendPointClouds(depth.data(), bodyIndexMap.data(), width, height, bodyIds, 2, frame * FrameIntervalUsec);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		SkeletonPointCloudStats stats = channel.GetStats();
+		channel.Stop();
+		voxelReader.join();
+		pointReader.join();
+		closesocket(voxelClient);
+		closesocket(pointClient);
+
+		ok = ok && voxelsOk && pointsOk && voxelFrames == frameCount && pointFrames == frameCount &&
+			stats.framesSent == static_cast<uint64_t>(2 * frameCount);
+		printf("  point cloud frames: %s, %d/%d voxel, %d/%d full, %.0f bytes per frame, extract p50 %llu us\n",
+			ok ? "ok" : "FAILED", voxelFrames, frameCount, pointFrames, frameCount, stats.averageFrameBytes,
+			(unsigned long long)stats.extractLatency.p50Usec);
+		return codecOk && ok;
+	}
+
+	// The listen-mode and depth streams again, sent through io_uring: skeleton frames
+	// batched over all clients, depth frames zero-copy from registered buffers
+	bool TestSendRing()
+	{
+		SkeletonSendRing ring;
+		if (!ring.Open())
+		{
+			printf("  io_uring is not available, skipped\n");
+			return true;
+		}
+		ring.Close();
+
+		bool listenOk = TestListenMode(TestPort + 8, true);
+		bool depthOk = StreamDepthFrames(TestPort + 9, true);
+		return listenOk && depthOk;
+	}
+
+	// A simulated link that drops from 1 MB/s to 50 KB/s for 30 seconds, fed 4000 byte
+	// frames at the rate the controller picks. It must back off far enough to keep the
+	// queueing delay at the target, and come back to the full rate afterwards.
+	bool SimulateRateControl()
+	{
+		const double frameBytes = 4000.0;
+		const double sourceRateHz = 30.0;
+		const double step = SkeletonRateController::SampleIntervalUsec / 1e6;
+		const int slowStart = 50;
+		const int slowEnd = 200;
+		const int sampleCount = 400;
+
+		SkeletonRateController controller;
+		uint64_t written = 0;
+		double backlog = 0.0;
+		bool fastOk = true;
+		int slowLevel = 0;
+		double slowDelay = 0.0;
+		int slowDelaySamples = 0;
+		for (int i = 0; i < sampleCount; i++)
+		{
+			double capacity = i >= slowStart && i < slowEnd ? 50000.0 : 1000000.0;
+			float rate = controller.GetRateHz(0.0f);
+			double offered = (rate > 0.0f ? std::min<double>(rate, sourceRateHz) : sourceRateHz) * frameBytes * step;
+			written += static_cast<uint64_t>(offered);
+			backlog += offered;
+			backlog -= std::min(backlog, capacity * step);
+
+			SkeletonRateController::Sample sample;
+			sample.timeUsec = static_cast<uint64_t>(i + 1) * SkeletonRateController::SampleIntervalUsec;
+			sample.bytesWritten = written;
+			sample.hasSocketInfo = true;
+			sample.socketBacklog = static_cast<uint64_t>(backlog);
+			sample.rttUsec = 5000 + static_cast<uint32_t>(backlog * 1e6 / capacity);
+			controller.Update(sample);
+
+			fastOk = fastOk && (i >= slowStart || controller.GetLevel() == 0);
+			if (i >= (slowStart + slowEnd) / 2 && i < slowEnd)
+			{
+				slowLevel = std::max(slowLevel, controller.GetLevel());
+				slowDelay += controller.GetEstimate().queueDelayUsec;
+				slowDelaySamples++;
+			}
+		}
+
+		// 50 KB/s carries 4000 byte frames at 12.5 Hz, which takes the 10 Hz level
+		slowDelay /= slowDelaySamples;
+		bool slowOk = slowLevel >= 4 && slowDelay <= SkeletonRateController::DefaultTargetDelayUsec;
+		bool recoveredOk = controller.GetLevel() == 0;
+		printf("  simulated link: %s, full rate on the fast link %s, level %d with %.0f ms mean queue delay on the slow link, level %d after it\n",
+			fastOk && slowOk && recoveredOk ? "ok" : "FAILED", fastOk ? "kept" : "lost", slowLevel, slowDelay / 1000.0,
+			controller.GetLevel());
+		return fastOk && slowOk && recoveredOk;
+	}
+
+	// Three clients of the same stream, one of them never reads. Only that one, which
+	// asked to be adaptive, is slowed down, the adaptive one that keeps up is not.
+	bool TestAdaptiveRate()
+	{
+		bool simulationOk = SimulateRateControl();
+
+		const int port = TestPort + 10;
+		const int frameCount = 3000;
+
+		SkeletonSocketSender sender("127.0.0.1", port, SkeletonEncoding::Binary, SenderMode::Listen);
+		if (!sender.Initialize())
+		{
+			return false;
+		}
+
+		// A small receive buffer fills up quickly once nobody reads from it
+		SOCKET stalled = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		int receiveBuffer = 4096;
+		setsockopt(stalled, SOL_SOCKET, SO_RCVBUF, (const char*)&receiveBuffer, sizeof(receiveBuffer));
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+		connect(stalled, (sockaddr*)&address, sizeof(address));
+		send(stalled, "{\"adaptive\":true}\n", 18, 0);
+
+		SOCKET readers[2] = { ConnectClient(port, "{}"), ConnectClient(port, "{\"adaptive\":true}") };
+		for (int wait = 0; wait < 200 && sender.GetStats().clientCount < 3; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		int received[2] = {};
+		bool passed[2] = {};
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 2; i++)
+		{
+			threads.emplace_back([&, i] { passed[i] = ReadStream(readers[i], frameCount - 1, received[i]); });
+		}
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			sender.SendSkeletonData(MakeBody(frame), static_cast<uint64_t>(frame));
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		SkeletonSenderStats stats = sender.GetStats();
+		sender.Close();
+		closesocket(stalled);
+		closesocket(readers[0]);
+		closesocket(readers[1]);
+
+		// Clients are listed in the order they connected
+		bool statsOk = stats.clients.size() == 3;
+		if (statsOk)
+		{
+			const SkeletonClientStats& stalledStats = stats.clients[0];
+			const SkeletonClientStats& fixedStats = stats.clients[1];
+			const SkeletonClientStats& adaptiveStats = stats.clients[2];
+			statsOk = stalledStats.adaptive && stalledStats.level == SkeletonRateController::LevelCount - 1 &&
+				stalledStats.rateHz > 0.0f && stalledStats.precisionLevel > 0 && stalledStats.estimate.queueDelayUsec > 0 &&
+				!fixedStats.adaptive && fixedStats.rateHz == 0.0f &&
+				adaptiveStats.adaptive && adaptiveStats.level == 0 && adaptiveStats.rateHz == 0.0f &&
+				adaptiveStats.estimate.goodputBytesPerSec > 0.0;
+			printf("  stalled client: level %d, %.0f Hz, precision level %u, %.0f ms queue delay\n", stalledStats.level,
+				stalledStats.rateHz, stalledStats.precisionLevel, stalledStats.estimate.queueDelayUsec / 1000.0);
+			printf("  adaptive client keeping up: level %d, %.1f KB/s goodput, rtt %u us\n", adaptiveStats.level,
+				adaptiveStats.estimate.goodputBytesPerSec / 1024.0, adaptiveStats.estimate.rttUsec);
+		}
+
+		bool readersOk = passed[0] && passed[1];
+		printf("  clients keeping up: %s, %d/%d and %d/%d frames\n", readersOk ? "ok" : "FAILED", received[0], frameCount,
+			received[1], frameCount);
+		printf("  client stats: %s\n", statsOk ? "ok" : "FAILED");
+		return simulationOk && readersOk && statsOk;
+	}
+
+	// Where the dead reckoning test's body really is: standing with 2 mm of jitter,
+	// walking along x at 1.2 m/s from frame 90 to 180, then standing again
+	k4abt_body_t MakeWalkingBody(int frame)
+	{
+		const int walkStart = 90;
+		const int walkEnd = 180;
+		float walked = 1.2f * FrameIntervalUsec / 1000.0f * static_cast<float>(std::clamp(frame, walkStart, walkEnd) - walkStart);
+
+		k4abt_body_t body = MakeBody(0);
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			k4a_float3_t& position = body.skeleton.joints[joint].position;
+			position.xyz.x += walked + static_cast<float>((frame * 7 + joint * 3) % 5 - 2);
+			position.xyz.y += static_cast<float>((frame * 3 + joint) % 5 - 2);
+		}
+		return body;
+	}
+
+	// A DELTA client of a dead-reckoned stream. Frames of the standing body are left out
+	// but for the heartbeat, and between the frames that do arrive the decoder's
+	// extrapolation never strays further from the real body than the error allowed.
+	bool TestDeadReckoning()
+	{
+		const int port = TestPort + 11;
+		const int frameCount = 270;
+		const float errorMm = 10.0f;
+
+		SkeletonSocketSender sender("127.0.0.1", port, SkeletonEncoding::Delta, SenderMode::Listen);
+		sender.SetDeadReckoning(errorMm, 500);
+		if (!sender.Initialize())
+		{
+			return false;
+		}
+
+		SOCKET client = ConnectClient(port, "{}");
+		for (int wait = 0; wait < 200 && sender.GetStats().clientCount < 1; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		int received = 0;
+		int standingReceived = 0;
+		size_t bytesReceived = 0;
+		float maxError = 0.0f;
+		bool decodedOk = true;
+		std::thread reader([&] {
+			SkeletonDeltaDecoder decoder;
+			std::vector<uint8_t> frame;
+			int next = 0;
+
+			// What the client shows for a frame against where the body really was
+			auto check = [&](int index, const k4abt_body_t& body) {
+				k4abt_body_t expected = MakeWalkingBody(index);
+				for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+				{
+					for (int i = 0; i < 3; i++)
+					{
+						float error = std::fabs(body.skeleton.joints[joint].position.v[i] - expected.skeleton.joints[joint].position.v[i]);
+						maxError = std::max(maxError, error);
+					}
+				}
+			};
+
+			// Frames that were left out are shown extrapolated from the last one that arrived
+			auto extrapolate = [&](int end) {
+				for (; next < end; next++)
+				{
+					k4abt_body_t body;
+					size_t count;
+					decoder.Predict(next * FrameIntervalUsec, &body, 1, count);
+					if (count == 1)
+					{
+						check(next, body);
+					}
+				}
+			};
+
+			while (ReceiveFrame(client, frame))
+			{
+				SkeletonWire::FrameHeader header;
+				k4abt_body_t body;
+				uint64_t timestamp;
+				if (!SkeletonWire::ReadFrameHeader(frame.data(), frame.size(), header))
+				{
+					decodedOk = false;
+					continue;
+				}
+				int index = static_cast<int>(header.timestamp / FrameIntervalUsec);
+				extrapolate(index);
+				if (!decoder.Read(frame.data(), frame.size(), body, timestamp))
+				{
+					decodedOk = false;
+					continue;
+				}
+				check(index, body);
+				next = index + 1;
+				received++;
+				standingReceived += index < 90 ? 1 : 0;
+				bytesReceived += frame.size();
+			}
+			extrapolate(frameCount);
+		});
+
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			sender.SendSkeletonData(MakeWalkingBody(frame), frame * FrameIntervalUsec);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		SkeletonSenderStats stats = sender.GetStats();
+		sender.Close();
+		reader.join();
+		closesocket(client);
+
+		// 3 seconds of standing take the first keyframe and one heartbeat every 500 ms.
+		// Decoded positions are 0.1 mm steps, the error compares against the real ones.
+		bool suppressedOk = standingReceived <= 7 && received + static_cast<int>(stats.framesSuppressed) == frameCount;
+		bool errorOk = decodedOk && maxError <= errorMm + 0.05f;
+		printf("  frames left out: %s, %d/%d frames and %zu bytes received, %d of the first 90 standing\n",
+			suppressedOk ? "ok" : "FAILED", received, frameCount, bytesReceived, standingReceived);
+		printf("  extrapolation error: %s, at most %.2f mm\n", errorOk ? "ok" : "FAILED", maxError);
+		return suppressedOk && errorOk;
+	}
+
+	// Reordering, duplicates and the wrap of the 32-bit sequence numbers, fed to the
+	// tracker directly
+	bool TestSequenceTracker()
+	{
+		using Result = SkeletonWire::SequenceTracker::Result;
+		const std::pair<uint32_t, Result> steps[] = {
+			{ 0xFFFFFFFDu, Result::InOrder },
+			{ 0xFFFFFFFEu, Result::InOrder },
+			{ 0u, Result::Gap },             // 0xFFFFFFFF skipped over the wrap
+			{ 1u, Result::InOrder },
+			{ 0xFFFFFFFFu, Result::Late },   // arrives after all
+			{ 4u, Result::Gap },             // 2 and 3 skipped
+			{ 3u, Result::Late },
+			{ 3u, Result::Late },            // duplicate
+			{ 5u, Result::InOrder },
+			{ 0x80000005u, Result::Late },   // half the sequence space behind counts as old
+		};
+
+		SkeletonWire::SequenceTracker tracker;
+		bool resultsOk = true;
+		for (const auto& step : steps)
+		{
+			resultsOk = resultsOk && tracker.Accept(step.first) == step.second;
+		}
+		bool ok = resultsOk && tracker.GetReceived() == 6 && tracker.GetLost() == 3 && tracker.GetLate() == 4;
+		printf("  sequence tracker: %s, %llu received, %llu lost, %llu late\n", ok ? "ok" : "FAILED",
+			(unsigned long long)tracker.GetReceived(), (unsigned long long)tracker.GetLost(),
+			(unsigned long long)tracker.GetLate());
+		return ok;
+	}
+
+	// Datagrams the receiver throws away on purpose, every tenth and a burst of five,
+	// must cost only themselves: the tracker counts exactly those as lost and the frames
+	// behind them arrive without waiting for anything, unlike a TCP retransmission that
+	// takes at least 200 ms
+	bool TestUdpLoss()
+	{
+		const int port = TestPort + 12;
+		const int frameCount = 600;
+		const uint64_t maxLatencyUsec = 20000;
+		bool trackerOk = TestSequenceTracker();
+
+		SOCKET receiver = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		int bufferSize = 4 << 20;
+		setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferSize, sizeof(bufferSize));
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+		if (bind(receiver, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+		{
+			closesocket(receiver);
+			return false;
+		}
+
+		SkeletonSocketSender sender("127.0.0.1", port, SkeletonEncoding::Binary, SenderMode::Udp);
+		if (!sender.Initialize())
+		{
+			closesocket(receiver);
+			return false;
+		}
+
+		std::unique_ptr<std::atomic<uint64_t>[]> sendTimes(new std::atomic<uint64_t>[frameCount]);
+		SkeletonWire::SequenceTracker tracker;
+		std::vector<uint64_t> latencies;
+		int dropped = 0;
+		bool decodedOk = true;
+		std::thread reader([&] {
+			std::vector<uint8_t> datagram(SkeletonWire::MaxSkeletonFrameSize);
+			for (int arrived = 0;; arrived++)
+			{
+				int size = recv(receiver, reinterpret_cast<char*>(datagram.data()), (int)datagram.size(), 0);
+				SkeletonWire::FrameHeader header;
+				if (size <= 0 || !SkeletonWire::ReadFrameHeader(datagram.data(), static_cast<size_t>(size), header))
+				{
+					// The stop datagram, or the socket failed
+					return;
+				}
+				if (arrived % 10 == 3 || (arrived >= 300 && arrived < 305))
+				{
+					dropped++;
+					continue;
+				}
+
+				uint64_t now = SkeletonLatency::HostTimeUsec();
+				k4abt_body_t body;
+				uint64_t timestamp;
+				if (!SkeletonWire::ReadSkeletonFrame(datagram.data(), static_cast<size_t>(size), body, timestamp) ||
+					timestamp >= static_cast<uint64_t>(frameCount) ||
+					body.skeleton.joints[5].position.xyz.y != MakeBody(static_cast<int>(timestamp)).skeleton.joints[5].position.xyz.y)
+				{
+					decodedOk = false;
+					continue;
+				}
+				tracker.Accept(header.sequence);
+				latencies.push_back(now - sendTimes[timestamp].load());
+				if (timestamp == static_cast<uint64_t>(frameCount - 1))
+				{
+					return;
+				}
+			}
+		});
+
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			sendTimes[frame] = SkeletonLatency::HostTimeUsec();
+			sender.SendSkeletonData(MakeBody(frame), static_cast<uint64_t>(frame));
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		// Should the last frame have gone missing after all, a datagram that is no frame ends the reader
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		SOCKET stopper = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		sendto(stopper, "x", 1, 0, (const sockaddr*)&address, sizeof(address));
+		reader.join();
+		closesocket(stopper);
+		SkeletonSenderStats stats = sender.GetStats();
+		sender.Close();
+		closesocket(receiver);
+
+		std::sort(latencies.begin(), latencies.end());
+		uint64_t p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+		bool countsOk = decodedOk && stats.framesDropped == 0 && static_cast<int>(tracker.GetReceived()) + dropped == frameCount &&
+			tracker.GetLost() == static_cast<uint64_t>(dropped) && tracker.GetLate() == 0;
+		bool latencyOk = !latencies.empty() && p99 <= maxLatencyUsec;
+		printf("  dropped datagrams: %s, %d of %d dropped, %llu counted lost, %llu late\n", countsOk ? "ok" : "FAILED",
+			dropped, frameCount, (unsigned long long)tracker.GetLost(), (unsigned long long)tracker.GetLate());
+		printf("  latency of the rest: %s, p99 %llu us\n", latencyOk ? "ok" : "FAILED", (unsigned long long)p99);
+		return trackerOk && countsOk && latencyOk;
+	}
+
+	// Send one body through a quantized frame and measure what came back: the largest
+	// position error in millimeters and rotation error in degrees. The id and the
+	// confidence levels must come back exactly.
+	bool QuantizedRoundTrip(const k4abt_body_t& body, double& positionError, double& angleError)
+	{
+		std::vector<uint8_t> frame(SkeletonWire::QuantizedSkeletonFrameSize);
+		size_t size = SkeletonWire::WriteQuantizedSkeletonFrame(frame.data(), body, 1234, 1);
+		k4abt_body_t decoded;
+		uint64_t timestamp;
+		if (size != frame.size() || !SkeletonWire::ReadSkeletonFrame(frame.data(), size, decoded, timestamp) ||
+			timestamp != 1234 || decoded.id != body.id)
+		{
+			return false;
+		}
+
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			const k4abt_joint_t& source = body.skeleton.joints[joint];
+			const k4abt_joint_t& result = decoded.skeleton.joints[joint];
+			if (result.confidence_level != source.confidence_level)
+			{
+				return false;
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				positionError = std::max(positionError, std::fabs(static_cast<double>(result.position.v[i]) - source.position.v[i]));
+			}
+
+			// q and -q are the same rotation, the decoded quaternion is normalized
+			double dot = 0.0;
+			double norm = 0.0;
+			for (int i = 0; i < 4; i++)
+			{
+				dot += static_cast<double>(source.orientation.v[i]) * result.orientation.v[i];
+				norm += static_cast<double>(source.orientation.v[i]) * source.orientation.v[i];
+			}
+			double cosHalfAngle = std::min(1.0, std::fabs(dot) / std::sqrt(norm));
+			angleError = std::max(angleError, 2.0 * std::acos(cosHalfAngle) * 180.0 / 3.14159265358979);
+		}
+		return true;
+	}
+
+	// Bodies at the edges of what the quantized frames carry: joints as far from the
+	// pelvis as int16 reaches, halfway between two steps, and orientations whose two
+	// largest components tie or whose largest one is negative
+	std::vector<k4abt_body_t> MakeQuantizationLimitBodies()
+	{
+		const float offsets[] = { 3276.7f, -3276.7f, 3276.65f, -3276.65f, 0.05f, -0.05f, 1234.55f, 0.0f };
+		const float halfSqrt2 = 0.70710678f;
+		const k4a_quaternion_t edgeOrientations[] = {
+			{ { 1.0f, 0.0f, 0.0f, 0.0f } },
+			{ { -1.0f, 0.0f, 0.0f, 0.0f } },
+			{ { 0.5f, 0.5f, 0.5f, 0.5f } },
+			{ { -0.5f, 0.5f, -0.5f, 0.5f } },
+			{ { halfSqrt2, halfSqrt2, 0.0f, 0.0f } },
+			{ { 0.0f, 0.0f, -halfSqrt2, halfSqrt2 } },
+			{ { 0.0f, 0.0f, 0.0f, -1.0f } },
+		};
+
+		std::vector<k4abt_body_t> bodies;
+		std::mt19937 random(6);
+		std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+		const k4a_float3_t pelvises[] = { { { 0.0f, 0.0f, 0.0f } }, { { -2500.3f, 1800.7f, 5999.9f } } };
+		for (const k4a_float3_t& pelvis : pelvises)
+		{
+			for (int variant = 0; variant < 4; variant++)
+			{
+				k4abt_body_t body = {};
+				body.id = static_cast<uint32_t>(bodies.size() + 1);
+				for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+				{
+					k4abt_joint_t& target = body.skeleton.joints[joint];
+					for (int i = 0; i < 3; i++)
+					{
+						float offset = joint == K4ABT_JOINT_PELVIS ? 0.0f : offsets[(joint + i + variant) % 8];
+						target.position.v[i] = pelvis.v[i] + offset;
+					}
+
+					k4a_quaternion_t& orientation = target.orientation;
+					if ((joint + variant) % 2 == 0)
+					{
+						orientation = edgeOrientations[(joint / 2 + variant) % 7];
+					}
+					else
+					{
+						float norm = 0.0f;
+						for (int i = 0; i < 4; i++)
+						{
+							orientation.v[i] = component(random);
+							norm += orientation.v[i] * orientation.v[i];
+						}
+						for (int i = 0; i < 4; i++)
+						{
+							orientation.v[i] /= std::sqrt(norm);
+						}
+					}
+					target.confidence_level = static_cast<k4abt_joint_confidence_level_t>((joint + variant) % K4ABT_JOINT_CONFIDENCE_LEVELS_COUNT);
+				}
+				bodies.push_back(body);
+			}
+		}
+		return bodies;
+	}
+
+	// The quantized encoding against the float one, for a recorded pose and for bodies
+	// at its limits. The bounds are the ones SkeletonWireFormat.h documents.
+	bool TestQuantizedErrorBound(const char* recording)
+	{
+		// Float rounding of the millimeter values adds to the 0.05 mm of the int16 steps
+		const double maxPositionError = 0.05 + 0.001;
+		const double maxAngleError = 0.3;
+
+		std::vector<SkeletonRecording::Frame> frames;
+		bool loadedOk = SkeletonRecording::Load(recording, frames);
+		std::vector<k4abt_body_t> bodies;
+		for (const SkeletonRecording::Frame& frame : frames)
+		{
+			bodies.insert(bodies.end(), frame.bodies.begin(), frame.bodies.end());
+		}
+		size_t recordedCount = bodies.size();
+		std::vector<k4abt_body_t> limitBodies = MakeQuantizationLimitBodies();
+		bodies.insert(bodies.end(), limitBodies.begin(), limitBodies.end());
+
+		bool decodedOk = true;
+		double recordedPositionError = 0.0;
+		double recordedAngleError = 0.0;
+		double limitPositionError = 0.0;
+		double limitAngleError = 0.0;
+		for (size_t i = 0; i < bodies.size(); i++)
+		{
+			bool recorded = i < recordedCount;
+			decodedOk = decodedOk && QuantizedRoundTrip(bodies[i], recorded ? recordedPositionError : limitPositionError,
+				recorded ? recordedAngleError : limitAngleError);
+		}
+
+		bool ok = loadedOk && recordedCount > 0 && decodedOk &&
+			std::max(recordedPositionError, limitPositionError) <= maxPositionError &&
+			std::max(recordedAngleError, limitAngleError) <= maxAngleError;
+		printf("  quantized error: %s, %zu recorded bodies at most %.4f mm and %.3f degrees, %zu at the limits %.4f mm and %.3f degrees%s\n",
+			ok ? "ok" : "FAILED", recordedCount, recordedPositionError, recordedAngleError, limitBodies.size(),
+			limitPositionError, limitAngleError, decodedOk ? "" : ", ids or confidence levels changed");
+		return ok;
+	}
+
+	// The viewer's capture, tracker, stream and render threads share the command channel,
+	// and the capture thread records capture times while the tracker thread looks them up
+	bool TestPipelineHandoff()
+	{
+		// A request posted twice before it is taken acts once, Stop stays posted
+		SkeletonCommandChannel commands;
+		commands.Post(SkeletonCommand::Snapshot);
+		commands.Post(SkeletonCommand::Snapshot);
+		bool commandsOk = commands.Take(SkeletonCommand::Snapshot) && !commands.Take(SkeletonCommand::Snapshot) &&
+			!commands.IsStopping();
+		commands.Post(SkeletonCommand::Stop);
+		commandsOk = commandsOk && commands.Take(SkeletonCommand::Stop) && commands.IsStopping() &&
+			!commands.Take(SkeletonCommand::Snapshot);
+
+		// Requests from several threads while one takes them: each is taken at most once, and
+		// the last one posted is not lost
+		SkeletonCommandChannel requests;
+		std::atomic<bool> posting(true);
+		int taken = 0;
+		std::thread taker([&] {
+			while (posting)
+			{
+				taken += requests.Take(SkeletonCommand::Snapshot) ? 1 : 0;
+			}
+		});
+		std::vector<std::thread> posters;
+		for (int i = 0; i < 4; i++)
+		{
+			posters.emplace_back([&] {
+				for (int j = 0; j < 1000; j++)
+				{
+					requests.Post(SkeletonCommand::Snapshot);
+				}
+			});
+		}
+		for (std::thread& poster : posters)
+		{
+			poster.join();
+		}
+		posting = false;
+		taker.join();
+		taken += requests.Take(SkeletonCommand::Snapshot) ? 1 : 0;
+		commandsOk = commandsOk && taken >= 1 && taken <= 4000 && !requests.IsStopping();
+		printf("  command channel: %s\n", commandsOk ? "ok" : "FAILED");
+
+		// Every host time found belongs to the capture looked up, never to the one overwriting it
+		const int captureCount = 2000;
+		SkeletonLatency::CaptureTimes captureTimes;
+		std::atomic<int> recorded(-1);
+		std::thread recorder([&] {
+			for (int i = 0; i < captureCount; i++)
+			{
+				captureTimes.Record(FrameIntervalUsec * (i + 1), 1000 + i);
+				recorded = i;
+
+				// Paced like a camera, far slower than the look-ups
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		});
+		uint64_t found = 0;
+		uint64_t wrong = 0;
+		for (int latest = -1; latest < captureCount - 1;)
+		{
+			latest = recorded;
+			for (int i = std::max(latest - 40, 0); i <= latest; i++)
+			{
+				uint64_t hostTime = captureTimes.Find(FrameIntervalUsec * (i + 1));
+				found += hostTime != 0 ? 1 : 0;
+				wrong += hostTime != 0 && hostTime != static_cast<uint64_t>(1000 + i) ? 1 : 0;
+			}
+		}
+		recorder.join();
+		bool timesOk = found > 0 && wrong == 0;
+		printf("  capture times across threads: %s, %llu found, %llu wrong\n", timesOk ? "ok" : "FAILED",
+			(unsigned long long)found, (unsigned long long)wrong);
+		return commandsOk && timesOk;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* recording = argc > 1 ? argv[1] : "pose_snapshot_example.json";
+
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+
+	printf("Listen mode, %d clients:\n", ClientCount);
+	bool listenOk = TestListenMode();
+	printf("Connect mode with consumer restart:\n");
+	bool connectOk = TestConnectMode();
+	printf("Subscriptions:\n");
+	bool subscriptionsOk = TestSubscriptions();
+	printf("WebSocket mode:\n");
+	bool webSocketOk = TestWebSocket();
+	printf("Latency stamps:\n");
+	bool latencyOk = TestLatencyStamps();
+	printf("Depth channel:\n");
+	bool depthOk = TestDepthChannel();
+	printf("Silhouette channel:\n");
+	bool silhouetteOk = TestSilhouetteChannel();
+	printf("Point cloud channel:\n");
+	bool pointCloudOk = TestPointCloudChannel();
+	printf("io_uring sends:\n");
+	bool sendRingOk = TestSendRing();
+	printf("Adaptive rate:\n");
+	bool adaptiveOk = TestAdaptiveRate();
+	printf("Dead reckoning:\n");
+	bool deadReckoningOk = TestDeadReckoning();
+	printf("Pipeline hand-offs:\n");
+	bool pipelineOk = TestPipelineHandoff();
+	printf("UDP with dropped datagrams:\n");
+	bool udpOk = TestUdpLoss();
+	printf("Quantized error bound:\n");
+	bool quantizedOk = TestQuantizedErrorBound(recording);
+
+	WSACleanup();
+
+	bool ok = listenOk && connectOk && subscriptionsOk && webSocketOk && latencyOk && depthOk && silhouetteOk && pointCloudOk &&
+		sendRingOk && adaptiveOk && deadReckoningOk && pipelineOk &&
+		udpOk && quantizedOk;
+	printf("%s\n", ok ? "PASSED" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -1,9 +1,14 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <k4arecord/playback.h>
 #include <k4a/k4a.h>
@@ -14,20 +19,39 @@
 #include <Utilities.h>
 #include <Window3dWrapper.h>
 #include "PoseSnapshotCapture.h"
+#include "SkeletonCommandChannel.h"
+#include "SkeletonDepthChannel.h"
+#include "SkeletonPointCloudChannel.h"
+#include "SkeletonSilhouetteChannel.h"
+#include "SkeletonLatency.h"
+#include "SkeletonSendRing.h"
+#include "SkeletonSharedMemory.h"
 #include "SkeletonSocketSender.h"
+#include "SpscRingBuffer.h"
 
 // Information provided upon startup of the unity application which
 // automatically logs the select PORT and the attributed IP by the network
 // (server prioritizes the wireless hotspot IP)
 std::string IP = "10.77.22.68";
 const int PORT = 8888;
+const char* DefaultSharedMemoryName = "kinect_skeletons";
+const float DefaultDeadReckoningErrorMm = 10.0f;
+const int DefaultHeartbeatMs = 1000;
+
+// Body frames the stream and render stages may fall behind by
+const size_t StageQueueCapacity = 4;
+
+// How long an idle stage blocks before it checks whether to stop, and how long after
+// its last redraw the renderer redraws without a new body frame
+const int32_t StageWaitTimeoutMs = 100;
+const int RenderWaitMs = 16;
 
 void PrintUsage()
 {
 #ifdef _WIN32
-	printf("\nUSAGE: (k4abt_)simple_3d_viewer.exe SensorMode[NFOV_UNBINNED, WFOV_BINNED](optional) RuntimeMode[CPU, CUDA, DIRECTML, TENSORRT](optional) -model MODEL_PATH(optional)\n");
+	printf("\nUSAGE: (k4abt_)simple_3d_viewer.exe SensorMode[NFOV_UNBINNED, WFOV_BINNED](optional) RuntimeMode[CPU, CUDA, DIRECTML, TENSORRT](optional) -model MODEL_PATH(optional) -encoding ENCODING(optional) -listen|-websocket|-udp DESTINATIONS(optional) -async POLICY(optional) -multibody(optional) -shm NAME(optional) -depth PORT(optional) -silhouettes PORT(optional) -pointclouds PORT(optional) -uring(optional) -adaptive(optional) -deadreckoning ERROR_MM(optional) -heartbeat MS(optional) -waits WAITS(optional)\n");
 #else
-	printf("\nUSAGE: (k4abt_)simple_3d_viewer.exe SensorMode[NFOV_UNBINNED, WFOV_BINNED](optional) RuntimeMode[CPU, CUDA, TENSORRT](optional)\n");
+	printf("\nUSAGE: (k4abt_)simple_3d_viewer.exe SensorMode[NFOV_UNBINNED, WFOV_BINNED](optional) RuntimeMode[CPU, CUDA, TENSORRT](optional) -encoding ENCODING(optional) -listen|-websocket|-udp DESTINATIONS(optional) -async POLICY(optional) -multibody(optional) -shm NAME(optional) -depth PORT(optional) -silhouettes PORT(optional) -pointclouds PORT(optional) -uring(optional) -adaptive(optional) -deadreckoning ERROR_MM(optional) -heartbeat MS(optional) -waits WAITS(optional)\n");
 #endif
 	printf("  - SensorMode: \n");
 	printf("      NFOV_UNBINNED (default) - Narrow Field of View Unbinned Mode [Resolution: 640x576; FOI: 75 degree x 65 degree]\n");
@@ -40,10 +64,48 @@ void PrintUsage()
 #endif
 	printf("      TENSORRT - Use the TensorRT processing mode.\n");
 	printf("      OFFLINE - Play a specified file. Does not require Kinect device\n");
+	printf("  - Encoding: \n");
+	printf("      JSON (default) - Newline-delimited JSON skeleton frames\n");
+	printf("      BINARY - Length-prefixed fixed-layout binary skeleton frames\n");
+	printf("      QUANTIZED - Binary frames with int16 positions and packed quaternions (358 bytes)\n");
+	printf("      DELTA - Quantized changes since the previous frame, with a full keyframe every 30 frames\n");
+	printf("  - Listen mode (-listen): accept any number of skeleton clients on port %d instead of connecting to %s\n", PORT, IP.c_str());
+	printf("  - WebSocket mode (-websocket): like -listen, for browsers connecting to ws://HOST:%d; JSON goes out as text messages, BINARY, QUANTIZED and DELTA as binary messages\n", PORT);
+	printf("  - UDP mode (-udp [HOST[,HOST...]]): one binary datagram per frame to each unicast or multicast destination on port %d (default %s)\n", PORT, IP.c_str());
+	printf("  - Multi-body frames (-multibody): send every tracked body (up to %zu) in one message per frame instead of only the first\n", SkeletonWire::MaxBodies);
+	printf("  - Shared memory (-shm [NAME]): also publish every body frame to the shared memory ring NAME (default %s) for consumers on this machine\n", DefaultSharedMemoryName);
+	printf("  - Depth channel (-depth [PORT]): stream the RVL-compressed depth image of every body frame to any number of clients on PORT (default %d), WebSocket with -websocket\n", PORT + 1);
+	printf("  - Silhouette channel (-silhouettes [PORT]): stream the body index map of every body frame as run-length rows or outline polygons on PORT (default %d), WebSocket with -websocket\n", PORT + 2);
+	printf("  - Point cloud channel (-pointclouds [PORT]): stream the depth points of every tracked body, %d mm voxels unless a client asks otherwise, on PORT (default %d), WebSocket with -websocket\n", SkeletonPointCloud::DefaultVoxelSizeMm, PORT + 3);
+	printf("  - io_uring sends (-uring): on Linux, send to listen, WebSocket and channel clients through io_uring, all clients in one submission and frames of %zu bytes or more zero-copy; plain sends where io_uring is unavailable\n", SkeletonSendRing::ZeroCopyThreshold);
+	printf("  - Adaptive rate (-adaptive): lower the frame rate and precision of listen and WebSocket clients whose link cannot keep up, unless they subscribe with \"adaptive\":false\n");
+	printf("  - Dead reckoning (-deadreckoning [ERROR_MM]): DELTA streams only send a joint once it drifts more than ERROR_MM (default %.0f) from where the receiver extrapolates it, and no frame while nothing does\n", DefaultDeadReckoningErrorMm);
+	printf("  - Heartbeat (-heartbeat MS): with -deadreckoning, send a keyframe every MS milliseconds regardless (default %d)\n", DefaultHeartbeatMs);
+	printf("  - Stage waits (-waits WAITS): how the capture and tracker stages wait for the SDK\n");
+	printf("      POLL (default) - Poll the device and the tracker in turn on one thread, for the lowest latency at one busy core\n");
+	printf("      EVENT - Block in the device and tracker waits on a thread each, idling without frames\n");
+	printf("  - Async sending (-async [POLICY]): serialize and send on a separate thread\n");
+	printf("      DROP_OLDEST (default) - Evict the oldest queued frame when the queue is full\n");
+	printf("      DROP_NEWEST - Discard the new frame when the queue is full\n");
+	printf("      BLOCK - Wait for the sender thread when the queue is full\n");
 	printf("e.g.   (k4abt_)simple_3d_viewer.exe WFOV_BINNED CPU\n");
 	printf("e.g.   (k4abt_)simple_3d_viewer.exe CPU\n");
 	printf("e.g.   (k4abt_)simple_3d_viewer.exe WFOV_BINNED\n");
 	printf("e.g.   (k4abt_)simple_3d_viewer.exe OFFLINE MyFile.mkv\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe CPU -encoding BINARY\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -encoding BINARY -async DROP_OLDEST\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -listen -encoding BINARY\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -websocket -encoding QUANTIZED\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -udp 239.255.0.1\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -listen -encoding QUANTIZED -multibody\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -shm\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -listen -encoding BINARY -depth\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -websocket -encoding QUANTIZED -silhouettes\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -listen -encoding QUANTIZED -multibody -pointclouds\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -listen -encoding BINARY -depth -uring\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -websocket -encoding DELTA -adaptive\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -udp -encoding DELTA -deadreckoning 5 -heartbeat 500\n");
+	printf("e.g.   (k4abt_)simple_3d_viewer.exe -listen -encoding QUANTIZED -waits EVENT\n");
 }
 
 void PrintAppUsage()
@@ -68,21 +130,139 @@ void PrintAppUsage()
 	printf("\n");
 }
 
-// Global State and Key Process Function
-bool s_isRunning = true;
+void PrintDepthStats(const SkeletonDepthChannel& depthChannel)
+{
+	if (!depthChannel.IsRunning())
+	{
+		return;
+	}
+	SkeletonDepthStats stats = depthChannel.GetStats();
+	printf("Depth channel: %llu frames sent, %llu dropped, %.2f:1 compression, compress p50 %llu us, p99 %llu us\n",
+		(unsigned long long)stats.framesSent, (unsigned long long)stats.framesDropped, stats.compressionRatio,
+		(unsigned long long)stats.compressLatency.p50Usec, (unsigned long long)stats.compressLatency.p99Usec);
+}
+
+void PrintSilhouetteStats(const SkeletonSilhouetteChannel& silhouetteChannel)
+{
+	if (!silhouetteChannel.IsRunning())
+	{
+		return;
+	}
+	SkeletonSilhouetteStats stats = silhouetteChannel.GetStats();
+	printf("Silhouette channel: %llu frames sent, %llu dropped, %.0f bytes per frame, encode p50 %llu us, p99 %llu us\n",
+		(unsigned long long)stats.framesSent, (unsigned long long)stats.framesDropped, stats.averageFrameBytes,
+		(unsigned long long)stats.encodeLatency.p50Usec, (unsigned long long)stats.encodeLatency.p99Usec);
+}
+
+void PrintPointCloudStats(const SkeletonPointCloudChannel& pointCloudChannel)
+{
+	if (!pointCloudChannel.IsRunning())
+	{
+		return;
+	}
+	SkeletonPointCloudStats stats = pointCloudChannel.GetStats();
+	printf("Point cloud channel: %llu frames sent, %llu dropped, %.0f bytes per frame, %zu threads, extract p50 %llu us, p99 %llu us\n",
+		(unsigned long long)stats.framesSent, (unsigned long long)stats.framesDropped, stats.averageFrameBytes, stats.threadCount,
+		(unsigned long long)stats.extractLatency.p50Usec, (unsigned long long)stats.extractLatency.p99Usec);
+}
+
+// Ray of every depth pixel as x / z and y / z, 0, 0 where the pixel has none
+std::vector<float> CreateXyTable(const k4a_calibration_t& sensorCalibration)
+{
+	int width = sensorCalibration.depth_camera_calibration.resolution_width;
+	int height = sensorCalibration.depth_camera_calibration.resolution_height;
+	std::vector<float> xyTable(2 * static_cast<size_t>(width) * static_cast<size_t>(height), 0.0f);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			k4a_float2_t point = { { static_cast<float>(x), static_cast<float>(y) } };
+			k4a_float3_t ray;
+			int valid = 0;
+			if (k4a_calibration_2d_to_3d(&sensorCalibration, &point, 1.f, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH,
+				&ray, &valid) == K4A_RESULT_SUCCEEDED && valid != 0)
+			{
+				size_t pixel = static_cast<size_t>(y) * width + x;
+				xyTable[2 * pixel] = ray.xyz.x;
+				xyTable[2 * pixel + 1] = ray.xyz.y;
+			}
+		}
+	}
+	return xyTable;
+}
+
+void PrintSenderStats(const SkeletonSocketSender& socketSender)
+{
+	SkeletonSenderStats stats = socketSender.GetStats();
+	printf("Skeleton stream: %llu frames sent, %llu dropped", (unsigned long long)stats.framesSent, (unsigned long long)stats.framesDropped);
+	if (stats.clientCount > 0)
+	{
+		printf(", %zu clients", stats.clientCount);
+	}
+	if (socketSender.GetEncoding() != SkeletonEncoding::Json && stats.framesSent > 0)
+	{
+		printf(", %.1f bytes/frame (%.2f:1 vs float binary frames)",
+			static_cast<double>(stats.bytesSerialized) / static_cast<double>(stats.framesSent), stats.compressionRatio);
+	}
+	if (stats.framesSuppressed > 0)
+	{
+		printf(", %llu left out by dead reckoning", (unsigned long long)stats.framesSuppressed);
+	}
+	if (socketSender.IsAsync())
+	{
+		printf(", enqueue-to-wire latency avg %.0f us, max %llu us", stats.averageLatencyUsec, (unsigned long long)stats.maxLatencyUsec);
+	}
+	printf("\n");
+
+	const std::pair<const char*, SkeletonLatencyPercentiles> stages[] = {
+		{ "tracker", stats.trackerLatency },
+		{ "frame loop", stats.loopLatency },
+		{ "serialize", stats.serializeLatency },
+		{ "write", stats.writeLatency },
+		{ "capture to wire", stats.totalLatency },
+	};
+	for (const auto& stage : stages)
+	{
+		if (stage.second.samples > 0)
+		{
+			printf("  %-16s p50 %6llu us, p99 %6llu us\n", stage.first,
+				(unsigned long long)stage.second.p50Usec, (unsigned long long)stage.second.p99Usec);
+		}
+	}
+
+	// Clients still connected, and what their links allow
+	for (const SkeletonClientStats& client : stats.clients)
+	{
+		printf("  client %s: %s", client.address.c_str(), client.adaptive ? "adaptive" : "fixed");
+		if (client.rateHz > 0.0f)
+		{
+			printf(", %.0f Hz", client.rateHz);
+		}
+		if (client.precisionLevel > 0)
+		{
+			printf(", precision level %u", client.precisionLevel);
+		}
+		printf(", goodput %.1f KB/s, rtt %.1f ms (min %.1f), queue delay %.1f ms\n", client.estimate.goodputBytesPerSec / 1024.0,
+			client.estimate.rttUsec / 1000.0, client.estimate.minRttUsec / 1000.0, client.estimate.queueDelayUsec / 1000.0);
+	}
+}
+
+// Window State and Key Process Function. The window callbacks run on the render
+// thread, the commands for the other stages go through the channel in context.
 Visualization::Layout3d s_layoutMode = Visualization::Layout3d::OnlyMainView;
 bool s_visualizeJointFrame = false;
-bool s_triggerManualSnapshot = false;
 
 
-int64_t ProcessKey(void* /*context*/, int key)
+int64_t ProcessKey(void* context, int key)
 {
+	SkeletonCommandChannel* commands = static_cast<SkeletonCommandChannel*>(context);
+
 	// https://www.glfw.org/docs/latest/group__keys.html
 	switch (key)
 	{
 		// Quit
 	case GLFW_KEY_ESCAPE:
-		s_isRunning = false;
+		commands->Post(SkeletonCommand::Stop);
 		break;
 	case GLFW_KEY_K:
 		s_layoutMode = (Visualization::Layout3d)(((int)s_layoutMode + 1) % (int)Visualization::Layout3d::Count);
@@ -94,16 +274,16 @@ int64_t ProcessKey(void* /*context*/, int key)
 		PrintAppUsage();
 		break;
 	case GLFW_KEY_R:
-		s_triggerManualSnapshot = true;
+		commands->Post(SkeletonCommand::Snapshot);
 		printf("R key pressed - snapshot will be captured!\n");
 		break;
 	}
 	return 1;
 }
 
-int64_t CloseCallback(void* /*context*/)
+int64_t CloseCallback(void* context)
 {
-	s_isRunning = false;
+	static_cast<SkeletonCommandChannel*>(context)->Post(SkeletonCommand::Stop);
 	return 1;
 }
 
@@ -118,6 +298,23 @@ struct InputSettings
 	bool Offline = false;
 	std::string FileName;
 	std::string ModelPath;
+	SkeletonEncoding Encoding = SkeletonEncoding::Json;
+	bool Listen = false;
+	bool WebSocket = false;
+	bool Udp = false;
+	std::string UdpDestinations;
+	bool AsyncSend = false;
+	QueueOverflowPolicy OverflowPolicy = QueueOverflowPolicy::DropOldest;
+	bool MultiBody = false;
+	std::string SharedMemoryName;
+	int DepthPort = 0;
+	int SilhouettePort = 0;
+	int PointCloudPort = 0;
+	bool SendRing = false;
+	bool AdaptiveRate = false;
+	float DeadReckoningErrorMm = 0.0f;
+	int HeartbeatMs = DefaultHeartbeatMs;
+	bool EventWaits = false;
 };
 
 bool ParseInputSettingsFromArg(int argc, char** argv, InputSettings& inputSettings)
@@ -173,6 +370,129 @@ bool ParseInputSettingsFromArg(int argc, char** argv, InputSettings& inputSettin
 				return false;
 			}
 		}
+		else if (inputArg == std::string("-encoding"))
+		{
+			std::string encoding = i < argc - 1 ? argv[++i] : "";
+			if (encoding == "JSON")
+				inputSettings.Encoding = SkeletonEncoding::Json;
+			else if (encoding == "BINARY")
+				inputSettings.Encoding = SkeletonEncoding::Binary;
+			else if (encoding == "QUANTIZED")
+				inputSettings.Encoding = SkeletonEncoding::Quantized;
+			else if (encoding == "DELTA")
+				inputSettings.Encoding = SkeletonEncoding::Delta;
+			else
+			{
+				printf("Error: unknown skeleton encoding: %s\n", encoding.c_str());
+				return false;
+			}
+		}
+		else if (inputArg == std::string("-listen"))
+		{
+			inputSettings.Listen = true;
+		}
+		else if (inputArg == std::string("-websocket"))
+		{
+			inputSettings.WebSocket = true;
+		}
+		else if (inputArg == std::string("-udp"))
+		{
+			inputSettings.Udp = true;
+			// Optional comma-separated list of unicast or multicast destinations
+			if (i < argc - 1 && argv[i + 1][0] != '-')
+			{
+				inputSettings.UdpDestinations = argv[++i];
+			}
+		}
+		else if (inputArg == std::string("-multibody"))
+		{
+			inputSettings.MultiBody = true;
+		}
+		else if (inputArg == std::string("-uring"))
+		{
+			inputSettings.SendRing = true;
+		}
+		else if (inputArg == std::string("-adaptive"))
+		{
+			inputSettings.AdaptiveRate = true;
+		}
+		else if (inputArg == std::string("-deadreckoning"))
+		{
+			inputSettings.DeadReckoningErrorMm = i < argc - 1 && argv[i + 1][0] != '-' ?
+				static_cast<float>(atof(argv[++i])) : DefaultDeadReckoningErrorMm;
+			if (!(inputSettings.DeadReckoningErrorMm > 0.0f))
+			{
+				printf("Error: invalid dead reckoning error\n");
+				return false;
+			}
+		}
+		else if (inputArg == std::string("-waits"))
+		{
+			std::string waits = i < argc - 1 ? argv[++i] : "";
+			if (waits == "POLL")
+				inputSettings.EventWaits = false;
+			else if (waits == "EVENT")
+				inputSettings.EventWaits = true;
+			else
+			{
+				printf("Error: unknown stage waits: %s\n", waits.c_str());
+				return false;
+			}
+		}
+		else if (inputArg == std::string("-heartbeat"))
+		{
+			inputSettings.HeartbeatMs = i < argc - 1 ? atoi(argv[++i]) : 0;
+			if (inputSettings.HeartbeatMs <= 0)
+			{
+				printf("Error: invalid heartbeat interval\n");
+				return false;
+			}
+		}
+		else if (inputArg == std::string("-shm"))
+		{
+			inputSettings.SharedMemoryName = i < argc - 1 && argv[i + 1][0] != '-' ? argv[++i] : DefaultSharedMemoryName;
+		}
+		else if (inputArg == std::string("-depth"))
+		{
+			inputSettings.DepthPort = i < argc - 1 && argv[i + 1][0] != '-' ? atoi(argv[++i]) : PORT + 1;
+			if (inputSettings.DepthPort <= 0 || inputSettings.DepthPort > 65535)
+			{
+				printf("Error: invalid depth channel port\n");
+				return false;
+			}
+		}
+		else if (inputArg == std::string("-silhouettes"))
+		{
+			inputSettings.SilhouettePort = i < argc - 1 && argv[i + 1][0] != '-' ? atoi(argv[++i]) : PORT + 2;
+			if (inputSettings.SilhouettePort <= 0 || inputSettings.SilhouettePort > 65535)
+			{
+				printf("Error: invalid silhouette channel port\n");
+				return false;
+			}
+		}
+		else if (inputArg == std::string("-pointclouds"))
+		{
+			inputSettings.PointCloudPort = i < argc - 1 && argv[i + 1][0] != '-' ? atoi(argv[++i]) : PORT + 3;
+			if (inputSettings.PointCloudPort <= 0 || inputSettings.PointCloudPort > 65535)
+			{
+				printf("Error: invalid point cloud channel port\n");
+				return false;
+			}
+		}
+		else if (inputArg == std::string("-async"))
+		{
+			inputSettings.AsyncSend = true;
+			std::string policy = i < argc - 1 ? argv[i + 1] : "";
+			if (policy == "DROP_OLDEST")
+				inputSettings.OverflowPolicy = QueueOverflowPolicy::DropOldest;
+			else if (policy == "DROP_NEWEST")
+				inputSettings.OverflowPolicy = QueueOverflowPolicy::DropNewest;
+			else if (policy == "BLOCK")
+				inputSettings.OverflowPolicy = QueueOverflowPolicy::Block;
+			else
+				continue;
+			i++;
+		}
 		else
 		{
 			printf("Error: command not understood: %s\n", inputArg.c_str());
@@ -182,24 +502,192 @@ bool ParseInputSettingsFromArg(int argc, char** argv, InputSettings& inputSettin
 	return true;
 }
 
-void VisualizeResult(k4abt_frame_t bodyFrame, Window3dWrapper& window3d, int depthWidth, int depthHeight,
-	PoseSnapshotCapture* snapshotCapture = nullptr, SkeletonSocketSender* socketSender = nullptr) {
+SkeletonSocketSender CreateSocketSender(const InputSettings& inputSettings)
+{
+	if (inputSettings.WebSocket)
+	{
+		return SkeletonSocketSender("0.0.0.0", PORT, inputSettings.Encoding, SenderMode::WebSocket);
+	}
+	if (inputSettings.Listen)
+	{
+		return SkeletonSocketSender("0.0.0.0", PORT, inputSettings.Encoding, SenderMode::Listen);
+	}
+	if (inputSettings.Udp)
+	{
+		std::string destinations = inputSettings.UdpDestinations.empty() ? IP : inputSettings.UdpDestinations;
+		SkeletonEncoding encoding = inputSettings.Encoding == SkeletonEncoding::Json ? SkeletonEncoding::Binary : inputSettings.Encoding;
+		return SkeletonSocketSender(destinations, PORT, encoding, SenderMode::Udp);
+	}
+	return SkeletonSocketSender(IP, PORT, inputSettings.Encoding, SenderMode::Connect);
+}
+
+// Where the tracked bodies go besides the window
+struct StreamTargets
+{
+	SkeletonSocketSender* socketSender = nullptr;
+	bool sendAllBodies = false;
+	SkeletonShmWriter* shmWriter = nullptr;
+	SkeletonDepthChannel* depthChannel = nullptr;
+	SkeletonSilhouetteChannel* silhouetteChannel = nullptr;
+	SkeletonPointCloudChannel* pointCloudChannel = nullptr;
+};
+
+// One body tracking result on its way to the stream and render stages. Every stage
+// it is handed to holds its own reference to the body frame and releases it when done.
+struct TrackedFrame
+{
+	k4abt_frame_t bodyFrame = nullptr;
+	k4abt_body_t bodies[SkeletonWire::MaxBodies];
+	uint32_t bodyCount = 0;
+	uint64_t timestamp = 0;
+	SkeletonWire::StageTimes stageTimes;
+};
+
+// Counters of the device pipeline, printed when the viewer exits
+struct PipelineStats
+{
+	std::atomic<uint64_t> capturesSkipped{ 0 };  // the tracker queue was full
+	std::atomic<uint64_t> framesNotStreamed{ 0 };  // the stream stage was StageQueueCapacity frames behind
+	std::atomic<uint64_t> framesNotRendered{ 0 };  // a newer frame was there by the next render
+};
+
+// Wakes a stage waiting for its queue. The producer takes the mutex
+// before notifying, so a wake-up between the consumer's check and its wait is not lost.
+struct StageSignal
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	void Notify()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		condition.notify_one();
+	}
+
+	// Until ready() or the deadline, whichever comes first
+	template <typename Ready>
+	void WaitUntil(std::chrono::steady_clock::time_point deadline, Ready ready)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait_until(lock, deadline, ready);
+	}
+};
+
+void PrintPipelineStats(const PipelineStats& stats)
+{
+	printf("Pipeline: %llu captures skipped with the tracker queue full, %llu body frames not streamed, %llu not rendered\n",
+		(unsigned long long)stats.capturesSkipped, (unsigned long long)stats.framesNotStreamed,
+		(unsigned long long)stats.framesNotRendered);
+}
+
+// Read everybody in view out of the body frame, no heap allocation however many there are
+void ReadTrackedFrame(k4abt_frame_t bodyFrame, const SkeletonLatency::CaptureTimes& captureTimes, TrackedFrame& frame)
+{
+	frame.stageTimes = SkeletonWire::StageTimes();
+	frame.stageTimes.pop = SkeletonLatency::HostTimeUsec();
+	frame.bodyFrame = bodyFrame;
+	frame.timestamp = k4abt_frame_get_device_timestamp_usec(bodyFrame);
+	frame.stageTimes.capture = captureTimes.Find(frame.timestamp);
+	frame.bodyCount = std::min<uint32_t>(k4abt_frame_get_num_bodies(bodyFrame), static_cast<uint32_t>(SkeletonWire::MaxBodies));
+	for (uint32_t i = 0; i < frame.bodyCount; i++)
+	{
+		VERIFY(k4abt_frame_get_body_skeleton(bodyFrame, i, &frame.bodies[i].skeleton), "Get skeleton from body frame failed!");
+		frame.bodies[i].id = k4abt_frame_get_body_id(bodyFrame, i);
+	}
+}
 
+// Manual snapshot capture with 'r' key, of the first body. The request waits for somebody to be in view.
+void TakeSnapshot(const TrackedFrame& frame, PoseSnapshotCapture& snapshotCapture, SkeletonCommandChannel& commands)
+{
+	if (frame.bodyCount > 0 && commands.Take(SkeletonCommand::Snapshot))
+	{
+		snapshotCapture.TriggerManualCapture(frame.bodies[0]);
+	}
+}
+
+// Hand the frame to the sender, the shared memory ring and the image channels
+void StreamResult(const TrackedFrame& frame, const StreamTargets& targets)
+{
+	bool sendingSilhouettes = targets.silhouetteChannel && targets.silhouetteChannel->IsRunning();
+	bool sendingPointClouds = targets.pointCloudChannel && targets.pointCloudChannel->IsRunning();
+	bool sendingDepth = targets.depthChannel && targets.depthChannel->IsRunning();
+	if (sendingSilhouettes || sendingPointClouds || sendingDepth)
+	{
+		k4a_capture_t originalCapture = k4abt_frame_get_capture(frame.bodyFrame);
+		k4a_image_t depthImage = k4a_capture_get_depth_image(originalCapture);
+		const uint16_t* depthBuffer = reinterpret_cast<const uint16_t*>(k4a_image_get_buffer(depthImage));
+		if (sendingSilhouettes || sendingPointClouds)
+		{
+			uint32_t bodyIds[SkeletonWire::MaxBodies];
+			for (uint32_t i = 0; i < frame.bodyCount; i++)
+			{
+				bodyIds[i] = frame.bodies[i].id;
+			}
+			k4a_image_t bodyIndexMap = k4abt_frame_get_body_index_map(frame.bodyFrame);
+			const uint8_t* bodyIndexMapBuffer = k4a_image_get_buffer(bodyIndexMap);
+			int mapWidth = k4a_image_get_width_pixels(bodyIndexMap);
+			int mapHeight = k4a_image_get_height_pixels(bodyIndexMap);
+			if (sendingSilhouettes)
+			{
+				targets.silhouetteChannel->SendBodyIndexMap(bodyIndexMapBuffer, mapWidth, mapHeight, bodyIds, frame.bodyCount, frame.timestamp);
+			}
+			if (sendingPointClouds)
+			{
+				targets.pointCloudChannel->SendPointClouds(depthBuffer, bodyIndexMapBuffer, mapWidth, mapHeight, bodyIds,
+					frame.bodyCount, frame.timestamp);
+			}
+			k4a_image_release(bodyIndexMap);
+		}
+
+		// Remote clients get the same depth image, paired with the skeletons by the body frame timestamp
+		if (sendingDepth)
+		{
+			targets.depthChannel->SendDepth(depthBuffer, k4a_image_get_width_pixels(depthImage),
+				k4a_image_get_height_pixels(depthImage), frame.timestamp);
+		}
+		k4a_image_release(depthImage);
+		k4a_capture_release(originalCapture);
+	}
+
+	if (targets.shmWriter && targets.shmWriter->IsOpen())
+	{
+		// Same-host consumers always get every body, serialized in place
+		targets.shmWriter->WriteBodies(frame.bodies, frame.bodyCount, frame.timestamp);
+	}
+	// Without -multibody every consumer gets the first body its subscription includes
+	if (targets.socketSender && targets.socketSender->IsConnected())
+	{
+		if (targets.sendAllBodies)
+		{
+			targets.socketSender->SendBodies(frame.bodies, frame.bodyCount, frame.timestamp, frame.stageTimes);
+		}
+		else
+		{
+			targets.socketSender->SendSkeletonData(frame.bodies, frame.bodyCount, frame.timestamp, frame.stageTimes);
+		}
+	}
+}
+
+// Draw the point cloud colored by body, and the joints and bones of everybody in view
+void RenderResult(const TrackedFrame& frame, Window3dWrapper& window3d, int depthWidth, int depthHeight)
+{
 	// Obtain original capture that generates the body tracking result
-	k4a_capture_t originalCapture = k4abt_frame_get_capture(bodyFrame);
+	k4a_capture_t originalCapture = k4abt_frame_get_capture(frame.bodyFrame);
 	k4a_image_t depthImage = k4a_capture_get_depth_image(originalCapture);
 
 	std::vector<Color> pointCloudColors(depthWidth * depthHeight, { 1.f, 1.f, 1.f, 1.f });
 
 	// Read body index map and assign colors
-	k4a_image_t bodyIndexMap = k4abt_frame_get_body_index_map(bodyFrame);
+	k4a_image_t bodyIndexMap = k4abt_frame_get_body_index_map(frame.bodyFrame);
 	const uint8_t* bodyIndexMapBuffer = k4a_image_get_buffer(bodyIndexMap);
 	for (int i = 0; i < depthWidth * depthHeight; i++)
 	{
 		uint8_t bodyIndex = bodyIndexMapBuffer[i];
 		if (bodyIndex != K4ABT_BODY_INDEX_MAP_BACKGROUND)
 		{
-			uint32_t bodyId = k4abt_frame_get_body_id(bodyFrame, bodyIndex);
+			uint32_t bodyId = k4abt_frame_get_body_id(frame.bodyFrame, bodyIndex);
 			pointCloudColors[i] = g_bodyColors[bodyId % g_bodyColors.size()];
 		}
 	}
@@ -210,37 +698,9 @@ void VisualizeResult(k4abt_frame_t bodyFrame, Window3dWrapper& window3d, int dep
 
 	// Visualize the skeleton data
 	window3d.CleanJointsAndBones();
-	uint32_t numBodies = k4abt_frame_get_num_bodies(bodyFrame);
-
-	// Process snapshot capture and socket sending for the first body
-	if (numBodies > 0)
+	for (uint32_t i = 0; i < frame.bodyCount; i++)
 	{
-		k4abt_body_t body;
-		VERIFY(k4abt_frame_get_body_skeleton(bodyFrame, 0, &body.skeleton), "Get skeleton from body frame failed!");
-		body.id = k4abt_frame_get_body_id(bodyFrame, 0);
-
-		// Get timestamp
-		uint64_t timestamp = k4abt_frame_get_device_timestamp_usec(bodyFrame);
-
-		// Send data via socket
-		if (socketSender && socketSender->IsConnected())
-		{
-			socketSender->SendSkeletonData(body, timestamp);
-		}
-
-		// Manual snapshot capture with 'r' key
-		if (snapshotCapture && s_triggerManualSnapshot)
-		{
-			snapshotCapture->TriggerManualCapture(body);
-			s_triggerManualSnapshot = false;
-		}
-	}
-
-	for (uint32_t i = 0; i < numBodies; i++)
-	{
-		k4abt_body_t body;
-		VERIFY(k4abt_frame_get_body_skeleton(bodyFrame, i, &body.skeleton), "Get skeleton from body frame failed!");
-		body.id = k4abt_frame_get_body_id(bodyFrame, i);
+		const k4abt_body_t& body = frame.bodies[i];
 
 		// Assign the correct color based on the body id
 		Color color = g_bodyColors[body.id % g_bodyColors.size()];
@@ -284,13 +744,172 @@ void VisualizeResult(k4abt_frame_t bodyFrame, Window3dWrapper& window3d, int dep
 
 	k4a_capture_release(originalCapture);
 	k4a_image_release(depthImage);
+}
+
+// Capture stage: dequeue a capture from the device and hand it to the tracker. A capture
+// the tracker has no room for is skipped, so it always works on the freshest ones.
+// waitMs 0 polls the device, otherwise it blocks until the next capture. Returns false
+// once the pipeline has to stop.
+bool CaptureStep(k4a_device_t device, k4abt_tracker_t tracker, int32_t waitMs, SkeletonLatency::CaptureTimes& captureTimes,
+	PipelineStats& stats, SkeletonCommandChannel& commands)
+{
+	k4a_capture_t sensorCapture = nullptr;
+	k4a_wait_result_t getCaptureResult = k4a_device_get_capture(device, &sensorCapture, waitMs);
+	if (getCaptureResult == K4A_WAIT_RESULT_TIMEOUT)
+	{
+		return true;
+	}
+	if (getCaptureResult != K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		std::cout << "Get depth capture returned error: " << getCaptureResult << std::endl;
+		commands.Post(SkeletonCommand::Stop);
+		return false;
+	}
+
+	k4a_image_t depthImage = k4a_capture_get_depth_image(sensorCapture);
+	if (depthImage != nullptr)
+	{
+		captureTimes.Record(k4a_image_get_device_timestamp_usec(depthImage), SkeletonLatency::HostTimeUsec());
+		k4a_image_release(depthImage);
+	}
+
+	// timeout_in_ms is set to 0. Return immediately no matter whether the sensorCapture is successfully added
+	// to the queue or not.
+	k4a_wait_result_t queueCaptureResult = k4abt_tracker_enqueue_capture(tracker, sensorCapture, 0);
+
+	// Release the sensor capture once it is no longer needed.
+	k4a_capture_release(sensorCapture);
+
+	if (queueCaptureResult == K4A_WAIT_RESULT_TIMEOUT)
+	{
+		stats.capturesSkipped++;
+	}
+	else if (queueCaptureResult == K4A_WAIT_RESULT_FAILED)
+	{
+		std::cout << "Error! Add capture to tracker process queue failed!" << std::endl;
+		commands.Post(SkeletonCommand::Stop);
+		return false;
+	}
+	return true;
+}
+
+// Where the tracker stage hands its body frames, and how it wakes the stages behind it
+struct TrackerOutputs
+{
+	SpscRingBuffer<TrackedFrame>& streamQueue;
+	SpscRingBuffer<TrackedFrame>& renderQueue;
+	StageSignal& streamSignal;
+	StageSignal& renderSignal;
+};
+
+// Tracker stage: pop a body frame, take a requested snapshot and hand the frame on.
+// The stream stage gets each one, the render stage only needs to keep up with the display.
+// waitMs 0 polls the tracker, otherwise it blocks until the next result. Returns false
+// once the pipeline has to stop.
+bool TrackerStep(k4abt_tracker_t tracker, int32_t waitMs, const SkeletonLatency::CaptureTimes& captureTimes,
+	PoseSnapshotCapture& snapshotCapture, const TrackerOutputs& outputs, TrackedFrame& frame, PipelineStats& stats,
+	SkeletonCommandChannel& commands)
+{
+	k4abt_frame_t bodyFrame = nullptr;
+	k4a_wait_result_t popFrameResult = k4abt_tracker_pop_result(tracker, &bodyFrame, waitMs);
+	if (popFrameResult == K4A_WAIT_RESULT_TIMEOUT)
+	{
+		return true;
+	}
+	if (popFrameResult != K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		std::cout << "Pop body frame result failed!" << std::endl;
+		commands.Post(SkeletonCommand::Stop);
+		return false;
+	}
+
+	/************* Successfully get a body tracking result, process the result here ***************/
+	ReadTrackedFrame(bodyFrame, captureTimes, frame);
+	TakeSnapshot(frame, snapshotCapture, commands);
+
+	// The popped reference goes to the stream stage, the render stage gets one of its own.
+	// Queues are never evicted from here, that would lose the references of the evicted frames.
+	k4abt_frame_reference(bodyFrame);
+	if (!outputs.renderQueue.TryPush(frame))
+	{
+		k4abt_frame_release(bodyFrame);
+		stats.framesNotRendered++;
+	}
+	if (!outputs.streamQueue.TryPush(frame))
+	{
+		k4abt_frame_release(bodyFrame);
+		stats.framesNotStreamed++;
+	}
+	outputs.streamSignal.Notify();
+	outputs.renderSignal.Notify();
+	return true;
+}
 
+// With -waits EVENT the capture and tracker stages each block in the SDK on a thread of their own
+void CaptureLoop(k4a_device_t device, k4abt_tracker_t tracker, SkeletonLatency::CaptureTimes& captureTimes,
+	PipelineStats& stats, SkeletonCommandChannel& commands)
+{
+	while (!commands.IsStopping() && CaptureStep(device, tracker, StageWaitTimeoutMs, captureTimes, stats, commands))
+	{
+	}
+}
+
+void TrackerLoop(k4abt_tracker_t tracker, const SkeletonLatency::CaptureTimes& captureTimes,
+	PoseSnapshotCapture& snapshotCapture, const TrackerOutputs& outputs, PipelineStats& stats, SkeletonCommandChannel& commands)
+{
+	TrackedFrame frame;
+	while (!commands.IsStopping() &&
+		TrackerStep(tracker, StageWaitTimeoutMs, captureTimes, snapshotCapture, outputs, frame, stats, commands))
+	{
+	}
+}
+
+// With -waits POLL both stages poll in turn on one thread, like the single device loop
+// did, so the pipeline keeps no more than that one core busy
+void DeviceLoop(k4a_device_t device, k4abt_tracker_t tracker, SkeletonLatency::CaptureTimes& captureTimes,
+	PoseSnapshotCapture& snapshotCapture, const TrackerOutputs& outputs, PipelineStats& stats, SkeletonCommandChannel& commands)
+{
+	TrackedFrame frame;
+	while (!commands.IsStopping() && CaptureStep(device, tracker, 0, captureTimes, stats, commands) &&
+		TrackerStep(tracker, 0, captureTimes, snapshotCapture, outputs, frame, stats, commands))
+	{
+	}
+}
+
+// Stream stage: serialize and send every frame in order, off the tracker and render threads.
+// Sleeps until the tracker stage signals, whatever the -waits setting.
+void StreamLoop(SpscRingBuffer<TrackedFrame>& streamQueue, StageSignal& signal, const StreamTargets& targets,
+	SkeletonCommandChannel& commands)
+{
+	TrackedFrame frame;
+	while (!commands.IsStopping())
+	{
+		if (!streamQueue.TryPop(frame))
+		{
+			signal.WaitUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(StageWaitTimeoutMs),
+				[&] { return !streamQueue.Empty() || commands.IsStopping(); });
+			continue;
+		}
+		StreamResult(frame, targets);
+		k4abt_frame_release(frame.bodyFrame);
+	}
+}
+
+// Release the body frames a stage did not get to before the pipeline stopped
+void ReleaseQueuedFrames(SpscRingBuffer<TrackedFrame>& queue)
+{
+	TrackedFrame frame;
+	while (queue.TryPop(frame))
+	{
+		k4abt_frame_release(frame.bodyFrame);
+	}
 }
 
 void PlayFile(InputSettings inputSettings)
 {
 	// Initialize the 3d window controller
 	Window3dWrapper window3d;
+	SkeletonCommandChannel commands;
 
 	//create the tracker and playback handle
 	k4a_calibration_t sensorCalibration;
@@ -322,26 +941,70 @@ void PlayFile(InputSettings inputSettings)
 	int depthHeight = sensorCalibration.depth_camera_calibration.resolution_height;
 
 	window3d.Create("3D Visualization", sensorCalibration);
-	window3d.SetCloseCallback(CloseCallback);
-	window3d.SetKeyCallback(ProcessKey);
+	window3d.SetCloseCallback(CloseCallback, &commands);
+	window3d.SetKeyCallback(ProcessKey, &commands);
 
 	// Create pose snapshot capture (3 seconds countdown)
 	PoseSnapshotCapture snapshotCapture(std::chrono::milliseconds(3000));
 
 	// Create and initialize socket sender
-	SkeletonSocketSender socketSender(IP, PORT);
+	SkeletonSocketSender socketSender = CreateSocketSender(inputSettings);
+	socketSender.SetSendRing(inputSettings.SendRing);
+	socketSender.SetAdaptiveRate(inputSettings.AdaptiveRate);
+	socketSender.SetDeadReckoning(inputSettings.DeadReckoningErrorMm, static_cast<uint32_t>(inputSettings.HeartbeatMs));
 	if (socketSender.Initialize())
 	{
-		printf("Socket sender initialized and connected!\n");
+		printf(inputSettings.Listen || inputSettings.WebSocket ? "Socket sender listening for clients!\n" : "Socket sender initialized!\n");
+		if (inputSettings.AsyncSend)
+		{
+			socketSender.StartAsync(4, inputSettings.OverflowPolicy);
+		}
 	}
 	else
 	{
-		printf("Socket sender failed to connect. Continuing without streaming...\n");
+		printf("Socket sender failed to initialize. Continuing without streaming...\n");
 	}
 
-	while (playbackResult == K4A_STREAM_RESULT_SUCCEEDED && s_isRunning)
+	SkeletonShmWriter shmWriter;
+	if (!inputSettings.SharedMemoryName.empty())
+	{
+		shmWriter.Open(inputSettings.SharedMemoryName);
+	}
+
+	SkeletonDepthChannel depthChannel(depthWidth, depthHeight, inputSettings.WebSocket);
+	if (inputSettings.DepthPort != 0 && !depthChannel.Start("0.0.0.0", inputSettings.DepthPort, inputSettings.SendRing))
+	{
+		printf("Depth channel failed to start. Continuing without depth...\n");
+	}
+	SkeletonSilhouetteChannel silhouetteChannel(depthWidth, depthHeight, inputSettings.WebSocket);
+	if (inputSettings.SilhouettePort != 0 && !silhouetteChannel.Start("0.0.0.0", inputSettings.SilhouettePort, inputSettings.SendRing))
+	{
+		printf("Silhouette channel failed to start. Continuing without silhouettes...\n");
+	}
+	SkeletonPointCloudChannel pointCloudChannel(depthWidth, depthHeight,
+		inputSettings.PointCloudPort != 0 ? CreateXyTable(sensorCalibration) : std::vector<float>(), inputSettings.WebSocket);
+	if (inputSettings.PointCloudPort != 0 && !pointCloudChannel.Start("0.0.0.0", inputSettings.PointCloudPort, inputSettings.SendRing))
+	{
+		printf("Point cloud channel failed to start. Continuing without point clouds...\n");
+	}
+
+	StreamTargets targets;
+	targets.socketSender = &socketSender;
+	targets.sendAllBodies = inputSettings.MultiBody;
+	targets.shmWriter = &shmWriter;
+	targets.depthChannel = &depthChannel;
+	targets.silhouetteChannel = &silhouetteChannel;
+	targets.pointCloudChannel = &pointCloudChannel;
+
+	// Host times of the pipeline stages, streamed with the frames
+	SkeletonLatency::CaptureTimes captureTimes;
+
+	// Playback stays on one thread and waits for every result, so no recorded frame is skipped
+	TrackedFrame frame;
+	while (playbackResult == K4A_STREAM_RESULT_SUCCEEDED && !commands.IsStopping())
 	{
 		playbackResult = k4a_playback_get_next_capture(playbackHandle, &capture);
+		uint64_t captureTime = SkeletonLatency::HostTimeUsec();
 		if (playbackResult == K4A_STREAM_RESULT_EOF)
 		{
 			// End of file reached
@@ -358,6 +1021,7 @@ void PlayFile(InputSettings inputSettings)
 				k4a_capture_release(capture);
 				continue;
 			}
+			captureTimes.Record(k4a_image_get_device_timestamp_usec(depthImage), captureTime);
 			// Release the Depth image
 			k4a_image_release(depthImage);
 
@@ -378,7 +1042,10 @@ void PlayFile(InputSettings inputSettings)
 			if (popFrameResult == K4A_WAIT_RESULT_SUCCEEDED)
 			{
 				/************* Successfully get a body tracking result, process the result here ***************/
-				VisualizeResult(bodyFrame, window3d, depthWidth, depthHeight, &snapshotCapture, &socketSender);
+				ReadTrackedFrame(bodyFrame, captureTimes, frame);
+				TakeSnapshot(frame, snapshotCapture, commands);
+				StreamResult(frame, targets);
+				RenderResult(frame, window3d, depthWidth, depthHeight);
 				//Release the bodyFrame
 				k4abt_frame_release(bodyFrame);
 			}
@@ -394,7 +1061,15 @@ void PlayFile(InputSettings inputSettings)
 		window3d.Render();
 	}
 
+	PrintSenderStats(socketSender);
+	PrintDepthStats(depthChannel);
+	PrintSilhouetteStats(silhouetteChannel);
+	PrintPointCloudStats(pointCloudChannel);
 	socketSender.Close();
+	depthChannel.Stop();
+	silhouetteChannel.Stop();
+	pointCloudChannel.Stop();
+	shmWriter.Close();
 	k4abt_tracker_shutdown(tracker);
 	k4abt_tracker_destroy(tracker);
 	window3d.Delete();
@@ -430,59 +1105,119 @@ void PlayFromDevice(InputSettings inputSettings)
 
 	// Initialize the 3d window controller
 	Window3dWrapper window3d;
+	SkeletonCommandChannel commands;
 	window3d.Create("3D Visualization", sensorCalibration);
-	window3d.SetCloseCallback(CloseCallback);
-	window3d.SetKeyCallback(ProcessKey);
+	window3d.SetCloseCallback(CloseCallback, &commands);
+	window3d.SetKeyCallback(ProcessKey, &commands);
 
 	// Create pose snapshot capture (3 seconds countdown)
 	PoseSnapshotCapture snapshotCapture(std::chrono::milliseconds(3000));
 
 	// Create and initialize socket sender
-	SkeletonSocketSender socketSender(IP, PORT);
+	SkeletonSocketSender socketSender = CreateSocketSender(inputSettings);
+	socketSender.SetSendRing(inputSettings.SendRing);
+	socketSender.SetAdaptiveRate(inputSettings.AdaptiveRate);
+	socketSender.SetDeadReckoning(inputSettings.DeadReckoningErrorMm, static_cast<uint32_t>(inputSettings.HeartbeatMs));
 	if (socketSender.Initialize())
 	{
-		printf("Socket sender initialized and connected!\n");
+		printf(inputSettings.Listen || inputSettings.WebSocket ? "Socket sender listening for clients!\n" : "Socket sender initialized!\n");
+		if (inputSettings.AsyncSend)
+		{
+			socketSender.StartAsync(4, inputSettings.OverflowPolicy);
+		}
 	}
 	else
 	{
-		printf("Socket sender failed to connect. Continuing without streaming...\n");
+		printf("Socket sender failed to initialize. Continuing without streaming...\n");
 	}
 
-	while (s_isRunning)
+	SkeletonShmWriter shmWriter;
+	if (!inputSettings.SharedMemoryName.empty())
 	{
-		k4a_capture_t sensorCapture = nullptr;
-		k4a_wait_result_t getCaptureResult = k4a_device_get_capture(device, &sensorCapture, 0); // timeout_in_ms is set to 0
+		shmWriter.Open(inputSettings.SharedMemoryName);
+	}
 
-		if (getCaptureResult == K4A_WAIT_RESULT_SUCCEEDED)
-		{
-			// timeout_in_ms is set to 0. Return immediately no matter whether the sensorCapture is successfully added
-			// to the queue or not.
-			k4a_wait_result_t queueCaptureResult = k4abt_tracker_enqueue_capture(tracker, sensorCapture, 0);
+	SkeletonDepthChannel depthChannel(depthWidth, depthHeight, inputSettings.WebSocket);
+	if (inputSettings.DepthPort != 0 && !depthChannel.Start("0.0.0.0", inputSettings.DepthPort, inputSettings.SendRing))
+	{
+		printf("Depth channel failed to start. Continuing without depth...\n");
+	}
+	SkeletonSilhouetteChannel silhouetteChannel(depthWidth, depthHeight, inputSettings.WebSocket);
+	if (inputSettings.SilhouettePort != 0 && !silhouetteChannel.Start("0.0.0.0", inputSettings.SilhouettePort, inputSettings.SendRing))
+	{
+		printf("Silhouette channel failed to start. Continuing without silhouettes...\n");
+	}
+	SkeletonPointCloudChannel pointCloudChannel(depthWidth, depthHeight,
+		inputSettings.PointCloudPort != 0 ? CreateXyTable(sensorCalibration) : std::vector<float>(), inputSettings.WebSocket);
+	if (inputSettings.PointCloudPort != 0 && !pointCloudChannel.Start("0.0.0.0", inputSettings.PointCloudPort, inputSettings.SendRing))
+	{
+		printf("Point cloud channel failed to start. Continuing without point clouds...\n");
+	}
 
-			// Release the sensor capture once it is no longer needed.
-			k4a_capture_release(sensorCapture);
+	StreamTargets targets;
+	targets.socketSender = &socketSender;
+	targets.sendAllBodies = inputSettings.MultiBody;
+	targets.shmWriter = &shmWriter;
+	targets.depthChannel = &depthChannel;
+	targets.silhouetteChannel = &silhouetteChannel;
+	targets.pointCloudChannel = &pointCloudChannel;
+
+	// Host times of the pipeline stages, streamed with the frames
+	SkeletonLatency::CaptureTimes captureTimes;
+
+	// Capture, tracker and stream stages run on threads of their own, connected by the
+	// tracker's input queue and bounded lock-free queues of body frames. This thread renders,
+	// since the window has to be driven from the thread that created it. The stream and render
+	// stages sleep until the tracker stage signals a frame. With -waits POLL the capture and
+	// tracker stages poll in turn on one thread, with EVENT each blocks in the SDK on its own.
+	PipelineStats pipelineStats;
+	SpscRingBuffer<TrackedFrame> streamQueue(StageQueueCapacity);
+	SpscRingBuffer<TrackedFrame> renderQueue(StageQueueCapacity);
+	StageSignal streamSignal;
+	StageSignal renderSignal;
+	TrackerOutputs trackerOutputs = { streamQueue, renderQueue, streamSignal, renderSignal };
+	std::thread captureThread;
+	std::thread trackerThread;
+	if (inputSettings.EventWaits)
+	{
+		captureThread = std::thread(CaptureLoop, device, tracker, std::ref(captureTimes), std::ref(pipelineStats),
+			std::ref(commands));
+		trackerThread = std::thread(TrackerLoop, tracker, std::cref(captureTimes), std::ref(snapshotCapture),
+			std::cref(trackerOutputs), std::ref(pipelineStats), std::ref(commands));
+	}
+	else
+	{
+		captureThread = std::thread(DeviceLoop, device, tracker, std::ref(captureTimes), std::ref(snapshotCapture),
+			std::cref(trackerOutputs), std::ref(pipelineStats), std::ref(commands));
+	}
+	std::thread streamThread(StreamLoop, std::ref(streamQueue), std::ref(streamSignal), std::cref(targets), std::ref(commands));
 
-			if (queueCaptureResult == K4A_WAIT_RESULT_FAILED)
+	TrackedFrame frame;
+	TrackedFrame newest;
+	std::chrono::steady_clock::time_point nextRedraw = std::chrono::steady_clock::now();
+	while (!commands.IsStopping())
+	{
+		// Without vsync nothing else holds an idle window back from redrawing as fast as it can.
+		// With vsync the redraw itself takes that long, and this returns right away.
+		renderSignal.WaitUntil(nextRedraw, [&] { return !renderQueue.Empty() || commands.IsStopping(); });
+		nextRedraw = std::chrono::steady_clock::now() + std::chrono::milliseconds(RenderWaitMs);
+
+		// Draw the newest body frame, older ones that piled up during the last render are skipped
+		bool updated = false;
+		while (renderQueue.TryPop(frame))
+		{
+			if (updated)
 			{
-				std::cout << "Error! Add capture to tracker process queue failed!" << std::endl;
-				break;
+				k4abt_frame_release(newest.bodyFrame);
+				pipelineStats.framesNotRendered++;
 			}
+			newest = frame;
+			updated = true;
 		}
-		else if (getCaptureResult != K4A_WAIT_RESULT_TIMEOUT)
+		if (updated)
 		{
-			std::cout << "Get depth capture returned error: " << getCaptureResult << std::endl;
-			break;
-		}
-
-		// Pop Result from Body Tracker
-		k4abt_frame_t bodyFrame = nullptr;
-		k4a_wait_result_t popFrameResult = k4abt_tracker_pop_result(tracker, &bodyFrame, 0); // timeout_in_ms is set to 0
-		if (popFrameResult == K4A_WAIT_RESULT_SUCCEEDED)
-		{
-			/************* Successfully get a body tracking result, process the result here ***************/
-			VisualizeResult(bodyFrame, window3d, depthWidth, depthHeight, &snapshotCapture, &socketSender);
-			//Release the bodyFrame
-			k4abt_frame_release(bodyFrame);
+			RenderResult(newest, window3d, depthWidth, depthHeight);
+			k4abt_frame_release(newest.bodyFrame);
 		}
 
 		window3d.SetLayout3d(s_layoutMode);
@@ -490,9 +1225,29 @@ void PlayFromDevice(InputSettings inputSettings)
 		window3d.Render();
 	}
 
+	// Wake the stream stage rather than letting it notice the stop at its next timeout
+	streamSignal.Notify();
+	captureThread.join();
+	if (trackerThread.joinable())
+	{
+		trackerThread.join();
+	}
+	streamThread.join();
+	ReleaseQueuedFrames(streamQueue);
+	ReleaseQueuedFrames(renderQueue);
+
 	std::cout << "Finished body tracking processing!" << std::endl;
 
+	PrintPipelineStats(pipelineStats);
+	PrintSenderStats(socketSender);
+	PrintDepthStats(depthChannel);
+	PrintSilhouetteStats(silhouetteChannel);
+	PrintPointCloudStats(pointCloudChannel);
 	socketSender.Close();
+	depthChannel.Stop();
+	silhouetteChannel.Stop();
+	pointCloudChannel.Stop();
+	shmWriter.Close();
 	window3d.Delete();
 	k4abt_tracker_shutdown(tracker);
 	k4abt_tracker_destroy(tracker);
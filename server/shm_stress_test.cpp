@@ -0,0 +1,185 @@
+// Licensed under the MIT License.
+
+// Publishes frames into the shared memory ring as fast as possible while several
+// readers, each with its own mapping, consume them. Every frame is derived from
+// its index, so a torn read shows up as a body that does not match its header.
+// One reader is deliberately slow and has to skip over frames it was lapped on.
+// Exits with 0 when every check passed.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SkeletonSharedMemory.h"
+
+namespace
+{
+	const char* SegmentName = "skeleton_shm_stress_test";
+	const uint64_t FrameCount = 200000;
+	const int ReaderCount = 4;
+
+	size_t BodyCount(uint64_t index)
+	{
+		return 1 + index % 3;
+	}
+
+	k4abt_body_t MakeBody(uint64_t index, size_t body)
+	{
+		k4abt_body_t result = {};
+		result.id = static_cast<uint32_t>(index * 8 + body);
+		for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+		{
+			result.skeleton.joints[joint].position.xyz.x = static_cast<float>(index % 65536);
+			result.skeleton.joints[joint].position.xyz.y = static_cast<float>(joint);
+			result.skeleton.joints[joint].position.xyz.z = static_cast<float>(body);
+			result.skeleton.joints[joint].orientation.wxyz.w = 1.0f;
+		}
+		return result;
+	}
+
+	bool CheckFrame(const uint8_t* data, size_t size, uint64_t& index)
+	{
+		k4abt_body_t bodies[SkeletonWire::MaxBodies];
+		size_t count;
+		if (!SkeletonWire::ReadBodiesFrame(data, size, bodies, SkeletonWire::MaxBodies, count, index) ||
+			count != BodyCount(index))
+		{
+			return false;
+		}
+
+		for (size_t body = 0; body < count; body++)
+		{
+			k4abt_body_t expected = MakeBody(index, body);
+			if (bodies[body].id != expected.id)
+			{
+				return false;
+			}
+			for (int joint = 0; joint < static_cast<int>(K4ABT_JOINT_COUNT); joint++)
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					if (bodies[body].skeleton.joints[joint].position.v[i] != expected.skeleton.joints[joint].position.v[i])
+					{
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	struct ReaderResult
+	{
+		bool ok = true;
+		uint64_t framesRead = 0;
+		uint64_t framesSkipped = 0;
+	};
+
+	void RunReader(bool slow, std::atomic<int>& ready, ReaderResult& result)
+	{
+		SkeletonShmReader reader;
+		if (!reader.Open(SegmentName))
+		{
+			result.ok = false;
+			ready++;
+			return;
+		}
+		ready++;
+
+		std::vector<uint8_t> frame(SkeletonShm::SlotSize);
+		bool started = false;
+		uint64_t previous = 0;
+		for (;;)
+		{
+			if (!reader.Wait(2000))
+			{
+				result.ok = false;
+				break;
+			}
+
+			size_t size;
+			uint64_t index = 0;
+			while (reader.Read(frame.data(), size))
+			{
+				// Frames may be skipped, but never torn or out of order
+				if (!CheckFrame(frame.data(), size, index) || (started && index <= previous))
+				{
+					result.ok = false;
+				}
+				started = true;
+				previous = index;
+				result.framesRead++;
+
+				if (slow)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(20));
+				}
+			}
+			if (started && previous == FrameCount - 1)
+			{
+				break;
+			}
+		}
+
+		result.framesSkipped = reader.GetFramesSkipped();
+	}
+}
+
+int main()
+{
+	SkeletonShmWriter writer;
+	if (!writer.Open(SegmentName))
+	{
+		printf("FAILED\n");
+		return 1;
+	}
+
+	std::atomic<int> ready(0);
+	std::vector<ReaderResult> results(ReaderCount + 1);
+	std::vector<std::thread> readers;
+	for (int i = 0; i <= ReaderCount; i++)
+	{
+		readers.emplace_back(RunReader, i == ReaderCount, std::ref(ready), std::ref(results[i]));
+	}
+	while (ready < ReaderCount + 1)
+	{
+		std::this_thread::yield();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t index = 0; index < FrameCount; index++)
+	{
+		k4abt_body_t bodies[3];
+		for (size_t body = 0; body < BodyCount(index); body++)
+		{
+			bodies[body] = MakeBody(index, body);
+		}
+		writer.WriteBodies(bodies, BodyCount(index), index);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (std::thread& reader : readers)
+	{
+		reader.join();
+	}
+	writer.Close();
+
+	printf("Published %llu frames in %.3f s (%.0f frames/s)\n", (unsigned long long)FrameCount, seconds, FrameCount / seconds);
+
+	bool ok = true;
+	for (int i = 0; i <= ReaderCount; i++)
+	{
+		// Every frame was either read or counted as skipped
+		const ReaderResult& result = results[i];
+		bool passed = result.ok && result.framesRead + result.framesSkipped == FrameCount;
+		ok = ok && passed;
+		printf("  %s reader %d: %s, %llu read, %llu skipped\n", i == ReaderCount ? "slow" : "fast", i,
+			passed ? "ok" : "FAILED", (unsigned long long)result.framesRead, (unsigned long long)result.framesSkipped);
+	}
+
+	printf("%s\n", ok ? "PASSED" : "FAILED");
+	return ok ? 0 : 1;
+}